@@ -56,6 +56,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <assert.h>
 
 
@@ -138,6 +139,16 @@ print_buildid(
     MTC_U32 size,
     void *param);
 
+static MTC_STATUS
+print_comprofile(
+    MTC_U32 size,
+    void *param);
+
+static MTC_STATUS
+print_fhtrace(
+    MTC_U32 size,
+    void *param);
+
 static MTC_STATUS
 req_privatelog(
     int argc,
@@ -157,6 +168,13 @@ req_fist(
     MTC_U32 *len,
     void *buf);
 
+static MTC_STATUS
+req_attest_fenced(
+    int argc,
+    char **argv,
+    MTC_U32 *len,
+    void *buf);
+
 
 //
 //
@@ -196,6 +214,9 @@ CMD_INFO cmd_info_list[] = {
     {SCRIPT_TYPE_PRIVATELOG,     "privatelog",     req_privatelog, print_privatelog},
     {SCRIPT_TYPE_FIST,           "fist",           req_fist, return_retval},
     {SCRIPT_TYPE_RELOAD_HOST_WEIGHT,  "reload_host_weight",  NULL, return_retval},
+    {SCRIPT_TYPE_COMPROFILE,     "comprofile",     NULL, print_comprofile},
+    {SCRIPT_TYPE_FHTRACE,        "fhtrace",        NULL, print_fhtrace},
+    {SCRIPT_TYPE_ATTEST_FENCED,  "attest_fenced",  req_attest_fenced, return_retval},
 
     {0, NULL, NULL, NULL}};
 
@@ -547,6 +568,8 @@ print_query_liveset(
     SCRIPT_DATA_RESPONSE_QUERY_LIVESET *l;
     MTC_U32 h_index, h_active_index;
     MTC_S8 err_string[XAPI_MAX_ERROR_STRING_LEN + 1];
+    MTC_U32 section, access;
+    PSF_LATENCY_SUMMARY summary;
 
     l = (SCRIPT_DATA_RESPONSE_QUERY_LIVESET *) param;
 
@@ -596,6 +619,22 @@ print_query_liveset(
         printf("    <statefile_latency>%d</statefile_latency>\n", l->sf_latency);
         printf("    <statefile_latency_max>%d</statefile_latency_max>\n", l->sf_latency_max);
         printf("    <statefile_latency_min>%d</statefile_latency_min>\n", l->sf_latency_min);
+        for (section = 0; section < SF_SECTION_NUM; section++)
+        {
+            for (access = 0; access < SF_ACCESS_NUM; access++)
+            {
+                summary = &l->sf_latency_summary[section][access];
+                printf("    <statefile_latency_distribution section=\"%s\" access=\"%s\">\n",
+                       (section == SF_SECTION_GLOBAL)? "global": "host",
+                       (access == SF_ACCESS_READ)? "read": "write");
+                printf("      <samples>%d</samples>\n", summary->samples);
+                printf("      <p50>%d</p50>\n", summary->p50);
+                printf("      <p99>%d</p99>\n", summary->p99);
+                printf("      <p999>%d</p999>\n", summary->p999);
+                printf("      <max>%d</max>\n", summary->max);
+                printf("    </statefile_latency_distribution>\n");
+            }
+        }
         printf("    <heartbeat_latency>%d</heartbeat_latency>\n", l->hb_latency);
         printf("    <heartbeat_latency_max>%d</heartbeat_latency_max>\n", l->hb_latency_max);
         printf("    <heartbeat_latency_min>%d</heartbeat_latency_min>\n", l->hb_latency_min);
@@ -931,6 +970,205 @@ print_buildid(
 }
 
 
+//
+//
+//  NAME:
+//
+//      print_comprofile
+//
+//  DESCRIPTION:
+//
+//      print the lock profile of the HA Common Objects in XML.
+//      Times are in microseconds.
+//
+//  FORMAL PARAMETERS:
+//
+//      param - pointer to the SCRIPT_DATA_RESPONSE_COMPROFILE
+//          
+//  RETURN VALUE:
+//
+//      none
+//
+//  ENVIRONMENT:
+//
+//      none
+//
+//
+
+static MTC_STATUS
+print_comprofile(
+    MTC_U32 size,
+    void *param)
+{
+    static char *role_name[COM_ROLE_NUM] = COM_ROLE_NAME_ARRAY;
+    SCRIPT_DATA_RESPONSE_COMPROFILE *p;
+    COM_OBJECT_PROFILE *o;
+    COM_LOCK_SUMMARY *summary;
+    MTC_U32 o_index, role, mode, level;
+
+    p = (SCRIPT_DATA_RESPONSE_COMPROFILE *) param;
+
+    if (size < sizeof(SCRIPT_DATA_RESPONSE_COMPROFILE) ||
+        p->objectnum > COM_PROFILE_OBJECT_MAX) 
+    {
+        return MTC_ERROR_SC_IMPROPER_DATA;
+    }
+
+    printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    printf("<com_profile version=\"1.0\">\n");
+    for (o_index = 0; o_index < p->objectnum; o_index++)
+    {
+        o = &p->object[o_index];
+        printf("  <object id=\"%.*s\">\n", COM_PROFILE_ID_LEN, o->object_id);
+        for (role = 0; role < COM_ROLE_NUM; role++)
+        {
+            for (mode = 0; mode < COM_LOCK_MODE_NUM; mode++)
+            {
+                summary = &o->lock[role][mode];
+                if (summary->count == 0)
+                {
+                    continue;
+                }
+                printf("    <lock role=\"%s\" mode=\"%s\">\n", role_name[role],
+                       (mode == COM_LOCK_MODE_WRITER)? "writer": "reader");
+                printf("      <count>%u</count>\n", summary->count);
+                printf("      <wait_p50>%u</wait_p50>\n", summary->wait_p50);
+                printf("      <wait_p99>%u</wait_p99>\n", summary->wait_p99);
+                printf("      <wait_max>%u</wait_max>\n", summary->wait_max);
+                printf("      <hold_p50>%u</hold_p50>\n", summary->hold_p50);
+                printf("      <hold_p99>%u</hold_p99>\n", summary->hold_p99);
+                printf("      <hold_max>%u</hold_max>\n", summary->hold_max);
+                printf("    </lock>\n");
+            }
+        }
+        if (o->longest_hold > 0 && o->longest_holder_role < COM_ROLE_NUM)
+        {
+            printf("    <longest_holder role=\"%s\" mode=\"%s\">\n", role_name[o->longest_holder_role],
+                   (o->longest_holder_mode == COM_LOCK_MODE_WRITER)? "writer": "reader");
+            printf("      <hold>%u</hold>\n", o->longest_hold);
+            for (level = 0; level < o->backtrace_num && level < COM_PROFILE_BACKTRACE_SIZE; level++)
+            {
+                printf("      <frame>%.*s</frame>\n", COM_PROFILE_SYMBOL_LEN, o->backtrace[level]);
+            }
+            printf("    </longest_holder>\n");
+        }
+        printf("  </object>\n");
+    }
+    printf("</com_profile>\n");
+    return MTC_SUCCESS;
+}
+
+
+//
+//
+//  NAME:
+//
+//      print_fhtrace
+//
+//  DESCRIPTION:
+//
+//      print the fault handler trace of the recent episodes in XML,
+//      the most recent first. Each point is given in milliseconds
+//      from the start of the episode (the last time the lost host was
+//      seen, or the start of the fault handler if it was forced),
+//      followed by the breakdown of the failover time:
+//
+//          detection   - lost host last seen to fault handler start
+//          rendezvous  - waiting for the other hosts at FH1..FH4 and
+//                        at the end
+//          consistency - HB/SF stabilization and consistent view
+//          fence_wait  - fence wait in FH4
+//          commit      - new liveset commit
+//
+//  FORMAL PARAMETERS:
+//
+//      param - pointer to the SCRIPT_DATA_RESPONSE_FHTRACE
+//          
+//  RETURN VALUE:
+//
+//      none
+//
+//  ENVIRONMENT:
+//
+//      none
+//
+//
+
+#define FH_SPAN(t, from, to) \
+    (((t)[SM_FH_TRACE_##from] >= 0 && (t)[SM_FH_TRACE_##to] >= 0)? \
+        (t)[SM_FH_TRACE_##to] - (t)[SM_FH_TRACE_##from]: 0)
+
+static MTC_STATUS
+print_fhtrace(
+    MTC_U32 size,
+    void *param)
+{
+    static char *point_name[SM_FH_TRACE_POINT_NUM] = SM_FH_TRACE_POINT_NAME_ARRAY;
+    SCRIPT_DATA_RESPONSE_FHTRACE *p;
+    SM_FH_TRACE *trace;
+    MTC_CLOCK *t, origin, rendezvous;
+    MTC_U32 t_index, point;
+    MTC_S32 host;
+
+    p = (SCRIPT_DATA_RESPONSE_FHTRACE *) param;
+
+    if (size < sizeof(SCRIPT_DATA_RESPONSE_FHTRACE) ||
+        p->tracenum > SM_FH_TRACE_MAX) 
+    {
+        return MTC_ERROR_SC_IMPROPER_DATA;
+    }
+
+    printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    printf("<fh_trace version=\"1.0\">\n");
+    for (t_index = 0; t_index < p->tracenum; t_index++)
+    {
+        trace = &p->trace[t_index];
+        t = trace->time;
+        origin = (t[SM_FH_TRACE_LAST_SEEN] >= 0)? t[SM_FH_TRACE_LAST_SEEN]: t[SM_FH_TRACE_START];
+
+        printf("  <episode number=\"%u\" complete=\"%s\">\n", trace->episode,
+               (t[SM_FH_TRACE_END] >= 0)? "true": "false");
+        for (host = 0; host < MAX_HOST_NUM; host++)
+        {
+            if (MTC_HOSTMAP_ISON(trace->removed, host))
+            {
+                printf("    <removed>%d</removed>\n", host);
+            }
+        }
+        for (point = 0; point < SM_FH_TRACE_POINT_NUM; point++)
+        {
+            if (t[point] >= 0)
+            {
+                printf("    <%s>%"PRId64"</%s>\n",
+                       point_name[point], t[point] - origin, point_name[point]);
+            }
+        }
+
+        rendezvous = FH_SPAN(t, START, FH1) + FH_SPAN(t, STABLE, FH2) +
+                     FH_SPAN(t, CONSISTENT, FH3) + FH_SPAN(t, FH3, FH4) +
+                     ((t[SM_FH_TRACE_COMMITTED] >= 0)? FH_SPAN(t, COMMITTED, END):
+                      (t[SM_FH_TRACE_FENCED] >= 0)? FH_SPAN(t, FENCED, END):
+                      FH_SPAN(t, FH4, END));
+        printf("    <breakdown>\n");
+        printf("      <detection>%"PRId64"</detection>\n",
+               (t[SM_FH_TRACE_LAST_SEEN] >= 0)? FH_SPAN(t, LAST_SEEN, START): 0);
+        printf("      <rendezvous>%"PRId64"</rendezvous>\n", rendezvous);
+        printf("      <consistency>%"PRId64"</consistency>\n",
+               FH_SPAN(t, FH1, STABLE) + FH_SPAN(t, FH2, CONSISTENT));
+        printf("      <fence_wait>%"PRId64"</fence_wait>\n", FH_SPAN(t, FH4, FENCED));
+        printf("      <commit>%"PRId64"</commit>\n", FH_SPAN(t, FENCED, COMMITTED));
+        if (t[SM_FH_TRACE_END] >= 0)
+        {
+            printf("      <total>%"PRId64"</total>\n", t[SM_FH_TRACE_END] - origin);
+        }
+        printf("    </breakdown>\n");
+        printf("  </episode>\n");
+    }
+    printf("</fh_trace>\n");
+    return MTC_SUCCESS;
+}
+
+
 //
 //
 //  NAME:
@@ -1349,6 +1587,63 @@ req_fist(
     return MTC_SUCCESS;
 }
 
+//
+//
+//  NAME:
+//
+//      req_attest_fenced
+//
+//  DESCRIPTION:
+//
+//      set request data for attest_fenced
+//
+//  FORMAL PARAMETERS:
+//
+//      argc - number of argument from command line except argv[0] and argv[1]
+//      argv - pointer of arguments except argv[0] and argv[1]
+//      len - in: buffer length
+//            out: actual length of request data
+//      buf - buffer for request data
+//          
+//  RETURN VALUE:
+//
+//      none
+//
+//  ENVIRONMENT:
+//
+//      none
+//
+//
+
+
+static MTC_STATUS
+req_attest_fenced(
+    int argc,
+    char **argv,
+    MTC_U32 *len,
+    void *buf)
+{
+    SCRIPT_DATA_REQUEST_ATTEST_FENCED *f = buf;
+    char *end;
+
+    if (*len < sizeof(SCRIPT_DATA_REQUEST_ATTEST_FENCED)) 
+    {
+        return MTC_ERROR_SC_IMPROPER_DATA;
+    }
+
+    if (argc != 1)
+    {
+        return MTC_ERROR_SC_INVALID_PARAMETER;  // invalid argument
+    }
+
+    f->host_index = strtoul(argv[0], &end, 10);
+    if (*argv[0] == '\0' || *end != '\0' || f->host_index >= MAX_HOST_NUM)
+    {
+        return MTC_ERROR_SC_INVALID_PARAMETER;  // invalid argument
+    }
+    return MTC_SUCCESS;
+}
+
 //
 //
 //  NAME:
@@ -1406,6 +1701,10 @@ printhelp(void)
             {
                 printf("    %s enable|disable <fist_point_name>\n", cmd_info_list[cmd_index].name);
             }
+            else if (!strcmp(cmd_info_list[cmd_index].name, "attest_fenced"))
+            {
+                printf("    %s <host_index>\n", cmd_info_list[cmd_index].name);
+            }
             else
             {
                 printf("    %s\n", cmd_info_list[cmd_index].name);
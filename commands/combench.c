@@ -0,0 +1,287 @@
+//
+//      Copyright (c) Stratus Technologies Bermuda Ltd., 2008.
+//      All Rights Reserved. Unpublished rights reserved
+//      under the copyright laws of the United States.
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU Lesser General Public License as published
+//      by the Free Software Foundation; version 2.1 only. with the special
+//      exception on linking described in file LICENSE.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU Lesser General Public License for more details.
+//
+//
+//  DESCRIPTION:
+//
+//      Benchmark of the COM lock/unlock path.
+//
+//      Runs the daemon's com.c in-process: a number of threads lock
+//      a set of COM objects as readers, and every --write-every'th
+//      operation as writer (with one callback registered on each object,
+//      as in the daemon). The first pass runs one thread alone to give
+//      the uncontended cost per lock/unlock pair; the second pass runs
+//      all the threads at once.
+//
+//      --size sets the size of the objects (default sizeof(COM_DATA_HB),
+//      as the debug check of reader-side modification on unlock depends on
+//      the object size). --write-every 0 measures readers only and
+//      --write-every 1 writers only.
+//
+//      --priority sets the value xhad_thread_priority returns in the
+//      benchmark threads, so that the paths taken by the threads below
+//      XHA_PRIORITY_HIGH in the daemon are measured as well (the threads
+//      are not actually given a real-time priority).
+//
+//      Not installed; built for development only.
+//
+//  CREATION DATE:
+//
+//      October 19, 2026
+//
+
+//
+//
+//  O P E R A T I N G   S Y S T E M   I N C L U D E   F I L E S
+//
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+
+//
+//
+//  M A R A T H O N   I N C L U D E   F I L E S
+//
+//
+
+#include "mtctypes.h"
+#include "mtcerrno.h"
+#include "log.h"
+#include "com.h"
+#include "xha.h"
+#include "sm.h"
+
+
+//
+//
+//  L O C A L   D E F I N I T I O N S
+//
+//
+
+#define BENCH_MAX_THREADS   64
+#define BENCH_MAX_OBJECTS   64
+
+static struct {
+    MTC_U32     threads;
+    MTC_U32     objects;
+    MTC_U32     iterations;
+    MTC_U32     write_every;
+    MTC_U32     size;
+    int         priority;
+} param = {
+    .threads = 8,
+    .objects = 8,
+    .iterations = 200000,
+    .write_every = 8,
+    .size = sizeof(COM_DATA_HB),
+    .priority = 0,
+};
+
+static HA_COMMON_OBJECT_HANDLE object[BENCH_MAX_OBJECTS];
+
+
+//
+//  The daemon (main.c) provides these to the COM module.
+//
+
+pthread_attr_t *xhad_pthread_attr = NULL;
+
+static __thread int thread_priority = 0;
+
+void
+xhad_set_thread_priority(
+    int priority)
+{
+    thread_priority = priority;
+}
+
+int
+xhad_thread_priority(void)
+{
+    return thread_priority;
+}
+
+MTC_STATIC double
+bench_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+MTC_STATIC void
+bench_callback(
+    HA_COMMON_OBJECT_HANDLE handle,
+    void *buffer)
+{
+    (void) handle;
+    (void) buffer;
+}
+
+MTC_STATIC void *
+bench_thread(
+    void *arg)
+{
+    MTC_U32 index = (MTC_U32) (long) arg, k, o;
+    MTC_U32 *p;
+
+    xhad_set_thread_priority(param.priority);
+    for (k = 0; k < param.iterations; k++)
+    {
+        o = (index + k) % param.objects;
+        if (param.write_every != 0 && k % param.write_every == 0)
+        {
+            com_writer_lock(object[o], (void **) &p);
+            (*p)++;
+            com_writer_unlock(object[o]);
+        }
+        else
+        {
+            com_reader_lock(object[o], (void **) &p);
+            com_reader_unlock(object[o]);
+        }
+    }
+    return NULL;
+}
+
+MTC_STATIC double
+bench_run(
+    MTC_U32 threads)
+{
+    pthread_t   thread[BENCH_MAX_THREADS];
+    double      start;
+    MTC_U32     i;
+
+    start = bench_ns();
+    for (i = 0; i < threads; i++)
+    {
+        if (pthread_create(&thread[i], NULL, bench_thread, (void *) (long) i) != 0)
+        {
+            fprintf(stderr, "cannot create thread\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(thread[i], NULL);
+    }
+    return (bench_ns() - start) / ((double) threads * param.iterations);
+}
+
+MTC_STATIC void
+usage()
+{
+    fprintf(stderr,
+        "usage: combench [--threads N] [--objects N] [--iterations N]\n"
+        "                [--write-every N] [--size BYTES] [--priority P]\n");
+    exit(1);
+}
+
+int
+main(
+    int argc,
+    char **argv)
+{
+    char        name[16];
+    void        *init;
+    MTC_U32     i;
+    double      single, contended;
+
+    for (i = 1; i < (MTC_U32) argc; i++)
+    {
+        if (i + 1 >= (MTC_U32) argc)
+        {
+            usage();
+        }
+        if (!strcmp(argv[i], "--threads"))
+        {
+            param.threads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--objects"))
+        {
+            param.objects = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--iterations"))
+        {
+            param.iterations = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--write-every"))
+        {
+            param.write_every = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--size"))
+        {
+            param.size = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--priority"))
+        {
+            param.priority = atoi(argv[++i]);
+        }
+        else
+        {
+            usage();
+        }
+    }
+    if (param.threads == 0 || param.threads > BENCH_MAX_THREADS ||
+        param.objects == 0 || param.objects > BENCH_MAX_OBJECTS ||
+        param.iterations == 0 || param.size < sizeof(MTC_U32))
+    {
+        usage();
+    }
+
+    if ((init = calloc(1, param.size)) == NULL)
+    {
+        fprintf(stderr, "cannot allocate %u bytes\n", param.size);
+        return 1;
+    }
+    if (com_initialize(0) != MTC_SUCCESS)
+    {
+        fprintf(stderr, "cannot initialize COM\n");
+        return 1;
+    }
+    for (i = 0; i < param.objects; i++)
+    {
+        snprintf(name, sizeof(name), "bench%u", i);
+        if (com_create(name, &object[i], param.size, init) != MTC_SUCCESS)
+        {
+            fprintf(stderr, "cannot create COM object\n");
+            return 1;
+        }
+        com_register_callback(object[i], bench_callback);
+    }
+
+    single = bench_run(1);
+    contended = bench_run(param.threads);
+
+    printf("threads %u, objects %u, iterations %u, write every %u, size %u, priority %d\n",
+           param.threads, param.objects, param.iterations, param.write_every,
+           param.size, param.priority);
+    printf("uncontended %.1f ns/op, contended %.1f ns/op\n", single, contended);
+
+    for (i = 0; i < param.objects; i++)
+    {
+        com_deregister_callback(object[i], bench_callback);
+        com_close(object[i]);
+    }
+    free(init);
+    return 0;
+}
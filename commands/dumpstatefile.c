@@ -37,6 +37,7 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <pthread.h>
 #include <signal.h>
@@ -46,7 +47,9 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <fcntl.h>
+#include <time.h>
 
 
 //
@@ -102,6 +105,25 @@ HA_CONFIG ha_config;
 // int x __attribute__ ((aligned (16))) = 0;
 static STATE_FILE StateFile __attribute__ ((aligned (IOALIGN)));
 
+//  State-File contents as of the previous poll (watch mode)
+
+static STATE_FILE PrevStateFile;
+static int prev_global_invmask, prev_host_invmask[MAX_HOST_NUM];
+
+//  options
+
+static struct {
+    MTC_BOOLEAN watch;          // --watch
+    MTC_U32     interval;       // poll interval in ms
+    MTC_BOOLEAN json;           // --json
+    char        *config_path;
+} opt = {
+    .watch = FALSE,
+    .interval = 1000,
+    .json = FALSE,
+    .config_path = NULL,
+};
+
 //
 //
 //  F U N C T I O N   P R O T O T Y P E S
@@ -145,6 +167,47 @@ sf_readhostspecific_nocheck(
     PSF_HOST_SPECIFIC_SECTION phost,
     int *pinvmask);
 
+static int
+parse_options(
+    int argc,
+    char *argv[]);
+
+static void
+watch(
+    int sf);
+
+static void
+diff_global(
+    PSF_GLOBAL_SECTION pold,
+    PSF_GLOBAL_SECTION pnew,
+    int oldinv,
+    int newinv,
+    MTC_BOOLEAN first);
+
+static void
+diff_host(
+    int host_index,
+    PSF_HOST_SPECIFIC_SECTION pold,
+    PSF_HOST_SPECIFIC_SECTION pnew,
+    int oldinv,
+    int newinv,
+    MTC_BOOLEAN first);
+
+static void
+report_change(
+    char *section,
+    int index,
+    char *field,
+    char *oldval,
+    char *newval,
+    MTC_BOOLEAN numeric);
+
+static void
+report_error(
+    char *section,
+    int index,
+    MTC_STATUS status);
+
 //
 //
 //  F U N C T I O N   D E F I N I T I O N S
@@ -154,7 +217,12 @@ sf_readhostspecific_nocheck(
 //
 //  main
 //
-//  dumpstatefile config-file-path
+//  dumpstatefile [--watch [interval-ms]] [--json] config-file-path
+//
+//  With --watch, the State-File is polled at the interval (default 1000ms)
+//  with the descriptor kept open, and only the fields changed since the
+//  previous poll are printed with timestamps. With --json, each change is
+//  printed as a JSON object per line.
 //
 
 int
@@ -167,12 +235,13 @@ main(
     int sf;
     int host_index, invmask;
 
-    if (argc != 2)
+    if (parse_options(argc, argv) < 0)
     {
+        fprintf(stderr, "usage: dumpstatefile [--watch [interval-ms]] [--json] config-file-path\n");
         exit(MTC_EXIT_INVALID_PARAMETER);
     }
 
-    if ((status = interpret_config_file(argv[1], &ha_config)) < 0)
+    if ((status = interpret_config_file(opt.config_path, &ha_config)) < 0)
     {
         exit(status_to_exit(status));
     }
@@ -185,6 +254,11 @@ main(
         exit(status_to_exit(MTC_ERROR_SF_OPEN));
     }
 
+    if (opt.watch)
+    {
+        watch(sf);      // never returns
+    }
+
     status = sf_readglobal_nocheck(sf, &StateFile.global, _gen_UUID, &invmask);
 
     if (status != MTC_SUCCESS)
@@ -261,6 +335,7 @@ dump_host(
     HEADER(0); printf("host[%2d].host_uuid = %s\n", host_index, uuid_string(phost->data.host_uuid));
     HEADER(0); printf("host[%2d].excluded = %d\n", host_index, phost->data.excluded);
     HEADER(0); printf("host[%2d].starting = %d\n", host_index, phost->data.starting);
+    HEADER(0); printf("host[%2d].self_fencing = %d\n", host_index, phost->data.self_fencing);
 
     for (i = 0; _is_configured_host(i); i++)
     {
@@ -339,7 +414,8 @@ hostmap_string(
 void
 sf_reportlatency(
     MTC_CLOCK latency,
-    MTC_BOOLEAN write)
+    MTC_BOOLEAN write,
+    SF_SECTION section)
 {
     // void
 }
@@ -444,3 +520,293 @@ sf_readhostspecific_nocheck(
     return MTC_SUCCESS;
 }
 
+//
+//  parse_options -
+//
+//  Returns -1 if the command line is invalid.
+//
+
+static int
+parse_options(
+    int argc,
+    char *argv[])
+{
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--watch"))
+        {
+            opt.watch = TRUE;
+            if (i + 1 < argc - 1 && isdigit(argv[i + 1][0]))
+            {
+                opt.interval = atoi(argv[++i]);
+            }
+        }
+        else if (!strcmp(argv[i], "--json"))
+        {
+            opt.json = TRUE;
+        }
+        else if (argv[i][0] == '-' || opt.config_path != NULL)
+        {
+            return -1;
+        }
+        else
+        {
+            opt.config_path = argv[i];
+        }
+    }
+
+    if (opt.config_path == NULL || (opt.json && !opt.watch) || opt.interval == 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+//
+//  watch -
+//
+//  Poll the State-File and print the changes.
+//
+
+static void
+watch(
+    int sf)
+{
+    MTC_STATUS status;
+    int host_index, invmask;
+    MTC_BOOLEAN first = TRUE;
+    MTC_BOOLEAN host_valid[MAX_HOST_NUM];
+
+    for (host_index = 0; host_index < MAX_HOST_NUM; host_index++)
+    {
+        host_valid[host_index] = FALSE;
+    }
+
+    while (TRUE)
+    {
+        status = sf_readglobal_nocheck(sf, &StateFile.global, _gen_UUID, &invmask);
+        if (status != MTC_SUCCESS)
+        {
+            report_error("global", -1, status);
+        }
+        else
+        {
+            diff_global(&PrevStateFile.global, &StateFile.global,
+                        prev_global_invmask, invmask, first);
+            PrevStateFile.global = StateFile.global;
+            prev_global_invmask = invmask;
+            first = FALSE;
+        }
+
+        for (host_index = 0; _is_configured_host(host_index); host_index++)
+        {
+            status = sf_readhostspecific_nocheck(sf, host_index, &StateFile.host[host_index], &invmask);
+            if (status != MTC_SUCCESS)
+            {
+                report_error("host", host_index, status);
+                continue;
+            }
+
+            diff_host(host_index, &PrevStateFile.host[host_index], &StateFile.host[host_index],
+                      prev_host_invmask[host_index], invmask, !host_valid[host_index]);
+            PrevStateFile.host[host_index] = StateFile.host[host_index];
+            prev_host_invmask[host_index] = invmask;
+            host_valid[host_index] = TRUE;
+        }
+
+        fflush(stdout);
+        sf_sleep(opt.interval);
+    }
+}
+
+//
+//  Field comparison macros for diff_global and diff_host
+//
+
+#define DIFF_U32(section, index, field, o, n) \
+    if (first || (o)->data.field != (n)->data.field) \
+    { \
+        char oldval[16], newval[16]; \
+        sprintf(oldval, "%d", (o)->data.field); \
+        sprintf(newval, "%d", (n)->data.field); \
+        report_change(section, index, #field, (first)? NULL: oldval, newval, TRUE); \
+    }
+
+#define DIFF_UUID(section, index, field, o, n) \
+    if (first || UUID_comp((o)->data.field, (n)->data.field) != 0) \
+    { \
+        char oldval[MTC_UUID_SIZE + 1], newval[MTC_UUID_SIZE + 1]; \
+        strcpy(oldval, uuid_string((o)->data.field)); \
+        strcpy(newval, uuid_string((n)->data.field)); \
+        report_change(section, index, #field, (first)? NULL: oldval, newval, FALSE); \
+    }
+
+#define DIFF_HOSTMAP(section, index, field, o, n) \
+    if (first || MTC_HOSTMAP_COMPARE((o)->data.field, '!=', (n)->data.field)) \
+    { \
+        char oldval[MAX_HOST_NUM * 2], newval[MAX_HOST_NUM * 2]; \
+        strcpy(oldval, hostmap_string((o)->data.field)); \
+        strcpy(newval, hostmap_string((n)->data.field)); \
+        report_change(section, index, #field, (first)? NULL: oldval, newval, FALSE); \
+    }
+
+#define DIFF_INVMASK(section, index, o, n) \
+    if ((first && (n)) || (!first && (o) != (n))) \
+    { \
+        char oldval[16], newval[16]; \
+        sprintf(oldval, "0x%x", (o)); \
+        sprintf(newval, "0x%x", (n)); \
+        report_change(section, index, "invalid", (first)? NULL: oldval, newval, FALSE); \
+    }
+
+static void
+diff_global(
+    PSF_GLOBAL_SECTION pold,
+    PSF_GLOBAL_SECTION pnew,
+    int oldinv,
+    int newinv,
+    MTC_BOOLEAN first)
+{
+    DIFF_INVMASK("global", -1, oldinv, newinv);
+    DIFF_U32("global", -1, version, pold, pnew);
+    DIFF_UUID("global", -1, gen_uuid, pold, pnew);
+    DIFF_U32("global", -1, pool_state, pold, pnew);
+    DIFF_UUID("global", -1, master, pold, pnew);
+    DIFF_U32("global", -1, config_hosts, pold, pnew);
+}
+
+static void
+diff_host(
+    int host_index,
+    PSF_HOST_SPECIFIC_SECTION pold,
+    PSF_HOST_SPECIFIC_SECTION pnew,
+    int oldinv,
+    int newinv,
+    MTC_BOOLEAN first)
+{
+    DIFF_INVMASK("host", host_index, oldinv, newinv);
+    DIFF_U32("host", host_index, sequence, pold, pnew);
+    DIFF_UUID("host", host_index, host_uuid, pold, pnew);
+    DIFF_U32("host", host_index, excluded, pold, pnew);
+    DIFF_U32("host", host_index, starting, pold, pnew);
+    DIFF_HOSTMAP("host", host_index, current_liveset, pold, pnew);
+    DIFF_HOSTMAP("host", host_index, proposed_liveset, pold, pnew);
+    DIFF_HOSTMAP("host", host_index, hbdomain, pold, pnew);
+    DIFF_HOSTMAP("host", host_index, sfdomain, pold, pnew);
+    DIFF_U32("host", host_index, lock_request, pold, pnew);
+    DIFF_HOSTMAP("host", host_index, lock_grant, pold, pnew);
+    DIFF_U32("host", host_index, sm_phase, pold, pnew);
+    DIFF_U32("host", host_index, weight, pold, pnew);
+    DIFF_U32("host", host_index, self_fencing, pold, pnew);
+}
+
+//
+//  timestamp_string -
+//
+//  Returns the current local time with milliseconds.
+//
+
+static char *
+timestamp_string()
+{
+    static char buf[64];
+    struct timeval tv;
+    struct tm tm;
+    size_t len;
+
+    gettimeofday(&tv, NULL);
+    localtime_r(&tv.tv_sec, &tm);
+    len = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf + len, sizeof(buf) - len, ".%03ld", (long) tv.tv_usec / 1000);
+
+    return buf;
+}
+
+//
+//  report_change -
+//
+//  Print a changed field. oldval is NULL for the first poll.
+//
+
+static void
+report_change(
+    char *section,
+    int index,
+    char *field,
+    char *oldval,
+    char *newval,
+    MTC_BOOLEAN numeric)
+{
+    char *quote = (numeric)? "": "\"";
+
+    if (opt.json)
+    {
+        printf("{\"time\": \"%s\", \"section\": \"%s\", ", timestamp_string(), section);
+        if (index >= 0)
+        {
+            printf("\"index\": %d, ", index);
+        }
+        printf("\"field\": \"%s\", ", field);
+        if (oldval == NULL)
+        {
+            printf("\"old\": null, ");
+        }
+        else
+        {
+            printf("\"old\": %s%s%s, ", quote, oldval, quote);
+        }
+        printf("\"new\": %s%s%s}\n", quote, newval, quote);
+    }
+    else
+    {
+        printf("%s ", timestamp_string());
+        if (index >= 0)
+        {
+            printf("%s[%2d].%s = %s", section, index, field, newval);
+        }
+        else
+        {
+            printf("%s.%s = %s", section, field, newval);
+        }
+        if (oldval != NULL)
+        {
+            printf(" (was %s)", oldval);
+        }
+        printf("\n");
+    }
+}
+
+//
+//  report_error -
+//
+//  Print a read error in watch mode.
+//
+
+static void
+report_error(
+    char *section,
+    int index,
+    MTC_STATUS status)
+{
+    if (opt.json)
+    {
+        printf("{\"time\": \"%s\", \"section\": \"%s\", ", timestamp_string(), section);
+        if (index >= 0)
+        {
+            printf("\"index\": %d, ", index);
+        }
+        printf("\"error\": %d}\n", status);
+    }
+    else
+    {
+        printf("%s can not read the %s section", timestamp_string(), section);
+        if (index >= 0)
+        {
+            printf(" for index %d", index);
+        }
+        printf(" (%d)\n", status);
+    }
+}
@@ -0,0 +1,1925 @@
+//
+//      Copyright (c) Stratus Technologies Bermuda Ltd., 2008.
+//      All Rights Reserved. Unpublished rights reserved
+//      under the copyright laws of the United States.
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU Lesser General Public License as published
+//      by the Free Software Foundation; version 2.1 only. with the special
+//      exception on linking described in file LICENSE.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU Lesser General Public License for more details.
+//
+//
+//  DESCRIPTION:
+//
+//      Discrete-event simulator of the fault handling protocol.
+//
+//      N virtual hosts run against a virtual clock, a simulated heartbeat
+//      network (loss, delay, partition) and a simulated State-File. Each
+//      host has a model of the HB and SF threads (periodic heartbeats,
+//      State-File write and read cycles, HB/SF domains with T1/T2
+//      timeouts, watchdogs) and of the State Manager (fault handler
+//      phases and rendezvous, stable and consistent view, Survival Rule,
+//      fencing wait, self-fence with the State-File record).
+//
+//      The model follows the rules of sm.c, heartbeat.c and statefile.c,
+//      but does not run their code: the daemon modules keep their state
+//      in per-process objects and threads. Only the timing rules of the
+//      fault handler (sm.h) are shared with the daemon; when the other
+//      rules in those modules change, this model has to be updated as
+//      well. The results are those of the model, not measurements of
+//      the daemon.
+//
+//      A self-fencing host stops at once, and is reset after a delay
+//      (--reset-delay). With the probability of --stall the reset does
+//      not happen, and the host stays alive until its watchdogs expire;
+//      those are armed to WATCHDOG_FENCE_TIMEOUT before the record.
+//
+//      Every run is deterministic for its seed. At each commit of a new
+//      liveset, the simulator checks that all the removed hosts are
+//      already dead (otherwise the run is counted as a violation), and at
+//      the end of a run that the surviving hosts agree on the liveset.
+//
+//      Not installed; built for development only.
+//
+//      The State Manager is evaluated every SIM_SM_TICK ms of virtual
+//      time, so the failover times have that granularity.
+//
+//  CREATION DATE:
+//
+//      October 19, 2026
+//
+
+//
+//
+//  O P E R A T I N G   S Y S T E M   I N C L U D E   F I L E S
+//
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+
+//
+//
+//  M A R A T H O N   I N C L U D E   F I L E S
+//
+//
+
+#include "mtctypes.h"
+#include "mtcerrno.h"
+#include "log.h"
+#include "config.h"
+#include "sm.h"
+#include "watchdog.h"
+#include "xha.h"
+
+
+//
+//
+//  L O C A L   D E F I N I T I O N S
+//
+//
+
+HA_CONFIG ha_config;
+
+#define SIM_SM_TICK                 100     //  SM evaluation interval (ms)
+#define SIM_SF_ACCELERATED          400     //  SF interval while accelerated (ms)
+#define SIM_SF_JITTER               500     //  +- SF interval randomization (ms)
+#define SIM_MAX_SCENARIO            64
+
+//
+//  Events
+//
+
+typedef enum {
+    EV_SCENARIO,            //  scenario action (arg = index)
+    EV_HB_SEND,             //  periodic heartbeat
+    EV_HB_RECEIVE,          //  heartbeat delivered to the host
+    EV_SF_CYCLE,            //  State-File write
+    EV_SF_READ,             //  State-File read completes
+    EV_SM_TICK,             //  State Manager evaluation
+    EV_SELF_FENCE_RECORD,   //  self-fencing record wait ends (arg = recorded)
+    EV_DEATH,               //  host is reset (arg = cause)
+} SIM_EVENT_TYPE;
+
+typedef struct _SIM_HB_MESSAGE {
+    MTC_S32     sender;
+    SM_PHASE    phase;
+    MTC_HOSTMAP hbdomain;
+    MTC_HOSTMAP sfdomain;
+} SIM_HB_MESSAGE;
+
+typedef struct _SIM_EVENT {
+    MTC_CLOCK       time;
+    MTC_U64         seq;            //  FIFO order among the events of the same time
+    SIM_EVENT_TYPE  type;
+    MTC_S32         host;
+    MTC_U32         arg;
+    SIM_HB_MESSAGE  hb;
+} SIM_EVENT;
+
+//
+//  Scenario
+//
+
+typedef enum {
+    ACT_CRASH,              //  host stops at once (power loss)
+    ACT_HANG,               //  host stops, reset by the watchdog later
+    ACT_PARTITION,          //  split the heartbeat network
+    ACT_HEAL,               //  rejoin the heartbeat network
+    ACT_SFCUT,              //  host loses the State-File access
+    ACT_SFHEAL,             //  host regains the State-File access
+} SIM_ACTION_TYPE;
+
+typedef struct _SIM_ACTION {
+    MTC_CLOCK       time;
+    SIM_ACTION_TYPE type;
+    MTC_S32         host;
+    MTC_U32         group[MAX_HOST_NUM];    //  partition group of each host
+} SIM_ACTION;
+
+//
+//  Fault handler program
+//
+//  The sequence of steps of fault_handler(). A rendezvous step is one
+//  half of rendezvous(): set the phase and wait for the hosts to be in
+//  the phase or the next one.
+//
+
+typedef enum {
+    STEP_RENDEZVOUS,
+    STEP_STABLE,
+    STEP_CONSISTENT,
+    STEP_SURVIVAL,
+    STEP_FENCE_WAIT,
+    STEP_END,
+} SIM_STEP_TYPE;
+
+static const struct {
+    SIM_STEP_TYPE   type;
+    SM_PHASE        phase;
+    SM_PHASE        next;
+    MTC_BOOLEAN     on_heartbeat;
+    MTC_BOOLEAN     on_statefile;
+} fh_program[] = {
+    {STEP_RENDEZVOUS,   SM_PHASE_FHREADY,   SM_PHASE_FH1,       TRUE,   FALSE},
+    {STEP_RENDEZVOUS,   SM_PHASE_FH1,       SM_PHASE_FH1DONE,   TRUE,   FALSE},
+    {STEP_STABLE},
+    {STEP_RENDEZVOUS,   SM_PHASE_FH1DONE,   SM_PHASE_FH2,       TRUE,   TRUE},
+    {STEP_RENDEZVOUS,   SM_PHASE_FH2,       SM_PHASE_FH2DONE,   TRUE,   TRUE},
+    {STEP_CONSISTENT},
+    {STEP_RENDEZVOUS,   SM_PHASE_FH2DONE,   SM_PHASE_FH3,       TRUE,   FALSE},
+    {STEP_RENDEZVOUS,   SM_PHASE_FH3,       SM_PHASE_FH3DONE,   TRUE,   FALSE},
+    {STEP_SURVIVAL},
+    {STEP_RENDEZVOUS,   SM_PHASE_FH3DONE,   SM_PHASE_FH4,       TRUE,   FALSE},
+    {STEP_RENDEZVOUS,   SM_PHASE_FH4,       SM_PHASE_FH4DONE,   TRUE,   FALSE},
+    {STEP_FENCE_WAIT},
+    {STEP_RENDEZVOUS,   SM_PHASE_FH4DONE,   SM_PHASE_STARTED,   TRUE,   FALSE},
+    {STEP_RENDEZVOUS,   SM_PHASE_STARTED,   SM_PHASE_FHREADY,   TRUE,   FALSE},
+    {STEP_END},
+};
+
+//
+//  Stable view
+//
+//  The snapshot of the domains taken by the consistent view step, which
+//  the Survival Rule is applied to (smvar.stable_hb and stable_sf).
+//
+
+typedef struct _SIM_VIEW {
+    MTC_HOSTMAP     hbdomain;
+    MTC_HOSTMAP     sfdomain;
+    MTC_HOSTMAP     raw_hbdomain_on_hb[MAX_HOST_NUM];
+    MTC_HOSTMAP     raw_sfdomain_on_hb[MAX_HOST_NUM];
+    MTC_HOSTMAP     raw_hbdomain_on_sf[MAX_HOST_NUM];
+    MTC_HOSTMAP     raw_sfdomain_on_sf[MAX_HOST_NUM];
+} SIM_VIEW;
+
+//
+//  Virtual host
+//
+
+typedef enum {
+    HOST_RUNNING,
+    HOST_HUNG,
+    HOST_DEAD,
+} SIM_HOST_STATE;
+
+typedef enum {
+    DEATH_CRASH,
+    DEATH_WATCHDOG,
+    DEATH_SELF_FENCE,
+} SIM_DEATH_CAUSE;
+
+typedef struct _SIM_HOST {
+    SIM_HOST_STATE  state;
+    MTC_CLOCK       death_time;
+    MTC_BOOLEAN     self_fencing;           //  SM has decided to self-fence
+    MTC_CLOCK       fence_armed;            //  watchdogs armed to fence (-1 if not)
+    MTC_BOOLEAN     sf_cut;
+    MTC_U32         group;                  //  partition group on the network
+
+    //  HB and SF threads
+
+    MTC_CLOCK       wd_hb, wd_sf;           //  last watchdog refresh
+    MTC_CLOCK       time_last_HB[MAX_HOST_NUM];
+    MTC_CLOCK       time_last_SF[MAX_HOST_NUM];
+    MTC_U32         seen_sequence[MAX_HOST_NUM];
+    MTC_HOSTMAP     hbdomain;
+    MTC_HOSTMAP     sfdomain;
+    SM_PHASE        phase_on_hb[MAX_HOST_NUM];
+    SM_PHASE        phase_on_sf[MAX_HOST_NUM];
+    MTC_HOSTMAP     raw_hbdomain_on_hb[MAX_HOST_NUM];
+    MTC_HOSTMAP     raw_sfdomain_on_hb[MAX_HOST_NUM];
+    MTC_HOSTMAP     raw_hbdomain_on_sf[MAX_HOST_NUM];
+    MTC_HOSTMAP     raw_sfdomain_on_sf[MAX_HOST_NUM];
+    MTC_HOSTMAP     self_fencing_on_sf;
+    SIM_VIEW        stable;
+
+    //  State Manager
+
+    SM_PHASE        phase;
+    MTC_HOSTMAP     current_liveset;
+    MTC_HOSTMAP     proposed_liveset;
+    MTC_BOOLEAN     need_fh;
+    MTC_S32         step;                   //  index of fh_program (-1 if not in FH)
+    MTC_CLOCK       step_start;
+    MTC_CLOCK       p3_start;
+    MTC_CLOCK       fence_deadline;
+    MTC_CLOCK       recorded;               //  when all the self-fencing records were seen
+    MTC_BOOLEAN     sleep_extend;
+    MTC_CLOCK       fh_start;               //  first FH start after the fault
+    MTC_CLOCK       commit;                 //  last commit of a degraded liveset
+} SIM_HOST;
+
+//
+//  State-File host specific elements
+//
+
+typedef struct _SIM_SF_SECTION {
+    MTC_U32     sequence;
+    SM_PHASE    phase;
+    MTC_HOSTMAP hbdomain;
+    MTC_HOSTMAP sfdomain;
+    MTC_BOOLEAN self_fencing;
+} SIM_SF_SECTION;
+
+//
+//  Options
+//
+
+static struct {
+    MTC_U32     hosts;
+    MTC_U32     runs;
+    MTC_U32     seed;
+    MTC_U32     duration;       //  sec
+    double      loss;           //  heartbeat loss probability
+    MTC_U32     delay;          //  heartbeat delay (ms)
+    MTC_U32     jitter;         //  heartbeat delay jitter (ms)
+    MTC_U32     sf_latency;     //  State-File access latency (ms)
+    MTC_U32     reset_min;      //  self-fence to the reset of the host (ms)
+    MTC_U32     reset_max;
+    double      stall;          //  probability that the self-fence stalls
+    MTC_BOOLEAN confirm;        //  self-fencing record and early exit from FH4
+    MTC_BOOLEAN verbose;
+    MTC_U32     actions;
+    SIM_ACTION  action[SIM_MAX_SCENARIO];
+} opt = {
+    .hosts = 4,
+    .runs = 100,
+    .seed = 1,
+    .duration = 300,
+    .loss = 0,
+    .delay = 1,
+    .jitter = 1,
+    .sf_latency = 20,
+    .reset_min = 0,
+    .reset_max = 500,
+    .stall = 0,
+    .confirm = TRUE,
+    .verbose = FALSE,
+    .actions = 0,
+};
+
+//
+//  Simulation state of a run
+//
+
+static struct {
+    MTC_CLOCK       now;
+    MTC_U64         seq;
+    MTC_U64         random;
+    MTC_U64         events;
+    SIM_EVENT       *queue;         //  binary heap
+    MTC_U32         queued;
+    MTC_U32         capacity;
+    SIM_HOST        host[MAX_HOST_NUM];
+    SIM_SF_SECTION  sf[MAX_HOST_NUM];
+    MTC_CLOCK       fault_time;     //  first fault of the scenario
+    MTC_U32         violations;
+} sim;
+
+//
+//  Result of a run
+//
+
+typedef struct _SIM_RESULT {
+    MTC_CLOCK   detection;          //  fault to the first FH start (-1 if none)
+    MTC_CLOCK   failover;           //  fault to the last commit (-1 if none)
+    MTC_U32     survivors;
+    MTC_U32     self_fenced;
+    MTC_U32     violations;
+    MTC_BOOLEAN agreed;             //  survivors have the same liveset
+} SIM_RESULT;
+
+#define log_sim(fmt, args...) \
+    if (opt.verbose) printf("%8"PRId64".%03"PRId64" " fmt, sim.now / 1000, sim.now % 1000, ##args)
+
+
+//
+//
+//  F U N C T I O N   P R O T O T Y P E S
+//
+//
+
+static int
+parse_options(
+    int argc,
+    char *argv[]);
+
+static int
+parse_action(
+    char *spec,
+    SIM_ACTION *paction);
+
+static MTC_STATUS
+run(
+    MTC_U32 seed,
+    SIM_RESULT *presult);
+
+static void
+dispatch(
+    SIM_EVENT *pev);
+
+static void
+sm_tick(
+    MTC_S32 me);
+
+
+//
+//
+//  F U N C T I O N   D E F I N I T I O N S
+//
+//
+
+//
+//  Random numbers (xorshift64*), deterministic for the seed of the run
+//
+
+static double
+sim_uniform()
+{
+    sim.random ^= sim.random >> 12;
+    sim.random ^= sim.random << 25;
+    sim.random ^= sim.random >> 27;
+    return (double) ((sim.random * 2685821657736338717ULL) >> 11) / (double) (1ULL << 53);
+}
+
+static MTC_CLOCK
+sim_jitter(
+    MTC_CLOCK range)
+{
+    return (MTC_CLOCK) (sim_uniform() * (2 * range + 1)) - range;
+}
+
+//
+//  Event queue
+//
+
+static MTC_BOOLEAN
+event_before(
+    SIM_EVENT *a,
+    SIM_EVENT *b)
+{
+    return (a->time < b->time || (a->time == b->time && a->seq < b->seq));
+}
+
+static MTC_STATUS
+schedule(
+    MTC_CLOCK after,
+    SIM_EVENT_TYPE type,
+    MTC_S32 host,
+    MTC_U32 arg,
+    SIM_HB_MESSAGE *phb)
+{
+    SIM_EVENT ev, tmp;
+    MTC_U32 index, parent;
+
+    if (sim.queued == sim.capacity)
+    {
+        SIM_EVENT *queue;
+        MTC_U32 capacity = (sim.capacity)? sim.capacity * 2: 1024;
+
+        if ((queue = realloc(sim.queue, sizeof(SIM_EVENT) * capacity)) == NULL)
+        {
+            return MTC_ERROR_SYSTEM_LEVEL_FAILURE;
+        }
+        sim.queue = queue;
+        sim.capacity = capacity;
+    }
+
+    ev.time = sim.now + ((after > 0)? after: 0);
+    ev.seq = sim.seq++;
+    ev.type = type;
+    ev.host = host;
+    ev.arg = arg;
+    if (phb)
+    {
+        ev.hb = *phb;
+    }
+
+    index = sim.queued++;
+    sim.queue[index] = ev;
+    while (index > 0)
+    {
+        parent = (index - 1) / 2;
+        if (!event_before(&sim.queue[index], &sim.queue[parent]))
+        {
+            break;
+        }
+        tmp = sim.queue[parent];
+        sim.queue[parent] = sim.queue[index];
+        sim.queue[index] = tmp;
+        index = parent;
+    }
+    return MTC_SUCCESS;
+}
+
+static MTC_BOOLEAN
+next_event(
+    SIM_EVENT *pev)
+{
+    SIM_EVENT tmp;
+    MTC_U32 index = 0, child;
+
+    if (sim.queued == 0)
+    {
+        return FALSE;
+    }
+
+    *pev = sim.queue[0];
+    sim.queue[0] = sim.queue[--sim.queued];
+    while ((child = index * 2 + 1) < sim.queued)
+    {
+        if (child + 1 < sim.queued && event_before(&sim.queue[child + 1], &sim.queue[child]))
+        {
+            child++;
+        }
+        if (!event_before(&sim.queue[child], &sim.queue[index]))
+        {
+            break;
+        }
+        tmp = sim.queue[child];
+        sim.queue[child] = sim.queue[index];
+        sim.queue[index] = tmp;
+        index = child;
+    }
+    return TRUE;
+}
+
+//
+//  Host life
+//
+
+static void
+host_die(
+    MTC_S32 me,
+    SIM_DEATH_CAUSE cause)
+{
+    static const char *cause_name[] = {"crashed", "reset by watchdog", "self-fenced"};
+    SIM_HOST *h = &sim.host[me];
+
+    if (h->state == HOST_DEAD)
+    {
+        return;
+    }
+    h->state = HOST_DEAD;
+    h->death_time = sim.now;
+    log_sim("host %d %s.\n", me, cause_name[cause]);
+}
+
+//
+//  sim_reset -
+//
+//  The host has given up the self-fencing record wait and resets
+//  itself (watchdog_selffence()). The host stops at once, but stays
+//  alive for the reset delay; with the probability of --stall, the
+//  reset stalls (e.g. dom0 is not scheduled) and the host is alive
+//  until its watchdogs expire.
+//
+
+static void
+sim_reset(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    MTC_CLOCK delay = opt.reset_min, expiry;
+
+    h->state = HOST_HUNG;
+    expiry = _min(h->wd_hb + _Wh * ONE_SEC, h->wd_sf + _Ws * ONE_SEC);
+    if (h->fence_armed >= 0)
+    {
+        expiry = _min(expiry, h->fence_armed + WATCHDOG_FENCE_TIMEOUT * ONE_SEC);
+    }
+
+    if (opt.stall > 0 && sim_uniform() < opt.stall)
+    {
+        log_sim("host %d: self-fence stalls.\n", me);
+        delay = expiry - sim.now;
+    }
+    else if (opt.reset_max > opt.reset_min)
+    {
+        delay += (MTC_CLOCK) (sim_uniform() * (opt.reset_max - opt.reset_min + 1));
+    }
+
+    if (sim.now + delay < expiry)
+    {
+        schedule(delay, EV_DEATH, me, DEATH_SELF_FENCE, NULL);
+    }
+    else
+    {
+        schedule(expiry - sim.now, EV_DEATH, me, DEATH_WATCHDOG, NULL);
+    }
+}
+
+static void
+sim_self_fence(
+    MTC_S32 me,
+    const char *reason)
+{
+    SIM_HOST *h = &sim.host[me];
+    MTC_CLOCK record;
+
+    if (h->self_fencing)
+    {
+        return;
+    }
+    h->self_fencing = TRUE;
+    log_sim("host %d: %s - self-fence.\n", me, reason);
+
+    //  self_fence() arms the watchdogs, and sf_set_self_fencing()
+    //  accelerates the SF thread and waits for the record up to
+    //  SELF_FENCE_RECORD_TIMEOUT.
+
+    if (opt.confirm)
+    {
+        h->fence_armed = sim.now;
+    }
+    record = SIM_SF_ACCELERATED + opt.sf_latency;
+    if (opt.confirm && !h->sf_cut && record <= SELF_FENCE_RECORD_TIMEOUT)
+    {
+        schedule(record, EV_SELF_FENCE_RECORD, me, TRUE, NULL);
+    }
+    else if (opt.confirm && !h->sf_cut)
+    {
+        schedule(SELF_FENCE_RECORD_TIMEOUT, EV_SELF_FENCE_RECORD, me, FALSE, NULL);
+    }
+    else
+    {
+        sim_reset(me);
+    }
+}
+
+//
+//  HB thread
+//
+
+static void
+hb_send(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    SIM_HB_MESSAGE msg;
+    MTC_S32 to;
+
+    h->wd_hb = sim.now;
+
+    msg.sender = me;
+    msg.phase = h->phase;
+    MTC_HOSTMAP_COPY(msg.hbdomain, h->hbdomain);
+    MTC_HOSTMAP_COPY(msg.sfdomain, h->sfdomain);
+
+    for (to = 0; _is_configured_host(to); to++)
+    {
+        if (to == me || sim.host[to].group != h->group ||
+            (opt.loss > 0 && sim_uniform() < opt.loss))
+        {
+            continue;
+        }
+        schedule(opt.delay + (MTC_CLOCK) (sim_uniform() * opt.jitter),
+                 EV_HB_RECEIVE, to, 0, &msg);
+    }
+}
+
+static void
+hb_receive(
+    MTC_S32 me,
+    SIM_HB_MESSAGE *pmsg)
+{
+    SIM_HOST *h = &sim.host[me];
+    MTC_S32 from = pmsg->sender;
+
+    h->time_last_HB[from] = sim.now;
+    h->phase_on_hb[from] = pmsg->phase;
+    MTC_HOSTMAP_COPY(h->raw_hbdomain_on_hb[from], pmsg->hbdomain);
+    MTC_HOSTMAP_COPY(h->raw_sfdomain_on_hb[from], pmsg->sfdomain);
+
+    //  a heartbeat in FHREADY requests the fault handler (start_fh(TRUE))
+
+    if (pmsg->phase == SM_PHASE_FHREADY && h->phase == SM_PHASE_STARTED &&
+        MTC_HOSTMAP_ISON(h->current_liveset, from))
+    {
+        h->need_fh = TRUE;
+    }
+}
+
+//
+//  SF thread
+//
+
+static void
+sf_cycle(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    SIM_SF_SECTION *s = &sim.sf[me];
+
+    h->wd_sf = sim.now;
+    if (h->sf_cut)
+    {
+        return;
+    }
+
+    s->sequence++;
+    s->phase = h->phase;
+    MTC_HOSTMAP_COPY(s->hbdomain, h->hbdomain);
+    MTC_HOSTMAP_COPY(s->sfdomain, h->sfdomain);
+
+    schedule(opt.sf_latency, EV_SF_READ, me, 0, NULL);
+}
+
+static void
+sf_read(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    MTC_S32 index;
+
+    if (h->sf_cut)
+    {
+        return;
+    }
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        SIM_SF_SECTION *s = &sim.sf[index];
+
+        if (s->sequence != h->seen_sequence[index] || index == me)
+        {
+            h->seen_sequence[index] = s->sequence;
+            h->time_last_SF[index] = sim.now;
+        }
+        h->phase_on_sf[index] = s->phase;
+        MTC_HOSTMAP_COPY(h->raw_hbdomain_on_sf[index], s->hbdomain);
+        MTC_HOSTMAP_COPY(h->raw_sfdomain_on_sf[index], s->sfdomain);
+        MTC_HOSTMAP_SET_BOOLEAN(h->self_fencing_on_sf, index, s->self_fencing);
+    }
+}
+
+//
+//  update_domains -
+//
+//  Drop the hosts timed out on HB/SF from the domains, and request
+//  the fault handler if a host in the liveset is dropped (start_fh).
+//
+
+static void
+update_domains(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    MTC_BOOLEAN degraded = FALSE;
+    MTC_S32 index;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (MTC_HOSTMAP_ISON(h->hbdomain, index) && index != me &&
+            sim.now - h->time_last_HB[index] > _T1 * ONE_SEC)
+        {
+            MTC_HOSTMAP_RESET(h->hbdomain, index);
+            degraded |= MTC_HOSTMAP_ISON(h->current_liveset, index);
+            log_sim("host %d: host %d is removed from the HB domain.\n", me, index);
+        }
+        if (MTC_HOSTMAP_ISON(h->sfdomain, index) &&
+            sim.now - h->time_last_SF[index] > _T2 * ONE_SEC)
+        {
+            MTC_HOSTMAP_RESET(h->sfdomain, index);
+            degraded |= MTC_HOSTMAP_ISON(h->current_liveset, index);
+            log_sim("host %d: host %d is removed from the SF domain.\n", me, index);
+        }
+    }
+
+    if (degraded &&
+        !(SM_PHASE_FHREADY <= h->phase && h->phase <= SM_PHASE_FH2DONE))
+    {
+        h->need_fh = TRUE;
+    }
+}
+
+//
+//  State Manager
+//
+
+static MTC_BOOLEAN
+rendezvous_done(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    SM_PHASE p1 = fh_program[h->step].phase, p2 = fh_program[h->step].next;
+    MTC_S32 index;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (index == me || !MTC_HOSTMAP_ISON(h->current_liveset, index))
+        {
+            continue;
+        }
+        if (fh_program[h->step].on_heartbeat &&
+            MTC_HOSTMAP_ISON(h->hbdomain, index) &&
+            !(h->phase_on_hb[index] == p1 || h->phase_on_hb[index] == p2))
+        {
+            return FALSE;
+        }
+        if (fh_program[h->step].on_statefile &&
+            MTC_HOSTMAP_ISON(h->sfdomain, index) &&
+            !(h->phase_on_sf[index] == p1 || h->phase_on_sf[index] == p2))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static MTC_BOOLEAN
+stable_done(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    MTC_CLOCK since_start = sim.now - h->step_start;
+    MTC_S32 index;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (index == me)
+        {
+            continue;
+        }
+        if (MTC_HOSTMAP_ISON(h->hbdomain, index) &&
+            sim.now - h->time_last_HB[index] > _T1 * 10 * APPROACHING_TIMEOUT_FACTOR &&
+            sim.now - h->time_last_HB[index] > since_start)
+        {
+            return FALSE;
+        }
+        if (MTC_HOSTMAP_ISON(h->sfdomain, index) &&
+            sim.now - h->time_last_SF[index] > _T2 * 10 * APPROACHING_TIMEOUT_FACTOR &&
+            sim.now - h->time_last_SF[index] > since_start)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void
+take_snapshot(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    SIM_VIEW *v = &h->stable;
+    MTC_S32 index;
+
+    MTC_HOSTMAP_COPY(v->hbdomain, h->hbdomain);
+    MTC_HOSTMAP_COPY(v->sfdomain, h->sfdomain);
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        MTC_HOSTMAP_COPY(v->raw_hbdomain_on_hb[index], h->raw_hbdomain_on_hb[index]);
+        MTC_HOSTMAP_COPY(v->raw_sfdomain_on_hb[index], h->raw_sfdomain_on_hb[index]);
+        MTC_HOSTMAP_COPY(v->raw_hbdomain_on_sf[index], h->raw_hbdomain_on_sf[index]);
+        MTC_HOSTMAP_COPY(v->raw_sfdomain_on_sf[index], h->raw_sfdomain_on_sf[index]);
+    }
+}
+
+static MTC_BOOLEAN
+is_empty_hostmap(
+    MTC_HOSTMAP hostmap)
+{
+    MTC_S32 index;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (MTC_HOSTMAP_ISON(hostmap, index))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static MTC_BOOLEAN
+is_all_hosts_up(
+    MTC_HOSTMAP hostmap)
+{
+    MTC_S32 index;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (!MTC_HOSTMAP_ISON(hostmap, index))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static MTC_BOOLEAN
+consistent_done(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    SIM_VIEW *v = &h->stable;
+    MTC_HOSTMAP my_hbd, my_sfd, r_hbd, r_sfd, r_hbd_onsf, r_sfd_onhb;
+    MTC_S32 index;
+
+    take_snapshot(me);
+    MTC_HOSTMAP_INTERSECTION(my_hbd, '=', v->hbdomain, '&', h->current_liveset);
+    MTC_HOSTMAP_INTERSECTION(my_sfd, '=', v->sfdomain, '&', h->current_liveset);
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (index == me || !MTC_HOSTMAP_ISON(h->current_liveset, index))
+        {
+            continue;
+        }
+        MTC_HOSTMAP_INTERSECTION(r_hbd, '=', v->raw_hbdomain_on_hb[index], '&', h->current_liveset);
+        MTC_HOSTMAP_INTERSECTION(r_sfd, '=', v->raw_sfdomain_on_sf[index], '&', h->current_liveset);
+        MTC_HOSTMAP_INTERSECTION(r_hbd_onsf, '=', v->raw_hbdomain_on_sf[index], '&', h->current_liveset);
+        MTC_HOSTMAP_INTERSECTION(r_sfd_onhb, '=', v->raw_sfdomain_on_hb[index], '&', h->current_liveset);
+
+        if ((MTC_HOSTMAP_ISON(my_hbd, index) && MTC_HOSTMAP_COMPARE(my_hbd, '!=', r_hbd)) ||
+            (MTC_HOSTMAP_ISON(my_sfd, index) && MTC_HOSTMAP_COMPARE(my_sfd, '!=', r_sfd)) ||
+            (MTC_HOSTMAP_ISON(my_sfd, index) && MTC_HOSTMAP_COMPARE(my_hbd, '!=', r_hbd_onsf)) ||
+            (MTC_HOSTMAP_ISON(my_hbd, index) && MTC_HOSTMAP_COMPARE(my_sfd, '!=', r_sfd_onhb)))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+//
+//  partition_score -
+//
+//  get_partition_score() with the same weight for all the hosts.
+//
+
+static MTC_S64
+partition_score(
+    MTC_HOSTMAP hostmap)
+{
+    MTC_S64 index, size_score = 0, index_score = 0;
+
+    for (index = ha_config.common.hostnum - 1; index >= 0; index--)
+    {
+        if (MTC_HOSTMAP_ISON(hostmap, index))
+        {
+            size_score++;
+            index_score = MAX_HOST_NUM - index;
+        }
+    }
+    return (size_score * 0x10000 + size_score * 0x100 + index_score);
+}
+
+//
+//  merge_view -
+//
+//  The merger of the stable view when the hosts cannot agree on it
+//  within the timeout: drop the hosts without the State-File, then
+//  drop the hosts with the smallest HB domains until the rest have
+//  full connectivity on heartbeat.
+//
+
+static void
+merge_view(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    SIM_VIEW *v = &h->stable;
+    MTC_HOSTMAP my_hbd, my_sfd, removed, tmp;
+    MTC_S32 index, index2, selected;
+    MTC_S64 score, minimum;
+
+    MTC_HOSTMAP_INTERSECTION(my_hbd, '=', v->hbdomain, '&', h->current_liveset);
+    MTC_HOSTMAP_INTERSECTION(my_sfd, '=', v->sfdomain, '&', h->current_liveset);
+    MTC_HOSTMAP_COPY(v->raw_hbdomain_on_hb[me], my_hbd);
+    MTC_HOSTMAP_COPY(v->raw_hbdomain_on_sf[me], my_hbd);
+    MTC_HOSTMAP_COPY(v->raw_sfdomain_on_hb[me], my_sfd);
+    MTC_HOSTMAP_COPY(v->raw_sfdomain_on_sf[me], my_sfd);
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        MTC_HOSTMAP_INTERSECTION(v->raw_hbdomain_on_hb[index], '=', v->raw_hbdomain_on_hb[index], '&', h->current_liveset);
+        MTC_HOSTMAP_INTERSECTION(v->raw_sfdomain_on_sf[index], '=', v->raw_sfdomain_on_sf[index], '&', h->current_liveset);
+        MTC_HOSTMAP_INTERSECTION(v->raw_hbdomain_on_sf[index], '=', v->raw_hbdomain_on_sf[index], '&', h->current_liveset);
+        MTC_HOSTMAP_INTERSECTION(v->raw_sfdomain_on_hb[index], '=', v->raw_sfdomain_on_hb[index], '&', h->current_liveset);
+    }
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (index != me &&
+            (is_empty_hostmap(v->raw_sfdomain_on_sf[index]) ||
+             is_empty_hostmap(v->raw_sfdomain_on_hb[index])))
+        {
+            MTC_HOSTMAP_RESET(my_sfd, index);
+            MTC_HOSTMAP_RESET(v->sfdomain, index);
+            MTC_HOSTMAP_RESET(v->raw_sfdomain_on_sf[me], index);
+            MTC_HOSTMAP_RESET(v->raw_sfdomain_on_hb[me], index);
+        }
+    }
+
+    MTC_HOSTMAP_INIT_RESET(removed);
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (!MTC_HOSTMAP_ISON(my_sfd, index))
+        {
+            MTC_HOSTMAP_INIT_RESET(v->raw_hbdomain_on_sf[index]);
+            for (index2 = 0; _is_configured_host(index2); index2++)
+            {
+                MTC_HOSTMAP_RESET(v->raw_hbdomain_on_sf[index2], index);
+            }
+            MTC_HOSTMAP_SET(removed, index);
+        }
+    }
+
+    while (TRUE)
+    {
+        selected = -1;
+        minimum = -1;
+        for (index = ha_config.common.hostnum - 1; index >= 0; index--)
+        {
+            if (MTC_HOSTMAP_ISON(removed, index))
+            {
+                continue;
+            }
+            score = partition_score(v->raw_hbdomain_on_sf[index]);
+            if (selected < 0 || score < minimum)
+            {
+                selected = index;
+                minimum = score;
+            }
+        }
+        if (selected < 0)
+        {
+            MTC_HOSTMAP_COPY(tmp, removed);
+        }
+        else
+        {
+            MTC_HOSTMAP_UNION(tmp, '=', v->raw_hbdomain_on_sf[selected], '|', removed);
+        }
+        if (is_all_hosts_up(tmp))
+        {
+            break;
+        }
+        MTC_HOSTMAP_INIT_RESET(v->raw_hbdomain_on_sf[selected]);
+        for (index = 0; _is_configured_host(index); index++)
+        {
+            MTC_HOSTMAP_RESET(v->raw_hbdomain_on_sf[index], selected);
+        }
+        MTC_HOSTMAP_SET(removed, selected);
+    }
+
+    MTC_HOSTMAP_COPY(v->hbdomain, v->raw_hbdomain_on_sf[me]);
+    MTC_HOSTMAP_COPY(v->sfdomain, my_sfd);
+    log_sim("host %d: views are merged.\n", me);
+}
+
+static MTC_S32
+partition_size(
+    MTC_HOSTMAP sfdomain,
+    MTC_HOSTMAP hbdomain)
+{
+    MTC_S32 index, size = 0;
+
+    if (is_empty_hostmap(sfdomain))
+    {
+        return 0;
+    }
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (MTC_HOSTMAP_ISON(sfdomain, index) && MTC_HOSTMAP_ISON(hbdomain, index))
+        {
+            size += 1 + 0x100;      // all the hosts have the same weight
+        }
+    }
+    return size;
+}
+
+//
+//  survival -
+//
+//  test_Survival_Rule() on the stable view. No host is excluded in
+//  the model, so Survival Rule-2 applies only when no host in the HB
+//  domain has the State-File access and all the others are in it.
+//
+
+static MTC_BOOLEAN
+survival(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    SIM_VIEW *v = &h->stable;
+    MTC_HOSTMAP hbd, sfd;
+    MTC_S32 index, size, winner_size = 0, winner_index = -1;
+    MTC_BOOLEAN winner, sr2 = FALSE, sf_access, in_hbd, in_sfd;
+
+    MTC_HOSTMAP_INTERSECTION(hbd, '=', v->hbdomain, '&', h->current_liveset);
+    MTC_HOSTMAP_INTERSECTION(sfd, '=', v->sfdomain, '&', h->current_liveset);
+
+    winner = (MTC_HOSTMAP_SUBSETEQUAL(sfd, '(=', hbd) && !is_empty_hostmap(sfd));
+    if (!winner)
+    {
+        //  am_I_in_largest_partition()
+
+        for (index = 0; _is_configured_host(index); index++)
+        {
+            if (!MTC_HOSTMAP_ISON(v->sfdomain, index))
+            {
+                size = 0;
+            }
+            else if (index == me)
+            {
+                size = partition_size(v->sfdomain, v->hbdomain);
+            }
+            else
+            {
+                size = partition_size(v->raw_sfdomain_on_sf[index], v->raw_hbdomain_on_sf[index]);
+            }
+            if (size > winner_size)
+            {
+                winner_index = index;
+                winner_size = size;
+            }
+        }
+        winner = (winner_index >= 0 &&
+                  (winner_index == me ||
+                   (MTC_HOSTMAP_ISON(v->raw_sfdomain_on_sf[winner_index], me) &&
+                    MTC_HOSTMAP_ISON(v->raw_hbdomain_on_sf[winner_index], me) &&
+                    MTC_HOSTMAP_ISON(v->sfdomain, winner_index) &&
+                    MTC_HOSTMAP_ISON(v->hbdomain, winner_index))));
+    }
+    if (!winner)
+    {
+        sr2 = TRUE;
+        for (index = 0; _is_configured_host(index); index++)
+        {
+            sf_access = (index == me)? !h->sf_cut: MTC_HOSTMAP_ISON(v->raw_sfdomain_on_hb[index], index);
+            in_hbd = MTC_HOSTMAP_ISON(hbd, index);
+            if ((in_hbd && sf_access) || !in_hbd)
+            {
+                sr2 = FALSE;
+            }
+        }
+        winner = sr2;
+    }
+
+    h->sleep_extend = FALSE;
+    if (winner)
+    {
+        for (index = 0; _is_configured_host(index); index++)
+        {
+            in_hbd = MTC_HOSTMAP_ISON(hbd, index);
+            in_sfd = (sr2)? TRUE: MTC_HOSTMAP_ISON(sfd, index);
+            if (!in_hbd || !in_sfd)
+            {
+                MTC_HOSTMAP_RESET(h->proposed_liveset, index);
+                if (MTC_HOSTMAP_ISON(h->hbdomain, index))
+                {
+                    MTC_HOSTMAP_RESET(h->hbdomain, index);
+                    h->sleep_extend = TRUE;
+                }
+                if (MTC_HOSTMAP_ISON(h->sfdomain, index))
+                {
+                    MTC_HOSTMAP_RESET(h->sfdomain, index);
+                    h->sleep_extend = TRUE;
+                }
+            }
+        }
+    }
+    return winner;
+}
+
+//
+//  fence_wait_done -
+//
+//  The FH4 wait of the winners, including the early exit on the
+//  self-fencing records (wait_until_removed_hosts_fenced()).
+//
+
+static MTC_BOOLEAN
+fence_wait_done(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    MTC_HOSTMAP removed;
+
+    if (sim.now >= h->fence_deadline)
+    {
+        return TRUE;
+    }
+    if (!opt.confirm)
+    {
+        return FALSE;
+    }
+
+    MTC_HOSTMAP_DIFFERENCE(removed, '=', h->current_liveset, '-', h->proposed_liveset);
+    if (!MTC_HOSTMAP_SUBSETEQUAL(removed, '(=', h->self_fencing_on_sf))
+    {
+        h->recorded = -1;
+        return FALSE;
+    }
+    if (h->recorded < 0)
+    {
+        h->recorded = sim.now;
+    }
+    return (sim.now - h->recorded >= FH_SELF_FENCE_GRACE * ONE_SEC);
+}
+
+static void
+commit(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    MTC_S32 index;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (MTC_HOSTMAP_ISON(h->current_liveset, index) &&
+            !MTC_HOSTMAP_ISON(h->proposed_liveset, index) &&
+            sim.host[index].state != HOST_DEAD)
+        {
+            log_sim("host %d: VIOLATION - host %d is removed while alive.\n", me, index);
+            sim.violations++;
+        }
+    }
+    MTC_HOSTMAP_INTERSECTION(h->current_liveset, '=', h->current_liveset, '&', h->proposed_liveset);
+    h->commit = sim.now;
+    log_sim("host %d: liveset is updated.\n", me);
+}
+
+//
+//  enter_step -
+//
+//  Start the step of the fault handler.
+//
+
+static void
+enter_step(
+    MTC_S32 me,
+    MTC_S32 step)
+{
+    SIM_HOST *h = &sim.host[me];
+
+    h->step = step;
+    h->step_start = sim.now;
+
+    switch (fh_program[step].type)
+    {
+    case STEP_RENDEZVOUS:
+        h->phase = fh_program[step].phase;
+        hb_send(me);                    // hb_send_hb_now()
+        break;
+
+    case STEP_SURVIVAL:
+        h->p3_start = sim.now;
+        break;
+
+    case STEP_FENCE_WAIT:
+        if (MTC_HOSTMAP_SUBSETEQUAL(h->current_liveset, '(=', h->proposed_liveset))
+        {
+            h->fence_deadline = sim.now;
+            break;
+        }
+        h->fence_deadline = sim.now + FH_FENCE_WAIT(sim.now - h->p3_start, h->sleep_extend);
+        h->recorded = -1;
+        break;
+
+    default:
+        break;
+    }
+}
+
+//
+//  sm_tick -
+//
+//  Advance the State Manager of the host as far as possible.
+//
+
+static void
+sm_tick(
+    MTC_S32 me)
+{
+    SIM_HOST *h = &sim.host[me];
+    MTC_BOOLEAN done;
+
+    update_domains(me);
+    if (h->self_fencing)
+    {
+        return;
+    }
+
+    if (h->step < 0)
+    {
+        if (!h->need_fh)
+        {
+            return;
+        }
+        h->need_fh = FALSE;
+        MTC_HOSTMAP_COPY(h->proposed_liveset, h->current_liveset);
+        if (h->fh_start < 0 && sim.fault_time >= 0 && sim.now >= sim.fault_time)
+        {
+            h->fh_start = sim.now;
+        }
+        log_sim("host %d: start fault handler.\n", me);
+        enter_step(me, 0);
+    }
+
+    do
+    {
+        switch (fh_program[h->step].type)
+        {
+        case STEP_RENDEZVOUS:
+            done = rendezvous_done(me);
+            break;
+
+        case STEP_STABLE:
+            done = stable_done(me);
+            break;
+
+        case STEP_CONSISTENT:
+            done = consistent_done(me);
+            if (!done && sim.now - h->step_start >= _max(_T1, _T2) * ONE_SEC)
+            {
+                merge_view(me);
+                done = TRUE;
+            }
+            break;
+
+        case STEP_SURVIVAL:
+            if (!survival(me))
+            {
+                sim_self_fence(me, "Survival Rule is not met");
+                return;
+            }
+            done = TRUE;
+            break;
+
+        case STEP_FENCE_WAIT:
+            done = fence_wait_done(me);
+            if (done && MTC_HOSTMAP_COMPARE(h->current_liveset, '!=', h->proposed_liveset))
+            {
+                commit(me);
+            }
+            break;
+
+        case STEP_END:
+        default:
+            log_sim("host %d: end fault handler.\n", me);
+            h->step = -1;
+            return;
+        }
+
+        if (done)
+        {
+            enter_step(me, h->step + 1);
+        }
+    } while (done);
+}
+
+//
+//  apply_action -
+//
+//  Apply the scenario action.
+//
+
+static void
+apply_action(
+    SIM_ACTION *pa)
+{
+    SIM_HOST *h = (pa->host >= 0)? &sim.host[pa->host]: NULL;
+    MTC_S32 index;
+
+    switch (pa->type)
+    {
+    case ACT_CRASH:
+        host_die(pa->host, DEATH_CRASH);
+        break;
+
+    case ACT_HANG:
+        if (h->state == HOST_RUNNING)
+        {
+            h->state = HOST_HUNG;
+            log_sim("host %d hangs.\n", pa->host);
+            schedule(_min(h->wd_hb + _Wh * ONE_SEC, h->wd_sf + _Ws * ONE_SEC) - sim.now,
+                     EV_DEATH, pa->host, DEATH_WATCHDOG, NULL);
+        }
+        break;
+
+    case ACT_PARTITION:
+    case ACT_HEAL:
+        for (index = 0; _is_configured_host(index); index++)
+        {
+            sim.host[index].group = (pa->type == ACT_PARTITION)? pa->group[index]: 0;
+        }
+        log_sim("network is %s.\n", (pa->type == ACT_PARTITION)? "partitioned": "healed");
+        break;
+
+    case ACT_SFCUT:
+        h->sf_cut = TRUE;
+        log_sim("host %d loses the State-File.\n", pa->host);
+        break;
+
+    case ACT_SFHEAL:
+        h->sf_cut = FALSE;
+        log_sim("host %d regains the State-File.\n", pa->host);
+        break;
+    }
+}
+
+//
+//  dispatch -
+//
+//  Process an event.
+//
+
+static void
+dispatch(
+    SIM_EVENT *pev)
+{
+    SIM_HOST *h = (pev->type != EV_SCENARIO)? &sim.host[pev->host]: NULL;
+    MTC_BOOLEAN accelerated;
+
+    if (h && h->state != HOST_RUNNING && pev->type != EV_DEATH)
+    {
+        return;     // the host does nothing, and its timers are gone
+    }
+
+    switch (pev->type)
+    {
+    case EV_SCENARIO:
+        apply_action(&opt.action[pev->arg]);
+        break;
+
+    case EV_HB_SEND:
+        hb_send(pev->host);
+        schedule(_t1 * ONE_SEC, EV_HB_SEND, pev->host, 0, NULL);
+        break;
+
+    case EV_HB_RECEIVE:
+        hb_receive(pev->host, &pev->hb);
+        break;
+
+    case EV_SF_CYCLE:
+        sf_cycle(pev->host);
+        accelerated = (h->step >= 0 || h->self_fencing);
+        schedule((accelerated)? SIM_SF_ACCELERATED: _t2 * ONE_SEC + sim_jitter(SIM_SF_JITTER),
+                 EV_SF_CYCLE, pev->host, 0, NULL);
+        break;
+
+    case EV_SF_READ:
+        sf_read(pev->host);
+        break;
+
+    case EV_SM_TICK:
+        sm_tick(pev->host);
+        schedule(SIM_SM_TICK, EV_SM_TICK, pev->host, 0, NULL);
+        break;
+
+    case EV_SELF_FENCE_RECORD:
+        if (pev->arg && !h->sf_cut)
+        {
+            sim.sf[pev->host].self_fencing = TRUE;
+            sim.sf[pev->host].sequence++;
+        }
+        sim_reset(pev->host);
+        break;
+
+    case EV_DEATH:
+        host_die(pev->host, pev->arg);
+        break;
+    }
+}
+
+//
+//  run -
+//
+//  Run the scenario once with the seed.
+//
+
+static MTC_STATUS
+run(
+    MTC_U32 seed,
+    SIM_RESULT *presult)
+{
+    SIM_EVENT ev;
+    MTC_S32 index, index2, first = -1;
+    MTC_U32 action;
+    MTC_STATUS status = MTC_SUCCESS;
+
+    sim.now = 0;
+    sim.seq = 0;
+    sim.queued = 0;
+    sim.random = 0x9E3779B97F4A7C15ULL * (seed + 1);
+    sim.violations = 0;
+    sim.fault_time = -1;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        SIM_HOST *h = &sim.host[index];
+
+        bzero(h, sizeof(*h));
+        h->state = HOST_RUNNING;
+        h->phase = SM_PHASE_STARTED;
+        h->step = -1;
+        h->fh_start = h->commit = h->fence_armed = -1;
+        for (index2 = 0; _is_configured_host(index2); index2++)
+        {
+            MTC_HOSTMAP_SET(h->current_liveset, index2);
+            h->phase_on_hb[index2] = h->phase_on_sf[index2] = SM_PHASE_STARTED;
+        }
+        MTC_HOSTMAP_COPY(h->proposed_liveset, h->current_liveset);
+        MTC_HOSTMAP_COPY(h->hbdomain, h->current_liveset);
+        MTC_HOSTMAP_COPY(h->sfdomain, h->current_liveset);
+        for (index2 = 0; _is_configured_host(index2); index2++)
+        {
+            MTC_HOSTMAP_COPY(h->raw_hbdomain_on_hb[index2], h->current_liveset);
+            MTC_HOSTMAP_COPY(h->raw_sfdomain_on_hb[index2], h->current_liveset);
+            MTC_HOSTMAP_COPY(h->raw_hbdomain_on_sf[index2], h->current_liveset);
+            MTC_HOSTMAP_COPY(h->raw_sfdomain_on_sf[index2], h->current_liveset);
+        }
+
+        bzero(&sim.sf[index], sizeof(sim.sf[index]));
+        sim.sf[index].phase = SM_PHASE_STARTED;
+    }
+
+    //  the threads of each host start at random offsets
+
+    for (index = 0; _is_configured_host(index) && status == MTC_SUCCESS; index++)
+    {
+        status |= schedule((MTC_CLOCK) (sim_uniform() * _t1 * ONE_SEC), EV_HB_SEND, index, 0, NULL);
+        status |= schedule((MTC_CLOCK) (sim_uniform() * _t2 * ONE_SEC), EV_SF_CYCLE, index, 0, NULL);
+        status |= schedule((MTC_CLOCK) (sim_uniform() * SIM_SM_TICK), EV_SM_TICK, index, 0, NULL);
+    }
+    for (action = 0; action < opt.actions && status == MTC_SUCCESS; action++)
+    {
+        status = schedule(opt.action[action].time, EV_SCENARIO, -1, action, NULL);
+        if (opt.action[action].type != ACT_HEAL && opt.action[action].type != ACT_SFHEAL &&
+            (sim.fault_time < 0 || opt.action[action].time < sim.fault_time))
+        {
+            sim.fault_time = opt.action[action].time;
+        }
+    }
+    if (status != MTC_SUCCESS)
+    {
+        return status;
+    }
+
+    while (next_event(&ev) && ev.time <= opt.duration * ONE_SEC)
+    {
+        sim.now = ev.time;
+        sim.events++;
+        dispatch(&ev);
+    }
+
+    //  results
+
+    bzero(presult, sizeof(*presult));
+    presult->detection = presult->failover = -1;
+    presult->agreed = TRUE;
+    presult->violations = sim.violations;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        SIM_HOST *h = &sim.host[index];
+
+        if (h->fh_start >= 0 &&
+            (presult->detection < 0 || h->fh_start - sim.fault_time < presult->detection))
+        {
+            presult->detection = h->fh_start - sim.fault_time;
+        }
+        if (h->state == HOST_DEAD)
+        {
+            presult->self_fenced += (h->self_fencing)? 1: 0;
+            continue;
+        }
+
+        presult->survivors++;
+        if (h->commit >= 0 && h->commit - sim.fault_time > presult->failover)
+        {
+            presult->failover = h->commit - sim.fault_time;
+        }
+        if (first < 0)
+        {
+            first = index;
+        }
+        else if (MTC_HOSTMAP_COMPARE(h->current_liveset, '!=', sim.host[first].current_liveset))
+        {
+            presult->agreed = FALSE;
+        }
+    }
+
+    return MTC_SUCCESS;
+}
+
+//
+//  compare_clock - for qsort
+//
+
+static int
+compare_clock(
+    const void *a,
+    const void *b)
+{
+    MTC_CLOCK x = *(const MTC_CLOCK *) a, y = *(const MTC_CLOCK *) b;
+
+    return (x > y) - (x < y);
+}
+
+//
+//  main
+//
+//  fhsim [options]
+//
+//  Run the scenario the number of times with consecutive seeds, and
+//  print the failover time distribution and the correctness counts.
+//
+
+int
+main(
+    int argc,
+    char *argv[],
+    char *envp[])
+{
+    SIM_RESULT result;
+    MTC_CLOCK *failover;
+    MTC_U32 run_index, failovers = 0, violations = 0, disagreed = 0,
+            pool_lost = 0, self_fenced = 0;
+    double sum = 0, detection_sum = 0, elapsed;
+    struct timespec start, end;
+    MTC_STATUS status;
+
+    ha_config.common.hostnum = opt.hosts;
+    ha_config.common.heartbeat_interval = HEARTBEAT_INTERVAL_DEFAULT;
+    ha_config.common.heartbeat_timeout = HEARTBEAT_TIMEOUT_DEFAULT;
+    ha_config.common.heartbeat_watchdog_timeout = HEARTBEAT_WATCHDOG_TIMEOUT_DEFAULT;
+    ha_config.common.statefile_interval = STATEFILE_INTERVAL_DEFAULT;
+    ha_config.common.statefile_timeout = STATEFILE_TIMEOUT_DEFAULT;
+    ha_config.common.statefile_watchdog_timeout = STATEFILE_WATCHDOG_TIMEOUT_DEFAULT;
+
+    if (parse_options(argc, argv) < 0)
+    {
+        fprintf(stderr,
+                "usage: fhsim [--hosts n] [--runs n] [--seed n] [--duration sec]\n"
+                "             [--loss probability] [--delay ms] [--jitter ms] [--sf-latency ms]\n"
+                "             [--reset-delay ms[-ms]] [--stall probability]\n"
+                "             [--timeouts t1,T1,Wh,t2,T2,Ws] [--no-confirm] [--verbose]\n"
+                "             [--event sec:action]...\n"
+                "  actions: crash=<host>, hang=<host>, sfcut=<host>, sfheal=<host>,\n"
+                "           partition=<hosts>/<hosts>[/...] (e.g. 0-2,5/3-4), heal\n");
+        exit(MTC_EXIT_INVALID_PARAMETER);
+    }
+
+    if ((failover = malloc(sizeof(MTC_CLOCK) * opt.runs)) == NULL)
+    {
+        exit(MTC_EXIT_SYSTEM_ERROR);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (run_index = 0; run_index < opt.runs; run_index++)
+    {
+        if ((status = run(opt.seed + run_index, &result)) != MTC_SUCCESS)
+        {
+            fprintf(stderr, "simulation failed (%d).\n", status);
+            exit(status_to_exit(status));
+        }
+
+        if (opt.verbose || result.violations || !result.agreed)
+        {
+            printf("run %u (seed %u): detection %"PRId64" ms, failover %"PRId64" ms,"
+                   " survivors %u, self-fenced %u, violations %u%s\n",
+                   run_index, opt.seed + run_index, result.detection, result.failover,
+                   result.survivors, result.self_fenced, result.violations,
+                   (result.agreed)? "": ", livesets disagree");
+        }
+
+        violations += result.violations;
+        disagreed += (result.agreed)? 0: 1;
+        pool_lost += (result.survivors == 0)? 1: 0;
+        self_fenced += result.self_fenced;
+        if (result.failover >= 0)
+        {
+            failover[failovers++] = result.failover;
+            sum += result.failover;
+            detection_sum += result.detection;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("hosts %u, runs %u, confirmed fence %s, reset delay %u-%u ms, stall %g\n",
+           opt.hosts, opt.runs, (opt.confirm)? "on": "off",
+           opt.reset_min, opt.reset_max, opt.stall);
+    printf("failover (fault to the last commit), %u runs:", failovers);
+    if (failovers > 0)
+    {
+        qsort(failover, failovers, sizeof(MTC_CLOCK), compare_clock);
+        printf(" mean %.0f ms, p50 %"PRId64" ms, p99 %"PRId64" ms, max %"PRId64" ms"
+               " (detection mean %.0f ms)",
+               sum / failovers, failover[failovers / 2],
+               failover[(failovers * 99) / 100], failover[failovers - 1],
+               detection_sum / failovers);
+    }
+    printf("\n");
+    printf("self-fenced hosts %u, pool lost %u, livesets disagree %u, violations %u\n",
+           self_fenced, pool_lost, disagreed, violations);
+    printf("%"PRIu64" events in %.2f s (%.0f runs/min)\n",
+           sim.events, elapsed, (elapsed > 0)? opt.runs * 60 / elapsed: 0);
+
+    free(failover);
+    free(sim.queue);
+    return (violations || disagreed)? MTC_EXIT_SYSTEM_ERROR: MTC_EXIT_SUCCESS;
+}
+
+//
+//  parse_options -
+//
+
+static int
+parse_options(
+    int argc,
+    char *argv[])
+{
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        char *arg = (i + 1 < argc)? argv[i + 1]: NULL;
+
+        if (!strcmp(argv[i], "--no-confirm"))
+        {
+            opt.confirm = FALSE;
+            continue;
+        }
+        if (!strcmp(argv[i], "--verbose"))
+        {
+            opt.verbose = TRUE;
+            continue;
+        }
+        if (arg == NULL)
+        {
+            return -1;
+        }
+        i++;
+
+        if (!strcmp(argv[i - 1], "--hosts"))
+        {
+            opt.hosts = atoi(arg);
+        }
+        else if (!strcmp(argv[i - 1], "--runs"))
+        {
+            opt.runs = atoi(arg);
+        }
+        else if (!strcmp(argv[i - 1], "--seed"))
+        {
+            opt.seed = strtoul(arg, NULL, 0);
+        }
+        else if (!strcmp(argv[i - 1], "--duration"))
+        {
+            opt.duration = atoi(arg);
+        }
+        else if (!strcmp(argv[i - 1], "--loss"))
+        {
+            opt.loss = atof(arg);
+        }
+        else if (!strcmp(argv[i - 1], "--delay"))
+        {
+            opt.delay = atoi(arg);
+        }
+        else if (!strcmp(argv[i - 1], "--jitter"))
+        {
+            opt.jitter = atoi(arg);
+        }
+        else if (!strcmp(argv[i - 1], "--sf-latency"))
+        {
+            opt.sf_latency = atoi(arg);
+        }
+        else if (!strcmp(argv[i - 1], "--reset-delay"))
+        {
+            switch (sscanf(arg, "%u-%u", &opt.reset_min, &opt.reset_max))
+            {
+            case 1:
+                opt.reset_max = opt.reset_min;
+                break;
+            case 2:
+                break;
+            default:
+                return -1;
+            }
+        }
+        else if (!strcmp(argv[i - 1], "--stall"))
+        {
+            opt.stall = atof(arg);
+        }
+        else if (!strcmp(argv[i - 1], "--timeouts"))
+        {
+            if (sscanf(arg, "%u,%u,%u,%u,%u,%u",
+                       &ha_config.common.heartbeat_interval,
+                       &ha_config.common.heartbeat_timeout,
+                       &ha_config.common.heartbeat_watchdog_timeout,
+                       &ha_config.common.statefile_interval,
+                       &ha_config.common.statefile_timeout,
+                       &ha_config.common.statefile_watchdog_timeout) != 6)
+            {
+                return -1;
+            }
+        }
+        else if (!strcmp(argv[i - 1], "--event"))
+        {
+            if (opt.actions == SIM_MAX_SCENARIO ||
+                parse_action(arg, &opt.action[opt.actions++]) < 0)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    if (opt.hosts < 1 || opt.hosts > MAX_HOST_NUM || opt.runs < 1 ||
+        _t1 < 1 || _t2 < 1 || opt.loss < 0 || opt.loss > 1 ||
+        opt.reset_max < opt.reset_min || opt.stall < 0 || opt.stall > 1)
+    {
+        return -1;
+    }
+    ha_config.common.hostnum = opt.hosts;
+
+    //  default scenario: the last host crashes
+
+    if (opt.actions == 0)
+    {
+        opt.action[0].time = 60 * ONE_SEC;
+        opt.action[0].type = ACT_CRASH;
+        opt.action[0].host = opt.hosts - 1;
+        opt.actions = 1;
+    }
+
+    for (i = 0; i < opt.actions; i++)
+    {
+        if (opt.action[i].host >= (MTC_S32) opt.hosts)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//
+//  parse_action -
+//
+//  <sec>:<action>, where the action is one of
+//  crash=<host>, hang=<host>, sfcut=<host>, sfheal=<host>, heal and
+//  partition=<hosts>/<hosts>... Hosts not listed in the partition
+//  stay in the first group.
+//
+
+static int
+parse_action(
+    char *spec,
+    SIM_ACTION *paction)
+{
+    static const struct {
+        char            *name;
+        SIM_ACTION_TYPE type;
+    } actions[] = {
+        {"crash",       ACT_CRASH},
+        {"hang",        ACT_HANG},
+        {"sfcut",       ACT_SFCUT},
+        {"sfheal",      ACT_SFHEAL},
+        {"partition",   ACT_PARTITION},
+        {"heal",        ACT_HEAL},
+    };
+    char *p, *end;
+    double time;
+    MTC_U32 index, group = 0, from, to;
+    size_t len;
+
+    bzero(paction, sizeof(*paction));
+    paction->host = -1;
+
+    time = strtod(spec, &end);
+    if (end == spec || *end != ':' || time < 0)
+    {
+        return -1;
+    }
+    paction->time = (MTC_CLOCK) (time * ONE_SEC);
+    p = end + 1;
+
+    for (index = 0; index < sizeof(actions) / sizeof(actions[0]); index++)
+    {
+        len = strlen(actions[index].name);
+        if (!strncmp(p, actions[index].name, len) && (p[len] == '\0' || p[len] == '='))
+        {
+            break;
+        }
+    }
+    if (index == sizeof(actions) / sizeof(actions[0]))
+    {
+        return -1;
+    }
+    paction->type = actions[index].type;
+    p += len;
+
+    switch (paction->type)
+    {
+    case ACT_HEAL:
+        return (*p == '\0')? 0: -1;
+
+    case ACT_PARTITION:
+        if (*p++ != '=')
+        {
+            return -1;
+        }
+        while (*p)
+        {
+            from = strtoul(p, &end, 10);
+            if (end == p || from >= MAX_HOST_NUM)
+            {
+                return -1;
+            }
+            to = from;
+            if (*end == '-')
+            {
+                p = end + 1;
+                to = strtoul(p, &end, 10);
+                if (end == p || to >= MAX_HOST_NUM || to < from)
+                {
+                    return -1;
+                }
+            }
+            for (index = from; index <= to; index++)
+            {
+                paction->group[index] = group;
+            }
+            if (*end == '/')
+            {
+                group++;
+            }
+            else if (*end != ',' && *end != '\0')
+            {
+                return -1;
+            }
+            p = (*end)? end + 1: end;
+        }
+        return 0;
+
+    default:
+        if (*p++ != '=')
+        {
+            return -1;
+        }
+        paction->host = strtoul(p, &end, 10);
+        return (end != p && *end == '\0')? 0: -1;
+    }
+}
@@ -0,0 +1,629 @@
+//
+//      Copyright (c) Stratus Technologies Bermuda Ltd., 2008.
+//      All Rights Reserved. Unpublished rights reserved
+//      under the copyright laws of the United States.
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU Lesser General Public License as published
+//      by the Free Software Foundation; version 2.1 only. with the special
+//      exception on linking described in file LICENSE.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU Lesser General Public License for more details.
+//
+//
+//  DESCRIPTION:
+//
+//      Equivalence check and benchmark of the hostmap operations.
+//
+//      The hostmap macros of sm.h and the hostmap helpers of sm.c (linked
+//      in from the daemon's sm.o) are compared with the reference
+//      implementations below, which test one host bit at a time as the
+//      code did before the 64-bit word operations. The maps are random,
+//      including bits of hosts beyond the configured number, with random
+//      numbers of configured hosts and random weights. The check also
+//      verifies that the 64-bit words are the 32-bit wire and State-File
+//      encoding (host i in element i / 32, bit i % 32).
+//
+//      Any mismatch is printed and the exit status is 1. Then, unless
+//      --check-only is given, each operation is timed (ns per call) in
+//      both implementations with all the hosts configured.
+//
+//      The other daemon modules sm.o refers to are stubbed below; they
+//      are not called.
+//
+//      Not installed; built for development only.
+//
+//  CREATION DATE:
+//
+//      October 19, 2026
+//
+
+//
+//
+//  O P E R A T I N G   S Y S T E M   I N C L U D E   F I L E S
+//
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+
+//
+//
+//  M A R A T H O N   I N C L U D E   F I L E S
+//
+//
+
+#include "mtctypes.h"
+#include "mtcerrno.h"
+#include "log.h"
+#include "config.h"
+#include "sm.h"
+#include "heartbeat.h"
+#include "statefile.h"
+#include "watchdog.h"
+#include "xha.h"
+
+
+//
+//
+//  L O C A L   D E F I N I T I O N S
+//
+//
+
+HA_CONFIG ha_config;
+
+#define BENCH_POOL          1024    //  maps cycled through by the benchmark
+
+//  Keeps the compiler from hoisting the operation out of the timing loop
+
+#define BENCH_BARRIER()     __asm__ __volatile__("" ::: "memory")
+
+static struct {
+    MTC_U32     maps;
+    MTC_U32     iterations;
+    MTC_U64     seed;
+    MTC_BOOLEAN check_only;
+} param = {
+    .maps = 1000000,
+    .iterations = 1000000,
+    .seed = 1,
+    .check_only = FALSE,
+};
+
+static MTC_U64 rng_state;
+static MTC_U32 mismatches = 0;
+
+
+//
+//  The hostmap helpers of sm.c (MTC_STATIC functions are global)
+//
+
+extern MTC_S32
+get_partition_size(
+    MTC_HOSTMAP sfdomain,
+    MTC_HOSTMAP hbdomain,
+    MTC_U32     weight[]);
+
+extern MTC_S64
+get_partition_score(
+    MTC_HOSTMAP hostmap,
+    MTC_U32     weight[]);
+
+extern MTC_BOOLEAN
+is_all_hosts_up(
+    MTC_HOSTMAP hostmap);
+
+extern MTC_BOOLEAN
+is_all_nonexcluded_hosts_up(
+    MTC_HOSTMAP hostmap,
+    MTC_HOSTMAP excluded);
+
+extern MTC_BOOLEAN
+is_empty_liveset(
+    MTC_HOSTMAP liveset);
+
+
+//
+//  The other daemon modules referred to by sm.o, com.o and log.o.
+//  sm.o is only used for the functions above, so these are not called.
+//
+
+pthread_attr_t *xhad_pthread_attr = NULL;
+
+void xhad_set_thread_priority(int priority) { (void) priority; }
+int xhad_thread_priority(void) { return 0; }
+void main_terminate(MTC_STATUS status) { (void) status; abort(); }
+void main_steady_state(void) { abort(); }
+void hb_SF_accelerate() { abort(); }
+void hb_SF_cancel_accelerate() { abort(); }
+void hb_send_hb_now(MTC_S32 count) { (void) count; abort(); }
+MTC_STATUS sf_set_pool_state(MTC_U32 pool_state) { (void) pool_state; abort(); }
+MTC_STATUS sf_set_excluded(MTC_BOOLEAN excluded) { (void) excluded; abort(); }
+MTC_BOOLEAN sf_set_self_fencing(MTC_CLOCK timeout) { (void) timeout; abort(); }
+void sf_watchdog_set() { abort(); }
+void watchdog_selffence(void) { abort(); }
+MTC_STATUS watchdog_arm_fence(void) { abort(); }
+
+
+//
+//  Reference implementations, one host bit at a time
+//
+
+MTC_STATIC void
+ref_mask_unconfig(
+    MTC_HOSTMAP b1)
+{
+    int i;
+
+    for (i = 0; i < MAX_HOST_NUM; i++)
+    {
+        if (!_is_configured_host(i))
+        {
+            MTC_HOSTMAP_RESET(b1, i);
+        }
+    }
+}
+
+MTC_STATIC int
+ref_compare(
+    MTC_HOSTMAP b1,
+    MTC_HOSTMAP b2)
+{
+    int i;
+
+    for (i = 0; i < _rounddiv(MAX_HOST_NUM, MTC_HOSTMAP_UNIT); i++)
+    {
+        if (b1[i] - b2[i])
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+MTC_STATIC int
+ref_subsetequal(
+    MTC_HOSTMAP b1,
+    MTC_HOSTMAP b2)
+{
+    int i;
+
+    for (i = 0; i < MAX_HOST_NUM; i++)
+    {
+        if (MTC_HOSTMAP_ISON(b1, i) && !MTC_HOSTMAP_ISON(b2, i))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+MTC_STATIC int
+ref_count(
+    MTC_HOSTMAP b1)
+{
+    int i, count = 0;
+
+    for (i = 0; i < MAX_HOST_NUM; i++)
+    {
+        count += MTC_HOSTMAP_ISON(b1, i);
+    }
+    return count;
+}
+
+MTC_STATIC int
+ref_first(
+    MTC_HOSTMAP b1)
+{
+    int i;
+
+    for (i = 0; i < MAX_HOST_NUM; i++)
+    {
+        if (MTC_HOSTMAP_ISON(b1, i))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+MTC_STATIC MTC_BOOLEAN
+ref_is_empty_liveset(
+    MTC_HOSTMAP liveset)
+{
+    MTC_S32 index;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (MTC_HOSTMAP_ISON(liveset, index))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+MTC_STATIC MTC_BOOLEAN
+ref_is_all_hosts_up(
+    MTC_HOSTMAP hostmap)
+{
+    MTC_S32 index;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (!MTC_HOSTMAP_ISON(hostmap, index))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+MTC_STATIC MTC_BOOLEAN
+ref_is_all_nonexcluded_hosts_up(
+    MTC_HOSTMAP hostmap,
+    MTC_HOSTMAP excluded)
+{
+    MTC_S32 index;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (!MTC_HOSTMAP_ISON(hostmap, index) &&
+            !MTC_HOSTMAP_ISON(excluded, index))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+MTC_STATIC MTC_S32
+ref_get_partition_size(
+    MTC_HOSTMAP sfdomain,
+    MTC_HOSTMAP hbdomain,
+    MTC_U32     weight[])
+{
+    MTC_S32 index, size = 0;
+
+    if (ref_is_empty_liveset(sfdomain))
+    {
+        return 0;
+    }
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (MTC_HOSTMAP_ISON(sfdomain, index) && MTC_HOSTMAP_ISON(hbdomain, index))
+        {
+            size++;
+            if (weight)
+            {
+                size += 0x100 * weight[index];
+            }
+        }
+    }
+    return size;
+}
+
+MTC_STATIC MTC_S64
+ref_get_partition_score(
+    MTC_HOSTMAP hostmap,
+    MTC_U32     weight[])
+{
+    MTC_S64 index, size_score = 0, index_score = 0, weight_score = 0;
+
+    for (index = ha_config.common.hostnum - 1; index >= 0; index--)
+    {
+        if (MTC_HOSTMAP_ISON(hostmap, index))
+        {
+            weight_score += weight[index];
+            size_score++;
+            index_score = MAX_HOST_NUM - index;
+        }
+    }
+    return (weight_score * 0x10000 + size_score * 0x100 + index_score);
+}
+
+
+//
+//  Random maps
+//
+
+MTC_STATIC MTC_U64
+rng()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+//  A map whose bits are on with a probability of 0, 1/16, 1/2, 15/16
+//  or 1, so that empty, sparse, dense and full maps all occur.
+
+MTC_STATIC void
+random_map(
+    MTC_HOSTMAP b)
+{
+    static const MTC_U32 density[] = {0, 1, 8, 15, 16};
+    MTC_U32 d = density[rng() % 5], i;
+
+    memset(b, 0, sizeof(MTC_HOSTMAP));
+    for (i = 0; i < MAX_HOST_NUM; i++)
+    {
+        if (rng() % 16 < d)
+        {
+            MTC_HOSTMAP_SET(b, i);
+        }
+    }
+}
+
+MTC_STATIC void
+mismatch(
+    char *what,
+    MTC_HOSTMAP b,
+    long long expected,
+    long long got)
+{
+    MTC_U32 i;
+
+    if (mismatches++ < 20)
+    {
+        printf("MISMATCH %s: hostnum %d, expected %lld, got %lld, map",
+               what, ha_config.common.hostnum, expected, got);
+        for (i = 0; i < _rounddiv(MAX_HOST_NUM, MTC_HOSTMAP_UNIT); i++)
+        {
+            printf(" %08x", b[i]);
+        }
+        printf("\n");
+    }
+}
+
+#define CHECK(what, b, expected, got) ({ \
+    long long _e = (expected), _g = (got); \
+    if (_e != _g) \
+    { \
+        mismatch(what, b, _e, _g); \
+    } \
+})
+
+MTC_STATIC void
+check_one()
+{
+    MTC_HOSTMAP a, b, c, ref, new;
+    MTC_U32     weight[MAX_HOST_NUM];
+    MTC_S32     i, w, n, index, list[MAX_HOST_NUM];
+
+    ha_config.common.hostnum = 1 + rng() % MAX_HOST_NUM;
+    random_map(a);
+    random_map(b);
+    random_map(c);
+    for (i = 0; i < MAX_HOST_NUM; i++)
+    {
+        weight[i] = rng() % 4;
+    }
+
+    //  encoding of the 64-bit words
+
+    for (i = 0; i < MAX_HOST_NUM; i++)
+    {
+        CHECK("get_word", a, MTC_HOSTMAP_ISON(a, i),
+              (_hostmap_get_word(a, i / MTC_HOSTMAP_WORD_BITS) >>
+                    (i % MTC_HOSTMAP_WORD_BITS)) & 1);
+    }
+    memset(new, 0x5a, sizeof(new));
+    for (w = 0; w < MTC_HOSTMAP_WORD_NUM; w++)
+    {
+        _hostmap_put_word(new, w, _hostmap_get_word(a, w));
+    }
+    CHECK("put_word", a, 0, memcmp(a, new, sizeof(MTC_HOSTMAP)) != 0);
+
+    //  sm.h macros
+
+    memcpy(ref, a, sizeof(MTC_HOSTMAP));
+    memcpy(new, a, sizeof(MTC_HOSTMAP));
+    ref_mask_unconfig(ref);
+    MTC_HOSTMAP_MASK_UNCONFIG(new);
+    CHECK("MASK_UNCONFIG", a, 0, memcmp(ref, new, sizeof(MTC_HOSTMAP)) != 0);
+
+    CHECK("COMPARE", a, ref_compare(a, b), MTC_HOSTMAP_COMPARE(a, '!=', b));
+    CHECK("COMPARE", a, ref_compare(a, a), MTC_HOSTMAP_COMPARE(a, '!=', a));
+    CHECK("SUBSETEQUAL", a, ref_subsetequal(a, b), MTC_HOSTMAP_SUBSETEQUAL(a, '<=', b));
+    MTC_HOSTMAP_INTERSECTION(new, '=', a, '&', b);
+    CHECK("SUBSETEQUAL", a, ref_subsetequal(new, b), MTC_HOSTMAP_SUBSETEQUAL(new, '<=', b));
+    CHECK("COUNT", a, ref_count(a), MTC_HOSTMAP_COUNT(a));
+    CHECK("FIRST", a, ref_first(a), MTC_HOSTMAP_FIRST(a));
+
+    n = 0;
+    MTC_HOSTMAP_FOR_EACH(a, index)
+    {
+        list[n++] = index;
+    }
+    CHECK("FOR_EACH count", a, ref_count(a), n);
+    for (i = 0, w = 0; i < MAX_HOST_NUM && w < n; i++)
+    {
+        if (MTC_HOSTMAP_ISON(a, i))
+        {
+            CHECK("FOR_EACH", a, i, list[w++]);
+        }
+    }
+
+    //  sm.c helpers
+
+    CHECK("is_empty_liveset", a, ref_is_empty_liveset(a), is_empty_liveset(a));
+    CHECK("is_all_hosts_up", a, ref_is_all_hosts_up(a), is_all_hosts_up(a));
+    CHECK("is_all_nonexcluded_hosts_up", a,
+          ref_is_all_nonexcluded_hosts_up(a, c), is_all_nonexcluded_hosts_up(a, c));
+    CHECK("get_partition_size", a,
+          ref_get_partition_size(a, b, NULL), get_partition_size(a, b, NULL));
+    CHECK("get_partition_size (weight)", a,
+          ref_get_partition_size(a, b, weight), get_partition_size(a, b, weight));
+    CHECK("get_partition_score", a,
+          ref_get_partition_score(a, weight), get_partition_score(a, weight));
+}
+
+
+//
+//  Benchmark
+//
+
+static MTC_HOSTMAP pool_a[BENCH_POOL], pool_b[BENCH_POOL];
+static MTC_U32 pool_weight[MAX_HOST_NUM];
+
+MTC_STATIC double
+bench_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define BENCH(var, expr) ({ \
+    MTC_U32 _i; \
+    double _start = bench_ns(); \
+    for (_i = 0; _i < param.iterations; _i++) \
+    { \
+        MTC_U32 k = _i % BENCH_POOL; \
+        (void) k; \
+        sink += (expr); \
+        BENCH_BARRIER(); \
+    } \
+    (var) = (bench_ns() - _start) / param.iterations; \
+})
+
+MTC_STATIC void
+bench()
+{
+    MTC_HOSTMAP tmp;
+    MTC_U32     i;
+    double      ref, new;
+    volatile long long sink = 0;
+
+    ha_config.common.hostnum = MAX_HOST_NUM;
+    for (i = 0; i < BENCH_POOL; i++)
+    {
+        random_map(pool_a[i]);
+        MTC_HOSTMAP_COPY(pool_b[i], pool_a[i]);
+        if (rng() % 2)
+        {
+            MTC_HOSTMAP_SET(pool_b[i], rng() % MAX_HOST_NUM);
+        }
+    }
+    for (i = 0; i < MAX_HOST_NUM; i++)
+    {
+        pool_weight[i] = rng() % 4;
+    }
+
+    printf("hostnum %d, iterations %u, ns per call\n", MAX_HOST_NUM, param.iterations);
+    printf("                              reference       new\n");
+
+#define BENCH_PRINT(name, ref_expr, new_expr) ({ \
+    BENCH(ref, ref_expr); \
+    BENCH(new, new_expr); \
+    printf("%-28s %9.1f %9.1f\n", name, ref, new); \
+})
+
+    BENCH_PRINT("MASK_UNCONFIG",
+        (MTC_HOSTMAP_COPY(tmp, pool_a[k]), ref_mask_unconfig(tmp), tmp[0]),
+        (MTC_HOSTMAP_COPY(tmp, pool_a[k]), MTC_HOSTMAP_MASK_UNCONFIG(tmp), tmp[0]));
+    BENCH_PRINT("COMPARE",
+        ref_compare(pool_a[k], pool_b[k]),
+        MTC_HOSTMAP_COMPARE(pool_a[k], '!=', pool_b[k]));
+    BENCH_PRINT("SUBSETEQUAL",
+        ref_subsetequal(pool_a[k], pool_b[k]),
+        MTC_HOSTMAP_SUBSETEQUAL(pool_a[k], '<=', pool_b[k]));
+    BENCH_PRINT("COUNT",
+        ref_count(pool_a[k]),
+        MTC_HOSTMAP_COUNT(pool_a[k]));
+    BENCH_PRINT("is_empty_liveset",
+        ref_is_empty_liveset(pool_a[k]),
+        is_empty_liveset(pool_a[k]));
+    BENCH_PRINT("is_all_hosts_up",
+        ref_is_all_hosts_up(pool_a[k]),
+        is_all_hosts_up(pool_a[k]));
+    BENCH_PRINT("is_all_nonexcluded_hosts_up",
+        ref_is_all_nonexcluded_hosts_up(pool_a[k], pool_b[k]),
+        is_all_nonexcluded_hosts_up(pool_a[k], pool_b[k]));
+    BENCH_PRINT("get_partition_size",
+        ref_get_partition_size(pool_a[k], pool_b[k], pool_weight),
+        get_partition_size(pool_a[k], pool_b[k], pool_weight));
+    BENCH_PRINT("get_partition_score",
+        ref_get_partition_score(pool_a[k], pool_weight),
+        get_partition_score(pool_a[k], pool_weight));
+}
+
+MTC_STATIC void
+usage()
+{
+    fprintf(stderr,
+        "usage: hostmapbench [--maps N] [--iterations N] [--seed N] [--check-only]\n");
+    exit(1);
+}
+
+int
+main(
+    int argc,
+    char **argv)
+{
+    MTC_U32 i;
+
+    for (i = 1; i < (MTC_U32) argc; i++)
+    {
+        if (!strcmp(argv[i], "--check-only"))
+        {
+            param.check_only = TRUE;
+            continue;
+        }
+        if (i + 1 >= (MTC_U32) argc)
+        {
+            usage();
+        }
+        if (!strcmp(argv[i], "--maps"))
+        {
+            param.maps = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--iterations"))
+        {
+            param.iterations = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--seed"))
+        {
+            param.seed = strtoull(argv[++i], NULL, 0);
+        }
+        else
+        {
+            usage();
+        }
+    }
+    if (param.iterations == 0 || param.seed == 0)
+    {
+        usage();
+    }
+
+    rng_state = param.seed;
+    for (i = 0; i < param.maps; i++)
+    {
+        check_one();
+    }
+    printf("%u random maps (MAX_HOST_NUM %d, seed %llu): %u mismatches\n",
+           param.maps, MAX_HOST_NUM, (unsigned long long) param.seed, mismatches);
+    if (mismatches != 0)
+    {
+        return 1;
+    }
+
+    if (!param.check_only)
+    {
+        bench();
+    }
+    return 0;
+}
@@ -0,0 +1,327 @@
+//
+//      Copyright (c) Stratus Technologies Bermuda Ltd., 2008.
+//      All Rights Reserved. Unpublished rights reserved
+//      under the copyright laws of the United States.
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU Lesser General Public License as published
+//      by the Free Software Foundation; version 2.1 only. with the special
+//      exception on linking described in file LICENSE.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU Lesser General Public License for more details.
+//
+//
+//  DESCRIPTION:
+//
+//      Benchmark of the consistent view check of
+//      wait_until_all_hosts_have_consistent_view (sm.c) on the two
+//      layouts of the raw host views.
+//
+//      AoS is the layout before the structure-of-arrays change: one
+//      RAW_DATA entry per host, the hostmaps and the time vectors of a
+//      host together. SoA is the RAW_VIEW of sm.h, with the hostmap
+//      columns contiguous. The check is a copy of the loop in sm.c, run
+//      on the HB and SF views of a pool where all the hosts agree, so
+//      every host is scanned.
+//
+//      "warm" repeats the check with the views in the cache; "cold"
+//      evicts the caches before each check (only the check is timed).
+//
+//      Not installed; built for development only.
+//
+//  CREATION DATE:
+//
+//      October 19, 2026
+//
+
+//
+//
+//  O P E R A T I N G   S Y S T E M   I N C L U D E   F I L E S
+//
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+//
+//
+//  M A R A T H O N   I N C L U D E   F I L E S
+//
+//
+
+#include "mtctypes.h"
+#include "mtcerrno.h"
+#include "config.h"
+#include "sm.h"
+#include "xha.h"
+
+
+//
+//
+//  L O C A L   D E F I N I T I O N S
+//
+//
+
+HA_CONFIG ha_config;
+
+#define BENCH_EVICT_SIZE    (64 * 1024 * 1024)
+
+//  The raw data of one host, as laid out before RAW_VIEW
+
+typedef struct _RAW_DATA {
+    MTC_HOSTMAP current_liveset;
+    MTC_HOSTMAP proposed_liveset;
+    MTC_HOSTMAP hbdomain;
+    MTC_HOSTMAP sfdomain;
+    MTC_S32     time_since_last_HB_receipt[MAX_HOST_NUM];
+    MTC_S32     time_since_last_SF_update[MAX_HOST_NUM];
+    MTC_S32     time_since_xapi_restart;
+} RAW_DATA;
+
+static struct {
+    MTC_U32     hosts;
+    MTC_U32     iterations;
+} param = {
+    .hosts = MAX_HOST_NUM,
+    .iterations = 100000,
+};
+
+static RAW_DATA hb_aos[MAX_HOST_NUM], sf_aos[MAX_HOST_NUM];
+static RAW_VIEW hb_soa, sf_soa;
+static MTC_HOSTMAP liveset, hb_hbdomain, sf_sfdomain;
+static MTC_U8 *evict;
+
+//  Keeps the compiler from hoisting the check out of the timing loop
+
+#define BENCH_BARRIER()     __asm__ __volatile__("" ::: "memory")
+
+#define AOS_HBDOMAIN(v, index)  ((v)[index].hbdomain)
+#define AOS_SFDOMAIN(v, index)  ((v)[index].sfdomain)
+#define SOA_HBDOMAIN(v, index)  ((v)->hbdomain[index])
+#define SOA_SFDOMAIN(v, index)  ((v)->sfdomain[index])
+
+//
+//  The consistent view check of wait_until_all_hosts_have_consistent_view,
+//  for a layout given by its hostmap accessors.
+//
+
+#define BENCH_VIEW_CHECK(name, type, HBDOMAIN, SFDOMAIN) \
+MTC_STATIC MTC_BOOLEAN \
+name( \
+    type phb_raw, \
+    type psf_raw) \
+{ \
+    MTC_S32     index; \
+    MTC_HOSTMAP my_hbdomain, remote_hbdomain, my_sfdomain, remote_sfdomain, \
+                remote_hbdomain_onsf, remote_sfdomain_onhb, tmp_hostmap; \
+ \
+    MTC_HOSTMAP_COPY(tmp_hostmap, hb_hbdomain); \
+    MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap); \
+    MTC_HOSTMAP_INTERSECTION(my_hbdomain, '=', tmp_hostmap, '&', liveset); \
+    MTC_HOSTMAP_COPY(tmp_hostmap, sf_sfdomain); \
+    MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap); \
+    MTC_HOSTMAP_INTERSECTION(my_sfdomain, '=', tmp_hostmap, '&', liveset); \
+ \
+    for (index = 0; _is_configured_host(index); index++) \
+    { \
+        if (index != _my_index && MTC_HOSTMAP_ISON(liveset, index)) \
+        { \
+            MTC_HOSTMAP_COPY(tmp_hostmap, HBDOMAIN(phb_raw, index)); \
+            MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap); \
+            MTC_HOSTMAP_INTERSECTION(remote_hbdomain, '=', tmp_hostmap, '&', liveset); \
+            MTC_HOSTMAP_COPY(tmp_hostmap, SFDOMAIN(psf_raw, index)); \
+            MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap); \
+            MTC_HOSTMAP_INTERSECTION(remote_sfdomain, '=', tmp_hostmap, '&', liveset); \
+            MTC_HOSTMAP_COPY(tmp_hostmap, HBDOMAIN(psf_raw, index)); \
+            MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap); \
+            MTC_HOSTMAP_INTERSECTION(remote_hbdomain_onsf, '=', tmp_hostmap, '&', liveset); \
+            MTC_HOSTMAP_COPY(tmp_hostmap, SFDOMAIN(phb_raw, index)); \
+            MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap); \
+            MTC_HOSTMAP_INTERSECTION(remote_sfdomain_onhb, '=', tmp_hostmap, '&', liveset); \
+ \
+            if ((MTC_HOSTMAP_ISON(my_hbdomain, index) && \
+                 MTC_HOSTMAP_COMPARE(my_hbdomain, '!=', remote_hbdomain)) || \
+                (MTC_HOSTMAP_ISON(my_sfdomain, index) && \
+                 MTC_HOSTMAP_COMPARE(my_sfdomain, '!=', remote_sfdomain)) || \
+                (MTC_HOSTMAP_ISON(my_sfdomain, index) && \
+                 MTC_HOSTMAP_COMPARE(my_hbdomain, '!=', remote_hbdomain_onsf)) || \
+                (MTC_HOSTMAP_ISON(my_hbdomain, index) && \
+                 MTC_HOSTMAP_COMPARE(my_sfdomain, '!=', remote_sfdomain_onhb))) \
+            { \
+                return FALSE; \
+            } \
+        } \
+    } \
+    return TRUE; \
+}
+
+BENCH_VIEW_CHECK(check_aos, RAW_DATA *, AOS_HBDOMAIN, AOS_SFDOMAIN)
+BENCH_VIEW_CHECK(check_soa, RAW_VIEW *, SOA_HBDOMAIN, SOA_SFDOMAIN)
+
+
+MTC_STATIC double
+bench_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+MTC_STATIC void
+bench_evict()
+{
+    static MTC_U8 n = 0;
+
+    memset(evict, ++n, BENCH_EVICT_SIZE);
+}
+
+//
+//  Fill both layouts with the views of a pool in which all the hosts
+//  agree, with time vectors around the hostmaps as in the daemon.
+//
+
+MTC_STATIC void
+bench_setup()
+{
+    MTC_U32 index, index2;
+
+    ha_config.common.hostnum = param.hosts;
+    ha_config.local.localhost_index = 0;
+
+    MTC_HOSTMAP_INIT_RESET(liveset);
+    for (index = 0; index < param.hosts; index++)
+    {
+        MTC_HOSTMAP_SET(liveset, index);
+    }
+    MTC_HOSTMAP_COPY(hb_hbdomain, liveset);
+    MTC_HOSTMAP_COPY(sf_sfdomain, liveset);
+
+    for (index = 0; index < param.hosts; index++)
+    {
+        MTC_HOSTMAP_COPY(hb_aos[index].current_liveset, liveset);
+        MTC_HOSTMAP_COPY(hb_aos[index].proposed_liveset, liveset);
+        MTC_HOSTMAP_COPY(hb_aos[index].hbdomain, liveset);
+        MTC_HOSTMAP_COPY(hb_aos[index].sfdomain, liveset);
+        for (index2 = 0; index2 < param.hosts; index2++)
+        {
+            hb_aos[index].time_since_last_HB_receipt[index2] = index2;
+            hb_aos[index].time_since_last_SF_update[index2] = index2;
+        }
+        sf_aos[index] = hb_aos[index];
+
+        MTC_HOSTMAP_COPY(hb_soa.current_liveset[index], liveset);
+        MTC_HOSTMAP_COPY(hb_soa.proposed_liveset[index], liveset);
+        MTC_HOSTMAP_COPY(hb_soa.hbdomain[index], liveset);
+        MTC_HOSTMAP_COPY(hb_soa.sfdomain[index], liveset);
+        memcpy(hb_soa.time_since_last_HB_receipt[index],
+               hb_aos[index].time_since_last_HB_receipt,
+               sizeof(hb_soa.time_since_last_HB_receipt[index]));
+        memcpy(hb_soa.time_since_last_SF_update[index],
+               hb_aos[index].time_since_last_SF_update,
+               sizeof(hb_soa.time_since_last_SF_update[index]));
+    }
+    sf_soa = hb_soa;
+}
+
+MTC_STATIC void
+usage()
+{
+    fprintf(stderr, "usage: viewbench [--hosts N] [--iterations N]\n");
+    exit(1);
+}
+
+int
+main(
+    int argc,
+    char **argv)
+{
+    double      start, aos_warm, soa_warm, aos_cold = 0, soa_cold = 0;
+    MTC_U32     i, cold_iterations;
+    MTC_BOOLEAN ok = TRUE;
+
+    for (i = 1; i < (MTC_U32) argc; i++)
+    {
+        if (i + 1 >= (MTC_U32) argc)
+        {
+            usage();
+        }
+        if (!strcmp(argv[i], "--hosts"))
+        {
+            param.hosts = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--iterations"))
+        {
+            param.iterations = atoi(argv[++i]);
+        }
+        else
+        {
+            usage();
+        }
+    }
+    if (param.hosts < 2 || param.hosts > MAX_HOST_NUM || param.iterations == 0)
+    {
+        usage();
+    }
+    if ((evict = malloc(BENCH_EVICT_SIZE)) == NULL)
+    {
+        fprintf(stderr, "cannot allocate the eviction buffer\n");
+        return 1;
+    }
+
+    bench_setup();
+
+    start = bench_ns();
+    for (i = 0; i < param.iterations; i++)
+    {
+        ok &= check_aos(hb_aos, sf_aos);
+        BENCH_BARRIER();
+    }
+    aos_warm = (bench_ns() - start) / param.iterations;
+
+    start = bench_ns();
+    for (i = 0; i < param.iterations; i++)
+    {
+        ok &= check_soa(&hb_soa, &sf_soa);
+        BENCH_BARRIER();
+    }
+    soa_warm = (bench_ns() - start) / param.iterations;
+
+    cold_iterations = _min(param.iterations, 1000);
+    for (i = 0; i < cold_iterations; i++)
+    {
+        bench_evict();
+        start = bench_ns();
+        ok &= check_aos(hb_aos, sf_aos);
+        aos_cold += bench_ns() - start;
+
+        bench_evict();
+        start = bench_ns();
+        ok &= check_soa(&hb_soa, &sf_soa);
+        soa_cold += bench_ns() - start;
+    }
+    aos_cold /= cold_iterations;
+    soa_cold /= cold_iterations;
+
+    if (!ok)
+    {
+        fprintf(stderr, "the views do not agree\n");
+        return 1;
+    }
+
+    printf("hosts %u, iterations %u (cold %u)\n", param.hosts, param.iterations, cold_iterations);
+    printf("          AoS (old)    SoA (new)\n");
+    printf("warm   %9.0f ns %9.0f ns\n", aos_warm, soa_warm);
+    printf("cold   %9.0f ns %9.0f ns\n", aos_cold, soa_cold);
+
+    free(evict);
+    return 0;
+}
@@ -285,7 +285,8 @@ host_specific_ex(
 void
 sf_reportlatency(
     MTC_CLOCK latency,
-    MTC_BOOLEAN write)
+    MTC_BOOLEAN write,
+    SF_SECTION section)
 {
     // void
 }
@@ -57,6 +57,7 @@
 #include "bond_mon.h"
 #include "com.h"
 #include "config.h"
+#include "xha.h"
 #include "fist.h"
 
 
@@ -304,7 +305,7 @@ bm_initialize(
                 .status = FALSE,
                 .mtc_bond_status = BOND_STATUS_NOERR};
 
-            ret = com_create(COM_ID_BM, &bm_object, sizeof(COM_DATA_BM), &bm);
+            ret = com_create_typed(BM, &bm_object, &bm);
             if (ret != MTC_SUCCESS)
             {
                 log_internal(MTC_LOG_ERR, "BM: cannot create COM object. (%d)\n", ret);
@@ -376,6 +377,7 @@ bm(
     PCOM_DATA_BM            pbm;
 
     log_thread_id("BM");
+    xhad_set_thread_priority(XHA_PRIORITY_LOW);
     do
     {
         log_maskable_debug_message(TRACE, "BM: bonding monitor thread activity log.\n");
@@ -386,7 +388,7 @@ bm(
         switch (check_bonding_status())
         {
         case BOND_STATUS_NOBOND:
-            com_writer_lock(bm_object, (void **) &pbm);
+            com_writer_lock_typed(BM, bm_object, &pbm);
             pbm->status = FALSE;
             pbm->mtc_bond_status = BOND_STATUS_NOBOND;
             com_writer_unlock(bm_object);
@@ -399,7 +401,7 @@ bm(
             break;
 
         case BOND_STATUS_NOERR:
-            com_writer_lock(bm_object, (void **) &pbm);
+            com_writer_lock_typed(BM, bm_object, &pbm);
             pbm->status = FALSE;
             pbm->mtc_bond_status = BOND_STATUS_NOERR;
             com_writer_unlock(bm_object);
@@ -413,7 +415,7 @@ bm(
             break;
 
         case BOND_STATUS_DEGRADED:
-            com_writer_lock(bm_object, (void **) &pbm);
+            com_writer_lock_typed(BM, bm_object, &pbm);
             pbm->status = TRUE;
             pbm->mtc_bond_status = BOND_STATUS_DEGRADED;
             com_writer_unlock(bm_object);
@@ -429,7 +431,7 @@ bm(
 
         case BOND_STATUS_ERR:
         default:
-            com_writer_lock(bm_object, (void **) &pbm);
+            com_writer_lock_typed(BM, bm_object, &pbm);
             pbm->status = TRUE;
             pbm->mtc_bond_status = BOND_STATUS_ERR;
             com_writer_unlock(bm_object);
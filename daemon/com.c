@@ -38,6 +38,10 @@
 #include <unistd.h>
 #include <signal.h>
 #include <inttypes.h>
+#include <sched.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <stddef.h>
 
 #include "mtctypes.h"
 #include "mtcerrno.h"
@@ -56,8 +60,26 @@
 #define ENTER_CS {pthread_mutex_lock(&com_mutex);}
 #define LEAVE_CS {pthread_mutex_unlock(&com_mutex);}
 
-#define HA_COMMON_OBJECT_MAGIC "HACMNOB"
-#define HA_COMMON_OBJECT_MAGIC_SZ 8
+//
+// com_mutex protects the hash table and the reference count only.
+// The lock/unlock fast path does not take it; in_use is updated
+// atomically and each thread owns its slot in thread_id_record_table.
+//
+
+#define ATOMIC_INC(p)   __sync_add_and_fetch((p), 1)
+#define ATOMIC_DEC(p)   __sync_sub_and_fetch((p), 1)
+
+//
+// sequence of the object is odd while a writer owns it.
+// com_snapshot spins this many times before yielding the CPU.
+//
+
+#define SNAPSHOT_SPIN_COUNT 100
+
+#define SEQ_WRITE_BEGIN(object) {(object)->sequence++; __sync_synchronize();}
+#define SEQ_WRITE_END(object)   {__sync_synchronize(); (object)->sequence++;}
+
+#define HA_COMMON_OBJECT_TAG    0x484f424a  /* "HOBJ" */
 
 #define com_exit_process(status)   exit(status_to_exit(status))
 
@@ -69,6 +91,33 @@
 
 static pthread_mutex_t com_mutex;
 
+//
+// deferred callback dispatcher
+//
+// com_writer_unlock queues the object (once until it is dispatched)
+// and the dispatcher thread calls the async callbacks with a snapshot
+// of the object after the writer lock is released.
+// mutex protects the queue; callback_mutex protects the async callback
+// lists and is held while the async callbacks run.
+//
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_mutex_t callback_mutex;
+    struct ha_common_object *head, *tail;
+    MTC_BOOLEAN terminate;
+} dispatcher = {
+    .thread = 0,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .callback_mutex = PTHREAD_MUTEX_INITIALIZER,
+    .head = NULL,
+    .tail = NULL,
+    .terminate = FALSE,
+};
+
 
 //
 // thread-id reacord for diag of dead-lock
@@ -83,11 +132,52 @@ static pthread_mutex_t com_mutex;
 #define THREAD_ID_RECORD_NUM 16
 
 typedef struct thread_id_record {
-    MTC_U32 lock_state;
+    volatile MTC_U32 lock_state;
     MTC_CLOCK changed_time;
-    pthread_t thread_id;
+    MTC_U64 changed_time_us;        // for the lock profile
+    volatile pthread_t thread_id;   // 0 if the slot is free
 }   THREAD_ID_RECORD;
 
+//
+// lock profile
+//
+// bucket 0 counts 0us, bucket i (i > 0) counts [2^(i-1), 2^i) us
+// and the last bucket counts everything above.
+// Counters are updated with atomic operations without com_mutex.
+//
+
+#define PROFILE_BUCKETS 24
+
+typedef struct lock_profile {
+    MTC_U32 count;
+    MTC_U32 wait[PROFILE_BUCKETS];
+    MTC_U32 hold[PROFILE_BUCKETS];
+    MTC_U32 wait_max;
+    MTC_U32 hold_max;
+}   LOCK_PROFILE;
+
+static char *com_role_name[COM_ROLE_NUM] = COM_ROLE_NAME_ARRAY;
+
+static __thread MTC_S32 thread_role = -1;
+
+//
+// detection of modification by reader (debug build)
+//
+// The object buffer is divided into chunks and each reader unlock
+// verifies one chunk in turn, so that the cost does not depend on the
+// object size. The checksum of a chunk is computed by the first reader
+// that visits it after a write (stamp != sequence), and a modification
+// by a reader is detected when a later reader visits the chunk before
+// the next write.
+//
+
+#define CHECK_CHUNK_SIZE 512
+
+typedef struct check_chunk {
+    MTC_U64 checksum;
+    volatile MTC_U64 stamp;         // sequence of the data the checksum is for (odd: none)
+} CHECK_CHUNK;
+
 //
 // list of callback function
 //
@@ -97,9 +187,52 @@ typedef struct ha_common_object_callback_list_item
     struct ha_common_object_callback_list_item *next;
     HA_COMMON_OBJECT_HANDLE object_handle;
     HA_COMMON_OBJECT_CALLBACK func;
+    HA_COMMON_OBJECT_ASYNC_CALLBACK async_func;
 } HA_COMMON_OBJECT_CALLBACK_LIST_ITEM;
 
 
+//
+// Shared snapshot (see com_snapshot_share_many)
+//
+//  An immutable copy of the object data at one version, shared by
+//  the callers that take the same version. Freed when the last
+//  reference is released.
+//
+
+typedef struct com_shared_snapshot
+{
+    volatile MTC_U32 ref_count;
+    MTC_U32 size;
+    MTC_U64 sequence;               // object sequence of the data
+    MTC_U64 data[];
+} COM_SHARED_SNAPSHOT;
+
+#define SHARED_SNAPSHOT_OF(copy) \
+    ((COM_SHARED_SNAPSHOT *) ((char *) (copy) - offsetof(COM_SHARED_SNAPSHOT, data)))
+
+
+//
+// Waiter of com_wait_change_many
+//
+//  The waiter is linked to each object it waits on (one link per
+//  object). The writer of an object sets signalled and signals cond
+//  of the waiters linked to the object only.
+//
+
+typedef struct com_change_waiter
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;            // CLOCK_MONOTONIC
+    MTC_BOOLEAN signalled;
+} COM_CHANGE_WAITER;
+
+typedef struct com_change_link
+{
+    struct com_change_link *next;
+    COM_CHANGE_WAITER *waiter;
+} COM_CHANGE_LINK;
+
+
 //
 // HA Common Object
 //
@@ -108,14 +241,35 @@ typedef struct ha_common_object
 {
     struct ha_common_object *next;
     char *object_id;
+    COM_OBJECT_ID registry_id;      // COM_OBJECT_NUM if not registered
     MTC_U32  size;
     void *buffer;
     HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *callback_list_head;
     pthread_rwlock_t rwlock;
     MTC_U32 in_use;
     MTC_U32 ref_count;
-    MTC_U32 checksum;   // to detect modification by reader
+    struct check_chunk *check;      // to detect modification by reader
+    MTC_U32 check_num;              // number of chunks
+    volatile MTC_U32 check_next;    // chunk to be verified next
+    volatile MTC_U64 sequence;  // seqlock for com_snapshot
+    HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *async_callback_list_head;
+    volatile MTC_U32 async_callback_num;
+    MTC_BOOLEAN dispatch_pending;           // queued to the dispatcher
+    struct ha_common_object *dispatch_next; // next in the dispatch queue
+    void *dispatch_buffer;                  // snapshot passed to async callbacks
+    COM_SHARED_SNAPSHOT *shared;            // latest shared snapshot
+    pthread_mutex_t shared_mutex;           // protects shared
+    pthread_mutex_t change_mutex;           // protects change_waiters
+    COM_CHANGE_LINK *change_waiters;        // com_wait_change_many callers
+    volatile MTC_U32 change_waiter_num;     // read by writers without change_mutex
     THREAD_ID_RECORD thread_id_record_table[THREAD_ID_RECORD_NUM];
+    LOCK_PROFILE profile[COM_ROLE_NUM][COM_LOCK_MODE_NUM];
+    volatile MTC_U32 longest_hold;          // us
+    volatile MTC_U32 longest_holder_lock;   // spinlock for longest_holder*
+    MTC_U32 longest_holder_role;
+    MTC_U32 longest_holder_mode;
+    MTC_S32 longest_holder_depth;
+    void *longest_holder[COM_PROFILE_BACKTRACE_SIZE];
 } HA_COMMON_OBJECT;
 
 //
@@ -125,7 +279,7 @@ typedef struct ha_common_object
 typedef struct ha_common_object_handle_internal 
 {
     HA_COMMON_OBJECT *object;
-    char magic[HA_COMMON_OBJECT_MAGIC_SZ];
+    MTC_U32 tag;
 } HA_COMMON_OBJECT_HANDLE_INTERNAL;
 
 
@@ -135,16 +289,28 @@ typedef struct ha_common_object_handle_internal
 
 static HA_COMMON_OBJECT *common_object_hash[HASH_TABLE_SIZE] = {NULL};
 
+//
+// Registry of the objects known at compile time
+//
+// The registered objects are also in the hash table, so that
+// the string API and the walks over all objects find them.
+//
+
+static HA_COMMON_OBJECT *common_object_registry[COM_OBJECT_NUM] = {NULL};
+static char *common_object_name[COM_OBJECT_NUM] = COM_OBJECT_NAME_ARRAY;
+
 //
 // Internal Functions
 //
 
 #ifndef NDEBUG
-MTC_STATIC MTC_U32
+MTC_STATIC MTC_U64
 calc_checksum_object_buffer(
-    HA_COMMON_OBJECT *object)
+    HA_COMMON_OBJECT *object,
+    MTC_U32 offset,
+    MTC_U32 size)
 {
-    MTC_U32 checksum = 0;
+    MTC_U64 checksum = 0, word;
     MTC_U32 i;
     unsigned char *buf;
 
@@ -152,13 +318,54 @@ calc_checksum_object_buffer(
     {
         return 0;
     }
-    buf = object->buffer;
-    for (i = 0; i < object->size; i++) 
+    buf = (unsigned char *) object->buffer + offset;
+    for (i = 0; i + sizeof(word) <= size; i += sizeof(word)) 
+    {
+        memcpy(&word, buf + i, sizeof(word));
+        checksum ^= word;
+    }
+    for (; i < size; i++) 
     {
-        checksum ^= (MTC_U32) buf[i];
+        checksum ^= (MTC_U64) buf[i] << (8 * (i % sizeof(word)));
     }
     return checksum;
 }
+
+//
+// verify one chunk of the object buffer
+// called with the reader lock held
+//
+
+MTC_STATIC MTC_BOOLEAN
+check_object_buffer(
+    HA_COMMON_OBJECT *object)
+{
+    MTC_U32 i, offset;
+    MTC_U64 checksum, sequence;
+    CHECK_CHUNK *chunk;
+
+    if (object->check == NULL)
+    {
+        return TRUE;
+    }
+    i = __sync_fetch_and_add(&object->check_next, 1) % object->check_num;
+    chunk = &object->check[i];
+    offset = i * CHECK_CHUNK_SIZE;
+    checksum = calc_checksum_object_buffer(object, offset,
+        (object->size - offset < CHECK_CHUNK_SIZE)? object->size - offset: CHECK_CHUNK_SIZE);
+    sequence = object->sequence;
+    if (chunk->stamp != sequence)
+    {
+        // first visit since the last write
+
+        chunk->checksum = checksum;
+        __sync_synchronize();
+        chunk->stamp = sequence;
+        return TRUE;
+    }
+    __sync_synchronize();
+    return (chunk->checksum == checksum);
+}
 #endif  //NDEBUG
 
 
@@ -203,6 +410,20 @@ new_object_buffer(
         return MTC_ERROR_COM_INSUFFICIENT_RESOURCE;
     }
     memcpy(object->buffer, buffer, size);
+#ifndef NDEBUG
+    object->check_num = (size + CHECK_CHUNK_SIZE - 1) / CHECK_CHUNK_SIZE;
+    object->check_next = 0;
+    object->check = (object->check_num > 0)? malloc(sizeof(CHECK_CHUNK) * object->check_num): NULL;
+    if (object->check != NULL)
+    {
+        MTC_U32 i;
+
+        for (i = 0; i < object->check_num; i++)
+        {
+            object->check[i].stamp = 1;
+        }
+    }
+#endif //NDEBUG
     return ret;
 }
 
@@ -223,9 +444,9 @@ valid_object_handle(
         assert(FALSE);
         return FALSE;
     }
-    if (strcmp(handle->magic, HA_COMMON_OBJECT_MAGIC) != 0) 
+    if (handle->tag != HA_COMMON_OBJECT_TAG) 
     {
-        log_message(MTC_LOG_WARNING, "COM: magic_mismatch.\n");
+        log_message(MTC_LOG_WARNING, "COM: tag_mismatch.\n");
         assert(FALSE);
         return FALSE;
     }
@@ -242,19 +463,27 @@ MTC_STATIC MTC_STATUS
 object_safe_to_delete(
     HA_COMMON_OBJECT *object)
 {
+    MTC_BOOLEAN safe = TRUE;
+
     if (object->ref_count != 0) 
     {
         return FALSE;
     }
-    if (object->in_use != 0) 
+    if (object->callback_list_head != NULL ||
+        object->async_callback_list_head != NULL) 
     {
         return FALSE;
     }
-    if (object->callback_list_head != NULL) 
+
+    // the dispatcher increments in_use when it dequeues the object
+
+    pthread_mutex_lock(&dispatcher.mutex);
+    if (object->in_use != 0 || object->dispatch_pending) 
     {
-        return FALSE;
+        safe = FALSE;
     }
-    return TRUE;
+    pthread_mutex_unlock(&dispatcher.mutex);
+    return safe;
 }
 
 //
@@ -274,7 +503,7 @@ MTC_STATIC HA_COMMON_OBJECT_HANDLE_INTERNAL
         return NULL;
     }
     new_handle->object = object;
-    strcpy(new_handle->magic, HA_COMMON_OBJECT_MAGIC);
+    new_handle->tag = HA_COMMON_OBJECT_TAG;
     return new_handle;
 }
 
@@ -286,6 +515,7 @@ MTC_STATIC void
 free_object_handle(
     HA_COMMON_OBJECT_HANDLE_INTERNAL *handle)
 {
+    handle->tag = 0;
     free(handle);
     return;
 }
@@ -299,6 +529,7 @@ free_object_handle(
 MTC_STATIC HA_COMMON_OBJECT *
 new_object(
     char *object_id, 
+    COM_OBJECT_ID registry_id,
     MTC_U32 size, 
     void *buffer)
 {
@@ -319,8 +550,10 @@ new_object(
         free (new);
         return NULL;
     }
+    new->registry_id = registry_id;
     new->size = 0;
     new->buffer = NULL;
+    new->check = NULL;
     if (buffer != NULL) 
     {
         if (new_object_buffer(new, size, buffer) != 0) 
@@ -334,12 +567,23 @@ new_object(
     //new->rwlock = PTHREAD_RWLOCK_INITIALIZER;
     new->in_use = 0;
     new->ref_count = 0;
-#ifndef NDEBUG
-    new->checksum = calc_checksum_object_buffer(new);
-#endif //NDEBUG
+    new->sequence = 0;
+    new->async_callback_list_head = NULL;
+    new->async_callback_num = 0;
+    new->dispatch_pending = FALSE;
+    new->dispatch_next = NULL;
+    new->dispatch_buffer = NULL;
+    new->shared = NULL;
+    new->change_waiters = NULL;
+    new->change_waiter_num = 0;
     for (i = 0 ; i < THREAD_ID_RECORD_NUM; i++) {
         new->thread_id_record_table[i].lock_state = LOCK_STATE_NONE;
+        new->thread_id_record_table[i].thread_id = 0;
     }
+    memset(new->profile, 0, sizeof(new->profile));
+    new->longest_hold = 0;
+    new->longest_holder_lock = 0;
+    new->longest_holder_depth = 0;
     return new;
 }
 
@@ -355,6 +599,18 @@ free_object(
     {
         free(object->buffer);
     }
+    if (object->dispatch_buffer) 
+    {
+        free(object->dispatch_buffer);
+    }
+    if (object->shared) 
+    {
+        com_snapshot_release(object->shared->data);
+    }
+    if (object->check) 
+    {
+        free(object->check);
+    }
     if (object->object_id) 
     {
         free(object->object_id);
@@ -363,17 +619,44 @@ free_object(
     return;
 }
 
+//
+// Return the registry ID of the object ID,
+// or COM_OBJECT_NUM if it is not registered
+//
+
+MTC_STATIC COM_OBJECT_ID
+find_registry_id(
+    char *object_id)
+{
+    COM_OBJECT_ID id;
+
+    for (id = 0; id < COM_OBJECT_NUM; id++)
+    {
+        if (strcmp(common_object_name[id], object_id) == 0)
+        {
+            break;
+        }
+    }
+    return id;
+}
+
 //
 // Find Object from Table
 //
 
 MTC_STATIC HA_COMMON_OBJECT *
 find_common_object(
-    char *object_id)
+    char *object_id,
+    COM_OBJECT_ID registry_id)
 {
     MTC_U32 hash_value;
     HA_COMMON_OBJECT *object;
 
+    if (registry_id < COM_OBJECT_NUM)
+    {
+        return common_object_registry[registry_id];
+    }
+
     hash_value = calc_hash(object_id);
     
     // walk the hash table
@@ -404,6 +687,10 @@ insert_common_object(
 
     new->next = common_object_hash[hash_value];
     common_object_hash[hash_value] = new;
+    if (new->registry_id < COM_OBJECT_NUM)
+    {
+        common_object_registry[new->registry_id] = new;
+    }
 
     return;
 }
@@ -433,6 +720,10 @@ MTC_STATIC HA_COMMON_OBJECT
             // Remove Object from the Table
             ret = (*object);
             (*object) = (*object)->next;
+            if (ret->registry_id < COM_OBJECT_NUM)
+            {
+                common_object_registry[ret->registry_id] = NULL;
+            }
             return ret;
         }
     }
@@ -447,7 +738,8 @@ MTC_STATIC HA_COMMON_OBJECT
 MTC_STATIC HA_COMMON_OBJECT_CALLBACK_LIST_ITEM 
 *new_callback_list_item(
     HA_COMMON_OBJECT_HANDLE_INTERNAL *handle,
-    HA_COMMON_OBJECT_CALLBACK func)
+    HA_COMMON_OBJECT_CALLBACK func,
+    HA_COMMON_OBJECT_ASYNC_CALLBACK async_func)
 {
     HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *new;
     new = malloc(sizeof(HA_COMMON_OBJECT_CALLBACK_LIST_ITEM));
@@ -459,6 +751,7 @@ MTC_STATIC HA_COMMON_OBJECT_CALLBACK_LIST_ITEM
     new->next = NULL;
     new->object_handle = handle;
     new->func = func;
+    new->async_func = async_func;
     return new;
 }
 
@@ -481,11 +774,11 @@ free_callback_list_item(
 
 MTC_STATIC void 
 insert_callback_list_item(
-    HA_COMMON_OBJECT *object, 
+    HA_COMMON_OBJECT_CALLBACK_LIST_ITEM **head, 
     HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *callback_list_item)
 {
-    callback_list_item->next = object->callback_list_head;
-    object->callback_list_head = callback_list_item;
+    callback_list_item->next = *head;
+    *head = callback_list_item;
 
     return;
 }
@@ -496,17 +789,18 @@ insert_callback_list_item(
 
 MTC_STATIC HA_COMMON_OBJECT_CALLBACK_LIST_ITEM 
 *delete_callback_list_item(
-    HA_COMMON_OBJECT *object, 
-    HA_COMMON_OBJECT_CALLBACK func)
+    HA_COMMON_OBJECT_CALLBACK_LIST_ITEM **head, 
+    HA_COMMON_OBJECT_CALLBACK func,
+    HA_COMMON_OBJECT_ASYNC_CALLBACK async_func)
                                          
 {
     HA_COMMON_OBJECT_CALLBACK_LIST_ITEM **item, *ret;
 
-    for (item = &object->callback_list_head;
+    for (item = head;
          *item != NULL;
          item = &((*item)->next)) 
     {
-        if ((*item)->func == func) 
+        if ((*item)->func == func && (*item)->async_func == async_func) 
         {
             // Found it
             // Remove Item from the List
@@ -518,10 +812,241 @@ MTC_STATIC HA_COMMON_OBJECT_CALLBACK_LIST_ITEM
     return NULL;
 }
 
+//
+// lock profile
+//
+
+MTC_STATIC MTC_U32
+profile_bucket(
+    MTC_U32 us)
+{
+    MTC_U32 bucket;
+
+    if (us == 0)
+    {
+        return 0;
+    }
+    bucket = 32 - __builtin_clz(us);
+    return (bucket < PROFILE_BUCKETS)? bucket: PROFILE_BUCKETS - 1;
+}
+
+MTC_STATIC void
+profile_record(
+    MTC_U32 *histogram,
+    MTC_U32 *max,
+    MTC_U32 us)
+{
+    MTC_U32 old;
+
+    __sync_add_and_fetch(&histogram[profile_bucket(us)], 1);
+    while ((old = *(volatile MTC_U32 *) max) < us &&
+           !__sync_bool_compare_and_swap(max, old, us));
+}
+
+//
+// percentile in permille
+//
+
+MTC_STATIC MTC_U32
+profile_percentile(
+    MTC_U32 *histogram,
+    MTC_U32 max,
+    MTC_U32 permille)
+{
+    MTC_U32 bucket, total = 0, target, sum = 0, bound;
+
+    for (bucket = 0; bucket < PROFILE_BUCKETS; bucket++)
+    {
+        total += histogram[bucket];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    target = ((MTC_U64) total * permille + 999) / 1000;
+    for (bucket = 0; bucket < PROFILE_BUCKETS - 1; bucket++)
+    {
+        sum += histogram[bucket];
+        if (sum >= target)
+        {
+            break;
+        }
+    }
+    bound = (bucket == 0)? 0: (1U << bucket) - 1;
+    return (bucket < PROFILE_BUCKETS - 1 && bound < max)? bound: max;
+}
+
+//
+// role of the calling thread, from the name given to log_thread_id
+//
+
+MTC_STATIC MTC_U32
+get_thread_role()
+{
+    char *name;
+    MTC_U32 role;
+
+    if (thread_role >= 0)
+    {
+        return thread_role;
+    }
+    if ((name = log_thread_name()) == NULL)
+    {
+        // not named yet; do not cache
+        return COM_ROLE_OTHER;
+    }
+    for (role = 0; role < COM_ROLE_OTHER; role++)
+    {
+        if (!strcmp(name, com_role_name[role]))
+        {
+            break;
+        }
+    }
+    thread_role = role;
+    return role;
+}
+
+MTC_STATIC void
+profile_acquired(
+    HA_COMMON_OBJECT *object,
+    THREAD_ID_RECORD *record,
+    MTC_U32 lock_state,
+    MTC_U64 now_us)
+{
+    LOCK_PROFILE *profile;
+
+    profile = &object->profile[get_thread_role()]
+        [(lock_state == LOCK_STATE_WRITER_ACQUIRED)? COM_LOCK_MODE_WRITER: COM_LOCK_MODE_READER];
+    __sync_add_and_fetch(&profile->count, 1);
+    profile_record(profile->wait, &profile->wait_max, now_us - record->changed_time_us);
+}
+
+//  new longest hold of the calling thread, to be recorded after the unlock
+
+static __thread struct {
+    HA_COMMON_OBJECT *object;
+    MTC_U32 hold;
+    MTC_U32 role;
+    MTC_U32 mode;
+}   longest_pending;
+
+MTC_STATIC void
+profile_released(
+    HA_COMMON_OBJECT *object,
+    THREAD_ID_RECORD *record,
+    MTC_U64 now_us)
+{
+    LOCK_PROFILE *profile;
+    MTC_U32 role, mode, hold;
+
+    if (record->lock_state != LOCK_STATE_READER_ACQUIRED &&
+        record->lock_state != LOCK_STATE_WRITER_ACQUIRED)
+    {
+        return;
+    }
+    role = get_thread_role();
+    mode = (record->lock_state == LOCK_STATE_WRITER_ACQUIRED)? COM_LOCK_MODE_WRITER: COM_LOCK_MODE_READER;
+    hold = now_us - record->changed_time_us;
+    profile = &object->profile[role][mode];
+    profile_record(profile->hold, &profile->hold_max, hold);
+
+    // a new longest hold; its backtrace is taken by profile_longest_holder
+    // once the lock is released, so as not to lengthen the hold
+
+    if (hold > object->longest_hold)
+    {
+        longest_pending.object = object;
+        longest_pending.hold = hold;
+        longest_pending.role = role;
+        longest_pending.mode = mode;
+    }
+}
+
+//
+// Record the backtrace of the longest holder noted by profile_released.
+// Called by the unlock functions after pthread_rwlock_unlock.
+//
+
+MTC_STATIC void
+profile_longest_holder(
+    HA_COMMON_OBJECT *object)
+{
+    if (longest_pending.object != object)
+    {
+        return;
+    }
+    longest_pending.object = NULL;
+
+    // unless somebody else is doing it
+
+    if (longest_pending.hold > object->longest_hold &&
+        __sync_bool_compare_and_swap(&object->longest_holder_lock, 0, 1))
+    {
+        if (longest_pending.hold > object->longest_hold)
+        {
+            object->longest_holder_depth = backtrace(object->longest_holder, COM_PROFILE_BACKTRACE_SIZE);
+            object->longest_holder_role = longest_pending.role;
+            object->longest_holder_mode = longest_pending.mode;
+            object->longest_hold = longest_pending.hold;
+        }
+        __sync_lock_release(&object->longest_holder_lock);
+    }
+}
+
+MTC_STATIC void
+get_object_profile(
+    HA_COMMON_OBJECT *object,
+    COM_OBJECT_PROFILE *p)
+{
+    MTC_U32 role, mode, level;
+    LOCK_PROFILE *profile;
+    COM_LOCK_SUMMARY *summary;
+    char **symbols;
+
+    memset(p, 0, sizeof(*p));
+    strncpy(p->object_id, object->object_id, COM_PROFILE_ID_LEN - 1);
+    for (role = 0; role < COM_ROLE_NUM; role++)
+    {
+        for (mode = 0; mode < COM_LOCK_MODE_NUM; mode++)
+        {
+            profile = &object->profile[role][mode];
+            summary = &p->lock[role][mode];
+            summary->count = profile->count;
+            summary->wait_max = profile->wait_max;
+            summary->wait_p50 = profile_percentile(profile->wait, profile->wait_max, 500);
+            summary->wait_p99 = profile_percentile(profile->wait, profile->wait_max, 990);
+            summary->hold_max = profile->hold_max;
+            summary->hold_p50 = profile_percentile(profile->hold, profile->hold_max, 500);
+            summary->hold_p99 = profile_percentile(profile->hold, profile->hold_max, 990);
+        }
+    }
+
+    while (!__sync_bool_compare_and_swap(&object->longest_holder_lock, 0, 1))
+    {
+        sched_yield();
+    }
+    p->longest_hold = object->longest_hold;
+    p->longest_holder_role = object->longest_holder_role;
+    p->longest_holder_mode = object->longest_holder_mode;
+    if (object->longest_holder_depth > 0 &&
+        (symbols = backtrace_symbols(object->longest_holder, object->longest_holder_depth)) != NULL)
+    {
+        for (level = 0; level < object->longest_holder_depth; level++)
+        {
+            strncpy(p->backtrace[level], symbols[level], COM_PROFILE_SYMBOL_LEN - 1);
+        }
+        p->backtrace_num = object->longest_holder_depth;
+        free(symbols);
+    }
+    __sync_lock_release(&object->longest_holder_lock);
+}
+
 //
 // Set/Reset thread_id_record
 //
-// call in critical section.
+// A free slot is claimed by setting thread_id with compare-and-swap.
+// The slot is updated only by the owning thread until it is released,
+// so that no lock is required.
 //
 
 void
@@ -532,25 +1057,31 @@ set_thread_id_record(
     MTC_U32 i;
     pthread_t self = pthread_self();
     MTC_CLOCK now;
+    MTC_U64 now_us;
     struct timespec ts;
+    THREAD_ID_RECORD *record;
 
     clock_gettime(CLOCK_MONOTONIC, &ts);
     now = tstoms(ts);
+    now_us = (MTC_U64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 
     switch (lock_state) {
     case LOCK_STATE_READER_ACQUIREING:
     case LOCK_STATE_WRITER_ACQUIREING:
-        // find lock_state == NULL
+        // find a free slot
         for (i = 0 ; i < THREAD_ID_RECORD_NUM; i++) 
         {
-            if (object->thread_id_record_table[i].lock_state == LOCK_STATE_NONE)
+            record = &object->thread_id_record_table[i];
+            if (record->thread_id == 0 &&
+                __sync_bool_compare_and_swap(&record->thread_id, 0, self))
             {
                 //
                 // found
                 //
-                object->thread_id_record_table[i].lock_state = lock_state;
-                object->thread_id_record_table[i].thread_id = self;
-                object->thread_id_record_table[i].changed_time = now;
+                record->changed_time = now;
+                record->changed_time_us = now_us;
+                __sync_synchronize();
+                record->lock_state = lock_state;
                 return;
             }
         }
@@ -560,17 +1091,28 @@ set_thread_id_record(
         // find thread_id == self;
         for (i = 0 ; i < THREAD_ID_RECORD_NUM; i++) 
         {
-            if (object->thread_id_record_table[i].lock_state == LOCK_STATE_NONE) 
-            {
-                continue;
-            }
-            if (object->thread_id_record_table[i].thread_id == self)
+            record = &object->thread_id_record_table[i];
+            if (record->thread_id == self)
             {
                 //
                 // found
                 //
-                object->thread_id_record_table[i].lock_state = lock_state;
-                object->thread_id_record_table[i].changed_time = now;
+                if (lock_state == LOCK_STATE_NONE)
+                {
+                    profile_released(object, record, now_us);
+                }
+                else
+                {
+                    profile_acquired(object, record, lock_state, now_us);
+                }
+                record->changed_time = now;
+                record->changed_time_us = now_us;
+                record->lock_state = lock_state;
+                if (lock_state == LOCK_STATE_NONE)
+                {
+                    __sync_synchronize();
+                    record->thread_id = 0;
+                }
                 return;
             }
         }
@@ -582,44 +1124,285 @@ set_thread_id_record(
 }
 
 //
-// log all objects
+// priority ceiling for writers
 //
+// rwlocks cannot inherit priority. While a writer owns an object,
+// com_snapshot* callers spin on the odd sequence with sched_yield,
+// which never yields to a lower priority thread, so a writer
+// preempted by them would never finish. A thread running below
+// XHA_PRIORITY_HIGH is therefore raised to it while it waits for or
+// owns COM writer locks. Reader locks are not raised: a writer
+// waiting for them blocks rather than spins.
 //
 
-MTC_STATUS
-com_log_all_objects(
-    MTC_U32 dumpflag)
+static __thread MTC_U32 ceiling_depth = 0;
+
+MTC_STATIC void
+ceiling_raise()
 {
-    MTC_U32 hash_index;
-    HA_COMMON_OBJECT *object;
-    MTC_CLOCK now;
-    struct timespec ts;
-    MTC_U32 owned;
-    int pthread_ret;
-    HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *c;
-    MTC_U32 callbacknum;
+    int priority;
 
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    now = tstoms(ts);
+    if (ceiling_depth++ == 0 &&
+        (priority = xhad_thread_priority()) != 0 && priority < XHA_PRIORITY_HIGH)
+    {
+        pthread_setschedprio(pthread_self(), XHA_PRIORITY_HIGH);
+    }
+}
 
+MTC_STATIC void
+ceiling_restore()
+{
+    int priority;
 
-    log_message(MTC_LOG_DEBUG, "COM: ----------------<COM DUMP>----------------.\n");
-    for (hash_index = 0; hash_index < HASH_TABLE_SIZE; hash_index++)
+    assert(ceiling_depth > 0);
+    if (--ceiling_depth == 0 &&
+        (priority = xhad_thread_priority()) != 0 && priority < XHA_PRIORITY_HIGH)
     {
-        // try lock
-        pthread_ret = pthread_mutex_trylock(&com_mutex);
+        pthread_setschedprio(pthread_self(), priority);
+    }
+}
 
-        for (object = common_object_hash[hash_index]; object != NULL ; object = object->next)
-        {
-            MTC_U32 tid_index;
+//
+// Wake up com_wait_change callers waiting on the object
+// called after SEQ_WRITE_END
+//
 
-            owned = FALSE;
-            log_message(MTC_LOG_DEBUG, "COM: object_id=%s.\n",object->object_id);
-            log_message(MTC_LOG_DEBUG, "COM:   size=%d ref_count=%d in_use=%d.\n",object->size, object->ref_count, object->in_use);
-            for (tid_index = 0; tid_index < THREAD_ID_RECORD_NUM; tid_index++) 
-            {
-                if (object->thread_id_record_table[tid_index].lock_state != LOCK_STATE_NONE)
-                {
+MTC_STATIC void
+notify_change(
+    HA_COMMON_OBJECT *object)
+{
+    COM_CHANGE_LINK *link;
+
+    // pairs with the barrier in com_wait_change_many: either the
+    // waiter sees the new sequence, or the writer sees the waiter
+
+    __sync_synchronize();
+    if (object->change_waiter_num != 0)
+    {
+        pthread_mutex_lock(&object->change_mutex);
+        for (link = object->change_waiters; link != NULL; link = link->next)
+        {
+            pthread_mutex_lock(&link->waiter->mutex);
+            link->waiter->signalled = TRUE;
+            pthread_cond_signal(&link->waiter->cond);
+            pthread_mutex_unlock(&link->waiter->mutex);
+        }
+        pthread_mutex_unlock(&object->change_mutex);
+    }
+}
+
+//
+// TRUE if the version of any object differs from the snapshot
+//
+
+MTC_STATIC MTC_BOOLEAN
+version_changed(
+    HA_COMMON_OBJECT_SNAPSHOT *snapshot,
+    MTC_U32 num)
+{
+    HA_COMMON_OBJECT *object;
+    MTC_U32 i;
+
+    for (i = 0; i < num; i++)
+    {
+        object = ((HA_COMMON_OBJECT_HANDLE_INTERNAL *) snapshot[i].object_handle)->object;
+
+        // the version does not change until the writer releases the data
+
+        if ((MTC_U32) (object->sequence / 2) != snapshot[i].version)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+//
+// Queue the object to the dispatcher
+//
+
+MTC_STATIC void
+queue_dispatch(
+    HA_COMMON_OBJECT *object)
+{
+    pthread_mutex_lock(&dispatcher.mutex);
+    if (!object->dispatch_pending)
+    {
+        // coalesce with the pending update, if any
+
+        object->dispatch_pending = TRUE;
+        object->dispatch_next = NULL;
+        if (dispatcher.tail == NULL)
+        {
+            dispatcher.head = object;
+        }
+        else
+        {
+            dispatcher.tail->dispatch_next = object;
+        }
+        dispatcher.tail = object;
+        pthread_cond_signal(&dispatcher.cond);
+    }
+    pthread_mutex_unlock(&dispatcher.mutex);
+}
+
+//
+// Call the async callbacks of the object
+//
+
+MTC_STATIC void
+dispatch_callbacks(
+    HA_COMMON_OBJECT *object)
+{
+    HA_COMMON_OBJECT_HANDLE_INTERNAL handle;
+    HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *c;
+    MTC_U32 version;
+
+    handle.object = object;
+    handle.tag = HA_COMMON_OBJECT_TAG;
+
+    pthread_mutex_lock(&dispatcher.callback_mutex);
+    if (object->async_callback_list_head != NULL && object->buffer != NULL)
+    {
+        if (object->dispatch_buffer == NULL &&
+            (object->dispatch_buffer = malloc(object->size)) == NULL)
+        {
+            log_internal(MTC_LOG_ERR, "COM: cannot allocate buffer for dispatch (size=%d).\n", object->size);
+        }
+        else if (com_snapshot(&handle, object->dispatch_buffer, object->size, &version) == MTC_SUCCESS)
+        {
+            for (c = object->async_callback_list_head; c != NULL; c = c->next) 
+            {
+                c->async_func(c->object_handle, object->dispatch_buffer, version);
+            }
+        }
+    }
+    pthread_mutex_unlock(&dispatcher.callback_mutex);
+}
+
+//
+// dispatcher thread
+//
+
+MTC_STATIC void *
+com_dispatcher(
+    void *ignore)
+{
+    HA_COMMON_OBJECT *object;
+
+    log_thread_id("COM_dispatcher");
+    xhad_set_thread_priority(XHA_PRIORITY_MIDDLE);
+
+    pthread_mutex_lock(&dispatcher.mutex);
+    while (!dispatcher.terminate)
+    {
+        if ((object = dispatcher.head) == NULL)
+        {
+            pthread_cond_wait(&dispatcher.cond, &dispatcher.mutex);
+            continue;
+        }
+        if ((dispatcher.head = object->dispatch_next) == NULL)
+        {
+            dispatcher.tail = NULL;
+        }
+
+        // updates from now on are queued again
+
+        object->dispatch_pending = FALSE;
+        ATOMIC_INC(&object->in_use);
+        pthread_mutex_unlock(&dispatcher.mutex);
+
+        dispatch_callbacks(object);
+
+        ATOMIC_DEC(&object->in_use);
+        pthread_mutex_lock(&dispatcher.mutex);
+    }
+    pthread_mutex_unlock(&dispatcher.mutex);
+
+    return NULL;
+}
+
+//
+// log the lock profile of the object
+//
+
+MTC_STATIC void
+log_object_profile(
+    HA_COMMON_OBJECT *object)
+{
+    COM_OBJECT_PROFILE p;
+    COM_LOCK_SUMMARY *summary;
+    MTC_U32 role, mode, level;
+
+    get_object_profile(object, &p);
+    for (role = 0; role < COM_ROLE_NUM; role++)
+    {
+        for (mode = 0; mode < COM_LOCK_MODE_NUM; mode++)
+        {
+            summary = &p.lock[role][mode];
+            if (summary->count == 0)
+            {
+                continue;
+            }
+            log_message(MTC_LOG_DEBUG, "COM:   %s %s count=%u wait(us) p50=%u p99=%u max=%u hold(us) p50=%u p99=%u max=%u.\n",
+                        com_role_name[role], (mode == COM_LOCK_MODE_WRITER)? "writer": "reader",
+                        summary->count,
+                        summary->wait_p50, summary->wait_p99, summary->wait_max,
+                        summary->hold_p50, summary->hold_p99, summary->hold_max);
+        }
+    }
+    if (p.longest_hold > 0)
+    {
+        log_message(MTC_LOG_DEBUG, "COM:   longest holder %s %s hold=%u(us).\n",
+                    com_role_name[p.longest_holder_role],
+                    (p.longest_holder_mode == COM_LOCK_MODE_WRITER)? "writer": "reader",
+                    p.longest_hold);
+        for (level = 0; level < p.backtrace_num; level++)
+        {
+            log_message(MTC_LOG_DEBUG, "COM:     %2d: %s\n", level, p.backtrace[level]);
+        }
+    }
+}
+
+//
+// log all objects
+//
+//
+
+MTC_STATUS
+com_log_all_objects(
+    MTC_U32 dumpflag)
+{
+    MTC_U32 hash_index;
+    HA_COMMON_OBJECT *object;
+    MTC_CLOCK now;
+    struct timespec ts;
+    MTC_U32 owned;
+    int pthread_ret;
+    HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *c;
+    MTC_U32 callbacknum;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = tstoms(ts);
+
+
+    log_message(MTC_LOG_DEBUG, "COM: ----------------<COM DUMP>----------------.\n");
+    for (hash_index = 0; hash_index < HASH_TABLE_SIZE; hash_index++)
+    {
+        // try lock
+        pthread_ret = pthread_mutex_trylock(&com_mutex);
+
+        for (object = common_object_hash[hash_index]; object != NULL ; object = object->next)
+        {
+            MTC_U32 tid_index;
+
+            owned = FALSE;
+            log_message(MTC_LOG_DEBUG, "COM: object_id=%s.\n",object->object_id);
+            log_message(MTC_LOG_DEBUG, "COM:   size=%d ref_count=%d in_use=%d.\n",object->size, object->ref_count, object->in_use);
+            for (tid_index = 0; tid_index < THREAD_ID_RECORD_NUM; tid_index++) 
+            {
+                if (object->thread_id_record_table[tid_index].lock_state != LOCK_STATE_NONE)
+                {
                     log_message(MTC_LOG_DEBUG, "COM:     lock_state=%d thread_id=0x%lx changed_time=%"PRId64"(ms) .\n",
                                 object->thread_id_record_table[tid_index].lock_state,
                                 object->thread_id_record_table[tid_index].thread_id,
@@ -634,6 +1417,8 @@ com_log_all_objects(
             }
             for (callbacknum = 0, c = object->callback_list_head; c != NULL; callbacknum ++, c = c->next);
             log_message(MTC_LOG_DEBUG, "COM:   %d callback functions are registered.\n",callbacknum);
+            log_message(MTC_LOG_DEBUG, "COM:   %d async callback functions are registered.\n",object->async_callback_num);
+            log_object_profile(object);
             if (dumpflag && object->buffer)
             {
                 log_bin(MTC_LOG_DEBUG, object->buffer, object->size);
@@ -684,7 +1469,24 @@ com_initialize(
     {
     case 0: // initialize
         log_message(MTC_LOG_INFO, "COM: com_initialize(0).\n");
-        pthread_ret = pthread_mutex_init(&com_mutex, NULL);
+
+        // The first backtrace() loads libgcc_s; do it now rather than
+        // in a lock holder on the HB or SF thread (profile_longest_holder).
+
+        {
+            void *frame[1];
+
+            (void) backtrace(frame, 1);
+        }
+        pthread_ret = xhad_mutex_init(&com_mutex, PTHREAD_MUTEX_NORMAL);
+        if (pthread_ret == 0)
+        {
+            pthread_ret = xhad_mutex_init(&dispatcher.mutex, PTHREAD_MUTEX_NORMAL);
+        }
+        if (pthread_ret == 0)
+        {
+            pthread_ret = xhad_mutex_init(&dispatcher.callback_mutex, PTHREAD_MUTEX_NORMAL);
+        }
         if (fist_on("com.pthread")) pthread_ret = FIST_PTHREAD_ERRCODE;
         if (pthread_ret != 0) 
         {
@@ -695,11 +1497,27 @@ com_initialize(
         break;
     case 1: // start
         log_message(MTC_LOG_INFO, "COM: com_initialize(1).\n");
-        // do nothing
+        dispatcher.terminate = FALSE;
+        pthread_ret = pthread_create(&dispatcher.thread, xhad_pthread_attr, com_dispatcher, NULL);
+        if (fist_on("com.pthread")) pthread_ret = FIST_PTHREAD_ERRCODE;
+        if (pthread_ret != 0) 
+        {
+            log_internal(MTC_LOG_ERR, "COM: pthread_create failed (sys %d).\n", pthread_ret);
+            dispatcher.thread = 0;
+            return MTC_ERROR_COM_PTHREAD;
+        }
         break;
     case -1: // terminate
         log_message(MTC_LOG_INFO, "COM: com_initialize(-1).\n");
-        // do nothing
+        if (dispatcher.thread != 0)
+        {
+            pthread_mutex_lock(&dispatcher.mutex);
+            dispatcher.terminate = TRUE;
+            pthread_cond_signal(&dispatcher.cond);
+            pthread_mutex_unlock(&dispatcher.mutex);
+            pthread_join(dispatcher.thread, NULL);
+            dispatcher.thread = 0;
+        }
         break;
     }
     return MTC_SUCCESS;
@@ -707,29 +1525,16 @@ com_initialize(
 
 
 //
-// com_create
-//
-//  Create a HA Common Object.
-//  If the object already exists, Size and Buffer are ignored and 
-//  the function returns success with valid ObjectHandle.
-//
-//
-//  paramaters
-//    object_id: HA Common Object ID
-//    object_handle: Handle of the HA Common Object 
-//    size: data size of the HA Common Object
-//    buffer: initial data of the HA Common Object
+// Create or open the object
 //
-//  return value
-//    0: success
-//    not 0: fail
-//           fail in memory allocation
-//           other fail
+// registry_id is the registry ID of object_id (COM_OBJECT_NUM if
+// the object is not registered).
 //
 
-MTC_STATUS
-com_create(
+MTC_STATIC MTC_STATUS
+create_object(
     char *object_id,
+    COM_OBJECT_ID registry_id,
     HA_COMMON_OBJECT_HANDLE *object_handle,
     MTC_U32 size,
     void *buffer)
@@ -739,9 +1544,12 @@ com_create(
     HA_COMMON_OBJECT *object;
     HA_COMMON_OBJECT_HANDLE_INTERNAL *handle;
     HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *c;
+#ifndef NDEBUG
+    MTC_U64 checksum;
+#endif //NDEBUG
 
     ENTER_CS;
-    if ((object = find_common_object(object_id)) != NULL) 
+    if ((object = find_common_object(object_id, registry_id)) != NULL) 
     {
 
         // already exist
@@ -754,7 +1562,7 @@ com_create(
         }
         handle = (HA_COMMON_OBJECT_HANDLE_INTERNAL *) *object_handle;
         object->ref_count ++;
-        handle->object->in_use++;
+        ATOMIC_INC(&handle->object->in_use);
         set_thread_id_record(handle->object, LOCK_STATE_WRITER_ACQUIREING);
         LEAVE_CS;
 
@@ -779,6 +1587,7 @@ com_create(
                 ret = MTC_ERROR_COM_PTHREAD;
                 goto error_return;
             }
+            SEQ_WRITE_BEGIN(object);
             ret = new_object_buffer(object, size, buffer);
             if (ret != 0) 
             {
@@ -786,15 +1595,21 @@ com_create(
                 goto error_return;
             }
 #ifndef NDEBUG
-            object->checksum = calc_checksum_object_buffer(object);
+            checksum = calc_checksum_object_buffer(object, 0, object->size);
 #endif //NDEBUG
             for (c = handle->object->callback_list_head; c != NULL; c = c->next) 
             {
                 c->func(c->object_handle, handle->object->buffer);
 #ifndef NDEBUG
-                assert(object->checksum == calc_checksum_object_buffer(object));
+                assert(checksum == calc_checksum_object_buffer(object, 0, object->size));
 #endif //NDEBUG
             }
+            SEQ_WRITE_END(object);
+            notify_change(object);
+            if (object->async_callback_num != 0)
+            {
+                queue_dispatch(object);
+            }
             pthread_ret = pthread_rwlock_unlock(&handle->object->rwlock);
             if (fist_on("com.pthread")) pthread_ret = FIST_PTHREAD_ERRCODE;
 
@@ -804,16 +1619,16 @@ com_create(
                 ret = MTC_ERROR_COM_PTHREAD;
                 goto error_return;
             }
-            handle->object->in_use--;
+            ATOMIC_DEC(&handle->object->in_use);
             set_thread_id_record(handle->object, LOCK_STATE_NONE);
+            profile_longest_holder(handle->object);
             LEAVE_CS;
         }
         else 
         {
-            ENTER_CS;
             set_thread_id_record(handle->object, LOCK_STATE_NONE);
-            handle->object->in_use--;
-            LEAVE_CS;
+            profile_longest_holder(handle->object);
+            ATOMIC_DEC(&handle->object->in_use);
         }
 
         // OPEN SUCCESS
@@ -823,7 +1638,7 @@ com_create(
 
     /* not exist: Create new Object */
 
-    object = new_object(object_id, size, buffer);
+    object = new_object(object_id, registry_id, size, buffer);
     if (object == NULL) 
     {
         ret = MTC_ERROR_COM_INSUFFICIENT_RESOURCE;
@@ -838,6 +1653,17 @@ com_create(
         ret = MTC_ERROR_COM_PTHREAD;
         goto error_return;
     }
+    pthread_ret = xhad_mutex_init(&object->change_mutex, PTHREAD_MUTEX_NORMAL);
+    if (pthread_ret == 0)
+    {
+        pthread_ret = xhad_mutex_init(&object->shared_mutex, PTHREAD_MUTEX_NORMAL);
+    }
+    if (pthread_ret != 0) 
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) pthread_mutex_init failed (sys %d).\n", __func__, pthread_ret);
+        ret = MTC_ERROR_COM_PTHREAD;
+        goto error_return;
+    }
     insert_common_object(object);
     *object_handle = new_object_handle(object);
     if (*object_handle == NULL) 
@@ -861,6 +1687,56 @@ com_create(
     return ret;
 }
 
+//
+// com_create
+//
+//  Create a HA Common Object.
+//  If the object already exists, Size and Buffer are ignored and 
+//  the function returns success with valid ObjectHandle.
+//
+//
+//  paramaters
+//    object_id: HA Common Object ID
+//    object_handle: Handle of the HA Common Object 
+//    size: data size of the HA Common Object
+//    buffer: initial data of the HA Common Object
+//
+//  return value
+//    0: success
+//    not 0: fail
+//           fail in memory allocation
+//           other fail
+//
+
+MTC_STATUS
+com_create(
+    char *object_id,
+    HA_COMMON_OBJECT_HANDLE *object_handle,
+    MTC_U32 size,
+    void *buffer)
+{
+    return create_object(object_id, find_registry_id(object_id),
+                         object_handle, size, buffer);
+}
+
+//
+// com_create_id
+//
+//  Create a HA Common Object registered at compile time.
+//  See com_create.
+//
+
+MTC_STATUS
+com_create_id(
+    COM_OBJECT_ID id,
+    HA_COMMON_OBJECT_HANDLE *object_handle,
+    MTC_U32 size,
+    void *buffer)
+{
+    assert(id < COM_OBJECT_NUM);
+    return create_object(common_object_name[id], id, object_handle, size, buffer);
+}
+
 //
 // com_open
 //
@@ -887,6 +1763,21 @@ com_open(
     return com_create(object_id, object_handle, 0, NULL);
 }
 
+//
+// com_open_id
+//
+//  Open a HA Common Object registered at compile time.
+//  See com_open.
+//
+
+MTC_STATUS
+com_open_id(
+    COM_OBJECT_ID id,
+    HA_COMMON_OBJECT_HANDLE *object_handle)
+{
+    return com_create_id(id, object_handle, 0, NULL);
+}
+
 //
 // com_close
 //
@@ -938,6 +1829,8 @@ com_close(
         {
             log_message(MTC_LOG_WARNING, "COM: pthread_rwlock_destroy failed (sys %d).\n", pthread_ret);
         }
+        pthread_mutex_destroy(&object->change_mutex);
+        pthread_mutex_destroy(&object->shared_mutex);
         free_object(object);
     }
  error_return:
@@ -971,8 +1864,11 @@ com_register_callback(
     MTC_STATUS ret = MTC_SUCCESS;
     HA_COMMON_OBJECT_HANDLE_INTERNAL *handle = object_handle;
     HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *new;
+    int pthread_ret;
+
+    // the callback list is protected by the object's rwlock,
+    // since com_writer_unlock walks it without com_mutex.
 
-    ENTER_CS;
     if (!valid_object_handle(handle)) 
     {
         log_internal(MTC_LOG_ERR, "COM: (%s) invalid handle.\n", __func__);
@@ -987,16 +1883,24 @@ com_register_callback(
         ret =  MTC_ERROR_COM_CALLBACK_NOT_EXIST;
         goto error_return;
     }
-    new = new_callback_list_item(handle, func);
+    new = new_callback_list_item(handle, func, NULL);
     if (new == NULL) 
     {
         ret = MTC_ERROR_COM_INSUFFICIENT_RESOURCE;
         goto error_return;
     }
-    insert_callback_list_item(handle->object, new);
+    pthread_ret = pthread_rwlock_wrlock(&handle->object->rwlock);
+    if (pthread_ret != 0) 
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) pthread_rwlock_wrlock failed (sys %d).\n", __func__, pthread_ret);
+        free_callback_list_item(new);
+        ret = MTC_ERROR_COM_PTHREAD;
+        goto error_return;
+    }
+    insert_callback_list_item(&handle->object->callback_list_head, new);
+    pthread_rwlock_unlock(&handle->object->rwlock);
     
  error_return:
-    LEAVE_CS; 
     if (ret != MTC_SUCCESS) 
     {
         log_status(ret, NULL);
@@ -1032,8 +1936,8 @@ com_deregister_callback(
     MTC_STATUS ret = MTC_SUCCESS;
     HA_COMMON_OBJECT_HANDLE_INTERNAL *handle = object_handle;
     HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *item;
+    int pthread_ret;
 
-    ENTER_CS;
     if (!valid_object_handle(handle)) 
     {
         log_internal(MTC_LOG_ERR, "COM: (%s) invalid handle.\n", __func__);
@@ -1048,7 +1952,15 @@ com_deregister_callback(
         ret =  MTC_ERROR_COM_CALLBACK_NOT_EXIST;
         goto error_return;
     }
-    item = delete_callback_list_item(handle->object, func);
+    pthread_ret = pthread_rwlock_wrlock(&handle->object->rwlock);
+    if (pthread_ret != 0) 
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) pthread_rwlock_wrlock failed (sys %d).\n", __func__, pthread_ret);
+        ret = MTC_ERROR_COM_PTHREAD;
+        goto error_return;
+    }
+    item = delete_callback_list_item(&handle->object->callback_list_head, func, NULL);
+    pthread_rwlock_unlock(&handle->object->rwlock);
     if (item == NULL) 
     {
         log_internal(MTC_LOG_ERR, "COM: (%s) func not found.\n", __func__);
@@ -1059,7 +1971,6 @@ com_deregister_callback(
     free_callback_list_item(item);
 
  error_return:
-    LEAVE_CS;
     if (ret != MTC_SUCCESS) 
     {
         log_status(ret, NULL);
@@ -1072,7 +1983,139 @@ com_deregister_callback(
 
 
 //
-// com_writer_lock
+// com_register_async_callback
+//
+//  Register callback function which is called by the dispatcher thread
+//  after the object has been modified and the writer lock has been
+//  released. Updates made before the callback runs are coalesced.
+//
+//  paramaters
+//    object_handle: Handle of the HA Common Object 
+//    func: callback function
+//
+//  return value
+//    0: success
+//    not 0: fail
+//           The object is not found
+//           other fail
+//
+
+MTC_STATUS
+com_register_async_callback(
+    HA_COMMON_OBJECT_HANDLE object_handle,
+    HA_COMMON_OBJECT_ASYNC_CALLBACK func)
+{
+    MTC_STATUS ret = MTC_SUCCESS;
+    HA_COMMON_OBJECT_HANDLE_INTERNAL *handle = object_handle;
+    HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *new;
+
+    if (!valid_object_handle(handle)) 
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) invalid handle.\n", __func__);
+        assert(FALSE);
+        ret =  MTC_ERROR_COM_INVALID_HANDLE;
+        goto error_return;
+    }
+    if (func == NULL) 
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) func is NULL.\n", __func__);
+        assert(FALSE);
+        ret =  MTC_ERROR_COM_CALLBACK_NOT_EXIST;
+        goto error_return;
+    }
+    new = new_callback_list_item(handle, NULL, func);
+    if (new == NULL) 
+    {
+        ret = MTC_ERROR_COM_INSUFFICIENT_RESOURCE;
+        goto error_return;
+    }
+    pthread_mutex_lock(&dispatcher.callback_mutex);
+    insert_callback_list_item(&handle->object->async_callback_list_head, new);
+    ATOMIC_INC(&handle->object->async_callback_num);
+    pthread_mutex_unlock(&dispatcher.callback_mutex);
+
+ error_return:
+    if (ret != MTC_SUCCESS) 
+    {
+        log_status(ret, NULL);
+        log_message(MTC_LOG_WARNING, "COM: (%s) exit process.\n", __func__);
+        log_backtrace(MTC_LOG_WARNING);
+        com_exit_process(ret);
+    }
+    return ret;
+}
+
+
+//
+// com_deregister_async_callback
+//
+//  Deregister async callback function. The callback is not called
+//  once this function returns.
+//
+//  paramaters
+//    object_handle: Handle of the HA Common Object 
+//    func: callback function
+//
+//  return value
+//    0: success
+//    not 0: fail
+//           The object is not found
+//           other fail
+//
+
+MTC_STATUS 
+com_deregister_async_callback(
+    HA_COMMON_OBJECT_HANDLE object_handle,
+    HA_COMMON_OBJECT_ASYNC_CALLBACK func)
+{
+    MTC_STATUS ret = MTC_SUCCESS;
+    HA_COMMON_OBJECT_HANDLE_INTERNAL *handle = object_handle;
+    HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *item;
+
+    if (!valid_object_handle(handle)) 
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) invalid handle.\n", __func__);
+        assert(FALSE);
+        ret =  MTC_ERROR_COM_INVALID_HANDLE;
+        goto error_return;
+    }
+    if (func == NULL) 
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) func is NULL.\n", __func__);
+        assert(FALSE);
+        ret =  MTC_ERROR_COM_CALLBACK_NOT_EXIST;
+        goto error_return;
+    }
+    pthread_mutex_lock(&dispatcher.callback_mutex);
+    item = delete_callback_list_item(&handle->object->async_callback_list_head, NULL, func);
+    if (item != NULL)
+    {
+        ATOMIC_DEC(&handle->object->async_callback_num);
+    }
+    pthread_mutex_unlock(&dispatcher.callback_mutex);
+    if (item == NULL) 
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) func not found.\n", __func__);
+        assert(FALSE);
+        ret = MTC_ERROR_COM_CALLBACK_NOT_EXIST;
+        goto error_return;
+    }
+    free_callback_list_item(item);
+
+ error_return:
+    if (ret != MTC_SUCCESS) 
+    {
+        log_status(ret, NULL);
+        log_message(MTC_LOG_WARNING, "COM: (%s) exit process.\n", __func__);
+        log_backtrace(MTC_LOG_WARNING);
+        com_exit_process(ret);
+    }
+    return ret;
+}
+
+
+//
+// com_writer_lock
 //
 //  Acquire the writer lock for the object.
 //  com_writer_unlock must be called as soon as possible.
@@ -1098,7 +2141,6 @@ com_writer_lock(
     HA_COMMON_OBJECT_HANDLE_INTERNAL *handle = object_handle;
     int pthread_ret;
 
-    ENTER_CS;
     if (!valid_object_handle(handle)) 
     {
         log_internal(MTC_LOG_ERR, "COM: (%s) invalid handle.\n", __func__);
@@ -1106,12 +2148,11 @@ com_writer_lock(
         ret = MTC_ERROR_COM_INVALID_HANDLE;
         goto error_return;
     }
-    handle->object->in_use++;
+    ATOMIC_INC(&handle->object->in_use);
+    ceiling_raise();
     set_thread_id_record(handle->object, LOCK_STATE_WRITER_ACQUIREING);
-    LEAVE_CS;
     pthread_ret = pthread_rwlock_wrlock(&handle->object->rwlock);
     if (fist_on("com.pthread")) pthread_ret = FIST_PTHREAD_ERRCODE;
-    ENTER_CS;
     set_thread_id_record(handle->object, LOCK_STATE_WRITER_ACQUIRED);
     if (pthread_ret != 0) 
     {
@@ -1120,10 +2161,10 @@ com_writer_lock(
         goto error_return;
 
     }
+    SEQ_WRITE_BEGIN(handle->object);
     *buffer = handle->object->buffer;
 
  error_return:
-    LEAVE_CS;
     if (ret != MTC_SUCCESS) 
     {
         log_status(ret, NULL);
@@ -1157,8 +2198,8 @@ com_writer_unlock(
     HA_COMMON_OBJECT_HANDLE_INTERNAL *handle = object_handle;
     int pthread_ret;
     HA_COMMON_OBJECT_CALLBACK_LIST_ITEM *c;
+    MTC_BOOLEAN dispatch;
 
-    ENTER_CS;
     if (!valid_object_handle(handle)) 
     {
         log_internal(MTC_LOG_ERR, "COM: (%s) invalid handle.\n", __func__);
@@ -1171,14 +2212,14 @@ com_writer_unlock(
     {
         c->func(c->object_handle, handle->object->buffer);
     }
-#ifndef NDEBUG
-    handle->object->checksum = calc_checksum_object_buffer(handle->object);
-#endif //NDEBUG
-
+    dispatch = (handle->object->async_callback_num != 0);
+    SEQ_WRITE_END(handle->object);
+    notify_change(handle->object);
 
-    handle->object->in_use--;
+    ATOMIC_DEC(&handle->object->in_use);
     set_thread_id_record(handle->object, LOCK_STATE_NONE);
     pthread_ret = pthread_rwlock_unlock(&handle->object->rwlock);
+    profile_longest_holder(handle->object);
     if (fist_on("com.pthread")) pthread_ret = FIST_PTHREAD_ERRCODE;
     if (pthread_ret != 0) 
     {
@@ -1187,8 +2228,15 @@ com_writer_unlock(
         goto error_return;
     }
 
+    // async callbacks are called after the writer lock is released
+
+    if (dispatch)
+    {
+        queue_dispatch(handle->object);
+    }
+    ceiling_restore();
+
  error_return:
-    LEAVE_CS;
     if (ret != MTC_SUCCESS) 
     {
         log_status(ret, NULL);
@@ -1225,7 +2273,6 @@ com_reader_lock(
     HA_COMMON_OBJECT_HANDLE_INTERNAL *handle = object_handle;
     int pthread_ret;
 
-    ENTER_CS;
     if (!valid_object_handle(handle)) 
     {
         log_internal(MTC_LOG_ERR, "COM: (%s) invalid handle.\n", __func__);
@@ -1233,12 +2280,10 @@ com_reader_lock(
         ret = MTC_ERROR_COM_INVALID_HANDLE;
         goto error_return;
     }
-    handle->object->in_use++;
+    ATOMIC_INC(&handle->object->in_use);
     set_thread_id_record(handle->object, LOCK_STATE_READER_ACQUIREING);
-    LEAVE_CS;
     pthread_ret = pthread_rwlock_rdlock(&handle->object->rwlock);
     if (fist_on("com.pthread")) pthread_ret = FIST_PTHREAD_ERRCODE;
-    ENTER_CS;
     set_thread_id_record(handle->object, LOCK_STATE_READER_ACQUIRED);
     if (pthread_ret != 0) 
     {
@@ -1249,7 +2294,6 @@ com_reader_lock(
     *buffer = handle->object->buffer;
 
  error_return:
-    LEAVE_CS;
     if (ret != MTC_SUCCESS) 
     {
         log_status(ret, NULL);
@@ -1282,7 +2326,6 @@ com_reader_unlock(
     HA_COMMON_OBJECT_HANDLE_INTERNAL *handle = object_handle;
     int pthread_ret;
 
-    ENTER_CS;
     if (!valid_object_handle(handle)) 
     {
         log_internal(MTC_LOG_ERR, "COM: (%s) invalid handle.\n", __func__);
@@ -1292,11 +2335,12 @@ com_reader_unlock(
     }
 
 #ifndef NDEBUG
-    assert(handle->object->checksum == calc_checksum_object_buffer(handle->object));
+    assert(check_object_buffer(handle->object));
 #endif //NDEBUG
-    handle->object->in_use--;
+    ATOMIC_DEC(&handle->object->in_use);
     set_thread_id_record(handle->object, LOCK_STATE_NONE);
     pthread_ret = pthread_rwlock_unlock(&handle->object->rwlock);
+    profile_longest_holder(handle->object);
     if (fist_on("com.pthread")) pthread_ret = FIST_PTHREAD_ERRCODE;
     if (pthread_ret != 0) 
     {
@@ -1306,7 +2350,6 @@ com_reader_unlock(
     }
 
  error_return:
-    LEAVE_CS;
     if (ret != MTC_SUCCESS) 
     {
         log_status(ret, NULL);
@@ -1317,3 +2360,653 @@ com_reader_unlock(
     return ret;
 }
     
+
+//
+// com_snapshot
+//
+//  Copy the object data without taking the reader lock.
+//  See com_snapshot_many.
+//
+//  paramaters
+//    object_handle: Handle of the HA Common Object 
+//    copy: buffer to which the HA Common Object data is copied
+//    size: size of the copy buffer (must be the object size)
+//    version: version of the copied data is passed when this
+//             function returns (may be NULL)
+//
+//  return value
+//    0: success
+//    not 0: fail
+//           The object has no data
+//           other fail
+
+MTC_STATUS
+com_snapshot(
+    HA_COMMON_OBJECT_HANDLE object_handle,
+    void *copy,
+    MTC_U32 size,
+    MTC_U32 *version)
+{
+    HA_COMMON_OBJECT_SNAPSHOT snapshot;
+    MTC_STATUS ret;
+
+    snapshot.object_handle = object_handle;
+    snapshot.copy = copy;
+    snapshot.size = size;
+    ret = com_snapshot_many(&snapshot, 1);
+    if (ret == MTC_SUCCESS && version != NULL)
+    {
+        *version = snapshot.version;
+    }
+    return ret;
+}
+
+//
+// com_snapshot_many
+//
+//  Copy the data of several objects without taking the reader locks.
+//  The copies are retried until no writer has owned any of the
+//  objects during the copies, so that they form a consistent view
+//  of all the objects at one point in time. Writers are never
+//  blocked by this function.
+//
+//  paramaters
+//    snapshot: array of {object_handle, copy, size}. version of each
+//              copy is set when this function returns.
+//    num: number of the elements of snapshot
+//
+//  return value
+//    0: success
+//    not 0: fail
+//           One of the objects has no data
+//           other fail
+
+MTC_STATUS
+com_snapshot_many(
+    HA_COMMON_OBJECT_SNAPSHOT *snapshot,
+    MTC_U32 num)
+{
+    MTC_STATUS ret = MTC_SUCCESS;
+    HA_COMMON_OBJECT_HANDLE_INTERNAL *handle;
+    HA_COMMON_OBJECT *object;
+    MTC_U64 sequence[COM_SNAPSHOT_MAX];
+    MTC_U32 spin, i;
+    MTC_BOOLEAN retry;
+
+    if (num > COM_SNAPSHOT_MAX)
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) too many objects (%d).\n", __func__, num);
+        assert(FALSE);
+        ret = MTC_ERROR_INVALID_PARAMETER;
+        goto error_return;
+    }
+    for (i = 0; i < num; i++)
+    {
+        handle = snapshot[i].object_handle;
+        if (!valid_object_handle(handle)) 
+        {
+            log_internal(MTC_LOG_ERR, "COM: (%s) invalid handle.\n", __func__);
+            assert(FALSE);
+            ret = MTC_ERROR_COM_INVALID_HANDLE;
+            goto error_return;
+        }
+    }
+
+    for (spin = 0; ; spin++)
+    {
+        retry = FALSE;
+        for (i = 0; i < num && !retry; i++)
+        {
+            object = ((HA_COMMON_OBJECT_HANDLE_INTERNAL *) snapshot[i].object_handle)->object;
+            sequence[i] = object->sequence;
+
+            // odd if a writer owns the object
+
+            retry = (sequence[i] & 1)? TRUE: FALSE;
+        }
+        if (retry)
+        {
+            if (spin >= SNAPSHOT_SPIN_COUNT)
+            {
+                sched_yield();
+            }
+            continue;
+        }
+        __sync_synchronize();
+
+        for (i = 0; i < num; i++)
+        {
+            object = ((HA_COMMON_OBJECT_HANDLE_INTERNAL *) snapshot[i].object_handle)->object;
+            if (object->buffer == NULL)
+            {
+                return MTC_ERROR_COM_NO_DATA;
+            }
+            if (object->size != snapshot[i].size)
+            {
+                log_internal(MTC_LOG_ERR, "COM: (%s) size mismatch (%d != %d).\n", __func__, snapshot[i].size, object->size);
+                assert(FALSE);
+                ret = MTC_ERROR_INVALID_PARAMETER;
+                goto error_return;
+            }
+            memcpy(snapshot[i].copy, object->buffer, snapshot[i].size);
+        }
+
+        __sync_synchronize();
+        for (i = 0; i < num && !retry; i++)
+        {
+            object = ((HA_COMMON_OBJECT_HANDLE_INTERNAL *) snapshot[i].object_handle)->object;
+            retry = (object->sequence != sequence[i])? TRUE: FALSE;
+        }
+        if (!retry)
+        {
+            break;
+        }
+    }
+    for (i = 0; i < num; i++)
+    {
+        snapshot[i].version = (MTC_U32) (sequence[i] / 2);
+    }
+
+ error_return:
+    if (ret != MTC_SUCCESS) 
+    {
+        log_status(ret, NULL);
+        log_message(MTC_LOG_WARNING, "COM: (%s) exit process.\n", __func__);
+        log_backtrace(MTC_LOG_WARNING);
+        com_exit_process(ret);
+    }
+    return ret;
+}
+
+//
+// com_snapshot_share_many
+//
+//  Same as com_snapshot_many, but instead of copying the data into
+//  buffers of the caller, sets copy of each element to a copy which
+//  is shared by all the callers that take the same version of the
+//  object. The data is copied only when the object has been changed
+//  since the last shared copy was made, so that taking the same view
+//  again and again costs no copy.
+//
+//  The shared copies must not be modified (see com_snapshot_unshare),
+//  and must be released by com_snapshot_release.
+//
+//  paramaters
+//    snapshot: array of {object_handle, size}. copy and version of
+//              each element are set when this function returns.
+//    num: number of the elements of snapshot
+//
+//  return value
+//    0: success
+//    not 0: fail
+//           One of the objects has no data
+//           other fail
+
+MTC_STATUS
+com_snapshot_share_many(
+    HA_COMMON_OBJECT_SNAPSHOT *snapshot,
+    MTC_U32 num)
+{
+    MTC_STATUS ret = MTC_SUCCESS;
+    HA_COMMON_OBJECT_HANDLE_INTERNAL *handle;
+    HA_COMMON_OBJECT *object;
+    COM_SHARED_SNAPSHOT *shared[COM_SNAPSHOT_MAX], *old;
+    MTC_BOOLEAN fresh[COM_SNAPSHOT_MAX];
+    MTC_U64 sequence[COM_SNAPSHOT_MAX];
+    MTC_U32 spin, i, got;
+    MTC_BOOLEAN retry;
+
+    if (num > COM_SNAPSHOT_MAX)
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) too many objects (%d).\n", __func__, num);
+        assert(FALSE);
+        ret = MTC_ERROR_INVALID_PARAMETER;
+        goto error_return;
+    }
+    for (i = 0; i < num; i++)
+    {
+        handle = snapshot[i].object_handle;
+        if (!valid_object_handle(handle)) 
+        {
+            log_internal(MTC_LOG_ERR, "COM: (%s) invalid handle.\n", __func__);
+            assert(FALSE);
+            ret = MTC_ERROR_COM_INVALID_HANDLE;
+            goto error_return;
+        }
+    }
+
+    for (spin = 0; ; spin++)
+    {
+        retry = FALSE;
+        for (i = 0; i < num && !retry; i++)
+        {
+            object = ((HA_COMMON_OBJECT_HANDLE_INTERNAL *) snapshot[i].object_handle)->object;
+            sequence[i] = object->sequence;
+
+            // odd if a writer owns the object
+
+            retry = (sequence[i] & 1)? TRUE: FALSE;
+        }
+        if (retry)
+        {
+            if (spin >= SNAPSHOT_SPIN_COUNT)
+            {
+                sched_yield();
+            }
+            continue;
+        }
+        __sync_synchronize();
+
+        for (got = 0; got < num; got++)
+        {
+            object = ((HA_COMMON_OBJECT_HANDLE_INTERNAL *) snapshot[got].object_handle)->object;
+            if (object->buffer == NULL)
+            {
+                ret = MTC_ERROR_COM_NO_DATA;
+                break;
+            }
+            if (object->size != snapshot[got].size)
+            {
+                log_internal(MTC_LOG_ERR, "COM: (%s) size mismatch (%d != %d).\n", __func__, snapshot[got].size, object->size);
+                assert(FALSE);
+                ret = MTC_ERROR_INVALID_PARAMETER;
+                break;
+            }
+
+            // reuse the shared copy if it has the same version;
+            // shared_mutex inherits priority, as the callers run
+            // at different real-time priorities
+
+            pthread_mutex_lock(&object->shared_mutex);
+            shared[got] = object->shared;
+            if (shared[got] != NULL && shared[got]->sequence == sequence[got])
+            {
+                ATOMIC_INC(&shared[got]->ref_count);
+            }
+            else
+            {
+                shared[got] = NULL;
+            }
+            pthread_mutex_unlock(&object->shared_mutex);
+
+            fresh[got] = (shared[got] == NULL)? TRUE: FALSE;
+            if (fresh[got])
+            {
+                shared[got] = malloc(sizeof(COM_SHARED_SNAPSHOT) + snapshot[got].size);
+                if (shared[got] == NULL)
+                {
+                    log_internal(MTC_LOG_ERR, "COM: (%s) cannot malloc for snapshot.\n", __func__);
+                    ret = MTC_ERROR_COM_INSUFFICIENT_RESOURCE;
+                    break;
+                }
+                shared[got]->ref_count = 1;
+                shared[got]->size = snapshot[got].size;
+                shared[got]->sequence = sequence[got];
+                memcpy(shared[got]->data, object->buffer, snapshot[got].size);
+            }
+        }
+
+        __sync_synchronize();
+        for (i = 0; i < num && !retry; i++)
+        {
+            object = ((HA_COMMON_OBJECT_HANDLE_INTERNAL *) snapshot[i].object_handle)->object;
+            retry = (object->sequence != sequence[i])? TRUE: FALSE;
+        }
+        if (retry || ret != MTC_SUCCESS)
+        {
+            for (i = 0; i < got; i++)
+            {
+                com_snapshot_release(shared[i]->data);
+            }
+            if (ret == MTC_ERROR_COM_NO_DATA)
+            {
+                return ret;
+            }
+            if (ret != MTC_SUCCESS)
+            {
+                goto error_return;
+            }
+            continue;
+        }
+        break;
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        // publish the new copies for the next callers
+
+        if (fresh[i])
+        {
+            object = ((HA_COMMON_OBJECT_HANDLE_INTERNAL *) snapshot[i].object_handle)->object;
+            old = NULL;
+            pthread_mutex_lock(&object->shared_mutex);
+            if (object->shared == NULL || object->shared->sequence < sequence[i])
+            {
+                old = object->shared;
+                ATOMIC_INC(&shared[i]->ref_count);
+                object->shared = shared[i];
+            }
+            pthread_mutex_unlock(&object->shared_mutex);
+            if (old != NULL)
+            {
+                com_snapshot_release(old->data);
+            }
+        }
+        snapshot[i].copy = shared[i]->data;
+        snapshot[i].version = (MTC_U32) (sequence[i] / 2);
+    }
+
+ error_return:
+    if (ret != MTC_SUCCESS) 
+    {
+        log_status(ret, NULL);
+        log_message(MTC_LOG_WARNING, "COM: (%s) exit process.\n", __func__);
+        log_backtrace(MTC_LOG_WARNING);
+        com_exit_process(ret);
+    }
+    return ret;
+}
+
+//
+// com_snapshot_release
+//
+//  Release a copy set by com_snapshot_share_many or returned by
+//  com_snapshot_unshare.
+//
+//  paramaters
+//    copy: the copy (may be NULL)
+//
+//  return value
+//    none
+//
+
+void
+com_snapshot_release(
+    void *copy)
+{
+    COM_SHARED_SNAPSHOT *shared;
+
+    if (copy == NULL)
+    {
+        return;
+    }
+    shared = SHARED_SNAPSHOT_OF(copy);
+    if (ATOMIC_DEC(&shared->ref_count) == 0)
+    {
+        free(shared);
+    }
+}
+
+//
+// com_snapshot_unshare
+//
+//  Get a private copy, which the caller may modify, of a copy set by
+//  com_snapshot_share_many. The data is copied only if the copy is
+//  still shared. The reference to the shared copy is passed to the
+//  private copy, which must be released by com_snapshot_release.
+//
+//  paramaters
+//    copy: the shared copy
+//
+//  return value
+//    the private copy
+//
+
+void *
+com_snapshot_unshare(
+    void *copy)
+{
+    COM_SHARED_SNAPSHOT *shared = SHARED_SNAPSHOT_OF(copy), *private;
+
+    if (shared->ref_count == 1)
+    {
+        // no other reference (the object holds another one while
+        // the copy is its latest), so nobody else can see it
+
+        return copy;
+    }
+    private = malloc(sizeof(COM_SHARED_SNAPSHOT) + shared->size);
+    if (private == NULL)
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) cannot malloc for snapshot.\n", __func__);
+        log_status(MTC_ERROR_COM_INSUFFICIENT_RESOURCE, NULL);
+        log_message(MTC_LOG_WARNING, "COM: (%s) exit process.\n", __func__);
+        log_backtrace(MTC_LOG_WARNING);
+        com_exit_process(MTC_ERROR_COM_INSUFFICIENT_RESOURCE);
+        return NULL;
+    }
+    private->ref_count = 1;
+    private->size = shared->size;
+    private->sequence = shared->sequence;
+    memcpy(private->data, shared->data, shared->size);
+    com_snapshot_release(copy);
+    return private->data;
+}
+
+//
+// com_writer_version
+//
+//  Returns the version which the object data will have when the
+//  writer lock held by the caller is released (the version passed
+//  to com_snapshot callers and async callbacks).
+//
+//  paramaters
+//    object_handle: Handle of the HA Common Object 
+//
+//  return value
+//    version
+//
+
+MTC_U32
+com_writer_version(
+    HA_COMMON_OBJECT_HANDLE object_handle)
+{
+    HA_COMMON_OBJECT_HANDLE_INTERNAL *handle = object_handle;
+
+    assert(valid_object_handle(handle));
+    assert(handle->object->sequence & 1);
+
+    return (MTC_U32) ((handle->object->sequence + 1) / 2);
+}
+
+
+//
+// com_get_profile
+//
+//  Get the lock profile of the objects.
+//
+//  paramaters
+//    profile: array to receive the profile
+//    num: number of elements of profile
+//
+//  return value
+//    number of objects returned
+//
+
+MTC_U32
+com_get_profile(
+    COM_OBJECT_PROFILE *profile,
+    MTC_U32 num)
+{
+    MTC_U32 hash_index, count = 0;
+    HA_COMMON_OBJECT *object;
+
+    ENTER_CS;
+    for (hash_index = 0; hash_index < HASH_TABLE_SIZE; hash_index++)
+    {
+        for (object = common_object_hash[hash_index]; object != NULL && count < num; object = object->next)
+        {
+            get_object_profile(object, &profile[count++]);
+        }
+    }
+    LEAVE_CS;
+    return count;
+}
+
+
+//
+// com_wait_change
+//
+//  Wait until the version of the object differs from since_version.
+//
+//  paramaters
+//    object_handle: Handle of the HA Common Object 
+//    since_version: version the caller has seen (see com_snapshot)
+//    timeout: in ms, or negative to wait forever
+//
+//  return value
+//    MTC_SUCCESS: changed
+//    MTC_ERROR_COM_TIMEOUT: timed out
+//
+
+MTC_STATUS
+com_wait_change(
+    HA_COMMON_OBJECT_HANDLE object_handle,
+    MTC_U32 since_version,
+    MTC_CLOCK timeout)
+{
+    HA_COMMON_OBJECT_SNAPSHOT snapshot;
+
+    snapshot.object_handle = object_handle;
+    snapshot.copy = NULL;
+    snapshot.size = 0;
+    snapshot.version = since_version;
+    return com_wait_change_many(&snapshot, 1, timeout);
+}
+
+//
+// com_wait_change_many
+//
+//  Wait until the version of any of the objects differs from
+//  the version in snapshot, e.g. the one set by com_snapshot_many.
+//
+//  paramaters
+//    snapshot: array of {object_handle, version}. copy and size are
+//              not used.
+//    num: number of the elements of snapshot (up to COM_SNAPSHOT_MAX)
+//    timeout: in ms, or negative to wait forever
+//
+//  return value
+//    MTC_SUCCESS: changed
+//    MTC_ERROR_COM_TIMEOUT: timed out
+//    MTC_ERROR_INVALID_PARAMETER: num is larger than COM_SNAPSHOT_MAX
+//
+
+MTC_STATUS
+com_wait_change_many(
+    HA_COMMON_OBJECT_SNAPSHOT *snapshot,
+    MTC_U32 num,
+    MTC_CLOCK timeout)
+{
+    HA_COMMON_OBJECT *object;
+    COM_CHANGE_WAITER waiter;
+    COM_CHANGE_LINK link[COM_SNAPSHOT_MAX], **plink;
+    pthread_condattr_t condattr;
+    MTC_BOOLEAN changed;
+    struct timespec deadline;
+    MTC_U32 i;
+    int pthread_ret;
+
+    if (num > COM_SNAPSHOT_MAX)
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) too many objects (%d).\n", __func__, num);
+        assert(FALSE);
+        return MTC_ERROR_INVALID_PARAMETER;
+    }
+    for (i = 0; i < num; i++)
+    {
+        if (!valid_object_handle(snapshot[i].object_handle)) 
+        {
+            log_internal(MTC_LOG_ERR, "COM: (%s) invalid handle.\n", __func__);
+            assert(FALSE);
+            log_status(MTC_ERROR_COM_INVALID_HANDLE, NULL);
+            log_message(MTC_LOG_WARNING, "COM: (%s) exit process.\n", __func__);
+            log_backtrace(MTC_LOG_WARNING);
+            com_exit_process(MTC_ERROR_COM_INVALID_HANDLE);
+        }
+    }
+
+    waiter.signalled = FALSE;
+    pthread_ret = xhad_mutex_init(&waiter.mutex, PTHREAD_MUTEX_NORMAL);
+    if (pthread_ret == 0)
+    {
+        pthread_condattr_init(&condattr);
+        pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+        pthread_ret = pthread_cond_init(&waiter.cond, &condattr);
+        pthread_condattr_destroy(&condattr);
+    }
+    if (pthread_ret != 0) 
+    {
+        log_internal(MTC_LOG_ERR, "COM: (%s) pthread_cond_init failed (sys %d).\n", __func__, pthread_ret);
+        log_status(MTC_ERROR_COM_PTHREAD, NULL);
+        log_message(MTC_LOG_WARNING, "COM: (%s) exit process.\n", __func__);
+        log_backtrace(MTC_LOG_WARNING);
+        com_exit_process(MTC_ERROR_COM_PTHREAD);
+    }
+
+    if (timeout >= 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (timeout % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    //  link the waiter to each object
+
+    for (i = 0; i < num; i++)
+    {
+        object = ((HA_COMMON_OBJECT_HANDLE_INTERNAL *) snapshot[i].object_handle)->object;
+        link[i].waiter = &waiter;
+        pthread_mutex_lock(&object->change_mutex);
+        link[i].next = object->change_waiters;
+        object->change_waiters = &link[i];
+        ATOMIC_INC(&object->change_waiter_num);
+        pthread_mutex_unlock(&object->change_mutex);
+    }
+
+    // pairs with the barrier in notify_change
+
+    __sync_synchronize();
+
+    pthread_mutex_lock(&waiter.mutex);
+    while (!(changed = version_changed(snapshot, num)))
+    {
+        if (waiter.signalled)
+        {
+            waiter.signalled = FALSE;
+        }
+        else if (timeout < 0)
+        {
+            pthread_cond_wait(&waiter.cond, &waiter.mutex);
+        }
+        else if (pthread_cond_timedwait(&waiter.cond, &waiter.mutex, &deadline) == ETIMEDOUT)
+        {
+            changed = version_changed(snapshot, num);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&waiter.mutex);
+
+    //  unlink the waiter
+
+    for (i = 0; i < num; i++)
+    {
+        object = ((HA_COMMON_OBJECT_HANDLE_INTERNAL *) snapshot[i].object_handle)->object;
+        pthread_mutex_lock(&object->change_mutex);
+        for (plink = &object->change_waiters; *plink != &link[i]; plink = &(*plink)->next)
+            ;
+        *plink = link[i].next;
+        ATOMIC_DEC(&object->change_waiter_num);
+        pthread_mutex_unlock(&object->change_mutex);
+    }
+
+    pthread_cond_destroy(&waiter.cond);
+    pthread_mutex_destroy(&waiter.mutex);
+
+    return (changed)? MTC_SUCCESS: MTC_ERROR_COM_TIMEOUT;
+}
@@ -148,13 +148,13 @@ typedef struct _HB_PACKET {
     MTC_UUID    host_uuid;                                  // 32 bytes
     MTC_U32     host_index;                                 // 4 bytes
 
-    MTC_HOSTMAP current_liveset;                            // 8 bytes
-    MTC_HOSTMAP proposed_liveset;                           // 8 bytes
-    MTC_HOSTMAP hbdomain;                                   // 8 bytes
-    MTC_HOSTMAP sfdomain;                                   // 8 bytes
+    MTC_HOSTMAP current_liveset;                            // MAX_HOST_NUM / 8 bytes
+    MTC_HOSTMAP proposed_liveset;                           // MAX_HOST_NUM / 8 bytes
+    MTC_HOSTMAP hbdomain;                                   // MAX_HOST_NUM / 8 bytes
+    MTC_HOSTMAP sfdomain;                                   // MAX_HOST_NUM / 8 bytes
 
-    MTC_S32     time_since_last_HB_receipt[MAX_HOST_NUM];   // 256 bytes
-    MTC_S32     time_since_last_SF_update[MAX_HOST_NUM];    // 256 bytes
+    MTC_S32     time_since_last_HB_receipt[MAX_HOST_NUM];   // 4 * MAX_HOST_NUM bytes
+    MTC_S32     time_since_last_SF_update[MAX_HOST_NUM];    // 4 * MAX_HOST_NUM bytes
     MTC_S32     time_since_xapi_restart;                    // 4 bytes
 
     SM_PHASE    sm_phase;                                   // 4 bytes
@@ -169,9 +169,14 @@ typedef struct _HB_PACKET {
     MTC_BOOLEAN joining;                                    // 1 byte
 
     MTC_S8      padding[1];                                 // 1 byte
-}   HB_PACKET, *PHB_PACKET;                                 // total 744 bytes
+}   HB_PACKET, *PHB_PACKET;                                 // total 744 bytes (64 hosts)
 
-MTC_ASSERT_SIZE(sizeof(HB_PACKET) == 744);
+MTC_ASSERT_SIZE(sizeof(HB_PACKET) == 200 + MAX_HOST_NUM * 17 / 2);
+
+//  The packet is sent unfragmented: it must fit in a 1500-byte MTU less
+//  the IPv6 (40 bytes) and UDP (8 bytes) headers.
+
+MTC_ASSERT_SIZE(sizeof(HB_PACKET) <= 1500 - 40 - 8);
 
 
 // Referenced objects
@@ -184,15 +189,15 @@ static HA_COMMON_OBJECT_HANDLE
 
 static struct {
     HA_COMMON_OBJECT_HANDLE     *handle;
-    PMTC_S8                     name;
+    COM_OBJECT_ID               id;
     HA_COMMON_OBJECT_CALLBACK   callback;
 } objects[] =
 {
-    {&hb_object,        COM_ID_HB,      hb_hb_updated},
-    {&sf_object,        COM_ID_SF,      hb_sf_updated},
-    {&xapimon_object,   COM_ID_XAPIMON, hb_xapimon_updated},
-    {&sm_object,        COM_ID_SM,      hb_sm_updated},
-    {NULL,              NULL,           NULL}
+    {&hb_object,        COM_OBJECT_HB,      hb_hb_updated},
+    {&sf_object,        COM_OBJECT_SF,      hb_sf_updated},
+    {&xapimon_object,   COM_OBJECT_XAPIMON, hb_xapimon_updated},
+    {&sm_object,        COM_OBJECT_SM,      hb_sm_updated},
+    {NULL,              COM_OBJECT_NUM,     NULL}
 };
 
 
@@ -446,25 +451,25 @@ hb_initialize0()
 
         for (index = 0; index < MAX_HOST_NUM; index++)
         {
-            MTC_HOSTMAP_INIT_RESET(hb.raw[index].current_liveset);
-            MTC_HOSTMAP_INIT_RESET(hb.raw[index].proposed_liveset);
-            MTC_HOSTMAP_INIT_RESET(hb.raw[index].hbdomain);
-            MTC_HOSTMAP_INIT_RESET(hb.raw[index].sfdomain);
+            MTC_HOSTMAP_INIT_RESET(hb.raw.current_liveset[index]);
+            MTC_HOSTMAP_INIT_RESET(hb.raw.proposed_liveset[index]);
+            MTC_HOSTMAP_INIT_RESET(hb.raw.hbdomain[index]);
+            MTC_HOSTMAP_INIT_RESET(hb.raw.sfdomain[index]);
             hb.sm_phase[index] = SM_PHASE_STARTING;
             hb.time_last_HB[index] = -1;
             for (index2 = 0; index2 < MAX_HOST_NUM; index2++)
             {
-                hb.raw[index].time_since_last_HB_receipt[index2] = -1;
-                hb.raw[index].time_since_last_SF_update[index2] = -1;
+                hb.raw.time_since_last_HB_receipt[index][index2] = -1;
+                hb.raw.time_since_last_SF_update[index][index2] = -1;
             }
-            hb.raw[index].time_since_xapi_restart = -1;
+            hb.raw.time_since_xapi_restart[index] = -1;
             memset(hb.err_string[index], 0, sizeof(hb.err_string[index]));
         }
         MTC_HOSTMAP_INIT_RESET(hb.hbdomain);
         MTC_HOSTMAP_INIT_RESET(hb.notjoining);
 
         // create common object
-        ret = com_create(COM_ID_HB, &hb_object, sizeof(COM_DATA_HB), &hb);
+        ret = com_create_typed(HB, &hb_object, &hb);
         if (ret)
         {
             log_internal(MTC_LOG_ERR, "HB: cannot create COM object. (%d)\n", ret);
@@ -616,12 +621,12 @@ hb_open_objects()
         // open common objects
         if (*(objects[index].handle) == HA_COMMON_OBJECT_INVALID_HANDLE_VALUE)
         {
-            ret = com_open(objects[index].name, objects[index].handle);
+            ret = com_open_id(objects[index].id, objects[index].handle);
             if (ret)
             {
                 log_internal(MTC_LOG_ERR,
-                            "HB: cannot open COM object (name = %s). (%d)\n",
-                            objects[index].name, ret);
+                            "HB: cannot open COM object (id = %d). (%d)\n",
+                            objects[index].id, ret);
                 objects[index].handle = HA_COMMON_OBJECT_INVALID_HANDLE_VALUE;
                 return ret;
             }
@@ -636,8 +641,8 @@ hb_open_objects()
             if (ret)
             {
                 log_internal(MTC_LOG_ERR,
-                            "HB: cannot register callback on the COM object (%s). (%d)\n",
-                            objects[index].name, ret);
+                            "HB: cannot register callback on the COM object (id = %d). (%d)\n",
+                            objects[index].id, ret);
                 return ret;
             }
         }
@@ -879,7 +884,7 @@ hb_send(
 
             now = _getms();
 
-            com_writer_lock(hb_object, (void **) &phb);
+            com_writer_lock_typed(HB, hb_object, &phb);
             phb->time_last_HB[_my_index] = now;
             phb->latency = now - last;
             phb->latency_max = (phb->latency_max < 0)? phb->latency:
@@ -912,8 +917,8 @@ update_hbdomain()
     MTC_S32         index;
 
     now = _getms();
-    com_reader_lock(sm_object, (void **) &psm);
-    com_writer_lock(hb_object, (void **) &phb);
+    com_reader_lock_typed(SM, sm_object, &psm);
+    com_writer_lock_typed(HB, hb_object, &phb);
     for (index = 0; _is_configured_host(index); index++)
     {
         if (index == _my_index)
@@ -928,7 +933,7 @@ update_hbdomain()
             {
                 if (phb->sm_phase[index] >= SM_PHASE_FHREADY &&
                     psm->phase >= SM_PHASE_FHREADY &&
-                    !MTC_HOSTMAP_ISON(phb->raw[index].hbdomain, _my_index))
+                    !MTC_HOSTMAP_ISON(phb->raw.hbdomain[index], _my_index))
                 {
                     MTC_HOSTMAP_RESET(phb->hbdomain, index);
                     hostmap[index] = 'd';
@@ -1014,7 +1019,7 @@ send_hb()
         {
             PCOM_DATA_HB    phb;
 
-            com_reader_lock(hb_object, (void **) &phb);
+            com_reader_lock_typed(HB, hb_object, &phb);
             enable_HB_send = phb->ctl.enable_HB_send;
             com_reader_unlock(hb_object);
         }
@@ -1037,6 +1042,11 @@ send_hb()
         PCOM_DATA_HB        phb;
         PCOM_DATA_SF        psf;
         PCOM_DATA_XAPIMON   pxapimon;
+        HA_COMMON_OBJECT_SNAPSHOT snapshot[] = {
+            {sm_object, NULL, sizeof(COM_DATA_SM)},
+            {sf_object, NULL, sizeof(COM_DATA_SF)},
+            {xapimon_object, NULL, sizeof(COM_DATA_XAPIMON)},
+        };
 
         MTC_CLOCK           now;
 
@@ -1045,11 +1055,20 @@ send_hb()
         pkt.sequence = ++(hbvar.sequence[_my_index]);
         hb_spin_unlock();
 
-        // acquire reader_lock
-        com_reader_lock(sm_object, (void **) &psm);
-        com_writer_lock(hb_object, (void **) &phb);
-        com_reader_lock(sf_object, (void **) &psf);
-        com_reader_lock(xapimon_object, (void **) &pxapimon);
+        // take a snapshot of the objects only read here, so that
+        // their writers are not blocked by the heartbeat thread.
+        // The snapshot is shared, as the SF object grows with the
+        // square of MAX_HOST_NUM and mostly has not changed since
+        // the last heartbeat.
+        if (com_snapshot_share_many(snapshot, sizeof(snapshot) / sizeof(snapshot[0])) != MTC_SUCCESS)
+        {
+            return;
+        }
+        psm = snapshot[0].copy;
+        psf = snapshot[1].copy;
+        pxapimon = snapshot[2].copy;
+
+        com_writer_lock_typed(HB, hb_object, &phb);
 
         // SF accelerate
         pkt.SF_accelerate = phb->SF_accelerate;
@@ -1092,11 +1111,11 @@ send_hb()
         // fence request
         pkt.fence_request = phb->ctl.fence_request;
 
-        // release reaer_locks
-        com_reader_unlock(xapimon_object);
-        com_reader_unlock(sf_object);
         com_writer_unlock(hb_object);
-        com_reader_unlock(sm_object);
+
+        com_snapshot_release(psm);
+        com_snapshot_release(psf);
+        com_snapshot_release(pxapimon);
     }
 
     log_maskable_debug_message(TRACE, "HB: sending a heartbeat packet.\n");
@@ -1189,7 +1208,7 @@ receive_hb()
             MTC_BOOLEAN     enable_HB_receive;
             PCOM_DATA_HB    phb;
 
-            com_reader_lock(hb_object, (void **) &phb);
+            com_reader_lock_typed(HB, hb_object, &phb);
             enable_HB_receive = phb->ctl.enable_HB_receive;
             com_reader_unlock(hb_object);
 
@@ -1272,7 +1291,7 @@ receive_hb()
 
             // If I am thinking the sender is still alive, ignore the packet
             // until Fault Handler finish the process.
-            com_reader_lock(sm_object, (void **) &psm);
+            com_reader_lock_typed(SM, sm_object, &psm);
             ignore = MTC_HOSTMAP_ISON(psm->current_liveset, fm_index);
             com_reader_unlock(sm_object);
 
@@ -1319,22 +1338,22 @@ receive_hb()
         MTC_S32         index;
 
         // START - SM_OBJECT, HB_OBJECT data update
-        com_writer_lock(sm_object, (void **) &psm);
-        com_writer_lock(hb_object, (void **) &phb);
+        com_writer_lock_typed(SM, sm_object, &psm);
+        com_writer_lock_typed(HB, hb_object, &phb);
 
         // since last HB receipt
         phb->time_last_HB[fm_index] = now;
-        for (index = 0; index < MAX_HOST_NUM; index++)
+        for (index = 0; _is_configured_host(index); index++)
         {
-            phb->raw[_my_index].time_since_last_HB_receipt[index] =
+            phb->raw.time_since_last_HB_receipt[_my_index][index] =
                 (phb->time_last_HB[index] < 0)? -1: now - phb->time_last_HB[index];
         }
 
         // liveset information
-	    MTC_HOSTMAP_COPY(phb->raw[fm_index].current_liveset, pkt.current_liveset);
-	    MTC_HOSTMAP_COPY(phb->raw[fm_index].proposed_liveset, pkt.proposed_liveset);
-        MTC_HOSTMAP_COPY(phb->raw[fm_index].hbdomain, pkt.hbdomain);
-        MTC_HOSTMAP_COPY(phb->raw[fm_index].sfdomain, pkt.sfdomain);
+	    MTC_HOSTMAP_COPY(phb->raw.current_liveset[fm_index], pkt.current_liveset);
+	    MTC_HOSTMAP_COPY(phb->raw.proposed_liveset[fm_index], pkt.proposed_liveset);
+        MTC_HOSTMAP_COPY(phb->raw.hbdomain[fm_index], pkt.hbdomain);
+        MTC_HOSTMAP_COPY(phb->raw.sfdomain[fm_index], pkt.sfdomain);
 
         // joining
         // this host map is used to gather hosts that are ready to start,
@@ -1365,11 +1384,11 @@ receive_hb()
         MTC_HOSTMAP_SET_BOOLEAN(psm->sf_corrupted, fm_index, pkt.SF_corrupted);
 
         // raw data
-        arraycpy(phb->raw[fm_index].time_since_last_HB_receipt,
+        arraycpy(phb->raw.time_since_last_HB_receipt[fm_index],
                  pkt.time_since_last_HB_receipt);
-        arraycpy(phb->raw[fm_index].time_since_last_SF_update,
+        arraycpy(phb->raw.time_since_last_SF_update[fm_index],
                  pkt.time_since_last_SF_update);
-        phb->raw[fm_index].time_since_xapi_restart = pkt.time_since_xapi_restart;
+        phb->raw.time_since_xapi_restart[fm_index] = pkt.time_since_xapi_restart;
         strncpy(phb->err_string[fm_index], pkt.err_string, sizeof(pkt.err_string));
 
         com_writer_unlock(hb_object);
@@ -1448,7 +1467,7 @@ hb_SF_accelerate()
 
     sf_accelerate();
 
-    com_writer_lock(hb_object, (void **) &phb);
+    com_writer_lock_typed(HB, hb_object, &phb);
     phb->SF_accelerate = TRUE;
     com_writer_unlock(hb_object);
 
@@ -1463,7 +1482,7 @@ hb_SF_cancel_accelerate()
 
     sf_cancel_acceleration();
 
-    com_writer_lock(hb_object, (void **) &phb);
+    com_writer_lock_typed(HB, hb_object, &phb);
     phb->SF_accelerate = FALSE;
     com_writer_unlock(hb_object);
 
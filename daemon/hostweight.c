@@ -253,8 +253,8 @@ hostweight_set_sm(void)
     hostweight = calc_hostweight();
 
     // update SMOBJECT
-    com_open(COM_ID_SM, &h_sm);
-    com_writer_lock(h_sm, (void *)&sm);
+    com_open_typed(SM, &h_sm);
+    com_writer_lock_typed(SM, h_sm, &sm);
     if (sm == NULL) 
     {
         log_internal(MTC_LOG_WARNING, "SC: (%s) sm data is NULL.\n", __func__);
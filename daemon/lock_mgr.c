@@ -98,7 +98,8 @@
 MTC_STATIC void
 lm_sf_updated(
     HA_COMMON_OBJECT_HANDLE Handle,
-    void *Buffer);
+    void *Buffer,
+    MTC_U32 Version);
 
 MTC_STATIC void
 lm_sm_updated(
@@ -114,13 +115,14 @@ static HA_COMMON_OBJECT_HANDLE
 
 static struct {
     HA_COMMON_OBJECT_HANDLE     *handle;
-    PMTC_S8                     name;
+    COM_OBJECT_ID               id;
     HA_COMMON_OBJECT_CALLBACK   callback;
+    HA_COMMON_OBJECT_ASYNC_CALLBACK async_callback;
 } objects[] =
 {
-    {&sf_object,        COM_ID_SF,      lm_sf_updated},
-    {&sm_object,        COM_ID_SM,      lm_sm_updated},
-    {NULL,              NULL,           NULL}
+    {&sf_object,        COM_OBJECT_SF,      NULL,           lm_sf_updated},
+    {&sm_object,        COM_OBJECT_SM,      lm_sm_updated,  NULL},
+    {NULL,              COM_OBJECT_NUM,     NULL,           NULL}
 };
 
 
@@ -131,7 +133,13 @@ static struct {
     MTC_BOOLEAN     cancel_request;
     MTC_BOOLEAN     terminate;
     MTC_BOOLEAN     first_cleanup_done;
-    COM_DATA_SF     sf;
+    MTC_BOOLEAN     sf_access;      // SF_access of the SF object
+    struct {
+        MTC_BOOLEAN request;
+        MTC_HOSTMAP grant;
+    } lm;                           // lm[_my_index] of the SF object
+    MTC_U32         sf_version;     // COM version of sf_access and lm
+    const SF_SNAPSHOT *sf_snapshot; // acquired by lm_acquire_sf
     COM_DATA_SM     sm;
 } lmvar = {
     .mutex = PTHREAD_MUTEX_INITIALIZER,
@@ -185,6 +193,21 @@ MTC_STATIC void
 write_master_uuid(
     MTC_UUID uuidMaster);
 
+MTC_STATIC void
+lm_acquire_sf();
+
+MTC_STATIC void
+lm_release_sf();
+
+MTC_STATIC MTC_BOOLEAN
+lm_request_of(
+    MTC_S32 node_index);
+
+MTC_STATIC MTC_BOOLEAN
+lm_grant_of(
+    MTC_S32 node_index,
+    MTC_S32 grantee_index);
+
 
 //
 //
@@ -222,7 +245,16 @@ lm_initialize(
     case 0:
         log_message(MTC_LOG_INFO, "LM: lm_initialize(0).\n");
 
-        memset(&lmvar.sf, 0, sizeof(lmvar.sf));
+        if ((ret = xhad_mutex_init(&lmvar.mutex, PTHREAD_MUTEX_NORMAL)) != 0)
+        {
+            log_internal(MTC_LOG_ERR, "LM: cannot initialize mutex. (%d)\n", ret);
+            ret = MTC_ERROR_LM_PTHREAD;
+            goto error;
+        }
+        lmvar.sf_access = FALSE;
+        memset(&lmvar.lm, 0, sizeof(lmvar.lm));
+        lmvar.sf_version = 0;
+        lmvar.sf_snapshot = NULL;
         memset(&lmvar.sm, 0, sizeof(lmvar.sm));
 
         // open common objects
@@ -320,12 +352,12 @@ lm_open_objects()
         // open common objects
         if (*(objects[index].handle) == HA_COMMON_OBJECT_INVALID_HANDLE_VALUE)
         {
-            ret = com_open(objects[index].name, objects[index].handle);
+            ret = com_open_id(objects[index].id, objects[index].handle);
             if (ret)
             {
                 log_internal(MTC_LOG_ERR,
-                             "LM: cannot open COM object (name = %s). (%d)\n",
-                             objects[index].name, ret);
+                             "LM: cannot open COM object (id = %d). (%d)\n",
+                             objects[index].id, ret);
                 objects[index].handle = HA_COMMON_OBJECT_INVALID_HANDLE_VALUE;
                 return ret;
             }
@@ -340,8 +372,20 @@ lm_open_objects()
             if (ret)
             {
                 log_internal(MTC_LOG_ERR,
-                             "LM: cannot register callback to %s. (%d)\n",
-                             objects[index].name, ret);
+                             "LM: cannot register callback to COM object (id = %d). (%d)\n",
+                             objects[index].id, ret);
+                return ret;
+            }
+        }
+        if (objects[index].async_callback)
+        {
+            ret = com_register_async_callback(*(objects[index].handle),
+                                              objects[index].async_callback);
+            if (ret)
+            {
+                log_internal(MTC_LOG_ERR,
+                             "LM: cannot register callback to COM object (id = %d). (%d)\n",
+                             objects[index].id, ret);
                 return ret;
             }
         }
@@ -382,6 +426,10 @@ lm_cleanup_objects()
         {
             com_deregister_callback(*(objects[index].handle), objects[index].callback);
         }
+        if (objects[index].async_callback)
+        {
+            com_deregister_async_callback(*(objects[index].handle), objects[index].async_callback);
+        }
 
         if (*(objects[index].handle) != HA_COMMON_OBJECT_INVALID_HANDLE_VALUE)
         {
@@ -464,7 +512,9 @@ lm_request_lock(
 
     // Someone has locked?
     pthread_mutex_lock(&lmvar.mutex);
+    lm_acquire_sf();
     index = get_lock_node();
+    lm_release_sf();
     pthread_mutex_unlock(&lmvar.mutex);
 
     if (index == _my_index)
@@ -491,20 +541,24 @@ lm_request_lock(
 
     // wait until someone acquires the lock or the request is canceled
     pthread_mutex_lock(&lmvar.mutex);
+    lm_acquire_sf();
     while ((index = get_lock_node()) == INVALID_NODE)
     {
         // wait until state-file is updated or request status is changed
+        lm_release_sf();
         pthread_cond_wait(&lmvar.cond, &lmvar.mutex);
+        lm_acquire_sf();
 
         // check if the request is canceled or this node lost SF accessibility
-        if (!is_requesting(_my_index) || !lmvar.sf.SF_access)
+        if (!is_requesting(_my_index) || !lmvar.sf_access)
         {
             log_maskable_debug_message(LM_TRACE, 
                 "LM: lock request canceled, (my request, SF_access) = (%s, %s).\n",
-                (is_requesting(_my_index))? "T": "F", (lmvar.sf.SF_access)? "T": "F");
+                (is_requesting(_my_index))? "T": "F", (lmvar.sf_access)? "T": "F");
             break;
         }
     }
+    lm_release_sf();
     pthread_mutex_unlock(&lmvar.mutex);
 
     hb_SF_cancel_accelerate();
@@ -593,6 +647,7 @@ lock_mgr(
     MTC_S32         index;
 
     log_thread_id("LM");
+    xhad_set_thread_priority(XHA_PRIORITY_MIDDLE);
     while (TRUE)
     {
         // wait until state-file is updated or request status is changed
@@ -604,7 +659,7 @@ lock_mgr(
             break;
         }
 
-        if (!lmvar.sf.SF_access || !is_online(_my_index))
+        if (!lmvar.sf_access || !is_online(_my_index))
         {
             pthread_mutex_unlock(&lmvar.mutex);
             continue;
@@ -612,13 +667,14 @@ lock_mgr(
 
         pthread_mutex_unlock(&lmvar.mutex);
 
-        com_writer_lock(sf_object, (void **) &psf);
+        com_writer_lock_typed(SF, sf_object, &psf);
         pthread_mutex_lock(&lmvar.mutex);
+        lm_acquire_sf();
 
         // cancelling my grant flags when the request is canceled
         for (index = 0; _is_configured_host(index); index++)
         {
-            if (!lmvar.sf.lm[index].request || !is_online(index))
+            if (!lm_request_of(index) || !is_online(index))
             {
                 if (MTC_HOSTMAP_ISON(psf->lm[_my_index].grant, index))
                 {
@@ -626,7 +682,7 @@ lock_mgr(
                         "LM: the GRANT flag for host (%d) has turned to FALSE."
                         " (request, online) = (%s, %s), cancel detected.\n",
                         index,
-                        (lmvar.sf.lm[index].request)? "T": "F",
+                        (lm_request_of(index))? "T": "F",
                         (is_online(index))? "T": "F");
                 }
                 MTC_HOSTMAP_RESET(psf->lm[_my_index].grant, index);
@@ -664,7 +720,7 @@ lock_mgr(
         // granting to others
         for (index = 0; _is_configured_host(index); index++)
         {
-            if (lmvar.sf.lm[index].request && is_online(index))
+            if (lm_request_of(index) && is_online(index))
             {
                 if (!psf->lm[_my_index].request ||
                     is_equal_or_prior_to_this_node(index))
@@ -675,7 +731,7 @@ lock_mgr(
                             "LM: the GRANT flag for host (%d) has turned to TRUE,"
                             " (request, online) = (%s, %s), I am granting.\n",
                             index,
-                            (lmvar.sf.lm[index].request)? "T": "F",
+                            (lm_request_of(index))? "T": "F",
                             (is_online(index))? "T": "F");
                     }
 
@@ -687,7 +743,11 @@ lock_mgr(
         lmvar.first_cleanup_done = TRUE;
         pthread_cond_broadcast(&lmvar.cond);
 
-        lmvar.sf = *psf;
+        lmvar.sf_access = psf->SF_access;
+        lmvar.lm.request = psf->lm[_my_index].request;
+        MTC_HOSTMAP_COPY(lmvar.lm.grant, psf->lm[_my_index].grant);
+        lmvar.sf_version = com_writer_version(sf_object);
+        lm_release_sf();
         pthread_mutex_unlock(&lmvar.mutex);
         com_writer_unlock(sf_object);
         mssleep(100);
@@ -705,26 +765,36 @@ lock_mgr(
 //
 //  paramaters
 //   Handle: Object handle
-//   Buffer: State-File data
+//   Buffer: State-File data (snapshot)
+//   Version: version of the snapshot
 //
 //  return value
 //
 //  environment
-//   The State-File object must be locked as Writer.
+//   Called from the COM dispatcher thread.
 //
 
 MTC_STATIC void
 lm_sf_updated(
     HA_COMMON_OBJECT_HANDLE Handle,
-    void *Buffer)
+    void *Buffer,
+    MTC_U32 Version)
 {
     assert(Handle == sf_object);
 
-    // state-file is updated, then cache it, and
-    // broadcast to notify that state-file is updated
+    // state-file is updated, then cache the fields of this host, and
+    // broadcast to notify that state-file is updated.
+    // the cache may already be newer (updated by lock_mgr).
+    // the fields of the other hosts are taken from the SF snapshot.
 
     pthread_mutex_lock(&lmvar.mutex);
-    lmvar.sf = *((PCOM_DATA_SF) Buffer);
+    if ((MTC_S32) (Version - lmvar.sf_version) > 0)
+    {
+        lmvar.sf_access = ((PCOM_DATA_SF) Buffer)->SF_access;
+        lmvar.lm.request = ((PCOM_DATA_SF) Buffer)->lm[_my_index].request;
+        MTC_HOSTMAP_COPY(lmvar.lm.grant, ((PCOM_DATA_SF) Buffer)->lm[_my_index].grant);
+        lmvar.sf_version = Version;
+    }
     pthread_cond_broadcast(&lmvar.cond);
     pthread_mutex_unlock(&lmvar.mutex);
 
@@ -844,7 +914,7 @@ am_i_ready_to_request()
     {
         ret = ret &&
               (is_online(index)?
-                    !MTC_HOSTMAP_ISON(lmvar.sf.lm[index].grant, _my_index): TRUE);
+                    !lm_grant_of(index, _my_index): TRUE);
     }
 
     // make sure I don't grant the lock to lower priority node
@@ -852,7 +922,7 @@ am_i_ready_to_request()
     {
 		ret = ret &&
               ((!is_equal_or_prior_to_this_node(index) && is_online(index))?
-                    !MTC_HOSTMAP_ISON(lmvar.sf.lm[_my_index].grant, index): TRUE);
+                    !lm_grant_of(_my_index, index): TRUE);
     }
 
     return ret;
@@ -925,7 +995,7 @@ is_locked(
     {
 		ret = ret &&
               (is_online(index)?
-                    MTC_HOSTMAP_ISON(lmvar.sf.lm[index].grant, node_index): TRUE);
+                    lm_grant_of(index, node_index): TRUE);
     }
 
     return ret;
@@ -952,7 +1022,116 @@ MTC_STATIC MTC_BOOLEAN
 is_requesting(
     MTC_S32 node_index)
 {
-    return lmvar.pending_request || lmvar.sf.lm[node_index].request;
+    return lmvar.pending_request || lm_request_of(node_index);
+}
+
+
+// lm_acquire_sf
+//
+//  Acquire the latest State-File snapshot, which the lock manager data
+//  of the other hosts is taken from.
+//
+//
+//  paramaters
+//
+//  return value
+//
+//  environment
+//   lock_mgr_mutex must be locked before calling this function.
+//   The snapshot must be released by lm_release_sf before the mutex is
+//   released, since the SF thread cannot reuse the buffer until then.
+//
+
+MTC_STATIC void
+lm_acquire_sf()
+{
+    assert(lmvar.sf_snapshot == NULL);
+    lmvar.sf_snapshot = sf_snapshot_acquire();
+}
+
+
+// lm_release_sf
+//
+//  Release the State-File snapshot acquired by lm_acquire_sf.
+//
+//
+//  paramaters
+//
+//  return value
+//
+//  environment
+//   lock_mgr_mutex must be locked before calling this function
+//
+
+MTC_STATIC void
+lm_release_sf()
+{
+    sf_snapshot_release(lmvar.sf_snapshot);
+    lmvar.sf_snapshot = NULL;
+}
+
+
+// lm_request_of
+//
+//  This function returns the REQUEST flag of the specified host
+//  as written in the State-File (or by this host).
+//
+//
+//  paramaters
+//   node_index: specify host by node index
+//
+//  return value
+//   TRUE: the specified host has requested the lock
+//   FALSE: the specified host has not requested the lock
+//
+//  environment
+//   lock_mgr_mutex must be locked and the snapshot must be acquired
+//   before calling this function
+//
+
+MTC_STATIC MTC_BOOLEAN
+lm_request_of(
+    MTC_S32 node_index)
+{
+    if (node_index == _my_index)
+    {
+        return lmvar.lm.request;
+    }
+    return (lmvar.sf_snapshot != NULL)?
+                lmvar.sf_snapshot->decoded.lm[node_index].request: FALSE;
+}
+
+
+// lm_grant_of
+//
+//  This function returns TRUE if the specified host has granted
+//  the lock to the grantee.
+//
+//
+//  paramaters
+//   node_index: specify granting host by node index
+//   grantee_index: specify grantee host by node index
+//
+//  return value
+//   TRUE: the lock is granted
+//   FALSE: the lock is not granted
+//
+//  environment
+//   lock_mgr_mutex must be locked and the snapshot must be acquired
+//   before calling this function
+//
+
+MTC_STATIC MTC_BOOLEAN
+lm_grant_of(
+    MTC_S32 node_index,
+    MTC_S32 grantee_index)
+{
+    if (node_index == _my_index)
+    {
+        return MTC_HOSTMAP_ISON(lmvar.lm.grant, grantee_index);
+    }
+    return (lmvar.sf_snapshot != NULL)?
+                MTC_HOSTMAP_ISON(lmvar.sf_snapshot->decoded.lm[node_index].grant, grantee_index): FALSE;
 }
 
 
@@ -72,6 +72,7 @@ MTC_BOOLEAN privatelogflag = TRUE;
 
 static FILE                 *fpLogfile = NULL;
 static MTC_BOOLEAN          initialized = FALSE;
+static __thread char        *thread_name_self = NULL;
 
 
 /*
@@ -532,6 +533,7 @@ log_fsync()
 //  DESCRIPTION:
 //
 //      Log thread ID.
+//      The name is remembered for log_thread_name.
 //
 //  paramaters
 //
@@ -545,5 +547,30 @@ void
 log_thread_id(
     char *thread_name)
 {
+    thread_name_self = thread_name;
     log_message(MTC_LOG_INFO, "%s: Thread ID = %ld\n", thread_name, syscall(SYS_gettid));
 }
+
+//
+//
+//  NAME:
+//
+//      log_thread_name
+//
+//  DESCRIPTION:
+//
+//      Get the name of the calling thread.
+//
+//  paramaters
+//
+//      none
+//
+//  return value
+//
+//      Thread name given to log_thread_id, or NULL if not given.
+//
+char *
+log_thread_name()
+{
+    return thread_name_self;
+}
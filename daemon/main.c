@@ -688,6 +688,44 @@ main_reset_scheduler(void)
     status = sched_setscheduler(getpid() , sched_policy_save, &sparam_save);
 }
 
+//
+//  xhad_set_thread_priority
+//
+//  Set the priority of the calling thread (XHA_PRIORITY_*).
+//  The priority is remembered for xhad_thread_priority.
+//
+
+static __thread int thread_priority = 0;
+
+void
+xhad_set_thread_priority(
+    int priority)
+{
+    int ret;
+
+    ret = pthread_setschedprio(pthread_self(), priority);
+    if (ret != 0)
+    {
+        log_message(MTC_LOG_WARNING, "HA daemon set thread priority %d failed (sys %d)\n", 
+                    priority, ret);
+        return;
+    }
+    thread_priority = priority;
+}
+
+//
+//  xhad_thread_priority
+//
+//  Returns the priority set by xhad_set_thread_priority,
+//  or 0 if it has not been set.
+//
+
+int
+xhad_thread_priority(void)
+{
+    return thread_priority;
+}
+
 //
 //  main_log_timeouts
 //
@@ -93,8 +93,8 @@ get_hoststate(
     // fill from sm
     //
     
-    com_open(COM_ID_SM, &h_sm);
-    com_reader_lock(h_sm, (void *)&sm);
+    com_open_typed(SM, &h_sm);
+    com_reader_lock_typed(SM, h_sm, &sm);
     if (sm == NULL) 
     {
         log_internal(MTC_LOG_WARNING, "SC: (%s) sm data is NULL.\n", __func__);
@@ -156,15 +156,19 @@ script_service_do_query_liveset(
 
     HA_COMMON_OBJECT_HANDLE h_sm = NULL;
     COM_DATA_SM *sm = NULL;
+    HA_COMMON_OBJECT_SNAPSHOT sm_shared = {NULL, NULL, sizeof(COM_DATA_SM)};
 
     HA_COMMON_OBJECT_HANDLE h_hb = NULL;
     COM_DATA_HB *hb = NULL;
+    HA_COMMON_OBJECT_SNAPSHOT hb_shared = {NULL, NULL, sizeof(COM_DATA_HB)};
     
     HA_COMMON_OBJECT_HANDLE h_sf = NULL;
     COM_DATA_SF *sf = NULL;
+    HA_COMMON_OBJECT_SNAPSHOT sf_shared = {NULL, NULL, sizeof(COM_DATA_SF)};
     
     HA_COMMON_OBJECT_HANDLE h_xapimon = NULL;
     COM_DATA_XAPIMON *xapimon = NULL;
+    HA_COMMON_OBJECT_SNAPSHOT xapimon_shared = {NULL, NULL, sizeof(COM_DATA_XAPIMON)};
     
     HA_COMMON_OBJECT_HANDLE h_bm = NULL;
     COM_DATA_BM *bm = NULL;
@@ -213,8 +217,20 @@ script_service_do_query_liveset(
     // fill from sm
     //
     
-    com_open(COM_ID_SM, &h_sm);
-    com_reader_lock(h_sm, (void *)&sm);
+    //  The objects are read from shared snapshots (copied only when
+    //  updated since the last snapshot, and not on the stack of the
+    //  script service thread), so that the writers
+    //  (heartbeat, State-File and xapi monitor threads) are not blocked
+    //  while the response is composed. Only taking and resetting
+    //  the latency is done under the writer lock.
+    //
+
+    com_open_typed(SM, &h_sm);
+    sm_shared.object_handle = h_sm;
+    if (com_snapshot_share_many(&sm_shared, 1) == MTC_SUCCESS)
+    {
+        sm = sm_shared.copy;
+    }
     if (sm == NULL) 
     {
         log_internal(MTC_LOG_WARNING, "SC: (%s) sm data is NULL.\n", __func__);
@@ -242,7 +258,7 @@ script_service_do_query_liveset(
         sf_approaching_timeout_reported = sm->sf_approaching_timeout;
         xapi_approaching_timeout_reported = sm->xapi_approaching_timeout;
     }
-    com_reader_unlock(h_sm);
+    com_snapshot_release(sm_shared.copy);
     com_close(h_sm);
 
     //
@@ -250,15 +266,9 @@ script_service_do_query_liveset(
     // rewrite latency, latency_max, latency_min
     //
     
-    com_open(COM_ID_HB, &h_hb);
-    com_writer_lock(h_hb, (void *)&hb);
-    if (hb == NULL) 
-    {
-        log_internal(MTC_LOG_WARNING, "SC: (%s) hb data is NULL.\n", __func__);
-        assert(FALSE);
-        l->status = LIVESET_STATUS_STARTING;
-    }
-    else 
+    com_open_typed(HB, &h_hb);
+    com_writer_lock_typed(HB, h_hb, &hb);
+    if (hb != NULL)
     {
         l->hb_latency = hb->latency;
         l->hb_latency_max = hb->latency_max;
@@ -270,6 +280,18 @@ script_service_do_query_liveset(
             hb->latency_max = -1;
             hb->latency_min = -1;
         }
+    }
+    com_writer_unlock(h_hb);
+    hb_shared.object_handle = h_hb;
+    hb = (hb != NULL && com_snapshot_share_many(&hb_shared, 1) == MTC_SUCCESS)? hb_shared.copy: NULL;
+    if (hb == NULL) 
+    {
+        log_internal(MTC_LOG_WARNING, "SC: (%s) hb data is NULL.\n", __func__);
+        assert(FALSE);
+        l->status = LIVESET_STATUS_STARTING;
+    }
+    else 
+    {
 
         // check approaching timeout
 
@@ -306,9 +328,9 @@ script_service_do_query_liveset(
                     for (hi = 0; hi < _num_host; hi++)
                     {
                         l->host[host_index].hb_list_on_hb[hi] = 
-                            MTC_HOSTMAP_ISON(hb->raw[host_index].hbdomain, hi)?TRUE:FALSE;
+                            MTC_HOSTMAP_ISON(hb->raw.hbdomain[host_index], hi)?TRUE:FALSE;
                         l->host[host_index].sf_list_on_hb[hi] = 
-                            MTC_HOSTMAP_ISON(hb->raw[host_index].sfdomain, hi)?TRUE:FALSE;
+                            MTC_HOSTMAP_ISON(hb->raw.sfdomain[host_index], hi)?TRUE:FALSE;
                     }
                 }
 
@@ -330,9 +352,9 @@ script_service_do_query_liveset(
             // time since last HB received from the host + time_since_xapi_restart (recorded on HB packet)
 
             l->host[host_index].time_since_xapi_restart 
-                = (hb->raw[host_index].time_since_xapi_restart < 0)
+                = (hb->raw.time_since_xapi_restart[host_index] < 0)
                 ? -1
-                : l->host[host_index].time_since_last_hb + hb->raw[host_index].time_since_xapi_restart;
+                : l->host[host_index].time_since_last_hb + hb->raw.time_since_xapi_restart[host_index];
 
             // xapi error string
             strncpy(l->host[host_index].xapi_err_string, hb->err_string[host_index], sizeof(hb->err_string[host_index]));
@@ -348,7 +370,7 @@ script_service_do_query_liveset(
         }
 
     }
-    com_writer_unlock(h_hb);
+    com_snapshot_release(hb_shared.copy);
     com_close(h_hb);
 
     //
@@ -356,15 +378,9 @@ script_service_do_query_liveset(
     // rewrite latency, latency_max, latency_min
     //
     
-    com_open(COM_ID_SF, &h_sf);
-    com_writer_lock(h_sf, (void *)&sf);
-    if (sf == NULL) 
-    {
-        log_internal(MTC_LOG_WARNING, "SC: (%s) sf data is NULL.\n", __func__);
-        assert(FALSE);
-        l->status = LIVESET_STATUS_STARTING;
-    }
-    else 
+    com_open_typed(SF, &h_sf);
+    com_writer_lock_typed(SF, h_sf, &sf);
+    if (sf != NULL)
     {
         l->sf_latency = sf->latency;
         l->sf_latency_max = sf->latency_max;
@@ -376,6 +392,19 @@ script_service_do_query_liveset(
             sf->latency_min = -1;
             sf->latency_max = -1;
         }
+    }
+    com_writer_unlock(h_sf);
+    sf_shared.object_handle = h_sf;
+    sf = (sf != NULL && com_snapshot_share_many(&sf_shared, 1) == MTC_SUCCESS)? sf_shared.copy: NULL;
+    if (sf == NULL) 
+    {
+        log_internal(MTC_LOG_WARNING, "SC: (%s) sf data is NULL.\n", __func__);
+        assert(FALSE);
+        l->status = LIVESET_STATUS_STARTING;
+    }
+    else 
+    {
+        memcpy(l->sf_latency_summary, sf->latency_summary, sizeof(l->sf_latency_summary));
 
         // check approaching timeout
         // not report approaching timeout if sf_lost is TRUE
@@ -453,9 +482,9 @@ script_service_do_query_liveset(
                     {
                         if (MTC_HOSTMAP_ISON(sf->sfdomain, host_index)) {
                             l->host[host_index].hb_list_on_sf[hi] = 
-                                MTC_HOSTMAP_ISON(sf->raw[host_index].hbdomain, hi)?TRUE:FALSE;
+                                MTC_HOSTMAP_ISON(sf->raw.hbdomain[host_index], hi)?TRUE:FALSE;
                             l->host[host_index].sf_list_on_sf[hi] = 
-                                MTC_HOSTMAP_ISON(sf->raw[host_index].sfdomain, hi)?TRUE:FALSE;
+                                MTC_HOSTMAP_ISON(sf->raw.sfdomain[host_index], hi)?TRUE:FALSE;
                         }
                         else {
 
@@ -499,7 +528,7 @@ script_service_do_query_liveset(
 
         // l->sf_lost = (sf->SF_access)?FALSE:TRUE;
     }
-    com_writer_unlock(h_sf);
+    com_snapshot_release(sf_shared.copy);
     com_close(h_sf);
 
     //
@@ -507,17 +536,9 @@ script_service_do_query_liveset(
     // rewrite latency, latency_max, latency_min
     //
     
-    com_open(COM_ID_XAPIMON, &h_xapimon);
-    com_writer_lock(h_xapimon, (void *)&xapimon);
-    if (xapimon == NULL) 
-    {
-        log_internal(MTC_LOG_WARNING, "SC: (%s) xapimon data is NULL.\n", __func__);
-        assert(FALSE);
-        l->xapi_latency = -1;
-        l->xapi_latency_max = -1;
-        l->xapi_latency_min = -1;
-    }
-    else 
+    com_open_typed(XAPIMON, &h_xapimon);
+    com_writer_lock_typed(XAPIMON, h_xapimon, &xapimon);
+    if (xapimon != NULL)
     {
         l->xapi_latency = xapimon->latency;
         l->xapi_latency_max = xapimon->latency_max;
@@ -529,6 +550,20 @@ script_service_do_query_liveset(
             xapimon->latency_max = -1;
             xapimon->latency_min = -1;
         }
+    }
+    com_writer_unlock(h_xapimon);
+    xapimon_shared.object_handle = h_xapimon;
+    xapimon = (xapimon != NULL && com_snapshot_share_many(&xapimon_shared, 1) == MTC_SUCCESS)? xapimon_shared.copy: NULL;
+    if (xapimon == NULL) 
+    {
+        log_internal(MTC_LOG_WARNING, "SC: (%s) xapimon data is NULL.\n", __func__);
+        assert(FALSE);
+        l->xapi_latency = -1;
+        l->xapi_latency_max = -1;
+        l->xapi_latency_min = -1;
+    }
+    else 
+    {
 
         // xapi error string for my index
         strncpy(l->host[_my_index].xapi_err_string, xapimon->err_string, sizeof(xapimon->err_string));
@@ -566,15 +601,15 @@ script_service_do_query_liveset(
                 now - xapimon->time_Xapi_restart;        
         }
     }
-    com_writer_unlock(h_xapimon);
+    com_snapshot_release(xapimon_shared.copy);
     com_close(h_xapimon);
 
     //
     // fill from bond_mon
     //
     
-    com_open(COM_ID_BM, &h_bm);
-    com_reader_lock(h_bm, (void *)&bm);
+    com_open_typed(BM, &h_bm);
+    com_reader_lock_typed(BM, h_bm, &bm);
     if (bm == NULL) 
     {
         log_internal(MTC_LOG_WARNING, "SC: (%s) bm data is NULL.\n", __func__);
@@ -600,8 +635,8 @@ script_service_do_query_liveset(
     // write back warning (hb/sf/xapi approaching timeout) to SM
     //
     
-    com_open(COM_ID_SM, &h_sm);
-    com_writer_lock(h_sm, (void *)&sm);
+    com_open_typed(SM, &h_sm);
+    com_writer_lock_typed(SM, h_sm, &sm);
     if (sm == NULL) 
     {
         log_internal(MTC_LOG_WARNING, "SC: (%s) sm data is NULL.\n", __func__);
@@ -859,15 +894,15 @@ script_service_do_disarm_fencing(
     // open objects
     //
 
-    com_open(COM_ID_SM, &h_sm);
-    com_open(COM_ID_HB, &h_hb);
-    com_open(COM_ID_SF, &h_sf);
+    com_open_typed(SM, &h_sm);
+    com_open_typed(HB, &h_hb);
+    com_open_typed(SF, &h_sf);
 
     //
     // set fencing FENCING_DISARM_REQUESTED to SM
     //
 
-    com_writer_lock(h_sm, (void *)&sm);
+    com_writer_lock_typed(SM, h_sm, &sm);
     if (sm == NULL) 
     {
         log_internal(MTC_LOG_WARNING, "SC: (%s) sm data is NULL.\n", __func__);
@@ -890,7 +925,7 @@ script_service_do_disarm_fencing(
     // set fencing FENCING_DISARM_REQUESTED to HB
     //
     
-    com_writer_lock(h_hb, (void *)&hb);
+    com_writer_lock_typed(HB, h_hb, &hb);
     if (hb == NULL) 
     {
         log_internal(MTC_LOG_WARNING, "SC: (%s) hb data is NULL.\n", __func__);
@@ -913,7 +948,7 @@ script_service_do_disarm_fencing(
     // set fencing FENCING_DISARM_REQUESTED to SF
     //
     
-    com_writer_lock(h_sf, (void *)&sf);
+    com_writer_lock_typed(SF, h_sf, &sf);
     if (sf == NULL) 
     {
         log_internal(MTC_LOG_WARNING, "SC: (%s) sf data is NULL.\n", __func__);
@@ -939,7 +974,7 @@ script_service_do_disarm_fencing(
     fencing = FENCING_NONE;
     while (TRUE)
     {
-        com_reader_lock(h_sm, (void *)&sm);
+        com_reader_lock_typed(SM, h_sm, &sm);
         if (sm == NULL) 
         {
             log_internal(MTC_LOG_WARNING, "SC: (%s) sm data is NULL.\n", __func__);
@@ -965,7 +1000,7 @@ script_service_do_disarm_fencing(
     fencing = FENCING_NONE;
     while (TRUE)
     {
-        com_reader_lock(h_hb, (void *)&hb);
+        com_reader_lock_typed(HB, h_hb, &hb);
         if (hb == NULL) 
         {
             log_internal(MTC_LOG_WARNING, "SC: (%s) hb data is NULL.\n", __func__);
@@ -991,7 +1026,7 @@ script_service_do_disarm_fencing(
     fencing = FENCING_NONE;
     while (TRUE)
     {
-        com_reader_lock(h_sf, (void *)&sf);
+        com_reader_lock_typed(SF, h_sf, &sf);
         if (sf == NULL) 
         {
             log_internal(MTC_LOG_WARNING, "SC: (%s) sf data is NULL.\n", __func__);
@@ -1124,8 +1159,8 @@ script_service_do_set_pool_state(
     // check statefile access
     //
 
-    com_open(COM_ID_SF, &h_sf);
-    com_reader_lock(h_sf, (void *)&sf);
+    com_open_typed(SF, &h_sf);
+    com_reader_lock_typed(SF, h_sf, &sf);
     if (sf == NULL) 
     {
         log_message(MTC_LOG_WARNING, "SC: (%s) sf data is NULL.\n", __func__);
@@ -1157,7 +1192,7 @@ script_service_do_set_pool_state(
     //
 
     do {
-        com_reader_lock(h_sf, (void *)&sf);
+        com_reader_lock_typed(SF, h_sf, &sf);
         if (sf == NULL) 
         {
             log_message(MTC_LOG_WARNING, "SC: (%s) sf data is NULL.\n", __func__);
@@ -1241,8 +1276,8 @@ do_set_clear_excluded_sub(
     // check statefile access
     //
 
-    com_open(COM_ID_SF, &h_sf);
-    com_reader_lock(h_sf, (void *)&sf);
+    com_open_typed(SF, &h_sf);
+    com_reader_lock_typed(SF, h_sf, &sf);
     if (sf == NULL) 
     {
         log_message(MTC_LOG_WARNING, "SC: (%s) sf data is NULL.\n", __func__);
@@ -1281,7 +1316,7 @@ do_set_clear_excluded_sub(
     //
 
     do {
-        com_reader_lock(h_sf, (void *)&sf);
+        com_reader_lock_typed(SF, h_sf, &sf);
         if (sf == NULL) 
         {
             log_message(MTC_LOG_WARNING, "SC: (%s) sf data is NULL.\n", __func__);
@@ -1866,6 +1901,7 @@ script_service_do_dumpcom(
     r = (SCRIPT_DATA_RESPONSE_RETVAL_ONLY*) res_body;
 
     r->retval = com_log_all_objects(d->dumpflag);
+    sf_log_latency();
 
     log_maskable_debug_message(SCRIPT, "SC: leave %s.\n", __func__);
     return MTC_SUCCESS;
@@ -2071,6 +2107,177 @@ script_service_do_reload_host_weight(
     return MTC_SUCCESS;
 }
 
+//
+//
+//  NAME:
+//
+//      script_service_do_comprofile();
+//
+//  DESCRIPTION:
+//
+//      script service for the COM lock profile
+//
+//  FORMAL PARAMETERS:
+//
+//      req_len - length of request buffer (IN)
+//      req_body - body of request buffer  (IN)
+//      res_len - length of response buffer (IN/OUT)
+//      res_body - body of response buffer  (OUT)
+//          
+//  RETURN VALUE:
+//
+//      0 - success
+//      not 0 - fail
+//
+//  ENVIRONMENT:
+//
+//      dom0
+//
+//
+
+MTC_STATUS
+script_service_do_comprofile(
+    MTC_U32 req_len,
+    void *req_body,
+    MTC_U32 *res_len,
+    void *res_body)
+{
+    SCRIPT_DATA_RESPONSE_COMPROFILE *p;
+
+    log_maskable_debug_message(SCRIPT, "SC: enter %s.\n", __func__);
+    if (*res_len < sizeof(SCRIPT_DATA_RESPONSE_COMPROFILE)) 
+    {
+        log_message(MTC_LOG_WARNING, "SC: (%s) res_len is too small.\n", __func__);
+        assert(FALSE);
+        return MTC_ERROR_SC_INSUFFICIENT_RESOURCE;
+    }
+    *res_len = sizeof(SCRIPT_DATA_RESPONSE_COMPROFILE);
+    memset(res_body, 0, *res_len);
+    p = (SCRIPT_DATA_RESPONSE_COMPROFILE*) res_body;
+
+    p->objectnum = com_get_profile(p->object, COM_PROFILE_OBJECT_MAX);
+
+    log_maskable_debug_message(SCRIPT, "SC: leave %s.\n", __func__);
+    return MTC_SUCCESS;
+}
+
+//
+//
+//  NAME:
+//
+//      script_service_do_fhtrace();
+//
+//  DESCRIPTION:
+//
+//      script service for the fault handler trace
+//
+//  FORMAL PARAMETERS:
+//
+//      req_len - length of request buffer (IN)
+//      req_body - body of request buffer  (IN)
+//      res_len - length of response buffer (IN/OUT)
+//      res_body - body of response buffer  (OUT)
+//          
+//  RETURN VALUE:
+//
+//      0 - success
+//      not 0 - fail
+//
+//  ENVIRONMENT:
+//
+//      dom0
+//
+//
+
+MTC_STATUS
+script_service_do_fhtrace(
+    MTC_U32 req_len,
+    void *req_body,
+    MTC_U32 *res_len,
+    void *res_body)
+{
+    SCRIPT_DATA_RESPONSE_FHTRACE *p;
+
+    log_maskable_debug_message(SCRIPT, "SC: enter %s.\n", __func__);
+    if (*res_len < sizeof(SCRIPT_DATA_RESPONSE_FHTRACE)) 
+    {
+        log_message(MTC_LOG_WARNING, "SC: (%s) res_len is too small.\n", __func__);
+        assert(FALSE);
+        return MTC_ERROR_SC_INSUFFICIENT_RESOURCE;
+    }
+    *res_len = sizeof(SCRIPT_DATA_RESPONSE_FHTRACE);
+    memset(res_body, 0, *res_len);
+    p = (SCRIPT_DATA_RESPONSE_FHTRACE*) res_body;
+
+    p->tracenum = sm_get_fh_trace(p->trace, SM_FH_TRACE_MAX);
+
+    log_maskable_debug_message(SCRIPT, "SC: leave %s.\n", __func__);
+    return MTC_SUCCESS;
+}
+
+//
+//
+//  NAME:
+//
+//      script_service_do_attest_fenced();
+//
+//  DESCRIPTION:
+//
+//      script service for a fencing agent to attest that a host is down
+//
+//  FORMAL PARAMETERS:
+//
+//      req_len - length of request buffer (IN)
+//      req_body - body of request buffer  (IN)
+//      res_len - length of response buffer (IN/OUT)
+//      res_body - body of response buffer  (OUT)
+//          
+//  RETURN VALUE:
+//
+//      0 - success
+//      not 0 - fail
+//
+//  ENVIRONMENT:
+//
+//      dom0
+//
+//
+
+MTC_STATUS
+script_service_do_attest_fenced(
+    MTC_U32 req_len,
+    void *req_body,
+    MTC_U32 *res_len,
+    void *res_body)
+{
+    SCRIPT_DATA_REQUEST_ATTEST_FENCED *f;
+    SCRIPT_DATA_RESPONSE_RETVAL_ONLY *r;
+
+    log_maskable_debug_message(SCRIPT, "SC: enter %s.\n", __func__);
+    if (req_len < sizeof(SCRIPT_DATA_REQUEST_ATTEST_FENCED)) 
+    {
+        log_message(MTC_LOG_WARNING, "SC: (%s) req_len is too small.\n", __func__);
+        assert(FALSE);
+        return MTC_ERROR_SC_INSUFFICIENT_RESOURCE;
+    }
+    f = (SCRIPT_DATA_REQUEST_ATTEST_FENCED *)req_body;
+    if (*res_len < sizeof(SCRIPT_DATA_RESPONSE_RETVAL_ONLY)) 
+    {
+        log_message(MTC_LOG_WARNING, "SC: (%s) res_len is too small.\n", __func__);
+        assert(FALSE);
+        return MTC_ERROR_SC_INSUFFICIENT_RESOURCE;
+    }
+    *res_len = sizeof(SCRIPT_DATA_RESPONSE_RETVAL_ONLY);
+    memset(res_body, 0, *res_len);
+    r = (SCRIPT_DATA_RESPONSE_RETVAL_ONLY*) res_body;
+
+    r->retval = sm_attest_fenced(f->host_index);
+
+    log_message(MTC_LOG_INFO, "SC: host (%d) is attested as fenced, returns %d.\n", f->host_index, r->retval);
+    log_maskable_debug_message(SCRIPT, "SC: leave %s.\n", __func__);
+    return MTC_SUCCESS;
+}
+
 //
 //
 //  NAME:
@@ -51,6 +51,7 @@
 #include "mtcerrno.h"
 #include "log.h"
 #include "config.h"
+#include "xha.h"
 #include "script.h"
 #include "fist.h"
 
@@ -79,6 +80,12 @@ typedef struct script_service_thread_param
     int socket;
     int funcnum;
     SCRIPT_SERVICE_FUNC func[SCRIPT_TYPE_NUM];
+
+    //  message buffers of the thread, too large for its stack
+    //  with a large MAX_HOST_NUM
+
+    SCRIPT_DATA_REQUEST request;
+    SCRIPT_DATA_RESPONSE response;
 }   SCRIPT_SERVICE_THREAD_PARAM;
 
 
@@ -290,8 +297,8 @@ script_service_thread(
 
     char thread_name[THREAD_NAME_LEN];
     MTC_BOOLEAN         term = FALSE;
-    SCRIPT_DATA_REQUEST  request;
-    SCRIPT_DATA_RESPONSE response;
+    SCRIPT_DATA_REQUEST  *request;
+    SCRIPT_DATA_RESPONSE *response;
     MTC_U32 service_func_num;
     SCRIPT_SERVICE_FUNC *service_func;
 
@@ -304,8 +311,11 @@ script_service_thread(
     strcpy(thread_name, ((SCRIPT_SERVICE_THREAD_PARAM *) param)->thread_name);
     service_func_num = ((SCRIPT_SERVICE_THREAD_PARAM *) param)->funcnum;
     service_func = ((SCRIPT_SERVICE_THREAD_PARAM *) param)->func;
+    request = &((SCRIPT_SERVICE_THREAD_PARAM *) param)->request;
+    response = &((SCRIPT_SERVICE_THREAD_PARAM *) param)->response;
 
     log_thread_id("SC");
+    xhad_set_thread_priority(XHA_PRIORITY_CLIENT);
     do
     {
         fd_set fds;
@@ -318,8 +328,8 @@ script_service_thread(
         // wait new connection
         //
 
-        memset((void *)&request, 0, sizeof(request));
-        memset((void *)&response, 0, sizeof(response));
+        memset((void *)request, 0, sizeof(*request));
+        memset((void *)response, 0, sizeof(*response));
 
         FD_ZERO(&fds);
 
@@ -366,9 +376,9 @@ script_service_thread(
         // read request head
         //
 
-        size = sizeof(request.head);
+        size = sizeof(request->head);
         read_num = 0;
-        bufptr = (char *)&request;
+        bufptr = (char *)request;
 
         while (size - read_num > 0) 
         {
@@ -414,7 +424,7 @@ script_service_thread(
         // check head
         //
 
-        if (check_head_valid(&request.head) != MTC_SUCCESS) 
+        if (check_head_valid(&request->head) != MTC_SUCCESS) 
         {
                 
             // invalid head
@@ -433,9 +443,9 @@ script_service_thread(
         // read request body
         //
 
-        size = request.head.length;
+        size = request->head.length;
         read_num = 0;
-        bufptr = (char *)&request.body;
+        bufptr = (char *)&request->body;
 
         while (size - read_num > 0) 
         {
@@ -481,12 +491,12 @@ script_service_thread(
         // call script service function;
         //
             
-        response.head.magic = SCRIPT_MAGIC;
-        response.head.response = 1;
-        response.head.type = request.head.type;
-        response.head.length = sizeof(response.body);
+        response->head.magic = SCRIPT_MAGIC;
+        response->head.response = 1;
+        response->head.type = request->head.type;
+        response->head.length = sizeof(response->body);
 
-        if (request.head.type > service_func_num || service_func[request.head.type] == NULL) 
+        if (request->head.type > service_func_num || service_func[request->head.type] == NULL) 
         {
             // invalid type
             if (reported == FALSE)
@@ -494,22 +504,22 @@ script_service_thread(
                 log_message(MTC_LOG_ERR, "Script service received an invalid message.\n");
                 reported = TRUE;
             }
-            log_message(MTC_LOG_WARNING, "SC: invalid type(%d) in head (thread:%s).\n", request.head.type, thread_name);
+            log_message(MTC_LOG_WARNING, "SC: invalid type(%d) in head (thread:%s).\n", request->head.type, thread_name);
 
             close (message_socket);
             goto continue_loop;
         }
 
-        ret = service_func[request.head.type](request.head.length,
-                                              (void *) &request.body,
-                                              &(response.head.length),
-                                              (void *) &response.body);
+        ret = service_func[request->head.type](request->head.length,
+                                              (void *) &request->body,
+                                              &(response->head.length),
+                                              (void *) &response->body);
         if (ret != MTC_SUCCESS) 
         {
             // service func failed
             // internal error
 
-            log_internal(MTC_LOG_ERR, "SC: service func for type %d failed (thread:%s) status=%d.\n", request.head.type, thread_name, ret);
+            log_internal(MTC_LOG_ERR, "SC: service func for type %d failed (thread:%s) status=%d.\n", request->head.type, thread_name, ret);
             
             close (message_socket);
             goto continue_loop;
@@ -519,9 +529,9 @@ script_service_thread(
         // write response
         //
 
-        size = sizeof(response.head) + response.head.length;
+        size = sizeof(response->head) + response->head.length;
         write_num = 0;
-        bufptr = (char *)&response;
+        bufptr = (char *)response;
 
         while (size - write_num > 0) 
         {
@@ -568,9 +578,9 @@ script_service_thread(
 
         // check set_excluded
 
-        script_service_check_after_set_excluded(request.head.type,
-                                                response.head.length,
-                                                (void *) &response.body);
+        script_service_check_after_set_excluded(request->head.type,
+                                                response->head.length,
+                                                (void *) &response->body);
 
     continue_loop:
 
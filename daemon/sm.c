@@ -43,6 +43,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <errno.h>
 
 
 
@@ -83,12 +84,14 @@
 MTC_STATIC void
 sm_hb_updated(
     HA_COMMON_OBJECT_HANDLE handle,
-    void *buffer);
+    void *buffer,
+    MTC_U32 version);
 
 MTC_STATIC void
 sm_sf_updated(
     HA_COMMON_OBJECT_HANDLE handle,
-    void *buffer);
+    void *buffer,
+    MTC_U32 version);
 
 MTC_STATIC void
 sm_xapimon_updated(
@@ -115,17 +118,62 @@ static HA_COMMON_OBJECT_HANDLE
 
 static struct {
     HA_COMMON_OBJECT_HANDLE     *handle;
-    PMTC_S8                     name;
+    COM_OBJECT_ID               id;
     HA_COMMON_OBJECT_CALLBACK   callback;
+    HA_COMMON_OBJECT_ASYNC_CALLBACK async_callback;
 } objects[] =
 {
-    {&hb_object,        COM_ID_HB,      sm_hb_updated},
-    {&sf_object,        COM_ID_SF,      sm_sf_updated},
-    {&xapimon_object,   COM_ID_XAPIMON, sm_xapimon_updated},
-    {&sm_object,        COM_ID_SM,      sm_sm_updated},
-    {NULL,              NULL,           NULL}
+    {&hb_object,        COM_OBJECT_HB,      NULL,               sm_hb_updated},
+    {&sf_object,        COM_OBJECT_SF,      NULL,               sm_sf_updated},
+    {&xapimon_object,   COM_OBJECT_XAPIMON, sm_xapimon_updated, NULL},
+    {&sm_object,        COM_OBJECT_SM,      sm_sm_updated,      NULL},
+    {NULL,              COM_OBJECT_NUM,     NULL,               NULL}
 };
 
+//
+//  The parts of the HB object sm_worker looks at. HB updates which
+//  do not change them do not wake up sm_worker.
+//
+
+typedef struct _SM_WORKER_HB_VIEW {
+    MTC_HOSTMAP         hbdomain;
+    MTC_HOSTMAP         current_liveset[MAX_HOST_NUM];
+    MTC_HOSTMAP         proposed_liveset[MAX_HOST_NUM];
+    MTC_HOSTMAP         sfdomain[MAX_HOST_NUM];
+} SM_WORKER_HB_VIEW;
+
+//
+//  Consistent view digests
+//
+//  The domains the consistent view check compares, packed into 64 bit
+//  words. They are updated as the HB, SF and SM objects are updated,
+//  together with the number of the hosts in the liveset which do not
+//  agree with the local host, so that the fault handler scans the views
+//  only once all the hosts agree.
+//
+
+typedef MTC_U64 SM_HOSTMAP_DIGEST[MTC_HOSTMAP_WORD_NUM];
+
+typedef struct _SM_VIEW_DIGEST {
+    SM_HOSTMAP_DIGEST   liveset;                    // current liveset
+    SM_HOSTMAP_DIGEST   hbdomain;                   // local view
+    SM_HOSTMAP_DIGEST   sfdomain;
+    SM_HOSTMAP_DIGEST   hb_hbdomain[MAX_HOST_NUM];  // as reported on HB
+    SM_HOSTMAP_DIGEST   hb_sfdomain[MAX_HOST_NUM];
+    SM_HOSTMAP_DIGEST   sf_hbdomain[MAX_HOST_NUM];  // as reported on SF
+    SM_HOSTMAP_DIGEST   sf_sfdomain[MAX_HOST_NUM];
+    MTC_BOOLEAN         disagree[MAX_HOST_NUM];
+    MTC_U32             disagree_num;
+} SM_VIEW_DIGEST;
+
+typedef struct _SM_WORKER_STATS {
+    MTC_CLOCK           since;
+    MTC_U32             event_wakeups;
+    MTC_U32             timer_wakeups;
+    MTC_CLOCK           latency_sum;        // from the signal to the wakeup
+    MTC_CLOCK           latency_max;
+} SM_WORKER_STATS;
+
 //
 //  Internal data for this module
 //
@@ -147,8 +195,23 @@ static struct {
     MTC_BOOLEAN         hb_sig;
     MTC_BOOLEAN         sf_sig;
     MTC_BOOLEAN         fh_sleep_extend;
-    COM_DATA_HB         stable_hb;
-    COM_DATA_SF         stable_sf;
+    PCOM_DATA_HB        stable_hb;          // shared, read-only (see com_snapshot_share_many)
+    PCOM_DATA_SF        stable_sf;
+    MTC_CLOCK           fh_last_seen;       // for the next fault handler trace
+    MTC_CLOCK           fh_triggered;
+    MTC_U32             fh_episode;         // number of traced episodes
+    SM_FH_TRACE         fh_trace[SM_FH_TRACE_MAX];
+    MTC_CLOCK           fence_attested[MAX_HOST_NUM];
+                                            // when each host was attested as down
+                                            // by a fencing agent (-1 if never)
+    MTC_BOOLEAN         early_quorum;       // liveset formed by the early quorum
+    pthread_t           worker_thread;
+    pthread_cond_t      worker_cond;        // sm_worker waits on it with mutex
+    MTC_BOOLEAN         worker_sig;
+    MTC_CLOCK           worker_signaled;    // when worker_sig was set
+    SM_WORKER_HB_VIEW   worker_hb_view;     // for the COM dispatcher thread only
+    SM_VIEW_DIGEST      view_digest;        // protected by mutex
+    SM_WORKER_STATS     worker_stats;
 } smvar = {
     .terminate = FALSE,
     .start_time = -1,
@@ -164,6 +227,14 @@ static struct {
     .hb_sig = FALSE,
     .sf_sig = FALSE,
     .fh_sleep_extend = FALSE,
+    .fh_last_seen = -1,
+    .fh_triggered = -1,
+    .fh_episode = 0,
+    .early_quorum = FALSE,
+    .worker_thread = 0,
+    .worker_cond = PTHREAD_COND_INITIALIZER,
+    .worker_sig = FALSE,
+    .worker_signaled = -1,
 };
 
 
@@ -175,10 +246,6 @@ static struct {
 }
 
 
-#define APPROACHING_TIMEOUT_FACTOR          (25)    // [%] of T1 or T2
-
-#define FH_MINIMUM_SLEEP_BEFORE_FO          (10)
-
 #define SYNCHRONIZED_BOOT_TIMEOUT_EXTENDER  (_max(_t1, _t2) * 3)
 
 #define START_FLAGS_INIT                    (1)
@@ -191,7 +258,15 @@ static struct {
 #define HB_ACCELERATION_COUNT_JOIN          (3)
 #define HB_ACCELERATION_COUNT_RENDEZVOUS    (3)
 
-#define SM_WORKER_INTERVAL  (100)
+//  sm_worker runs when the SM, SF or (relevant part of) HB object is
+//  updated, and when a host in the SF domain is about to time out.
+//  SM_WORKER_SAFETY_TIMEOUT bounds the wait in case an event is missed.
+//  While surviving by SR2, it also refreshes the SF watchdog every
+//  SM_WORKER_INTERVAL.
+
+#define SM_WORKER_INTERVAL          (100)
+#define SM_WORKER_SAFETY_TIMEOUT    (5 * ONE_SEC)
+#define SM_WORKER_STATS_INTERVAL    (600 * ONE_SEC)
 
 
 //
@@ -213,6 +288,16 @@ MTC_STATIC void *
 sm_worker(
     void *ignore);
 
+MTC_STATIC void
+sm_wake_worker();
+
+MTC_STATIC MTC_CLOCK
+sm_worker_timeout();
+
+MTC_STATIC void
+sm_worker_wait(
+    MTC_CLOCK   timeout);
+
 MTC_STATIC void
 surviving_by_SR2();
 
@@ -247,6 +332,24 @@ rendezvous(
 MTC_STATIC void
 fault_handler();
 
+MTC_STATIC void
+release_stable_view();
+
+MTC_STATIC void
+fh_trace_start();
+
+MTC_STATIC void
+fh_trace_point(
+    SM_FH_TRACE_POINT point);
+
+MTC_STATIC void
+fh_trace_removed(
+    MTC_HOSTMAP removed);
+
+MTC_STATIC MTC_BOOLEAN
+wait_until_removed_hosts_fenced(
+    MTC_CLOCK   timeout);
+
 MTC_STATIC MTC_STATUS
 wait_all_hosts_recognize_I_was_down();
 
@@ -315,6 +418,18 @@ MTC_STATIC MTC_BOOLEAN
 is_all_hosts_up(
     MTC_HOSTMAP hostmap);
 
+MTC_STATIC MTC_BOOLEAN
+is_all_nonexcluded_hosts_up(
+    MTC_HOSTMAP hostmap,
+    MTC_HOSTMAP excluded);
+
+MTC_STATIC MTC_BOOLEAN
+get_early_quorum(
+    MTC_HOSTMAP  hbdomain,
+    MTC_HOSTMAP  sfdomain,
+    MTC_HOSTMAP  excluded,
+    MTC_HOSTMAP  *pquorum);
+
 MTC_STATIC MTC_BOOLEAN
 is_empty_liveset(
     MTC_HOSTMAP liveset);
@@ -345,6 +460,7 @@ am_I_in_largest_partition(
 
 MTC_STATIC MTC_BOOLEAN
 wait_until_all_hosts_booted(
+    MTC_HOSTMAP *phosts,
     MTC_CLOCK   timeout);
 
 MTC_STATIC MTC_U32
@@ -356,6 +472,21 @@ sm_send_signals_sm_hb_sf(
     MTC_BOOLEAN hb_sig,
     MTC_BOOLEAN sf_sig);
 
+MTC_STATIC void
+update_view_digest_hb(
+    PCOM_DATA_HB phb);
+
+MTC_STATIC void
+update_view_digest_sf(
+    PCOM_DATA_SF psf);
+
+MTC_STATIC void
+update_view_digest_sm(
+    PCOM_DATA_SM psm);
+
+MTC_STATIC MTC_U32
+count_disagreeing_hosts();
+
 MTC_STATIC MTC_BOOLEAN
 sm_wait_signals_sm_hb_sf(
     MTC_BOOLEAN sm_sig,
@@ -426,21 +557,21 @@ sm_initialize(
             PCOM_DATA_SF        psf;
             PCOM_DATA_XAPIMON   pxapimon;
 
-            com_writer_lock(sm_object, (void **) &psm);
+            com_writer_lock_typed(SM, sm_object, &psm);
             smvar.fencing = psm->fencing = FENCING_DISARMED;
             com_writer_unlock(sm_object);
 
-            com_writer_lock(hb_object, (void **) &phb);
+            com_writer_lock_typed(HB, hb_object, &phb);
             phb->ctl.enable_HB_send = FALSE;
             phb->ctl.enable_HB_receive = FALSE;
             com_writer_unlock(hb_object);
 
-            com_writer_lock(sf_object, (void **) &psf);
+            com_writer_lock_typed(SF, sf_object, &psf);
             psf->ctl.enable_SF_read = FALSE;
             psf->ctl.enable_SF_write = FALSE;
             com_writer_unlock(sf_object);
 
-            com_writer_lock(xapimon_object, (void **) &pxapimon);
+            com_writer_lock_typed(XAPIMON, xapimon_object, &pxapimon);
             pxapimon->ctl.enable_Xapi_monitor = FALSE;
             com_writer_unlock(xapimon_object);
         }
@@ -481,6 +612,37 @@ sm_initialize0()
 {
     COM_DATA_SM sm;
     MTC_S32     ret = MTC_SUCCESS;
+    MTC_S32     index;
+
+    // priority inheritance for the threads waiting for signals
+
+    if ((ret = xhad_mutex_init(&smvar.mutex, PTHREAD_MUTEX_RECURSIVE)) != 0)
+    {
+        log_internal(MTC_LOG_ERR, "SM: cannot initialize mutex. (%d)\n", ret);
+        ret = MTC_ERROR_SM_PTHREAD;
+        goto error;
+    }
+
+    // timed waits for signals are on CLOCK_MONOTONIC
+
+    {
+        pthread_condattr_t condattr;
+
+        pthread_condattr_init(&condattr);
+        pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+        ret = pthread_cond_init(&smvar.cond, &condattr);
+        if (ret == 0)
+        {
+            ret = pthread_cond_init(&smvar.worker_cond, &condattr);
+        }
+        pthread_condattr_destroy(&condattr);
+    }
+    if (ret != 0)
+    {
+        log_internal(MTC_LOG_ERR, "SM: cannot initialize condition variable. (%d)\n", ret);
+        ret = MTC_ERROR_SM_PTHREAD;
+        goto error;
+    }
 
     // initialize COM_DATA_SM
     MTC_HOSTMAP_INIT_RESET(sm.current_liveset);
@@ -500,7 +662,7 @@ sm_initialize0()
     sm.weight = sm.commited_weight = 0;
 
     // create common object
-    ret = com_create(COM_ID_SM, &sm_object, sizeof(COM_DATA_SM), &sm);
+    ret = com_create_typed(SM, &sm_object, &sm);
     if (ret != MTC_SUCCESS)
     {
         log_internal(MTC_LOG_ERR, "SM: cannot create COM object. (%d)\n", ret);
@@ -510,6 +672,10 @@ sm_initialize0()
 
     MTC_HOSTMAP_INIT_RESET(smvar.last_hbdomain);
     MTC_HOSTMAP_INIT_RESET(smvar.last_sfdomain);
+    for (index = 0; index < MAX_HOST_NUM; index++)
+    {
+        smvar.fence_attested[index] = -1;
+    }
 
     // open refereced objects
     ret = sm_open_objects();
@@ -536,6 +702,23 @@ self_fence(
     if (smvar.fencing == FENCING_ARMED)
     {
         log_status(code, message);
+
+        //  Let the other hosts know that this host is going down,
+        //  so that they need not wait for the fencing timeout.
+        //  The watchdogs are armed first, so that the record means
+        //  a reset within WATCHDOG_FENCE_TIMEOUT even if this host
+        //  stalls after writing it; without them, nothing is recorded.
+
+        if (watchdog_arm_fence() != MTC_SUCCESS)
+        {
+            log_message(MTC_LOG_WARNING,
+                        "SM: watchdog could not be armed; self-fencing is not recorded.\n");
+        }
+        else if (!sf_set_self_fencing(SELF_FENCE_RECORD_TIMEOUT))
+        {
+            log_message(MTC_LOG_WARNING,
+                        "SM: self-fencing could not be recorded in the State-File.\n");
+        }
         watchdog_selffence();
         exit(status_to_exit(code));     // if possible
     }
@@ -553,12 +736,12 @@ sm_open_objects()
         // open common objects
         if (*(objects[index].handle) == HA_COMMON_OBJECT_INVALID_HANDLE_VALUE)
         {
-            ret = com_open(objects[index].name, objects[index].handle);
+            ret = com_open_id(objects[index].id, objects[index].handle);
             if (ret != MTC_SUCCESS)
             {
                 log_internal(MTC_LOG_ERR,
-                            "SM: cannot open COM object (name = %s). (%d)\n",
-                            objects[index].name, ret);
+                            "SM: cannot open COM object (id = %d). (%d)\n",
+                            objects[index].id, ret);
                 objects[index].handle = HA_COMMON_OBJECT_INVALID_HANDLE_VALUE;
                 return ret;
             }
@@ -573,8 +756,20 @@ sm_open_objects()
             if (ret != MTC_SUCCESS)
             {
                 log_internal(MTC_LOG_ERR,
-                            "SM: cannot register callback to %s. (%d)\n",
-                            objects[index].name, ret);
+                            "SM: cannot register callback to COM object (id = %d). (%d)\n",
+                            objects[index].id, ret);
+                return ret;
+            }
+        }
+        if (objects[index].async_callback)
+        {
+            ret = com_register_async_callback(*(objects[index].handle),
+                                              objects[index].async_callback);
+            if (ret != MTC_SUCCESS)
+            {
+                log_internal(MTC_LOG_ERR,
+                            "SM: cannot register callback to COM object (id = %d). (%d)\n",
+                            objects[index].id, ret);
                 return ret;
             }
         }
@@ -596,6 +791,10 @@ sm_cleanup_objects()
         {
             com_deregister_callback(*(objects[index].handle), objects[index].callback);
         }
+        if (objects[index].async_callback)
+        {
+            com_deregister_async_callback(*(objects[index].handle), objects[index].async_callback);
+        }
 
         if (*(objects[index].handle) != HA_COMMON_OBJECT_INVALID_HANDLE_VALUE)
         {
@@ -611,26 +810,48 @@ sm_cleanup_objects()
 }
 
 
+//
+//  sm_hb_updated, sm_sf_updated -
+//
+//  Called from the COM dispatcher after the HB/SF object is updated.
+//  Updates made by the SM thread itself are also signaled; the waiters
+//  re-evaluate their conditions, so that it only costs a recheck.
+//
+
 MTC_STATIC void
 sm_hb_updated(
     HA_COMMON_OBJECT_HANDLE handle,
-    void *buffer)
+    void *buffer,
+    MTC_U32 version)
 {
-    if (smvar.sm_thread != pthread_self())
-    {
-        sm_send_signals_sm_hb_sf(FALSE, TRUE, FALSE);
+    PCOM_DATA_HB        phb = buffer;
+    SM_WORKER_HB_VIEW   *pview = &smvar.worker_hb_view;
+
+    update_view_digest_hb(phb);
+    sm_send_signals_sm_hb_sf(FALSE, TRUE, FALSE);
+
+    if (MTC_HOSTMAP_COMPARE(pview->hbdomain, '!=', phb->hbdomain) ||
+        memcmp(pview->current_liveset, phb->raw.current_liveset, sizeof(pview->current_liveset)) ||
+        memcmp(pview->proposed_liveset, phb->raw.proposed_liveset, sizeof(pview->proposed_liveset)) ||
+        memcmp(pview->sfdomain, phb->raw.sfdomain, sizeof(pview->sfdomain)))
+    {
+        MTC_HOSTMAP_COPY(pview->hbdomain, phb->hbdomain);
+        memcpy(pview->current_liveset, phb->raw.current_liveset, sizeof(pview->current_liveset));
+        memcpy(pview->proposed_liveset, phb->raw.proposed_liveset, sizeof(pview->proposed_liveset));
+        memcpy(pview->sfdomain, phb->raw.sfdomain, sizeof(pview->sfdomain));
+        sm_wake_worker();
     }
 }
 
 MTC_STATIC void
 sm_sf_updated(
     HA_COMMON_OBJECT_HANDLE handle,
-    void *buffer)
+    void *buffer,
+    MTC_U32 version)
 {
-    if (smvar.sm_thread != pthread_self())
-    {
-        sm_send_signals_sm_hb_sf(FALSE, FALSE, TRUE);
-    }
+    update_view_digest_sf(buffer);
+    sm_send_signals_sm_hb_sf(FALSE, FALSE, TRUE);
+    sm_wake_worker();
 }
 
 MTC_STATIC void
@@ -653,10 +874,15 @@ sm_sm_updated(
         smvar.fencing = psm->fencing = FENCING_DISARMED;
     }
 
+    update_view_digest_sm(psm);
     if (smvar.sm_thread != pthread_self())
     {
         sm_send_signals_sm_hb_sf(TRUE, FALSE, FALSE);
     }
+    if (smvar.worker_thread != pthread_self())
+    {
+        sm_wake_worker();
+    }
     
     smvar.SR2 = psm->SR2;
 }
@@ -674,22 +900,22 @@ sm_abort(
 
     log_status(code, msg);
 
-    com_writer_lock(sm_object, (void **) &psm);
+    com_writer_lock_typed(SM, sm_object, &psm);
     psm->status = code;
     smvar.phase = psm->phase = SM_PHASE_ABORTED;
     com_writer_unlock(sm_object);
 
-    com_writer_lock(hb_object, (void **) &phb);
+    com_writer_lock_typed(HB, hb_object, &phb);
     phb->ctl.enable_HB_send = FALSE;
     phb->ctl.enable_HB_receive = FALSE;
     com_writer_unlock(hb_object);
 
-    com_writer_lock(sf_object, (void **) &psf);
+    com_writer_lock_typed(SF, sf_object, &psf);
     psf->ctl.enable_SF_read = FALSE;
     psf->ctl.enable_SF_write = FALSE;
     com_writer_unlock(sf_object);
 
-    com_writer_lock(xapimon_object, (void **) &pxapimon);
+    com_writer_lock_typed(XAPIMON, xapimon_object, &pxapimon);
     pxapimon->ctl.enable_Xapi_monitor = FALSE;
     com_writer_unlock(xapimon_object);
 
@@ -704,7 +930,7 @@ set_sm_phase(
 {
     PCOM_DATA_SM    psm;
 
-    com_writer_lock(sm_object, (void **) &psm);
+    com_writer_lock_typed(SM, sm_object, &psm);
     smvar.phase = psm->phase = phase;
     com_writer_unlock(sm_object);
 }
@@ -718,6 +944,7 @@ sm(
     MTC_U32     weight;
 
     log_thread_id("SM");
+    xhad_set_thread_priority(XHA_PRIORITY_MIDDLE);
     // commit initial weight
     weight = commit_weight();
     log_message(MTC_LOG_INFO, "Initial weight = %d.\n", weight);
@@ -792,6 +1019,8 @@ sm(
     set_sm_phase(SM_PHASE_STARTED);
 
     log_message(MTC_LOG_NOTICE, "The local host has transitioned to online state.\n");
+    log_message(MTC_LOG_INFO, "SM: start-to-online time is %"PRId64" ms%s.\n",
+                _getms() - smvar.start_time, (smvar.early_quorum)? " (early quorum)": "");
 
     // Notify main that sm is in steady state
     main_steady_state();
@@ -822,6 +1051,11 @@ rendezvous_wait(
         PCOM_DATA_SM    psm;
         PCOM_DATA_HB    phb;
         PCOM_DATA_SF    psf;
+        HA_COMMON_OBJECT_SNAPSHOT snapshot[] = {
+            {sm_object, NULL, sizeof(COM_DATA_SM)},
+            {hb_object, NULL, sizeof(COM_DATA_HB)},
+            {sf_object, NULL, sizeof(COM_DATA_SF)},
+        };
         MTC_BOOLEAN     rendezvous;
         MTC_S32         index;
         MTC_CLOCK       log_time = _getms();
@@ -835,13 +1069,28 @@ rendezvous_wait(
             hb_SF_accelerate();
         }
 
+        //  The objects are scanned on shared snapshots, which are
+        //  copied only when the objects have been updated since the
+        //  last snapshot taken by any thread.
+
         rendezvous = FALSE;
         while (!rendezvous)
         {
+            com_snapshot_release(snapshot[0].copy);
+            com_snapshot_release(snapshot[1].copy);
+            com_snapshot_release(snapshot[2].copy);
+            snapshot[0].copy = snapshot[1].copy = snapshot[2].copy = NULL;
+            if (com_snapshot_share_many(snapshot, sizeof(snapshot) / sizeof(snapshot[0])) != MTC_SUCCESS)
+            {
+                log_internal(MTC_LOG_ERR, "SM: cannot take a snapshot of the SM/HB/SF objects.\n");
+                sm_wait_signals_sm_hb_sf(TRUE, TRUE, TRUE, ONE_SEC);
+                continue;
+            }
+            psm = snapshot[0].copy;
+            phb = snapshot[1].copy;
+            psf = snapshot[2].copy;
+
             rendezvous = TRUE;
-            com_reader_lock(sm_object, (void **) &psm);
-            com_reader_lock(hb_object, (void **) &phb);
-            com_reader_lock(sf_object, (void **) &psf);
             for (index = 0; _is_configured_host(index); index++)
             {
                 if (MTC_HOSTMAP_ISON(psm->current_liveset, index))
@@ -886,12 +1135,17 @@ rendezvous_wait(
                 assert(FALSE);
 #endif
             }
-            com_reader_unlock(sf_object);
-            com_reader_unlock(hb_object);
-            com_reader_unlock(sm_object);
 
-            sm_wait_signals_sm_hb_sf(TRUE, TRUE, TRUE, -1);
+            if (!rendezvous)
+            {
+                // scan again only after any of the objects has changed
+
+                com_wait_change_many(snapshot, sizeof(snapshot) / sizeof(snapshot[0]), -1);
+            }
         }
+        com_snapshot_release(snapshot[0].copy);
+        com_snapshot_release(snapshot[1].copy);
+        com_snapshot_release(snapshot[2].copy);
 
         if (on_statefile)
         {
@@ -927,17 +1181,21 @@ fault_handler()
     MTC_U32         weight;
     MTC_CLOCK       p3_start_time, p4_start_time, sleep_time;
     MTC_BOOLEAN     degrading;
+    MTC_HOSTMAP     removed;
 
 
     log_message(MTC_LOG_DEBUG, "FH: Start fault handler.\n");
 
+    fh_trace_start();
     smvar.join_block = TRUE;
 
 
     // phase 1: Wait until HB/SF state becomes stable, and commit weight value
     rendezvous(SM_PHASE_FHREADY, SM_PHASE_FH1, SM_PHASE_FH1DONE, TRUE, FALSE);
+    fh_trace_point(SM_FH_TRACE_FH1);
 
     wait_until_HBSF_state_stable();
+    fh_trace_point(SM_FH_TRACE_STABLE);
     log_maskable_debug_message(FH_TRACE, "FH: HB/SF state has become stable.\n");
 
     weight = commit_weight();
@@ -945,18 +1203,21 @@ fault_handler()
 
     // phase 2: Wait until all hosts have consistent view
     rendezvous(SM_PHASE_FH1DONE, SM_PHASE_FH2, SM_PHASE_FH2DONE, TRUE, TRUE);
+    fh_trace_point(SM_FH_TRACE_FH2);
     log_maskable_debug_message(FH_TRACE, "FH: waiting for consistent view...\n");
     if (!wait_until_all_hosts_have_consistent_view(_max(_T1, _T2) * ONE_SEC))
     {
         self_fence(MTC_ERROR_SM_FAULTHANDLER_TIMEOUT,
                    "FH: cannot get consistent view within timeout.  - Self-Fence");
     }
+    fh_trace_point(SM_FH_TRACE_CONSISTENT);
     log_maskable_debug_message(FH_TRACE,
                  "FH: All hosts now have consistent view to the pool membership.\n");
 
     // phase 3: Determine one winner
     //          In this test, if I am winner, the proposed liveset is updated.
     rendezvous(SM_PHASE_FH2DONE, SM_PHASE_FH3, SM_PHASE_FH3DONE, TRUE, FALSE);
+    fh_trace_point(SM_FH_TRACE_FH3);
     p3_start_time = _getms();
 
     if (!test_Survival_Rule(&smvar.SR2))
@@ -964,6 +1225,7 @@ fault_handler()
         self_fence(MTC_ERROR_SM_SURVIVALRULE_FAILED,
                    "FH: Survival Rule is not met for the local host.  - Self-Fence");
     }
+    release_stable_view();
 
     if (fist_on("sm.fence_in_FH3"))
     {
@@ -981,8 +1243,9 @@ fault_handler()
     // phase 4: Perform fencing and updating liveset
     // Wait for fencing timeout
     rendezvous(SM_PHASE_FH3DONE, SM_PHASE_FH4, SM_PHASE_FH4DONE, TRUE, FALSE);
+    fh_trace_point(SM_FH_TRACE_FH4);
 
-    com_reader_lock(sm_object, (void **) &psm);
+    com_reader_lock_typed(SM, sm_object, &psm);
     degrading = !MTC_HOSTMAP_SUBSETEQUAL(psm->current_liveset, '(=', psm->proposed_liveset);
     com_reader_unlock(sm_object);
 
@@ -994,54 +1257,285 @@ fault_handler()
         }
 
         p4_start_time = _getms();
-        sleep_time = _max(((_max(_Wh, _Ws) - _min(_T1, _T2) + _max(_t1, _t2)) * ONE_SEC)
-                            - (p4_start_time - p3_start_time)
-                            + (smvar.fh_sleep_extend? _min(_T1, _T2): 0) * ONE_SEC,
-                          FH_MINIMUM_SLEEP_BEFORE_FO * ONE_SEC);
-        mssleep(sleep_time);
+        sleep_time = FH_FENCE_WAIT(p4_start_time - p3_start_time, smvar.fh_sleep_extend);
+        wait_until_removed_hosts_fenced(sleep_time);
+        fh_trace_point(SM_FH_TRACE_FENCED);
 
         // Update liveset
 
         if (smvar.fencing == FENCING_ARMED)
         {
-            com_writer_lock(sm_object, (void **) &psm);
+            com_writer_lock_typed(SM, sm_object, &psm);
+            MTC_HOSTMAP_DIFFERENCE(removed, '=',
+                                        psm->current_liveset, '-', psm->proposed_liveset);
             MTC_HOSTMAP_INTERSECTION(psm->current_liveset, '=',
                                         psm->current_liveset, '&', psm->proposed_liveset);
             print_liveset(MTC_LOG_NOTICE,
                 "Liveset has been updated."
                 "  new liveset = (%s)\n", psm->current_liveset);
             com_writer_unlock(sm_object);
+            fh_trace_removed(removed);
+            fh_trace_point(SM_FH_TRACE_COMMITTED);
 
             cancel_fence_request();
         }
     }
 
     rendezvous(SM_PHASE_FH4DONE, SM_PHASE_STARTED, SM_PHASE_FHREADY, TRUE, FALSE);
+    fh_trace_point(SM_FH_TRACE_END);
     smvar.join_block = FALSE;
+    sm_wake_worker();
     log_message(MTC_LOG_DEBUG, "FH: End fault handler.\n");
 }
 
 
+//
+//  release_stable_view
+//
+//  Release the stable view taken by
+//  wait_until_all_hosts_have_consistent_view.
+//
+
+MTC_STATIC void
+release_stable_view()
+{
+    com_snapshot_release(smvar.stable_hb);
+    com_snapshot_release(smvar.stable_sf);
+    smvar.stable_hb = NULL;
+    smvar.stable_sf = NULL;
+}
+
+
+//
+//  Fault handler trace
+//
+//  The SM thread records the points of the current episode.
+//  start_fh records when the episode was requested and when the lost
+//  host was seen last. smvar.mutex protects them.
+//
+
+MTC_STATIC void
+fh_trace_start()
+{
+    PSM_FH_TRACE    trace;
+    MTC_S32         point;
+
+    pthread_mutex_lock(&smvar.mutex);
+    trace = &smvar.fh_trace[smvar.fh_episode % SM_FH_TRACE_MAX];
+    trace->episode = ++smvar.fh_episode;
+    MTC_HOSTMAP_INIT_RESET(trace->removed);
+    for (point = 0; point < SM_FH_TRACE_POINT_NUM; point++)
+    {
+        trace->time[point] = -1;
+    }
+    trace->time[SM_FH_TRACE_LAST_SEEN] = smvar.fh_last_seen;
+    trace->time[SM_FH_TRACE_TRIGGERED] = smvar.fh_triggered;
+    trace->time[SM_FH_TRACE_START] = _getms();
+    smvar.fh_last_seen = smvar.fh_triggered = -1;
+    pthread_mutex_unlock(&smvar.mutex);
+}
+
+
+MTC_STATIC void
+fh_trace_point(
+    SM_FH_TRACE_POINT point)
+{
+    pthread_mutex_lock(&smvar.mutex);
+    if (smvar.fh_episode > 0)
+    {
+        smvar.fh_trace[(smvar.fh_episode - 1) % SM_FH_TRACE_MAX].time[point] = _getms();
+    }
+    pthread_mutex_unlock(&smvar.mutex);
+}
+
+
+MTC_STATIC void
+fh_trace_removed(
+    MTC_HOSTMAP removed)
+{
+    pthread_mutex_lock(&smvar.mutex);
+    if (smvar.fh_episode > 0)
+    {
+        memcpy(smvar.fh_trace[(smvar.fh_episode - 1) % SM_FH_TRACE_MAX].removed,
+               removed, sizeof(MTC_HOSTMAP));
+    }
+    pthread_mutex_unlock(&smvar.mutex);
+}
+
+
+//
+//  wait_until_removed_hosts_fenced -
+//
+//  Wait for the hosts removed from the liveset to be fenced.
+//  The wait ends at timeout, or earlier when every removed host
+//  is confirmed to be down, either
+//      - attested by a fencing agent (sm_attest_fenced) after the host
+//        was last seen on HB or SF, or
+//      - recorded in the State-File that it is self-fencing, and
+//        FH_SELF_FENCE_GRACE has elapsed since all the records were seen.
+//  Returns TRUE if the wait is ended by the confirmation.
+//
+
+MTC_STATIC MTC_BOOLEAN
+wait_until_removed_hosts_fenced(
+    MTC_CLOCK   timeout)
+{
+    PCOM_DATA_SM    psm;
+    PCOM_DATA_HB    phb;
+    PCOM_DATA_SF    psf;
+    MTC_HOSTMAP     removed, attested, confirmed;
+    MTC_CLOCK       start, elapsed, recorded = -1, wait;
+    MTC_S32         index;
+
+    start = _getms();
+
+    com_reader_lock_typed(SM, sm_object, &psm);
+    MTC_HOSTMAP_DIFFERENCE(removed, '=',
+                                psm->current_liveset, '-', psm->proposed_liveset);
+    com_reader_unlock(sm_object);
+
+    while ((elapsed = _getms() - start) < timeout)
+    {
+        //  an attestation holds unless the host has been seen since
+
+        com_reader_lock_typed(HB, hb_object, &phb);
+        com_reader_lock_typed(SF, sf_object, &psf);
+        MTC_HOSTMAP_INIT_RESET(attested);
+        pthread_mutex_lock(&smvar.mutex);
+        for (index = 0; _is_configured_host(index); index++)
+        {
+            if (smvar.fence_attested[index] >= 0 &&
+                smvar.fence_attested[index] > phb->time_last_HB[index] &&
+                smvar.fence_attested[index] > psf->time_last_SF[index])
+            {
+                MTC_HOSTMAP_SET(attested, index);
+            }
+        }
+        pthread_mutex_unlock(&smvar.mutex);
+        MTC_HOSTMAP_UNION(confirmed, '=', attested, '|', psf->self_fencing);
+        com_reader_unlock(sf_object);
+        com_reader_unlock(hb_object);
+
+        if (MTC_HOSTMAP_SUBSETEQUAL(removed, '(=', attested))
+        {
+            print_liveset(MTC_LOG_NOTICE,
+                "FH: all the removed hosts are attested as fenced. (%s)\n", removed);
+            return TRUE;
+        }
+
+        wait = timeout - elapsed;
+        if (MTC_HOSTMAP_SUBSETEQUAL(removed, '(=', confirmed))
+        {
+            if (recorded < 0)
+            {
+                recorded = _getms();
+                print_liveset(MTC_LOG_NOTICE,
+                    "FH: all the removed hosts have recorded self-fencing. (%s)\n", removed);
+            }
+            if (_getms() - recorded >= FH_SELF_FENCE_GRACE * ONE_SEC)
+            {
+                return TRUE;
+            }
+            wait = _min(wait, FH_SELF_FENCE_GRACE * ONE_SEC - (_getms() - recorded));
+        }
+        else
+        {
+            recorded = -1;
+        }
+
+        sm_wait_signals_sm_hb_sf(TRUE, FALSE, TRUE, _max(wait, 1));
+    }
+
+    return FALSE;
+}
+
+
+//
+//  sm_attest_fenced -
+//
+//  Called when a fencing agent attests that the host is down.
+//  The time of the attestation is recorded, and the fault handler
+//  takes it into account as long as the host has not been seen on
+//  HB or SF since then, even if it was made before the fault handler
+//  started.
+//
+
+MTC_STATUS
+sm_attest_fenced(
+    MTC_U32 host_index)
+{
+    if (host_index >= MAX_HOST_NUM || !_is_configured_host(host_index) ||
+        host_index == _my_index)
+    {
+        return MTC_ERROR_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&smvar.mutex);
+    smvar.fence_attested[host_index] = _getms();
+    pthread_mutex_unlock(&smvar.mutex);
+
+    sm_send_signals_sm_hb_sf(TRUE, FALSE, FALSE);
+
+    return MTC_SUCCESS;
+}
+
+
+//
+//  sm_get_fh_trace -
+//
+//  Copy the traces of up to num recent fault-handling episodes,
+//  the most recent first. Returns the number of the traces copied.
+//
+
+MTC_U32
+sm_get_fh_trace(
+    PSM_FH_TRACE trace,
+    MTC_U32 num)
+{
+    MTC_U32 count;
+
+    pthread_mutex_lock(&smvar.mutex);
+    for (count = 0;
+         count < num && count < smvar.fh_episode && count < SM_FH_TRACE_MAX;
+         count++)
+    {
+        trace[count] = smvar.fh_trace[(smvar.fh_episode - 1 - count) % SM_FH_TRACE_MAX];
+    }
+    pthread_mutex_unlock(&smvar.mutex);
+    return count;
+}
+
+
 MTC_STATIC MTC_BOOLEAN
 test_Survival_Rule(
     PMTC_BOOLEAN pSR2)
 {
     PCOM_DATA_SM    psm;
-    PCOM_DATA_HB    phb = &smvar.stable_hb;
-    PCOM_DATA_SF    psf = &smvar.stable_sf;
+    PCOM_DATA_HB    phb = smvar.stable_hb;
+    PCOM_DATA_SF    psf = smvar.stable_sf;
     MTC_HOSTMAP     hbd, sfd;
     MTC_BOOLEAN     winner = FALSE,
                     sf_access, excluded, in_hbd, in_sfd;
     MTC_S32         index;
 
-    com_writer_lock(sm_object, (void **) &psm);
+    if (phb == NULL || psf == NULL)
+    {
+        // no stable view (wait_until_all_hosts_have_consistent_view failed)
+
+        log_internal(MTC_LOG_ERR, "SM: no stable view for the Survival Rule.\n");
+        return FALSE;
+    }
+
+    com_writer_lock_typed(SM, sm_object, &psm);
+
+    //  The stable view is shared and read-only; mask the copies.
 
-    MTC_HOSTMAP_MASK_UNCONFIG(phb->hbdomain);
-    MTC_HOSTMAP_MASK_UNCONFIG(psf->sfdomain);
     MTC_HOSTMAP_COPY(smvar.last_hbdomain, phb->hbdomain);
     MTC_HOSTMAP_COPY(smvar.last_sfdomain, psf->sfdomain);
-    MTC_HOSTMAP_INTERSECTION(hbd, '=', phb->hbdomain, '&', psm->current_liveset);
-    MTC_HOSTMAP_INTERSECTION(sfd, '=', psf->sfdomain, '&', psm->current_liveset);
+    MTC_HOSTMAP_MASK_UNCONFIG(smvar.last_hbdomain);
+    MTC_HOSTMAP_MASK_UNCONFIG(smvar.last_sfdomain);
+    MTC_HOSTMAP_INTERSECTION(hbd, '=', smvar.last_hbdomain, '&', psm->current_liveset);
+    MTC_HOSTMAP_INTERSECTION(sfd, '=', smvar.last_sfdomain, '&', psm->current_liveset);
 
     if (MTC_HOSTMAP_SUBSETEQUAL(sfd, '(=', hbd) && !is_empty_liveset(sfd))
     {
@@ -1067,7 +1561,7 @@ test_Survival_Rule(
         // Check if Survival Rule-2
         for (index = 0; _is_configured_host(index); index++)
         {
-            sf_access = (index == _my_index)? psf->SF_access: MTC_HOSTMAP_ISON(phb->raw[index].sfdomain, index);
+            sf_access = (index == _my_index)? psf->SF_access: MTC_HOSTMAP_ISON(phb->raw.sfdomain[index], index);
             excluded = MTC_HOSTMAP_ISON(psf->excluded, index);
             in_hbd = MTC_HOSTMAP_ISON(hbd, index);
 
@@ -1093,8 +1587,8 @@ test_Survival_Rule(
 
     if (winner && smvar.fencing == FENCING_ARMED)
     {
-        com_writer_lock(hb_object, (void **) &phb);
-        com_writer_lock(sf_object, (void **) &psf);
+        com_writer_lock_typed(HB, hb_object, &phb);
+        com_writer_lock_typed(SF, sf_object, &psf);
 
         for (index = 0; _is_configured_host(index); index++)
         {
@@ -1141,15 +1635,13 @@ test_Start_Criteria()
     PCOM_DATA_SM    psm;
     PCOM_DATA_HB    phb;
     PCOM_DATA_SF    psf;
-    COM_DATA_SM     sm;
-    COM_DATA_HB     hb;
-    COM_DATA_SF     sf;
     MTC_U32         pool_state = get_pool_state(),
                     my_excluded_flag = get_excluded_flag(_my_index),
                     start_flags,
                     last_flags = -1;
-    MTC_HOSTMAP     sfdomain_nonstarting, hbdomain_or_excluded, liveset;
-    MTC_BOOLEAN     all_excluded, win;
+    MTC_HOSTMAP     sfdomain_nonstarting, hbdomain_or_excluded, liveset, members;
+    MTC_HOSTMAP     hbdomain, notjoining, sfdomain, starting, excluded;
+    MTC_BOOLEAN     all_excluded, win, synchronized, sf_access, SR2;
     MTC_CLOCK       timeout;
 
 
@@ -1179,19 +1671,23 @@ test_Start_Criteria()
     // Test Start Criteria with boot/enable timeout
     do
     {
-        com_reader_lock(sm_object, (void **) &psm);
-        com_reader_lock(hb_object, (void **) &phb);
-        com_reader_lock(sf_object, (void **) &psf);
-        sm = *psm;
-        hb = *phb;
-        sf = *psf;
+        com_reader_lock_typed(SM, sm_object, &psm);
+        com_reader_lock_typed(HB, hb_object, &phb);
+        com_reader_lock_typed(SF, sf_object, &psf);
+        SR2 = psm->SR2;
+        MTC_HOSTMAP_COPY(hbdomain, phb->hbdomain);
+        MTC_HOSTMAP_COPY(notjoining, phb->notjoining);
+        sf_access = psf->SF_access;
+        MTC_HOSTMAP_COPY(sfdomain, psf->sfdomain);
+        MTC_HOSTMAP_COPY(starting, psf->starting);
+        MTC_HOSTMAP_COPY(excluded, psf->excluded);
         com_reader_unlock(sf_object);
         com_reader_unlock(hb_object);
         com_reader_unlock(sm_object);
 
 
         // Still have State File access?
-        if (!sf.SF_access)
+        if (!sf_access)
         {
             log_internal(MTC_LOG_ERR,
                         "Start Criteria: lost the state file access while starting.\n");
@@ -1204,13 +1700,13 @@ test_Start_Criteria()
                             START_FLAGS_INIT: START_FLAGS_ACTIVE;
         start_flags |= (my_excluded_flag)?
                             START_FLAGS_EXCLUDED: START_FLAGS_NONEXCLUDED;
-        MTC_HOSTMAP_DIFFERENCE(sfdomain_nonstarting, '=', sf.sfdomain, '-', sf.starting);
+        MTC_HOSTMAP_DIFFERENCE(sfdomain_nonstarting, '=', sfdomain, '-', starting);
         MTC_HOSTMAP_MASK_UNCONFIG(sfdomain_nonstarting);
         // if pool is surviving by SR2 and this host can comunicate with all non-excluded hosts
         // by heartbeat, let's think as there is a liveset.
-        MTC_HOSTMAP_UNION(hbdomain_or_excluded, '=', hb.hbdomain, '|', sf.excluded);
+        MTC_HOSTMAP_UNION(hbdomain_or_excluded, '=', hbdomain, '|', excluded);
         if (is_empty_liveset(sfdomain_nonstarting) &&
-            !(sm.SR2 && is_all_hosts_up(hbdomain_or_excluded)))
+            !(SR2 && is_all_hosts_up(hbdomain_or_excluded)))
         {
             start_flags |= START_FLAGS_EMPTYLIVESET;
         }
@@ -1242,12 +1738,28 @@ test_Start_Criteria()
         case START_FLAGS_INIT   | START_FLAGS_NONEXCLUDED | START_FLAGS_EMPTYLIVESET:
         case START_FLAGS_ACTIVE | START_FLAGS_EXCLUDED    | START_FLAGS_EMPTYLIVESET:
         case START_FLAGS_ACTIVE | START_FLAGS_NONEXCLUDED | START_FLAGS_EMPTYLIVESET:
-            if (is_all_hosts_up(hb.hbdomain) && is_all_hosts_up(sf.sfdomain))
+            synchronized = FALSE;
+            if (is_all_hosts_up(hbdomain) && is_all_hosts_up(sfdomain))
             {
                 log_message(MTC_LOG_INFO,
                     "Start Criteria: Forming a new liveset with all configured hosts.\n");
-                com_writer_lock(sm_object, (void **) &psm);
-                MTC_HOSTMAP_COPY(psm->proposed_liveset, hb.hbdomain);
+                MTC_HOSTMAP_COPY(members, hbdomain);
+                synchronized = TRUE;
+            }
+            else if (!my_excluded_flag && get_early_quorum(hbdomain, sfdomain, excluded, &members))
+            {
+                //  The excluded hosts have been shut down cleanly. Do not
+                //  wait for the boot timeout for them; they join later.
+
+                log_message(MTC_LOG_INFO,
+                    "Start Criteria: Forming a new liveset with all non-excluded hosts (early quorum).\n");
+                synchronized = TRUE;
+            }
+
+            if (synchronized)
+            {
+                com_writer_lock_typed(SM, sm_object, &psm);
+                MTC_HOSTMAP_COPY(psm->proposed_liveset, members);
                 print_liveset(MTC_LOG_INFO,
                     "Start Criteria: current_liveset = (%s)\n", psm->current_liveset);
                 print_liveset(MTC_LOG_INFO,
@@ -1255,17 +1767,18 @@ test_Start_Criteria()
                 com_writer_unlock(sm_object);
 
                 // Wait until all other hosts boot up
-                if (wait_until_all_hosts_booted(
+                if (wait_until_all_hosts_booted(&members,
                     (((pool_state == SF_STATE_INIT)? _Tenable: _Tboot) +
                      SYNCHRONIZED_BOOT_TIMEOUT_EXTENDER) * ONE_SEC))
                 {
                     log_message(MTC_LOG_INFO,
                         "Start Criteria: all hosts are ready to start.\n");
-                    com_reader_lock(sm_object, (void **) &psm);
+                    com_reader_lock_typed(SM, sm_object, &psm);
                     MTC_HOSTMAP_COPY(liveset, psm->proposed_liveset);
                     com_reader_unlock(sm_object);
 
                     form_new_liveset(&psm->proposed_liveset);
+                    smvar.early_quorum = !is_all_hosts_up(members);
 
                     // change pool state to ACTIVE
                     if (pool_state == SF_STATE_INIT)
@@ -1291,15 +1804,15 @@ test_Start_Criteria()
                 return MTC_SUCCESS;
             }
 
-            MTC_HOSTMAP_MASK_UNCONFIG(hb.hbdomain);
-            MTC_HOSTMAP_MASK_UNCONFIG(sf.sfdomain);
-            if (MTC_HOSTMAP_SUBSETEQUAL(sf.sfdomain, '(=', hb.hbdomain))
+            MTC_HOSTMAP_MASK_UNCONFIG(hbdomain);
+            MTC_HOSTMAP_MASK_UNCONFIG(sfdomain);
+            if (MTC_HOSTMAP_SUBSETEQUAL(sfdomain, '(=', hbdomain))
             {
                 log_message(MTC_LOG_INFO,
                     "Start Criteria: Joining the existing liveset.\n");
-                com_writer_lock(sm_object, (void **) &psm);
+                com_writer_lock_typed(SM, sm_object, &psm);
                 MTC_HOSTMAP_DIFFERENCE(psm->proposed_liveset, '=',
-                                        sf.sfdomain, '-', sf.starting);
+                                        sfdomain, '-', starting);
                 MTC_HOSTMAP_MASK_UNCONFIG(psm->proposed_liveset);
                 MTC_HOSTMAP_COPY(psm->current_liveset, psm->proposed_liveset);
                 print_liveset(MTC_LOG_INFO,
@@ -1363,8 +1876,8 @@ test_Start_Criteria()
         break;
 
     case START_FLAGS_ACTIVE | START_FLAGS_EXCLUDED    | START_FLAGS_EMPTYLIVESET:
-        com_reader_lock(sf_object, (void **) &psf);
-        all_excluded = is_all_hosts_up(sf.excluded);
+        com_reader_lock_typed(SF, sf_object, &psf);
+        all_excluded = is_all_hosts_up(excluded);
         com_reader_unlock(sf_object);
         if (!all_excluded)
         {
@@ -1375,8 +1888,8 @@ test_Start_Criteria()
         }
         // (don't break) fall down to the next case
     case START_FLAGS_ACTIVE | START_FLAGS_NONEXCLUDED | START_FLAGS_EMPTYLIVESET:
-        com_reader_lock(hb_object, (void **) &phb);
-        com_reader_lock(sf_object, (void **) &psf);
+        com_reader_lock_typed(HB, hb_object, &phb);
+        com_reader_lock_typed(SF, sf_object, &psf);
         win = am_I_in_largest_partition(phb, psf, psf->weight);
         com_reader_unlock(sf_object);
         com_reader_unlock(hb_object);
@@ -1386,7 +1899,7 @@ test_Start_Criteria()
             log_message(MTC_LOG_INFO,
                 "Start Criteria: Forming a new liveset with a subset of configured hosts.\n");
 
-            MTC_HOSTMAP_DIFFERENCE(liveset, '=', hb.hbdomain, '-', hb.notjoining);
+            MTC_HOSTMAP_DIFFERENCE(liveset, '=', hbdomain, '-', notjoining);
             form_new_liveset(&liveset);
 
             return MTC_SUCCESS;
@@ -1421,8 +1934,8 @@ am_I_in_new_liveset(
     {
         if (MTC_HOSTMAP_ISON(*pliveset, index))
         {
-            com_reader_lock(sf_object, (void **) &psf);
-            MTC_HOSTMAP_COPY(*pnewliveset, psf->raw[index].current_liveset);
+            com_reader_lock_typed(SF, sf_object, &psf);
+            MTC_HOSTMAP_COPY(*pnewliveset, psf->raw.current_liveset[index]);
             com_reader_unlock(sf_object);
 
             if (MTC_HOSTMAP_ISON(*pnewliveset, _my_index))
@@ -1444,7 +1957,7 @@ form_new_liveset(
     PCOM_DATA_SM    psm;
     PCOM_DATA_HB    phb;
 
-    com_writer_lock(sm_object, (void **) &psm);
+    com_writer_lock_typed(SM, sm_object, &psm);
     MTC_HOSTMAP_COPY(psm->proposed_liveset, *pliveset);
     MTC_HOSTMAP_COPY(psm->current_liveset, psm->proposed_liveset);
     print_liveset(MTC_LOG_INFO,
@@ -1454,7 +1967,7 @@ form_new_liveset(
     com_writer_unlock(sm_object);
 
     // cancel join request
-    com_writer_lock(hb_object, (void **) &phb);
+    com_writer_lock_typed(HB, hb_object, &phb);
     phb->ctl.join = FALSE;
     com_writer_unlock(hb_object);
 }
@@ -1470,7 +1983,7 @@ join()
     MTC_S32         index;
 
     // Check if Join is requested
-    com_reader_lock(hb_object, (void **) &phb);
+    com_reader_lock_typed(HB, hb_object, &phb);
     join = phb->ctl.join;
     com_reader_unlock(hb_object);
     if (!join)
@@ -1479,7 +1992,7 @@ join()
     }
 
     // Send join request by heartbeat
-    com_writer_lock(sm_object, (void **) &psm);
+    com_writer_lock_typed(SM, sm_object, &psm);
     MTC_HOSTMAP_SET(psm->proposed_liveset, _my_index);
     print_liveset(MTC_LOG_DEBUG,
         "Join: trying to join [proposed_liveset = (%s)].\n", psm->proposed_liveset);
@@ -1496,14 +2009,14 @@ join()
         MTC_S32         index;
 
         // Check if all hosts allow to join
-        com_reader_lock(sm_object, (void **) &psm);
-        com_reader_lock(hb_object, (void **) &phb);
+        com_reader_lock_typed(SM, sm_object, &psm);
+        com_reader_lock_typed(HB, hb_object, &phb);
         joined = TRUE;
         for (index = 0; _is_configured_host(index); index++)
         {
             if (index != _my_index &&
                 MTC_HOSTMAP_ISON(psm->current_liveset, index) &&
-                !MTC_HOSTMAP_ISON(phb->raw[index].proposed_liveset, _my_index))
+                !MTC_HOSTMAP_ISON(phb->raw.proposed_liveset[index], _my_index))
             {
                 joined = FALSE;
                 break;
@@ -1522,8 +2035,8 @@ join()
     } while (sm_wait_signals_sm_hb_sf(TRUE, TRUE, FALSE, timeout));
 
     // If joined, update current_liveset.  If not, cancel join request
-    com_writer_lock(sm_object, (void **) &psm);
-    com_writer_lock(hb_object, (void **) &phb);
+    com_writer_lock_typed(SM, sm_object, &psm);
+    com_writer_lock_typed(HB, hb_object, &phb);
     phb->ctl.join = FALSE;
     if (joined)
     {
@@ -1542,7 +2055,7 @@ join()
         for (index = 0; _is_configured_host(index); index++)
         {
             print_liveset(MTC_LOG_WARNING,
-                "Join: \tother hosts [proposed liveset = (%s)]\n", phb->raw[index].proposed_liveset);
+                "Join: \tother hosts [proposed liveset = (%s)]\n", phb->raw.proposed_liveset[index]);
         }
         MTC_HOSTMAP_RESET(psm->proposed_liveset, _my_index);
     }
@@ -1564,9 +2077,9 @@ process_join_request()
 
     MTC_HOSTMAP_INIT_RESET(joining_set);
 
-    com_writer_lock(sm_object, (void **) &psm);
-    com_reader_lock(hb_object, (void **) &phb);
-    com_reader_lock(sf_object, (void **) &psf);
+    com_writer_lock_typed(SM, sm_object, &psm);
+    com_reader_lock_typed(HB, hb_object, &phb);
+    com_reader_lock_typed(SF, sf_object, &psf);
 
 #if 0
     if (psm->phase != SM_PHASE_STARTING)
@@ -1581,8 +2094,8 @@ process_join_request()
             // If Node i is requesting to join,
             if (index != _my_index &&
                 MTC_HOSTMAP_ISON(phb->hbdomain, index) &&
-                !MTC_HOSTMAP_ISON(phb->raw[index].current_liveset, index) &&
-                MTC_HOSTMAP_ISON(phb->raw[index].proposed_liveset, index))
+                !MTC_HOSTMAP_ISON(phb->raw.current_liveset[index], index) &&
+                MTC_HOSTMAP_ISON(phb->raw.proposed_liveset[index], index))
             {
                 // Validate if join can be allowed
                 if (!smvar.join_block &&
@@ -1607,7 +2120,7 @@ process_join_request()
                         if (MTC_HOSTMAP_ISON(psm->current_liveset, index2) &&
                             ((index2 == _my_index)?
                              !MTC_HOSTMAP_ISON(psm->proposed_liveset, index):
-                             !MTC_HOSTMAP_ISON(phb->raw[index2].proposed_liveset, index)))
+                             !MTC_HOSTMAP_ISON(phb->raw.proposed_liveset[index2], index)))
                         {
                             allowed = FALSE;
                             break;
@@ -1626,7 +2139,7 @@ process_join_request()
             // If the peer thinks he is in the liveset, accept join.
             else if (index != _my_index &&
                      MTC_HOSTMAP_ISON(phb->hbdomain, index) &&
-                     MTC_HOSTMAP_ISON(phb->raw[index].current_liveset, index))
+                     MTC_HOSTMAP_ISON(phb->raw.current_liveset[index], index))
             {
                 if (!MTC_HOSTMAP_ISON(psm->current_liveset, index))
                 {
@@ -1665,9 +2178,12 @@ sm_worker(
     void *ignore)
 {
     log_thread_id("SM_Worker");
+    xhad_set_thread_priority(XHA_PRIORITY_MIDDLE);
+    smvar.worker_thread = pthread_self();
+    smvar.worker_stats.since = _getms();
     while (!smvar.terminate)
     {
-        mssleep(SM_WORKER_INTERVAL);
+        sm_worker_wait(sm_worker_timeout());
 
         check_pool_state();
 
@@ -1688,6 +2204,129 @@ sm_worker(
 }
 
 
+//
+//  sm_wake_worker -
+//
+//  Have sm_worker re-evaluate the pool state, the SF domain and the
+//  join requests.
+//
+
+MTC_STATIC void
+sm_wake_worker()
+{
+    pthread_mutex_lock(&smvar.mutex);
+    if (!smvar.worker_sig)
+    {
+        smvar.worker_sig = TRUE;
+        smvar.worker_signaled = _getms();
+    }
+    pthread_cond_signal(&smvar.worker_cond);
+    pthread_mutex_unlock(&smvar.mutex);
+}
+
+
+//
+//  sm_worker_timeout -
+//
+//  Time [ms] until the first host in the SF domain times out, which
+//  update_sfdomain() has to see without any event.
+//
+
+MTC_STATIC MTC_CLOCK
+sm_worker_timeout()
+{
+    PCOM_DATA_SF    psf;
+    MTC_CLOCK       now, timeout = SM_WORKER_SAFETY_TIMEOUT;
+    MTC_S32         index;
+
+    if (smvar.SR2)
+    {
+        return SM_WORKER_INTERVAL;
+    }
+
+    now = _getms();
+    com_reader_lock_typed(SF, sf_object, &psf);
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        if (MTC_HOSTMAP_ISON(psf->sfdomain, index) &&
+            psf->time_last_SF[index] >= 0 &&
+            psf->time_last_SF[index] + _T2 * ONE_SEC - now < timeout)
+        {
+            timeout = psf->time_last_SF[index] + _T2 * ONE_SEC - now;
+        }
+    }
+    com_reader_unlock(sf_object);
+
+    return (timeout > 0)? timeout: 1;
+}
+
+
+//
+//  sm_worker_wait -
+//
+//  Wait for sm_wake_worker() or the timeout, and account the wakeup.
+//  The counters are logged every SM_WORKER_STATS_INTERVAL.
+//
+
+MTC_STATIC void
+sm_worker_wait(
+    MTC_CLOCK   timeout)
+{
+    SM_WORKER_STATS *pstats = &smvar.worker_stats;
+    struct timespec deadline;
+    MTC_CLOCK       now, latency = -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / ONE_SEC;
+    deadline.tv_nsec += (timeout % ONE_SEC) * 1000 * 1000;
+    if (deadline.tv_nsec >= 1000 * 1000 * 1000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000 * 1000 * 1000;
+    }
+
+    pthread_mutex_lock(&smvar.mutex);
+    while (!smvar.worker_sig &&
+           pthread_cond_timedwait(&smvar.worker_cond, &smvar.mutex, &deadline) != ETIMEDOUT)
+    {
+        ;
+    }
+    now = _getms();
+    if (smvar.worker_sig)
+    {
+        latency = now - smvar.worker_signaled;
+        smvar.worker_sig = FALSE;
+    }
+    pthread_mutex_unlock(&smvar.mutex);
+
+    if (latency >= 0)
+    {
+        pstats->event_wakeups++;
+        pstats->latency_sum += latency;
+        if (latency > pstats->latency_max)
+        {
+            pstats->latency_max = latency;
+        }
+    }
+    else
+    {
+        pstats->timer_wakeups++;
+    }
+
+    if (now - pstats->since >= SM_WORKER_STATS_INTERVAL)
+    {
+        log_message(MTC_LOG_DEBUG,
+            "SM: worker wakeups = %.2f/s (event %u, timer %u), reaction latency = %"PRId64" ms (avg) %"PRId64" ms (max).\n",
+            (double) (pstats->event_wakeups + pstats->timer_wakeups) * ONE_SEC / (now - pstats->since),
+            pstats->event_wakeups, pstats->timer_wakeups,
+            (pstats->event_wakeups)? pstats->latency_sum / pstats->event_wakeups: 0,
+            pstats->latency_max);
+        bzero(pstats, sizeof(*pstats));
+        pstats->since = now;
+    }
+}
+
+
 MTC_STATIC void
 surviving_by_SR2()
 {
@@ -1699,8 +2338,8 @@ surviving_by_SR2()
 
     sf_watchdog_set();
 
-    com_reader_lock(hb_object, (void **) &phb);
-    com_reader_lock(sf_object, (void **) &psf);
+    com_reader_lock_typed(HB, hb_object, &phb);
+    com_reader_lock_typed(SF, sf_object, &psf);
 
     // Check if recovering Survival Rule-2
     recovered = TRUE;
@@ -1715,7 +2354,7 @@ surviving_by_SR2()
         }
         else if (MTC_HOSTMAP_ISON(phb->hbdomain, index))
         {
-            if (! MTC_HOSTMAP_ISON(phb->raw[index].sfdomain, index))
+            if (! MTC_HOSTMAP_ISON(phb->raw.sfdomain[index], index))
             {
                 recovered = FALSE;
             }
@@ -1734,7 +2373,7 @@ surviving_by_SR2()
 
     if (recovered)
     {
-        com_writer_lock(sm_object, (void **) &psm);
+        com_writer_lock_typed(SM, sm_object, &psm);
         psm->SR2 = smvar.SR2 = FALSE;
         com_writer_unlock(sm_object);
         log_message(MTC_LOG_DEBUG, "SM: I am leaving from Survival Rule-2\n");
@@ -1753,10 +2392,11 @@ start_fh(
                     sf_degraded = FALSE,
                     force_requested = FALSE;
     MTC_S32         index;
+    MTC_CLOCK       last_seen = -1;
 
-    com_reader_lock(sm_object, (void **) &psm);
-    com_writer_lock(hb_object, (void **) &phb);
-    com_writer_lock(sf_object, (void **) &psf);
+    com_reader_lock_typed(SM, sm_object, &psm);
+    com_writer_lock_typed(HB, hb_object, &phb);
+    com_writer_lock_typed(SF, sf_object, &psf);
     for (index = 0; _is_configured_host(index); index++)
     {
         // check if up on HB domain
@@ -1778,6 +2418,11 @@ start_fh(
         {
             MTC_HOSTMAP_RESET(smvar.last_hbdomain, index);
             hb_degraded = MTC_HOSTMAP_ISON(psm->current_liveset, index);
+            if (hb_degraded && phb->time_last_HB[index] >= 0 &&
+                (last_seen < 0 || phb->time_last_HB[index] < last_seen))
+            {
+                last_seen = phb->time_last_HB[index];
+            }
         }
         // check if down on SF domain
         if (MTC_HOSTMAP_ISON(smvar.last_sfdomain, index) &&
@@ -1785,6 +2430,11 @@ start_fh(
         {
             MTC_HOSTMAP_RESET(smvar.last_sfdomain, index);
             sf_degraded = MTC_HOSTMAP_ISON(psm->current_liveset, index);
+            if (sf_degraded && psf->time_last_SF[index] >= 0 &&
+                (last_seen < 0 || psf->time_last_SF[index] < last_seen))
+            {
+                last_seen = psf->time_last_SF[index];
+            }
         }
     }
 
@@ -1818,6 +2468,11 @@ start_fh(
             // signal to the fault handler
             pthread_mutex_lock(&smvar.mutex);
             smvar.need_fh = TRUE;
+            if (smvar.fh_triggered < 0)
+            {
+                smvar.fh_triggered = _getms();
+                smvar.fh_last_seen = last_seen;
+            }
             pthread_cond_broadcast(&smvar.cond);
             pthread_mutex_unlock(&smvar.mutex);
             break;
@@ -1885,11 +2540,11 @@ update_sfdomain_sub(
 
         if (writable)
         {
-            com_writer_lock(sf_object, (void **) &psf);
+            com_writer_lock_typed(SF, sf_object, &psf);
         }
         else
         {
-            com_reader_lock(sf_object, (void **) &psf);
+            com_reader_lock_typed(SF, sf_object, &psf);
         }
 
         for (index = 0; _is_configured_host(index); index++)
@@ -2007,7 +2662,7 @@ get_excluded_flag(
     PCOM_DATA_SF    psf;
     MTC_U32         excluded;
 
-    com_reader_lock(sf_object, (void **) &psf);
+    com_reader_lock_typed(SF, sf_object, &psf);
     excluded = MTC_HOSTMAP_ISON(psf->excluded, host);
     com_reader_unlock(sf_object);
 
@@ -2021,7 +2676,7 @@ get_pool_state()
     PCOM_DATA_SF    psf;
     MTC_U32         pool_state;
 
-    com_reader_lock(sf_object, (void **) &psf);
+    com_reader_lock_typed(SF, sf_object, &psf);
     pool_state = psf->pool_state;
     com_reader_unlock(sf_object);
 
@@ -2035,26 +2690,24 @@ get_partition_size(
     MTC_HOSTMAP hbdomain,
     MTC_U32     weight[])
 {
-    MTC_S32 index, size = 0;
+    MTC_S32     index, size = 0;
+    MTC_HOSTMAP sf, hb, partition;
 
     if (is_empty_liveset(sfdomain))
     {
         return 0;
     }
 
-    for (index = 0; _is_configured_host(index); index++)
+    memcpy(sf, sfdomain, sizeof(MTC_HOSTMAP));
+    memcpy(hb, hbdomain, sizeof(MTC_HOSTMAP));
+    MTC_HOSTMAP_INTERSECTION(partition, '=', sf, '&', hb);
+    MTC_HOSTMAP_MASK_UNCONFIG(partition);
+    size = MTC_HOSTMAP_COUNT(partition);
+    if (weight)
     {
-        if (MTC_HOSTMAP_ISON(sfdomain, index) && MTC_HOSTMAP_ISON(hbdomain, index))
+        MTC_HOSTMAP_FOR_EACH(partition, index)
         {
-            if (!weight)
-            {
-                size++;
-            }
-            else
-            {
-                size++;
-                size += 0x100 * weight[index];
-            }
+            size += 0x100 * weight[index];
         }
     }
 
@@ -2067,16 +2720,24 @@ get_partition_score(
     MTC_HOSTMAP hostmap,
     MTC_U32     weight[])
 {
-    MTC_S64 index, size_score = 0, index_score = 0, weight_score = 0;
+    MTC_S64     size_score, index_score = 0, weight_score = 0;
+    MTC_S32     index;
+    MTC_HOSTMAP hosts;
 
-    for (index = ha_config.common.hostnum - 1; index >= 0; index--)
+    memcpy(hosts, hostmap, sizeof(MTC_HOSTMAP));
+    MTC_HOSTMAP_MASK_UNCONFIG(hosts);
+    size_score = MTC_HOSTMAP_COUNT(hosts);
+    MTC_HOSTMAP_FOR_EACH(hosts, index)
     {
-        if (MTC_HOSTMAP_ISON(hostmap, index))
-        {
-            weight_score += weight[index];
-            size_score++;
-            index_score = MAX_HOST_NUM - index;
-        }
+        weight_score += weight[index];
+    }
+
+    // the lowest index wins a tie
+
+    index = MTC_HOSTMAP_FIRST(hosts);
+    if (index >= 0)
+    {
+        index_score = MAX_HOST_NUM - index;
     }
 
     return (weight_score * 0x10000 + size_score * 0x100 + index_score);
@@ -2108,7 +2769,7 @@ am_I_in_largest_partition(
         else
         {
             partition_size[index] =
-                get_partition_size(psf->raw[index].sfdomain, psf->raw[index].hbdomain, weight);
+                get_partition_size(psf->raw.sfdomain[index], psf->raw.hbdomain[index], weight);
         }
 
         if (partition_size[index] > winner_size)
@@ -2125,8 +2786,8 @@ am_I_in_largest_partition(
     if (winner_index >= 0)
     {
         if (winner_index == _my_index ||
-            (MTC_HOSTMAP_ISON(psf->raw[winner_index].sfdomain, _my_index) &&
-             MTC_HOSTMAP_ISON(psf->raw[winner_index].hbdomain, _my_index) &&
+            (MTC_HOSTMAP_ISON(psf->raw.sfdomain[winner_index], _my_index) &&
+             MTC_HOSTMAP_ISON(psf->raw.hbdomain[winner_index], _my_index) &&
              MTC_HOSTMAP_ISON(psf->sfdomain, winner_index) &&
              MTC_HOSTMAP_ISON(phb->hbdomain, winner_index)))
         {
@@ -2141,17 +2802,69 @@ am_I_in_largest_partition(
 MTC_STATIC MTC_BOOLEAN
 is_all_hosts_up(
     MTC_HOSTMAP hostmap)
+{
+    MTC_U64     missing = 0;
+    MTC_S32     w;
+
+    for (w = 0; w < MTC_HOSTMAP_WORD_NUM; w++)
+    {
+        missing |= _hostmap_configured_word(ha_config.common.hostnum, w) &
+                    ~_hostmap_get_word(hostmap, w);
+    }
+    return (missing == 0)? TRUE: FALSE;
+}
+
+
+MTC_STATIC MTC_BOOLEAN
+is_all_nonexcluded_hosts_up(
+    MTC_HOSTMAP hostmap,
+    MTC_HOSTMAP excluded)
+{
+    MTC_U64     missing = 0;
+    MTC_S32     w;
+
+    for (w = 0; w < MTC_HOSTMAP_WORD_NUM; w++)
+    {
+        missing |= _hostmap_configured_word(ha_config.common.hostnum, w) &
+                    ~(_hostmap_get_word(hostmap, w) | _hostmap_get_word(excluded, w));
+    }
+    return (missing == 0)? TRUE: FALSE;
+}
+
+
+//
+//  get_early_quorum -
+//
+//  The early quorum is the set of all configured, non-excluded hosts,
+//  and is reached when all of them are seen on both heartbeat and
+//  State-File.  Returns TRUE with the quorum if it is reached and the
+//  local host is in it.
+//
+
+MTC_STATIC MTC_BOOLEAN
+get_early_quorum(
+    MTC_HOSTMAP  hbdomain,
+    MTC_HOSTMAP  sfdomain,
+    MTC_HOSTMAP  excluded,
+    MTC_HOSTMAP  *pquorum)
 {
     MTC_S32     index;
 
+    MTC_HOSTMAP_INIT_RESET(*pquorum);
     for (index = 0; _is_configured_host(index); index++)
     {
-        if (!MTC_HOSTMAP_ISON(hostmap, index))
+        if (MTC_HOSTMAP_ISON(excluded, index))
+        {
+            continue;
+        }
+        if (!MTC_HOSTMAP_ISON(hbdomain, index) ||
+            !MTC_HOSTMAP_ISON(sfdomain, index))
         {
             return FALSE;
         }
+        MTC_HOSTMAP_SET(*pquorum, index);
     }
-    return TRUE;
+    return MTC_HOSTMAP_ISON(*pquorum, _my_index);
 }
 
 
@@ -2159,17 +2872,15 @@ MTC_STATIC MTC_BOOLEAN
 is_empty_liveset(
     MTC_HOSTMAP liveset)
 {
-    MTC_S32 index;
+    MTC_U64     any = 0;
+    MTC_S32     w;
 
-    for (index = 0; _is_configured_host(index); index++)
+    for (w = 0; w < MTC_HOSTMAP_WORD_NUM; w++)
     {
-        if (MTC_HOSTMAP_ISON(liveset, index))
-        {
-            return FALSE;
-        }
+        any |= _hostmap_configured_word(ha_config.common.hostnum, w) &
+                _hostmap_get_word(liveset, w);
     }
-
-    return TRUE;
+    return (any == 0)? TRUE: FALSE;
 }
 
 
@@ -2190,16 +2901,16 @@ wait_all_hosts_recognize_I_was_down()
         MTC_S32         index;
 
         all_recognized = TRUE;
-        com_reader_lock(hb_object, (void **) &phb);
-        com_reader_lock(sf_object, (void **) &psf);
+        com_reader_lock_typed(HB, hb_object, &phb);
+        com_reader_lock_typed(SF, sf_object, &psf);
         for (index = 0; _is_configured_host(index); index++)
         {
 
             if (index != _my_index &&
                 ((MTC_HOSTMAP_ISON(phb->hbdomain, index) &&
-                  MTC_HOSTMAP_ISON(phb->raw[index].current_liveset, _my_index)) ||
+                  MTC_HOSTMAP_ISON(phb->raw.current_liveset[index], _my_index)) ||
                  (MTC_HOSTMAP_ISON(psf->sfdomain, index) &&
-                  MTC_HOSTMAP_ISON(psf->raw[index].current_liveset, _my_index))))
+                  MTC_HOSTMAP_ISON(psf->raw.current_liveset[index], _my_index))))
             {
                 all_recognized = FALSE;
             }
@@ -2225,17 +2936,21 @@ wait_all_hosts_up_on_heartbeat(
     MTC_CLOCK   timeout)
 {
     PCOM_DATA_HB    phb;
+    PCOM_DATA_SF    psf;
+    MTC_BOOLEAN     up;
     MTC_CLOCK       to;
 
     do
     {
-        com_reader_lock(hb_object, (void **) &phb);
-        if (is_all_hosts_up(phb->hbdomain))
+        com_reader_lock_typed(HB, hb_object, &phb);
+        com_reader_lock_typed(SF, sf_object, &psf);
+        up = is_all_nonexcluded_hosts_up(phb->hbdomain, psf->excluded);
+        com_reader_unlock(sf_object);
+        com_reader_unlock(hb_object);
+        if (up)
         {
-            com_reader_unlock(hb_object);
             break;
         }
-        com_reader_unlock(hb_object);
 
         to = timeout - (_getms() - smvar.start_time);
         to = (to < 0)? 0: to;
@@ -2252,8 +2967,8 @@ wait_all_hosts_up_on_statefile(
 
     do
     {
-        com_reader_lock(sf_object, (void **) &psf);
-        if (is_all_hosts_up(psf->sfdomain))
+        com_reader_lock_typed(SF, sf_object, &psf);
+        if (is_all_nonexcluded_hosts_up(psf->sfdomain, psf->excluded))
         {
             com_reader_unlock(sf_object);
             break;
@@ -2290,8 +3005,8 @@ wait_until_HBSF_state_stable()
         stable = TRUE;
         now = _getms();
 
-        com_reader_lock(hb_object, (void **) &phb);
-        com_reader_lock(sf_object, (void **) &psf);
+        com_reader_lock_typed(HB, hb_object, &phb);
+        com_reader_lock_typed(SF, sf_object, &psf);
         for (index = 0; _is_configured_host(index); index++)
         {
             if (MTC_HOSTMAP_ISON(phb->hbdomain, index) &&
@@ -2356,6 +3071,11 @@ wait_until_all_hosts_have_consistent_view(
     PCOM_DATA_SM    psm;
     PCOM_DATA_HB    phb;
     PCOM_DATA_SF    psf;
+    HA_COMMON_OBJECT_SNAPSHOT snapshot[] = {
+        {sm_object, NULL, sizeof(COM_DATA_SM)},
+        {hb_object, NULL, sizeof(COM_DATA_HB)},
+        {sf_object, NULL, sizeof(COM_DATA_SF)},
+    };
     MTC_BOOLEAN     consistent = FALSE;
     MTC_S32         index, index2, selected;
     MTC_S64         score, minimum;
@@ -2365,40 +3085,84 @@ wait_until_all_hosts_have_consistent_view(
 
     // TBD - do we need this timeout?
     MTC_CLOCK       start = _getms();
+    MTC_CLOCK       to;                 // remaining time; never negative
+
+    release_stable_view();
 
     do
     {
+        //  Scan the views only when the digests say all the hosts
+        //  agree, or at the timeout to report and merge the views.
+
+        to = timeout - (_getms() - start);
+        to = (to < 0)? 0: to;
+        if (count_disagreeing_hosts() > 0 && to > 0)
+        {
+            consistent = FALSE;
+            sm_wait_signals_sm_hb_sf(TRUE, TRUE, TRUE, to);
+            continue;
+        }
+
         consistent = TRUE;
 
-        com_reader_lock(sm_object, (void **) &psm);
-        com_writer_lock(hb_object, (void **) &phb);
-        com_writer_lock(sf_object, (void **) &psf);
+        //  The view is checked on a shared snapshot, which becomes
+        //  the stable view (smvar.stable_hb/sf) when this returns.
+        //  The objects are copied only when they have been updated
+        //  since the last check, and the snapshot is read-only, so
+        //  the hostmaps are masked into local copies.
 
-        MTC_HOSTMAP_MASK_UNCONFIG(phb->hbdomain);
-        MTC_HOSTMAP_MASK_UNCONFIG(psf->sfdomain);
+        com_snapshot_release(snapshot[0].copy);
+        com_snapshot_release(snapshot[1].copy);
+        com_snapshot_release(snapshot[2].copy);
+        snapshot[0].copy = snapshot[1].copy = snapshot[2].copy = NULL;
+        if (com_snapshot_share_many(snapshot, sizeof(snapshot) / sizeof(snapshot[0])) != MTC_SUCCESS)
+        {
+            //  the objects have no data yet; no view to check or merge
+
+            log_internal(MTC_LOG_ERR, "SM: cannot take a snapshot of the SM/HB/SF objects.\n");
+            if (to == 0)
+            {
+                return FALSE;
+            }
+            consistent = FALSE;
+            sm_wait_signals_sm_hb_sf(TRUE, TRUE, TRUE, to);
+            continue;
+        }
+        psm = snapshot[0].copy;
+        phb = snapshot[1].copy;
+        psf = snapshot[2].copy;
+
+        MTC_HOSTMAP_COPY(tmp_hostmap, phb->hbdomain);
+        MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap);
         MTC_HOSTMAP_INTERSECTION(my_hbdomain, '=',
-                                    phb->hbdomain, '&', psm->current_liveset);
+                                    tmp_hostmap, '&', psm->current_liveset);
+        MTC_HOSTMAP_COPY(tmp_hostmap, psf->sfdomain);
+        MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap);
         MTC_HOSTMAP_INTERSECTION(my_sfdomain, '=',
-                                    psf->sfdomain, '&', psm->current_liveset);
+                                    tmp_hostmap, '&', psm->current_liveset);
 
         for (index = 0; _is_configured_host(index); index++)
         {
             if (index != _my_index &&
                 MTC_HOSTMAP_ISON(psm->current_liveset, index))
             {
-                MTC_HOSTMAP_MASK_UNCONFIG(phb->raw[index].hbdomain);
-                MTC_HOSTMAP_MASK_UNCONFIG(psf->raw[index].sfdomain);
+                MTC_HOSTMAP_COPY(tmp_hostmap, phb->raw.hbdomain[index]);
+                MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap);
                 MTC_HOSTMAP_INTERSECTION(remote_hbdomain, '=',
-                                    phb->raw[index].hbdomain, '&', psm->current_liveset);
+                                    tmp_hostmap, '&', psm->current_liveset);
+                MTC_HOSTMAP_COPY(tmp_hostmap, psf->raw.sfdomain[index]);
+                MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap);
                 MTC_HOSTMAP_INTERSECTION(remote_sfdomain, '=',
-                                    psf->raw[index].sfdomain, '&', psm->current_liveset);
+                                    tmp_hostmap, '&', psm->current_liveset);
 
-                MTC_HOSTMAP_MASK_UNCONFIG(phb->raw[index].sfdomain);
-                MTC_HOSTMAP_MASK_UNCONFIG(psf->raw[index].hbdomain);
+                MTC_HOSTMAP_COPY(tmp_hostmap, psf->raw.hbdomain[index]);
+                MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap);
                 MTC_HOSTMAP_INTERSECTION(remote_hbdomain_onsf, '=',
-                                    psf->raw[index].hbdomain, '&', psm->current_liveset);
+                                    tmp_hostmap, '&', psm->current_liveset);
+                MTC_HOSTMAP_COPY(tmp_hostmap, phb->raw.sfdomain[index]);
+                MTC_HOSTMAP_MASK_UNCONFIG(tmp_hostmap);
                 MTC_HOSTMAP_INTERSECTION(remote_sfdomain_onhb, '=',
-                                    phb->raw[index].sfdomain, '&', psm->current_liveset);
+                                    tmp_hostmap, '&', psm->current_liveset);
 
                 if ((MTC_HOSTMAP_ISON(my_hbdomain, index) &&
                      MTC_HOSTMAP_COMPARE(my_hbdomain, '!=', remote_hbdomain))
@@ -2418,31 +3182,19 @@ wait_until_all_hosts_have_consistent_view(
                 }
             }
         }
-        com_writer_unlock(sf_object);
-        com_writer_unlock(hb_object);
-        com_reader_unlock(sm_object);
 
         if (!consistent)
         {
-            if (_getms() - start >= timeout) {
+            to = timeout - (_getms() - start);
+            to = (to < 0)? 0: to;
+            if (to == 0) {
                 index = -1;
                 break;
             }
-            mssleep(100);
-            sm_wait_signals_sm_hb_sf(TRUE, TRUE, TRUE, -1);
+            sm_wait_signals_sm_hb_sf(TRUE, TRUE, TRUE, to);
         }
     } while(!consistent);
 
-    com_reader_lock(sm_object, (void **) &psm);
-    com_reader_lock(hb_object, (void **) &phb);
-    com_reader_lock(sf_object, (void **) &psf);
-    smvar.stable_hb = *phb;
-    smvar.stable_sf = *psf;
-    com_reader_unlock(sf_object);
-    com_reader_unlock(hb_object);
-    phb = &(smvar.stable_hb);
-    psf = &(smvar.stable_sf);
-
     if (!consistent)
     {
         log_message(MTC_LOG_WARNING, "Host (%d) and the local host do not agree on the view to the pool membership.\n", index);
@@ -2453,32 +3205,39 @@ wait_until_all_hosts_have_consistent_view(
         print_liveset(MTC_LOG_WARNING, "\tremote HB domain on SF = (%s)\n", remote_hbdomain_onsf);
         print_liveset(MTC_LOG_WARNING, "\tremote SF domain on HB = (%s)\n", remote_sfdomain_onhb);
 
-        MTC_HOSTMAP_COPY(phb->raw[_my_index].hbdomain, my_hbdomain);
-        MTC_HOSTMAP_COPY(psf->raw[_my_index].hbdomain, my_hbdomain);
-        MTC_HOSTMAP_COPY(phb->raw[_my_index].sfdomain, my_sfdomain);
-        MTC_HOSTMAP_COPY(psf->raw[_my_index].sfdomain, my_sfdomain);
+        //  Merge the views on private copies of the snapshot.
+
+        phb = snapshot[1].copy = com_snapshot_unshare(snapshot[1].copy);
+        psf = snapshot[2].copy = com_snapshot_unshare(snapshot[2].copy);
+        MTC_HOSTMAP_MASK_UNCONFIG(phb->hbdomain);
+        MTC_HOSTMAP_MASK_UNCONFIG(psf->sfdomain);
+
+        MTC_HOSTMAP_COPY(phb->raw.hbdomain[_my_index], my_hbdomain);
+        MTC_HOSTMAP_COPY(psf->raw.hbdomain[_my_index], my_hbdomain);
+        MTC_HOSTMAP_COPY(phb->raw.sfdomain[_my_index], my_sfdomain);
+        MTC_HOSTMAP_COPY(psf->raw.sfdomain[_my_index], my_sfdomain);
 
         for (index = 0; _is_configured_host(index); index++)
         {
-            MTC_HOSTMAP_INTERSECTION(phb->raw[index].hbdomain, '=',
-                                    phb->raw[index].hbdomain, '&', psm->current_liveset);
+            MTC_HOSTMAP_INTERSECTION(phb->raw.hbdomain[index], '=',
+                                    phb->raw.hbdomain[index], '&', psm->current_liveset);
             print_liveset(MTC_LOG_WARNING,
-                "\tother HB domain = (%s)\n", phb->raw[index].hbdomain);
+                "\tother HB domain = (%s)\n", phb->raw.hbdomain[index]);
 
-            MTC_HOSTMAP_INTERSECTION(psf->raw[index].sfdomain, '=',
-                                    psf->raw[index].sfdomain, '&', psm->current_liveset);
+            MTC_HOSTMAP_INTERSECTION(psf->raw.sfdomain[index], '=',
+                                    psf->raw.sfdomain[index], '&', psm->current_liveset);
             print_liveset(MTC_LOG_WARNING,
-                "\tother SF domain = (%s)\n", psf->raw[index].sfdomain);
+                "\tother SF domain = (%s)\n", psf->raw.sfdomain[index]);
 
-            MTC_HOSTMAP_INTERSECTION(psf->raw[index].hbdomain, '=',
-                                    psf->raw[index].hbdomain, '&', psm->current_liveset);
+            MTC_HOSTMAP_INTERSECTION(psf->raw.hbdomain[index], '=',
+                                    psf->raw.hbdomain[index], '&', psm->current_liveset);
             print_liveset(MTC_LOG_WARNING,
-                "\tother HB domain on SF = (%s)\n", psf->raw[index].hbdomain);
+                "\tother HB domain on SF = (%s)\n", psf->raw.hbdomain[index]);
 
-            MTC_HOSTMAP_INTERSECTION(phb->raw[index].sfdomain, '=',
-                                    phb->raw[index].sfdomain, '&', psm->current_liveset);
+            MTC_HOSTMAP_INTERSECTION(phb->raw.sfdomain[index], '=',
+                                    phb->raw.sfdomain[index], '&', psm->current_liveset);
             print_liveset(MTC_LOG_WARNING,
-                "\tother SF domain on HB = (%s)\n", phb->raw[index].sfdomain);
+                "\tother SF domain on HB = (%s)\n", phb->raw.sfdomain[index]);
         }
         for (index = 0; _is_configured_host(index); index++)
         {
@@ -2493,13 +3252,13 @@ wait_until_all_hosts_have_consistent_view(
                 continue;
             }
 
-            if (is_empty_liveset(psf->raw[index].sfdomain) ||
-                is_empty_liveset(phb->raw[index].sfdomain))
+            if (is_empty_liveset(psf->raw.sfdomain[index]) ||
+                is_empty_liveset(phb->raw.sfdomain[index]))
             {
                 MTC_HOSTMAP_RESET(my_sfdomain, index);
                 MTC_HOSTMAP_RESET(psf->sfdomain, index);
-                MTC_HOSTMAP_RESET(psf->raw[_my_index].sfdomain, index);
-                MTC_HOSTMAP_RESET(phb->raw[_my_index].sfdomain, index);
+                MTC_HOSTMAP_RESET(psf->raw.sfdomain[_my_index], index);
+                MTC_HOSTMAP_RESET(phb->raw.sfdomain[_my_index], index);
             }
         }
 
@@ -2509,10 +3268,10 @@ wait_until_all_hosts_have_consistent_view(
         {
             if (!MTC_HOSTMAP_ISON(my_sfdomain, index))
             {
-                MTC_HOSTMAP_INIT_RESET(psf->raw[index].hbdomain);
+                MTC_HOSTMAP_INIT_RESET(psf->raw.hbdomain[index]);
                 for (index2 = 0; _is_configured_host(index2); index2++)
                 {
-                    MTC_HOSTMAP_RESET(psf->raw[index2].hbdomain, index);
+                    MTC_HOSTMAP_RESET(psf->raw.hbdomain[index2], index);
                 }
                 MTC_HOSTMAP_SET(removedhost, index);
             }
@@ -2530,7 +3289,7 @@ wait_until_all_hosts_have_consistent_view(
                 {
                     continue;
                 }
-                score = get_partition_score(psf->raw[index].hbdomain, psf->weight);
+                score = get_partition_score(psf->raw.hbdomain[index], psf->weight);
                 if (selected < 0 || score < minimum)
                 {
                     selected = index;
@@ -2543,17 +3302,17 @@ wait_until_all_hosts_have_consistent_view(
             }
             else
             {
-                MTC_HOSTMAP_UNION(tmp_hostmap, '=', psf->raw[selected].hbdomain, '|', removedhost);
+                MTC_HOSTMAP_UNION(tmp_hostmap, '=', psf->raw.hbdomain[selected], '|', removedhost);
             }
             if (is_all_hosts_up(tmp_hostmap))
             {
                 break;
             }
             // remove the selected host
-            MTC_HOSTMAP_INIT_RESET(psf->raw[selected].hbdomain);
+            MTC_HOSTMAP_INIT_RESET(psf->raw.hbdomain[selected]);
             for (index = 0; _is_configured_host(index); index++)
             {
-                MTC_HOSTMAP_RESET(psf->raw[index].hbdomain, selected);
+                MTC_HOSTMAP_RESET(psf->raw.hbdomain[index], selected);
             }
             MTC_HOSTMAP_SET(removedhost, selected);
         }
@@ -2561,32 +3320,32 @@ wait_until_all_hosts_have_consistent_view(
         log_message(MTC_LOG_WARNING, "after merger: %d\n", index);
         for (index = 0; _is_configured_host(index); index++)
         {
-            MTC_HOSTMAP_INTERSECTION(phb->raw[index].hbdomain, '=',
-                                    phb->raw[index].hbdomain, '&', psm->current_liveset);
+            MTC_HOSTMAP_INTERSECTION(phb->raw.hbdomain[index], '=',
+                                    phb->raw.hbdomain[index], '&', psm->current_liveset);
             print_liveset(MTC_LOG_WARNING,
-                "\tother HB domain = (%s)\n", phb->raw[index].hbdomain);
+                "\tother HB domain = (%s)\n", phb->raw.hbdomain[index]);
 
-            MTC_HOSTMAP_INTERSECTION(psf->raw[index].sfdomain, '=',
-                                    psf->raw[index].sfdomain, '&', psm->current_liveset);
+            MTC_HOSTMAP_INTERSECTION(psf->raw.sfdomain[index], '=',
+                                    psf->raw.sfdomain[index], '&', psm->current_liveset);
             print_liveset(MTC_LOG_WARNING,
-                "\tother SF domain = (%s)\n", psf->raw[index].sfdomain);
+                "\tother SF domain = (%s)\n", psf->raw.sfdomain[index]);
 
-            MTC_HOSTMAP_INTERSECTION(psf->raw[index].hbdomain, '=',
-                                    psf->raw[index].hbdomain, '&', psm->current_liveset);
+            MTC_HOSTMAP_INTERSECTION(psf->raw.hbdomain[index], '=',
+                                    psf->raw.hbdomain[index], '&', psm->current_liveset);
             print_liveset(MTC_LOG_WARNING,
-                "\tother HB domain on SF = (%s)\n", psf->raw[index].hbdomain);
+                "\tother HB domain on SF = (%s)\n", psf->raw.hbdomain[index]);
 
-            MTC_HOSTMAP_INTERSECTION(phb->raw[index].sfdomain, '=',
-                                    phb->raw[index].sfdomain, '&', psm->current_liveset);
+            MTC_HOSTMAP_INTERSECTION(phb->raw.sfdomain[index], '=',
+                                    phb->raw.sfdomain[index], '&', psm->current_liveset);
             print_liveset(MTC_LOG_WARNING,
-                "\tother SF domain on HB = (%s)\n", phb->raw[index].sfdomain);
+                "\tother SF domain on HB = (%s)\n", phb->raw.sfdomain[index]);
         }
         for (index = 0; _is_configured_host(index); index++)
         {
             log_message(MTC_LOG_WARNING, "\tweight[%d] = %d\n", index, psf->weight[index]);
         }
 
-        MTC_HOSTMAP_COPY(phb->hbdomain, psf->raw[_my_index].hbdomain);
+        MTC_HOSTMAP_COPY(phb->hbdomain, psf->raw.hbdomain[_my_index]);
         MTC_HOSTMAP_COPY(psf->sfdomain, my_sfdomain);
 
         print_liveset(MTC_LOG_WARNING, "\tmerged HB domain = (%s)\n", phb->hbdomain);
@@ -2600,14 +3359,193 @@ wait_until_all_hosts_have_consistent_view(
         print_liveset(MTC_LOG_WARNING, "\tHB domain = (%s)\n", phb->hbdomain);
         print_liveset(MTC_LOG_WARNING, "\tSF domain = (%s)\n", psf->sfdomain);
     }
-    com_reader_unlock(sm_object);
+
+    com_snapshot_release(snapshot[0].copy);
+    smvar.stable_hb = phb;
+    smvar.stable_sf = psf;
 
     return consistent;
 }
 
 
+//
+//  Consistent view digests (see SM_VIEW_DIGEST)
+//
+//  Called from the COM callbacks with the updated object. Only the
+//  hosts whose views have changed are re-evaluated, unless the local
+//  view or the liveset has changed.
+//
+
+//  Returns TRUE if the digest has changed.
+
+MTC_STATIC MTC_BOOLEAN
+update_hostmap_digest(
+    SM_HOSTMAP_DIGEST   digest,
+    MTC_HOSTMAP         hostmap)
+{
+    MTC_U64     word, changed = 0;
+    MTC_S32     w;
+
+    for (w = 0; w < MTC_HOSTMAP_WORD_NUM; w++)
+    {
+        word = _hostmap_get_word(hostmap, w);
+        changed |= word ^ digest[w];
+        digest[w] = word;
+    }
+    return (changed != 0);
+}
+
+MTC_STATIC void
+evaluate_view_digest(
+    SM_VIEW_DIGEST  *pdigest,
+    MTC_S32         index)
+{
+    MTC_U64     mask, my_hbdomain, my_sfdomain,
+                host = (MTC_U64) 1 << (index % MTC_HOSTMAP_WORD_BITS),
+                in_liveset = 0, in_hbdomain = 0, in_sfdomain = 0,
+                hb_differs = 0, sf_differs = 0;
+    MTC_BOOLEAN disagree = FALSE;
+    MTC_S32     w;
+
+    //
+    //  hb_differs: the views reported on HB differ from the local view
+    //  sf_differs: the views reported on SF differ from the local view
+    //
+
+    for (w = 0; w < MTC_HOSTMAP_WORD_NUM; w++)
+    {
+        mask = _hostmap_configured_word(ha_config.common.hostnum, w) & pdigest->liveset[w];
+        my_hbdomain = pdigest->hbdomain[w] & mask;
+        my_sfdomain = pdigest->sfdomain[w] & mask;
+        hb_differs |= (my_hbdomain ^ (pdigest->hb_hbdomain[index][w] & mask)) |
+                      (my_sfdomain ^ (pdigest->hb_sfdomain[index][w] & mask));
+        sf_differs |= (my_sfdomain ^ (pdigest->sf_sfdomain[index][w] & mask)) |
+                      (my_hbdomain ^ (pdigest->sf_hbdomain[index][w] & mask));
+        if (w == index / MTC_HOSTMAP_WORD_BITS)
+        {
+            in_liveset = mask & host;
+            in_hbdomain = my_hbdomain & host;
+            in_sfdomain = my_sfdomain & host;
+        }
+    }
+
+    if (index != _my_index && in_liveset)
+    {
+        disagree = (in_hbdomain && hb_differs) || (in_sfdomain && sf_differs);
+    }
+    if (disagree != pdigest->disagree[index])
+    {
+        pdigest->disagree[index] = disagree;
+        if (disagree)
+        {
+            pdigest->disagree_num++;
+        }
+        else
+        {
+            pdigest->disagree_num--;
+        }
+    }
+}
+
+MTC_STATIC void
+evaluate_view_digest_all(
+    SM_VIEW_DIGEST  *pdigest)
+{
+    MTC_S32     index;
+
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        evaluate_view_digest(pdigest, index);
+    }
+}
+
+MTC_STATIC void
+update_view_digest_hb(
+    PCOM_DATA_HB phb)
+{
+    SM_VIEW_DIGEST  *pdigest = &smvar.view_digest;
+    MTC_BOOLEAN     all, changed;
+    MTC_S32         index;
+
+    pthread_mutex_lock(&smvar.mutex);
+    all = update_hostmap_digest(pdigest->hbdomain, phb->hbdomain);
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        changed = update_hostmap_digest(pdigest->hb_hbdomain[index], phb->raw.hbdomain[index]);
+        changed |= update_hostmap_digest(pdigest->hb_sfdomain[index], phb->raw.sfdomain[index]);
+        if (changed)
+        {
+            if (!all)
+            {
+                evaluate_view_digest(pdigest, index);
+            }
+        }
+    }
+    if (all)
+    {
+        evaluate_view_digest_all(pdigest);
+    }
+    pthread_mutex_unlock(&smvar.mutex);
+}
+
+MTC_STATIC void
+update_view_digest_sf(
+    PCOM_DATA_SF psf)
+{
+    SM_VIEW_DIGEST  *pdigest = &smvar.view_digest;
+    MTC_BOOLEAN     all, changed;
+    MTC_S32         index;
+
+    pthread_mutex_lock(&smvar.mutex);
+    all = update_hostmap_digest(pdigest->sfdomain, psf->sfdomain);
+    for (index = 0; _is_configured_host(index); index++)
+    {
+        changed = update_hostmap_digest(pdigest->sf_hbdomain[index], psf->raw.hbdomain[index]);
+        changed |= update_hostmap_digest(pdigest->sf_sfdomain[index], psf->raw.sfdomain[index]);
+        if (changed)
+        {
+            if (!all)
+            {
+                evaluate_view_digest(pdigest, index);
+            }
+        }
+    }
+    if (all)
+    {
+        evaluate_view_digest_all(pdigest);
+    }
+    pthread_mutex_unlock(&smvar.mutex);
+}
+
+MTC_STATIC void
+update_view_digest_sm(
+    PCOM_DATA_SM psm)
+{
+    SM_VIEW_DIGEST  *pdigest = &smvar.view_digest;
+
+    pthread_mutex_lock(&smvar.mutex);
+    if (update_hostmap_digest(pdigest->liveset, psm->current_liveset))
+    {
+        evaluate_view_digest_all(pdigest);
+    }
+    pthread_mutex_unlock(&smvar.mutex);
+}
+
+MTC_STATIC MTC_U32
+count_disagreeing_hosts()
+{
+    MTC_U32     count;
+
+    pthread_mutex_lock(&smvar.mutex);
+    count = smvar.view_digest.disagree_num;
+    pthread_mutex_unlock(&smvar.mutex);
+    return count;
+}
+
+
 MTC_STATIC MTC_BOOLEAN
 wait_until_all_hosts_booted(
+    MTC_HOSTMAP *phosts,
     MTC_CLOCK   timeout)
 {
     PCOM_DATA_HB    phb;
@@ -2617,13 +3555,14 @@ wait_until_all_hosts_booted(
 
     do
     {
-        com_reader_lock(hb_object, (void **) &phb);
+        com_reader_lock_typed(HB, hb_object, &phb);
         booted = TRUE;
         for (index = 0; _is_configured_host(index); index++)
         {
             if (index != _my_index &&
+                MTC_HOSTMAP_ISON(*phosts, index) &&
                 MTC_HOSTMAP_ISON(phb->hbdomain, index) &&
-                !MTC_HOSTMAP_ISON(phb->raw[index].proposed_liveset, _my_index))
+                !MTC_HOSTMAP_ISON(phb->raw.proposed_liveset[index], _my_index))
             {
                 booted = FALSE;
                 break;
@@ -2650,7 +3589,7 @@ commit_weight()
     MTC_U32         weight;
     PCOM_DATA_SM    psm;
 
-    com_writer_lock(sm_object, (void **) &psm);
+    com_writer_lock_typed(SM, sm_object, &psm);
     weight = psm->commited_weight = psm->weight;
     com_writer_unlock(sm_object);
 
@@ -2665,7 +3604,7 @@ start_statefile()
 {
     PCOM_DATA_SF    psf;
 
-    com_writer_lock(sf_object, (void **) &psf);
+    com_writer_lock_typed(SF, sf_object, &psf);
     psf->ctl.starting = TRUE;
     psf->ctl.enable_SF_read = TRUE;
     psf->ctl.enable_SF_write = TRUE;
@@ -2678,7 +3617,7 @@ clear_statefile_starting()
 {
     PCOM_DATA_SF    psf;
 
-    com_writer_lock(sf_object, (void **) &psf);
+    com_writer_lock_typed(SF, sf_object, &psf);
     psf->ctl.starting = FALSE;
     com_writer_unlock(sf_object);
 }
@@ -2688,7 +3627,7 @@ start_heartbeat()
 {
     PCOM_DATA_HB    phb;
 
-    com_writer_lock(hb_object, (void **) &phb);
+    com_writer_lock_typed(HB, hb_object, &phb);
     phb->ctl.join = FALSE;
     phb->ctl.enable_HB_receive = TRUE;
     phb->ctl.enable_HB_send = TRUE;
@@ -2700,7 +3639,7 @@ set_heartbeat_join()
 {
     PCOM_DATA_HB    phb;
 
-    com_writer_lock(hb_object, (void **) &phb);
+    com_writer_lock_typed(HB, hb_object, &phb);
     phb->ctl.join = TRUE;
     com_writer_unlock(hb_object);
 }
@@ -2710,7 +3649,7 @@ fence_request()
 {
     PCOM_DATA_HB    phb;
 
-    com_writer_lock(hb_object, (void **) &phb);
+    com_writer_lock_typed(HB, hb_object, &phb);
     phb->ctl.fence_request = TRUE;
     com_writer_unlock(hb_object);
 }
@@ -2720,7 +3659,7 @@ cancel_fence_request()
 {
     PCOM_DATA_HB    phb;
 
-    com_writer_lock(hb_object, (void **) &phb);
+    com_writer_lock_typed(HB, hb_object, &phb);
     phb->ctl.fence_request = FALSE;
     com_writer_unlock(hb_object);
 }
@@ -2730,7 +3669,7 @@ start_xapi_monitor()
 {
     PCOM_DATA_XAPIMON   pxapimon;
 
-    com_writer_lock(xapimon_object, (void **) &pxapimon);
+    com_writer_lock_typed(XAPIMON, xapimon_object, &pxapimon);
     pxapimon->ctl.enable_Xapi_monitor = TRUE;
     com_writer_unlock(xapimon_object);
 }
@@ -2741,7 +3680,7 @@ arm_fencing()
 {
     PCOM_DATA_SM    psm;
 
-    com_writer_lock(sm_object, (void **) &psm);
+    com_writer_lock_typed(SM, sm_object, &psm);
     smvar.fencing = psm->fencing = FENCING_ARMED;
     com_writer_unlock(sm_object);
 }
@@ -2826,27 +3765,37 @@ sm_wait_signals_sm_hb_sf(
     MTC_BOOLEAN sf_sig,
     MTC_CLOCK   timeout)
 {
-    MTC_BOOLEAN signaled;
-    MTC_CLOCK   start = _getms();
+    MTC_BOOLEAN     signaled;
+    struct timespec deadline;
 
     if (timeout == 0)
     {
         return FALSE;
     }
 
+    if (timeout > 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout / ONE_SEC;
+        deadline.tv_nsec += (timeout % ONE_SEC) * 1000 * 1000;
+        if (deadline.tv_nsec >= 1000 * 1000 * 1000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000 * 1000 * 1000;
+        }
+    }
+
     pthread_mutex_lock(&smvar.mutex);
-    while (!(signaled = check_sigs(sm_sig, hb_sig, sf_sig)) &&
-           ((timeout < 0)? TRUE: (_getms() - start < timeout)))
+    while (!(signaled = check_sigs(sm_sig, hb_sig, sf_sig)))
     {
         if (timeout < 0)
         {
             pthread_cond_wait(&smvar.cond, &smvar.mutex);
         }
-        else
+        else if (pthread_cond_timedwait(&smvar.cond, &smvar.mutex, &deadline) == ETIMEDOUT)
         {
-            pthread_mutex_unlock(&smvar.mutex);
-            mssleep(100);
-            pthread_mutex_lock(&smvar.mutex);
+            signaled = check_sigs(sm_sig, hb_sig, sf_sig);
+            break;
         }
     }
     pthread_mutex_unlock(&smvar.mutex);
@@ -90,9 +90,36 @@
 #define SLEEP_INTERVAL  500     //  500ms
 #define ACCELERATED_ACCESS_INTERVAL (SLEEP_INTERVAL - 100)
 
-//  State-File buffer
+//  Latency histogram
+//
+//  Latencies (ms) are recorded in log-scaled buckets. Values less than
+//  LATENCY_SUB_BUCKETS have their own buckets, and each power of two
+//  above is divided into LATENCY_SUB_BUCKETS buckets (error < 1/16).
+//  Percentiles are taken from the current and the previous window.
+
+#define LATENCY_SUB_BUCKET_BITS 4
+#define LATENCY_SUB_BUCKETS     (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_BITS        20      //  up to about 17 minutes
+#define LATENCY_MAX_VALUE       ((1 << LATENCY_MAX_BITS) - 1)
+#define LATENCY_BUCKETS         ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+#define LATENCY_WINDOW          (10 * ONE_MINUTE)
+
+typedef struct _LATENCY_HISTOGRAM {
+    MTC_CLOCK   start;                      //  clock(ms) when this window started
+    MTC_U32     samples;
+    MTC_S32     max;
+    MTC_U32     bucket[LATENCY_BUCKETS];
+} LATENCY_HISTOGRAM, *PLATENCY_HISTOGRAM;
+
+//  State-File buffers
+//
+//  Snapshot[] are double-buffered images of the State-File. The SF thread
+//  reads into the one not published, then publishes it by a pointer swap.
+//  GlobalSection and LocalHostSection are the buffers used for writes.
 
-static STATE_FILE StateFile __attribute__ ((aligned (IOALIGN)));
+static SF_SNAPSHOT Snapshot[2] __attribute__ ((aligned (IOALIGN)));
+static SF_GLOBAL_SECTION GlobalSection __attribute__ ((aligned (IOALIGN)));
+static SF_HOST_SPECIFIC_SECTION LocalHostSection __attribute__ ((aligned (IOALIGN)));
 
 //  Referenced objects
 
@@ -109,13 +136,13 @@ static HA_COMMON_OBJECT_HANDLE
 
 static struct {
     PHA_COMMON_OBJECT_HANDLE    phandle;
-    PMTC_S8                     name;
+    COM_OBJECT_ID               id;
     HA_COMMON_OBJECT_CALLBACK   callback;
 } objects[] = {
-    {&hb_object,        COM_ID_HB,      NULL},
-    {&sf_object,        COM_ID_SF,      sf_sf_updated},
-    {&xapimon_object,   COM_ID_XAPIMON, NULL},
-    {&sm_object,        COM_ID_SM,      NULL},
+    {&hb_object,        COM_OBJECT_HB,      NULL},
+    {&sf_object,        COM_OBJECT_SF,      sf_sf_updated},
+    {&xapimon_object,   COM_OBJECT_XAPIMON, NULL},
+    {&sm_object,        COM_OBJECT_SM,      NULL},
 };
 
 //
@@ -127,6 +154,8 @@ static struct {
     MTC_BOOLEAN         terminate;
     MTC_U32             sequence;
     pthread_t sf_thread;
+    MTC_U32             written_sequence;       //  sequence number next to the last successful
+                                                //  write of the local host specific element
 
     struct {
         pthread_spinlock_t  lock;               // spinlock to serialize accesses
@@ -137,6 +166,11 @@ static struct {
             MTC_CLOCK       ms;                 // SF access interval in ms.
             MTC_U32         accelerate_count;   // number of stacked acceleration
         } interval;
+        struct {
+            PSF_SNAPSHOT    published;          // current snapshot (NULL until the first read)
+            MTC_U32         version;            // version of the published snapshot
+            MTC_U32         readers[2];         // number of readers holding Snapshot[i]
+        } snapshot;
     };
     struct {
         MTC_BOOLEAN readonce;
@@ -150,6 +184,10 @@ static struct {
         MTC_S32 max;
         MTC_S32 min;
     } readlatency, writelatency;
+    struct {
+        LATENCY_HISTOGRAM   window[2];      //  current and previous window
+        MTC_U32             current;        //  index of the current window
+    } histogram[SF_SECTION_NUM][SF_ACCESS_NUM];
 } sfvar = { 0 };
 
 //  lock
@@ -221,12 +259,27 @@ readsf();
 MTC_STATIC  MTC_STATUS
 write_hostspecific();
 
+MTC_STATIC  PSF_SNAPSHOT
+sf_snapshot_prepare();
+
+MTC_STATIC  MTC_U32
+sf_snapshot_decode(
+    PSF_SNAPSHOT snapshot);
+
+MTC_STATIC  void
+sf_snapshot_publish(
+    PSF_SNAPSHOT snapshot);
+
 MTC_STATIC  void
 sf_wakeupthread();
 
 MTC_STATIC  int
 sf_rand();
 
+MTC_STATIC  void
+sf_latency_summarize(
+    SF_LATENCY_SUMMARY summary[SF_SECTION_NUM][SF_ACCESS_NUM]);
+
 //
 //
 //  F U N C T I O N   D E F I N I T I O N S
@@ -312,6 +365,10 @@ sf_initialize0()
     sfvar.SF_access = FALSE;
     sfvar.interval.ms = _t2 * 1000;
 
+    sfvar.snapshot.published = NULL;
+    sfvar.snapshot.version = 0;
+    sfvar.snapshot.readers[0] = sfvar.snapshot.readers[1] = 0;
+
     for (host = 0; host < MAX_HOST_NUM; host++)
     {
         sfvar.hoststat[host].readonce = FALSE;
@@ -343,29 +400,56 @@ sf_initialize0()
     MTC_HOSTMAP_INIT_RESET(sfobj.excluded);
     MTC_HOSTMAP_INIT_RESET(sfobj.sfdomain);
     MTC_HOSTMAP_INIT_RESET(sfobj.starting);
+    MTC_HOSTMAP_INIT_RESET(sfobj.self_fencing);
     sfobj.pool_state = SF_STATE_NONE;
 
     for (host = 0; host < MAX_HOST_NUM; host++)
     {
-        MTC_HOSTMAP_INIT_RESET(sfobj.raw[host].current_liveset);
-        MTC_HOSTMAP_INIT_RESET(sfobj.raw[host].proposed_liveset);
-        MTC_HOSTMAP_INIT_RESET(sfobj.raw[host].hbdomain);
-        MTC_HOSTMAP_INIT_RESET(sfobj.raw[host].sfdomain);
+        MTC_HOSTMAP_INIT_RESET(sfobj.raw.current_liveset[host]);
+        MTC_HOSTMAP_INIT_RESET(sfobj.raw.proposed_liveset[host]);
+        MTC_HOSTMAP_INIT_RESET(sfobj.raw.hbdomain[host]);
+        MTC_HOSTMAP_INIT_RESET(sfobj.raw.sfdomain[host]);
         for (host2 = 0; host2 < MAX_HOST_NUM; host2++)
         {
-            sfobj.raw[host].time_since_last_HB_receipt[host2] = -1;
-            sfobj.raw[host].time_since_last_SF_update[host2] = -1;
+            sfobj.raw.time_since_last_HB_receipt[host][host2] = -1;
+            sfobj.raw.time_since_last_SF_update[host][host2] = -1;
         }
-        sfobj.raw[host].time_since_xapi_restart = -1;
+        sfobj.raw.time_since_xapi_restart[host] = -1;
     }
 
     sfobj.latency = sfobj.latency_max = sfobj.latency_min = -1;
+    sfobj.changed_sections = 0;
+    for (index = 0; index < SF_SECTION_NUM * SF_ACCESS_NUM; index++)
+    {
+        PSF_LATENCY_SUMMARY summary = &sfobj.latency_summary[0][0] + index;
+
+        summary->samples = 0;
+        summary->p50 = summary->p99 = summary->p999 = summary->max = -1;
+    }
 
     sfobj.fencing = FENCING_ARMED;
 
+    // initialize decoded area of the snapshots, so that
+    // unconfigured hosts have the same values as the SF object
+
+    for (index = 0; index < 2; index++)
+    {
+        Snapshot[index].version = 0;
+        Snapshot[index].readclock = -1;
+        MTC_HOSTMAP_INIT_RESET(Snapshot[index].decoded.valid);
+        MTC_HOSTMAP_INIT_RESET(Snapshot[index].decoded.changed);
+        memcpy(Snapshot[index].decoded.lm, sfobj.lm, sizeof(sfobj.lm));
+        MTC_HOSTMAP_INIT_RESET(Snapshot[index].decoded.excluded);
+        MTC_HOSTMAP_INIT_RESET(Snapshot[index].decoded.starting);
+        MTC_HOSTMAP_INIT_RESET(Snapshot[index].decoded.self_fencing);
+        Snapshot[index].decoded.raw = sfobj.raw;
+        memset(Snapshot[index].decoded.sm_phase, 0, sizeof(Snapshot[index].decoded.sm_phase));
+        memset(Snapshot[index].decoded.weight, 0, sizeof(Snapshot[index].decoded.weight));
+    }
+
     // create common object
 
-    status = com_create(COM_ID_SF, &sf_object, sizeof(COM_DATA_SF), &sfobj);
+    status = com_create_typed(SF, &sf_object, &sfobj);
 
     if (status != MTC_SUCCESS)
     {
@@ -382,11 +466,11 @@ sf_initialize0()
 
         if (*(objects[index].phandle) == HA_COMMON_OBJECT_INVALID_HANDLE_VALUE)
         {
-            status = com_open(objects[index].name, objects[index].phandle);
+            status = com_open_id(objects[index].id, objects[index].phandle);
             if (status != MTC_SUCCESS)
             {
                 log_internal(MTC_LOG_ERR,
-                            "SF: cannot open COM object (name = %s). (%d)\n", objects[index].name, status);
+                            "SF: cannot open COM object (id = %d). (%d)\n", objects[index].id, status);
                 *(objects[index].phandle) = HA_COMMON_OBJECT_INVALID_HANDLE_VALUE;
                 goto error;
             }
@@ -399,7 +483,7 @@ sf_initialize0()
             if (status != MTC_SUCCESS)
             {
                 log_internal(MTC_LOG_ERR,
-                            "SF: cannot register callback on the COM object (%s). (%d)\n", objects[index].name, status);
+                            "SF: cannot register callback on the COM object (id = %d). (%d)\n", objects[index].id, status);
                 goto error;
             }
         }
@@ -536,7 +620,7 @@ sfthread(
         }
         sf_unlock();
 
-        com_writer_lock(sf_object, (void **) &psf);
+        com_writer_lock_typed(SF, sf_object, &psf);
         writable = psf->ctl.enable_SF_write;
         readable = psf->ctl.enable_SF_read;
         com_writer_unlock(sf_object);
@@ -588,7 +672,7 @@ sfthread(
             case    MTC_ERROR_SF_PENDING_WRITE:
                 if ((status = FIST_global_write()) == MTC_SUCCESS)
                 {
-                    status = sf_writeglobal(sfvar.sfdesc, &StateFile.global);
+                    status = sf_writeglobal(sfvar.sfdesc, &GlobalSection);
                 }
 
                 if (status != MTC_SUCCESS && print_status != PSTATUS_ERROR)
@@ -630,15 +714,26 @@ sfthread(
 //
 //  Read entire State-File and update SF objects accordingly.
 //
+//  The State-File is read into the snapshot buffer which is not
+//  published, and host specific elements are decoded there without
+//  any lock held. Then the snapshot is published by a pointer swap
+//  and the decoded data is transferred to the SF object only for the
+//  host specific elements changed since the last publication, so that
+//  the work under the writer-lock scales with the update rate rather
+//  than the number of hosts.
+//
 
 MTC_STATIC  MTC_STATUS
 readsf()
 {
     MTC_STATUS status;
-    int attempt, host_index, host_index2;
+    int attempt, host_index;
     PCOM_DATA_SM        psm;
     PCOM_DATA_SF        psf;
+    PSF_SNAPSHOT        snapshot;
+    MTC_U32             changed_sections = 0;
     MTC_S32 max, min;
+    SF_LATENCY_SUMMARY  latency_summary[SF_SECTION_NUM][SF_ACCESS_NUM];
     struct {
         MTC_STATUS  global_section;
         MTC_STATUS  host_section[MAX_HOST_NUM];
@@ -650,6 +745,8 @@ readsf()
         iostatus.host_section[host_index] = MTC_ERROR_UNDEFINED;
     }
 
+    snapshot = sf_snapshot_prepare();
+
     //  Attempto to read entire State-File.
     //  Retry applies.
 
@@ -661,7 +758,7 @@ readsf()
         {
             if ((iostatus.global_section = FIST_global_read()) == MTC_SUCCESS)
             {
-                iostatus.global_section = sf_readglobal(sfvar.sfdesc, &StateFile.global, _gen_UUID);
+                iostatus.global_section = sf_readglobal(sfvar.sfdesc, &snapshot->file.global, _gen_UUID);
             }
         }
 
@@ -672,7 +769,7 @@ readsf()
                 if ((iostatus.host_section[host_index] = FIST_hostspecific_read()) == MTC_SUCCESS)
                 {
                     iostatus.host_section[host_index] =
-                            sf_readhostspecific(sfvar.sfdesc, host_index, &StateFile.host[host_index]);
+                            sf_readhostspecific(sfvar.sfdesc, host_index, &snapshot->file.host[host_index]);
                 }
 
                 if (iostatus.host_section[host_index] == MTC_SUCCESS)
@@ -683,7 +780,7 @@ readsf()
                     if (sfvar.hoststat[host_index].readonce == FALSE)
                     {
                         sfvar.hoststat[host_index].readonce = TRUE;
-                        sfvar.hoststat[host_index].sequence = StateFile.host[host_index].data.sequence;
+                        sfvar.hoststat[host_index].sequence = snapshot->file.host[host_index].data.sequence;
 
                         //  If this is the local host, initialize the
                         //  sequence number used in sf_writehostspecific, which
@@ -694,9 +791,9 @@ readsf()
                             sfvar.sequence = sfvar.hoststat[host_index].sequence;
                         }
                     }
-                    else if (sfvar.hoststat[host_index].sequence != StateFile.host[host_index].data.sequence)
+                    else if (sfvar.hoststat[host_index].sequence != snapshot->file.host[host_index].data.sequence)
                     {
-                        sfvar.hoststat[host_index].sequence = StateFile.host[host_index].data.sequence;
+                        sfvar.hoststat[host_index].sequence = snapshot->file.host[host_index].data.sequence;
                         sfvar.hoststat[host_index].updateclock = sfvar.hoststat[host_index].readclock;
 
                     }
@@ -722,23 +819,43 @@ readsf()
 
         sleep(1);
     }
+
+    sf_latency_summarize(latency_summary);
+
+    //  Decode the host specific elements and publish the snapshot.
+
+    if (status == MTC_SUCCESS)
+    {
+        changed_sections = sf_snapshot_decode(snapshot);
+        sf_snapshot_publish(snapshot);
+
+        log_maskable_debug_message(TRACE,
+            "SF: %d host specific element(s) changed.\n", changed_sections);
+    }
     
     //  State-File is sccessfully read, or the attempt failed after retries.
     //  Update SF objects.
 
-    com_reader_lock(sm_object, (void **) &psm);
-    com_writer_lock(sf_object, (void **) &psf);
+    com_reader_lock_typed(SM, sm_object, &psm);
+    com_writer_lock_typed(SF, sf_object, &psf);
 
     if (status == MTC_SUCCESS)
     {
+        //  host specific elements changed since the last publication
+
         for (host_index = 0; _is_configured_host(host_index); host_index++)
         {
+            if (!MTC_HOSTMAP_ISON(snapshot->decoded.changed, host_index))
+            {
+                continue;
+            }
+
             //  lock manager data
 
             if (host_index != _my_index)
             {
-                psf->lm[host_index].request = (StateFile.host[host_index].data.lock_request ? TRUE: FALSE);
-                MTC_HOSTMAP_COPY(psf->lm[host_index].grant, StateFile.host[host_index].data.lock_grant);
+                psf->lm[host_index].request = snapshot->decoded.lm[host_index].request;
+                MTC_HOSTMAP_COPY(psf->lm[host_index].grant, snapshot->decoded.lm[host_index].grant);
             }
 
             //  excluded
@@ -748,58 +865,52 @@ readsf()
             {
                 MTC_HOSTMAP_SET_BOOLEAN(psf->excluded,
                                         host_index,
-                                        StateFile.host[host_index].data.excluded);
+                                        MTC_HOSTMAP_ISON(snapshot->decoded.excluded, host_index));
             }
 
             //  starting
 
             MTC_HOSTMAP_SET_BOOLEAN(psf->starting,
                                     host_index,
-                                    StateFile.host[host_index].data.starting);
+                                    MTC_HOSTMAP_ISON(snapshot->decoded.starting, host_index));
+
+            //  self_fencing (the local host's flag is set only by sf_set_self_fencing)
+
+            if (host_index != _my_index)
+            {
+                MTC_HOSTMAP_SET_BOOLEAN(psf->self_fencing,
+                                        host_index,
+                                        MTC_HOSTMAP_ISON(snapshot->decoded.self_fencing, host_index));
+            }
 
             //  raw
 
-            MTC_HOSTMAP_COPY(psf->raw[host_index].current_liveset,
-                             StateFile.host[host_index].data.current_liveset);
-            MTC_HOSTMAP_COPY(psf->raw[host_index].proposed_liveset,
-                             StateFile.host[host_index].data.proposed_liveset);
-            MTC_HOSTMAP_COPY(psf->raw[host_index].hbdomain,
-                             StateFile.host[host_index].data.hbdomain);
-            MTC_HOSTMAP_COPY(psf->raw[host_index].sfdomain,
-                             StateFile.host[host_index].data.sfdomain);
+            RAW_VIEW_COPY_HOST(psf->raw, snapshot->decoded.raw, host_index);
+
+            //  version 1.1 Collect SM-phase and commited weight of the other hosts
 
-            for (host_index2 = 0; _is_configured_host(host_index2); host_index2++)
+            if (host_index != _my_index)
             {
-                psf->raw[host_index].time_since_last_HB_receipt[host_index2] =
-                    StateFile.host[host_index].data.since_last_hb_receipt[host_index2];
-                psf->raw[host_index].time_since_last_SF_update[host_index2] =
-                    StateFile.host[host_index].data.since_last_sf_update[host_index2];
+                psf->sm_phase[host_index] = snapshot->decoded.sm_phase[host_index];
+                psf->weight[host_index] = snapshot->decoded.weight[host_index];
             }
-            psf->raw[host_index].time_since_xapi_restart =
-                StateFile.host[host_index].data.since_xapi_restart_first_attempted;
+        }
+        psf->sm_phase[_my_index] = psm->phase;
+        psf->weight[_my_index] = psm->commited_weight;
+        psf->changed_sections = changed_sections;
 
-            //  time_last_SF
+        //  time_last_SF (only the clock is updated for unchanged elements)
 
+        for (host_index = 0; _is_configured_host(host_index); host_index++)
+        {
             // if the peer thinks he is not alive but I think he is alive, 
             // the peer must be booting before finishing the fault handler,
             // then let's wait until the fault handler finish its job.
-            if (!(!MTC_HOSTMAP_ISON(psf->raw[host_index].current_liveset, host_index) &&
+            if (!(!MTC_HOSTMAP_ISON(psf->raw.current_liveset[host_index], host_index) &&
                   MTC_HOSTMAP_ISON(psm->current_liveset, host_index)))
             {
                 psf->time_last_SF[host_index] = sfvar.hoststat[host_index].updateclock;
             }
-
-            //  version 1.1 Collect SM-phase and commited weight of the other hosts
-            if (host_index == _my_index)
-            {
-                psf->sm_phase[host_index] = psm->phase;
-                psf->weight[host_index] = psm->commited_weight;
-            }
-            else
-            {
-                psf->sm_phase[host_index] = StateFile.host[host_index].data.sm_phase;
-                psf->weight[host_index] = StateFile.host[host_index].data.weight;
-            }
         }
 
         // latency
@@ -822,21 +933,31 @@ readsf()
         sfvar.readlatency.max = sfvar.writelatency.max = -1;
         sfvar.readlatency.min = sfvar.writelatency.min = -1;
 
+        memcpy(psf->latency_summary, latency_summary, sizeof(psf->latency_summary));
+
         //  SF_access
         sf_lock();
         psf->SF_access = sfvar.SF_access = TRUE;
         sf_unlock();
 
+        //  The global section to be written is derived from the
+        //  published snapshot, which must not be modified.
+
+        if (psf->modified_mask & (SF_MODIFIED_MASK_MASTER | SF_MODIFIED_MASK_POOL_STATE))
+        {
+            GlobalSection.data = snapshot->file.global.data;
+        }
+
         //  master
         if (psf->modified_mask & SF_MODIFIED_MASK_MASTER)
         {
             psf->modified_mask &= ~SF_MODIFIED_MASK_MASTER;
             status = MTC_ERROR_SF_PENDING_WRITE;
-            UUID_cpy(StateFile.global.data.master, psf->master);
+            UUID_cpy(GlobalSection.data.master, psf->master);
         }
         else
         {
-            UUID_cpy(psf->master, StateFile.global.data.master);
+            UUID_cpy(psf->master, snapshot->file.global.data.master);
         }
 
         //  pool state
@@ -844,11 +965,11 @@ readsf()
         {
             psf->modified_mask &= ~SF_MODIFIED_MASK_POOL_STATE;
             status = MTC_ERROR_SF_PENDING_WRITE;
-            StateFile.global.data.pool_state = psf->pool_state;
+            GlobalSection.data.pool_state = psf->pool_state;
         }
         else
         {
-            psf->pool_state = StateFile.global.data.pool_state;
+            psf->pool_state = snapshot->file.global.data.pool_state;
         }
     }
     else
@@ -897,6 +1018,204 @@ readsf()
     return status;
 }
 
+//
+//  sf_snapshot_prepare -
+//
+//  Return the snapshot buffer to be filled by the next read.
+//  The buffer is the one not published. Wait until all the readers
+//  of the buffer (who acquired it before the last publication) have
+//  released it.
+//
+
+MTC_STATIC  PSF_SNAPSHOT
+sf_snapshot_prepare()
+{
+    int index;
+
+    sf_lock();
+    index = (sfvar.snapshot.published == &Snapshot[0])? 1: 0;
+    while (sfvar.snapshot.readers[index] > 0)
+    {
+        sf_unlock();
+        sf_sleep(1);
+        sf_lock();
+    }
+    sf_unlock();
+
+    return &Snapshot[index];
+}
+
+//
+//  sf_snapshot_decode -
+//
+//  Decode the host specific elements of the snapshot into
+//  the form of the SF object.
+//  An element is identified by its sequence number and checksum.
+//  Elements already decoded in this buffer are skipped, and elements
+//  unchanged since the published snapshot are taken from it.
+//  Called without any lock, since the snapshot is not published yet.
+//  Returns the number of elements changed since the published snapshot.
+//
+
+MTC_STATIC  MTC_U32
+sf_snapshot_decode(
+    PSF_SNAPSHOT snapshot)
+{
+    int host_index, host_index2;
+    MTC_U32 changed_sections = 0;
+    struct _sf_host_specific *phost;
+    PSF_SNAPSHOT published;
+
+    //  only the SF thread replaces the published snapshot
+
+    published = sfvar.snapshot.published;
+
+    for (host_index = 0; _is_configured_host(host_index); host_index++)
+    {
+        phost = &snapshot->file.host[host_index].data;
+
+        if (published == NULL ||
+            !MTC_HOSTMAP_ISON(published->decoded.valid, host_index) ||
+            published->decoded.sequence[host_index] != phost->sequence ||
+            published->decoded.checksum[host_index] != phost->checksum)
+        {
+            MTC_HOSTMAP_SET(snapshot->decoded.changed, host_index);
+            changed_sections++;
+        }
+        else
+        {
+            MTC_HOSTMAP_RESET(snapshot->decoded.changed, host_index);
+        }
+
+        if (MTC_HOSTMAP_ISON(snapshot->decoded.valid, host_index) &&
+            snapshot->decoded.sequence[host_index] == phost->sequence &&
+            snapshot->decoded.checksum[host_index] == phost->checksum)
+        {
+            //  already decoded in this buffer
+
+            continue;
+        }
+
+        snapshot->decoded.sequence[host_index] = phost->sequence;
+        snapshot->decoded.checksum[host_index] = phost->checksum;
+        MTC_HOSTMAP_SET(snapshot->decoded.valid, host_index);
+
+        if (!MTC_HOSTMAP_ISON(snapshot->decoded.changed, host_index))
+        {
+            //  same as the published one
+
+            snapshot->decoded.lm[host_index] = published->decoded.lm[host_index];
+            MTC_HOSTMAP_SET_BOOLEAN(snapshot->decoded.excluded, host_index,
+                                    MTC_HOSTMAP_ISON(published->decoded.excluded, host_index));
+            MTC_HOSTMAP_SET_BOOLEAN(snapshot->decoded.starting, host_index,
+                                    MTC_HOSTMAP_ISON(published->decoded.starting, host_index));
+            MTC_HOSTMAP_SET_BOOLEAN(snapshot->decoded.self_fencing, host_index,
+                                    MTC_HOSTMAP_ISON(published->decoded.self_fencing, host_index));
+            RAW_VIEW_COPY_HOST(snapshot->decoded.raw, published->decoded.raw, host_index);
+            snapshot->decoded.sm_phase[host_index] = published->decoded.sm_phase[host_index];
+            snapshot->decoded.weight[host_index] = published->decoded.weight[host_index];
+            continue;
+        }
+
+        //  lock manager data
+
+        snapshot->decoded.lm[host_index].request = (phost->lock_request ? TRUE: FALSE);
+        MTC_HOSTMAP_COPY(snapshot->decoded.lm[host_index].grant, phost->lock_grant);
+
+        //  excluded, starting and self_fencing
+
+        MTC_HOSTMAP_SET_BOOLEAN(snapshot->decoded.excluded, host_index, phost->excluded);
+        MTC_HOSTMAP_SET_BOOLEAN(snapshot->decoded.starting, host_index, phost->starting);
+        MTC_HOSTMAP_SET_BOOLEAN(snapshot->decoded.self_fencing, host_index, phost->self_fencing);
+
+        //  raw
+
+        MTC_HOSTMAP_COPY(snapshot->decoded.raw.current_liveset[host_index], phost->current_liveset);
+        MTC_HOSTMAP_COPY(snapshot->decoded.raw.proposed_liveset[host_index], phost->proposed_liveset);
+        MTC_HOSTMAP_COPY(snapshot->decoded.raw.hbdomain[host_index], phost->hbdomain);
+        MTC_HOSTMAP_COPY(snapshot->decoded.raw.sfdomain[host_index], phost->sfdomain);
+
+        for (host_index2 = 0; _is_configured_host(host_index2); host_index2++)
+        {
+            snapshot->decoded.raw.time_since_last_HB_receipt[host_index][host_index2] =
+                phost->since_last_hb_receipt[host_index2];
+            snapshot->decoded.raw.time_since_last_SF_update[host_index][host_index2] =
+                phost->since_last_sf_update[host_index2];
+        }
+        snapshot->decoded.raw.time_since_xapi_restart[host_index] =
+            phost->since_xapi_restart_first_attempted;
+
+        //  SM-phase and commited weight
+
+        snapshot->decoded.sm_phase[host_index] = phost->sm_phase;
+        snapshot->decoded.weight[host_index] = phost->weight;
+    }
+
+    return changed_sections;
+}
+
+//
+//  sf_snapshot_publish -
+//
+//  Publish the snapshot with a new version number.
+//
+
+MTC_STATIC  void
+sf_snapshot_publish(
+    PSF_SNAPSHOT snapshot)
+{
+    snapshot->readclock = _getms();
+
+    sf_lock();
+    snapshot->version = ++sfvar.snapshot.version;
+    sfvar.snapshot.published = snapshot;
+    sf_unlock();
+}
+
+//
+//  sf_snapshot_acquire -
+//
+//  Acquire the latest snapshot of the State-File.
+//  The snapshot remains unchanged until sf_snapshot_release is called.
+//  Returns NULL if the State-File has never been read successfully.
+//
+
+const SF_SNAPSHOT *
+sf_snapshot_acquire()
+{
+    PSF_SNAPSHOT snapshot;
+
+    sf_lock();
+    if ((snapshot = sfvar.snapshot.published) != NULL)
+    {
+        sfvar.snapshot.readers[snapshot - Snapshot]++;
+    }
+    sf_unlock();
+
+    return snapshot;
+}
+
+//
+//  sf_snapshot_release -
+//
+//  Release the snapshot acquired by sf_snapshot_acquire.
+//
+
+void
+sf_snapshot_release(
+    const SF_SNAPSHOT *snapshot)
+{
+    if (snapshot == NULL)
+    {
+        return;
+    }
+
+    sf_lock();
+    assert(sfvar.snapshot.readers[snapshot - Snapshot] > 0);
+    sfvar.snapshot.readers[snapshot - Snapshot]--;
+    sf_unlock();
+}
+
 //
 //  write_hostspecific -
 //
@@ -910,24 +1229,36 @@ write_hostspecific()
     PCOM_DATA_HB        phb;
     PCOM_DATA_SF        psf;
     PCOM_DATA_XAPIMON   pxapimon;
+    HA_COMMON_OBJECT_SNAPSHOT snapshot[] = {
+        {sm_object, NULL, sizeof(COM_DATA_SM)},
+        {hb_object, NULL, sizeof(COM_DATA_HB)},
+        {xapimon_object, NULL, sizeof(COM_DATA_XAPIMON)},
+    };
     PSF_HOST_SPECIFIC_SECTION phost;
     MTC_CLOCK now;
     int host;
     MTC_STATUS status;
     MTC_BOOLEAN excluded_pending_write;
 
-    phost = &StateFile.host[_my_index];
+    // take a shared snapshot of the objects only read here;
+    // it is copied only when they have been updated since the
+    // last snapshot taken by any thread
+
+    if ((status = com_snapshot_share_many(snapshot, sizeof(snapshot) / sizeof(snapshot[0]))) != MTC_SUCCESS)
+    {
+        return status;
+    }
+    psm = snapshot[0].copy;
+    phb = snapshot[1].copy;
+    pxapimon = snapshot[2].copy;
+
+    phost = &LocalHostSection;
 
     phost->data.sequence = sfvar.sequence++;
     phost->data.host_index = _my_index;
     UUID_cpy(phost->data.host_uuid, _my_UUID);
 
-    // acquire reader_lock
-
-    com_reader_lock(sm_object, (void **) &psm);
-    com_reader_lock(hb_object, (void **) &phb);
-    com_writer_lock(sf_object, (void **) &psf);
-    com_reader_lock(xapimon_object, (void **) &pxapimon);
+    com_writer_lock_typed(SF, sf_object, &psf);
 
     now = _getms();
 
@@ -971,20 +1302,31 @@ write_hostspecific()
 
     phost->data.starting = psf->ctl.starting;
 
-    // release reader_locks
-    com_reader_unlock(xapimon_object);
+    // self_fencing
+
+    phost->data.self_fencing = (MTC_HOSTMAP_ISON(psf->self_fencing, _my_index)? TRUE: FALSE);
+
     com_writer_unlock(sf_object);
-    com_reader_unlock(hb_object);
-    com_reader_unlock(sm_object);
+
+    com_snapshot_release(snapshot[0].copy);
+    com_snapshot_release(snapshot[1].copy);
+    com_snapshot_release(snapshot[2].copy);
 
     if ((status = FIST_hostspecific_write()) == MTC_SUCCESS)
     {
         status = sf_writehostspecific(sfvar.sfdesc, _my_index, phost);
     }
 
+    if (status == MTC_SUCCESS)
+    {
+        sf_lock();
+        sfvar.written_sequence = phost->data.sequence + 1;
+        sf_unlock();
+    }
+
     if (status != MTC_SUCCESS)
     {
-        com_writer_lock(sf_object, (void **) &psf);
+        com_writer_lock_typed(SF, sf_object, &psf);
 
         if (excluded_pending_write)
         {
@@ -1003,6 +1345,48 @@ write_hostspecific()
     return status;
 }
 
+//
+//  latency_bucket -
+//
+//  Returns the histogram bucket for the latency.
+//
+
+static inline MTC_U32
+latency_bucket(
+    MTC_U32 latency)
+{
+    MTC_U32 shift;
+
+    if (latency < LATENCY_SUB_BUCKETS)
+    {
+        return latency;
+    }
+
+    shift = (31 - __builtin_clz(latency)) - LATENCY_SUB_BUCKET_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + ((latency >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+//
+//  latency_bucket_value -
+//
+//  Returns the highest latency that falls in the bucket.
+//
+
+static inline MTC_S32
+latency_bucket_value(
+    MTC_U32 bucket)
+{
+    MTC_U32 shift;
+
+    if (bucket < LATENCY_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    return ((bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS + 1) << shift) - 1;
+}
+
 //
 //  sf_reportlatency -
 //
@@ -1013,11 +1397,43 @@ write_hostspecific()
 void
 sf_reportlatency(
     MTC_CLOCK latency,
-    MTC_BOOLEAN write)
+    MTC_BOOLEAN write,
+    SF_SECTION section)
 {
     struct _latency *lp;
+    PLATENCY_HISTOGRAM hp;
+    MTC_U32 *pcurrent;
+    MTC_CLOCK now;
 
     assert(latency >= 0);
+    assert(section < SF_SECTION_NUM);
+
+    //  histogram (the current window is rotated if it has expired)
+
+    now = _getms();
+    pcurrent = &sfvar.histogram[section][write? SF_ACCESS_WRITE: SF_ACCESS_READ].current;
+    hp = &sfvar.histogram[section][write? SF_ACCESS_WRITE: SF_ACCESS_READ].window[*pcurrent];
+
+    if (hp->samples == 0)
+    {
+        hp->start = now;
+    }
+    else if (now - hp->start >= LATENCY_WINDOW)
+    {
+        *pcurrent ^= 1;
+        hp = &sfvar.histogram[section][write? SF_ACCESS_WRITE: SF_ACCESS_READ].window[*pcurrent];
+        bzero(hp, sizeof(*hp));
+        hp->start = now;
+    }
+
+    hp->samples++;
+    hp->bucket[latency_bucket(_min(latency, LATENCY_MAX_VALUE))]++;
+    if (latency > hp->max)
+    {
+        hp->max = _min(latency, LATENCY_MAX_VALUE);
+    }
+
+    //  last, max and min
 
     lp = (write? &sfvar.writelatency: &sfvar.readlatency);
 
@@ -1046,7 +1462,7 @@ sf_set_pool_state(
 {
     PCOM_DATA_SF    psf;
 
-    com_writer_lock(sf_object, (void **) &psf);
+    com_writer_lock_typed(SF, sf_object, &psf);
     psf->modified_mask |= SF_MODIFIED_MASK_POOL_STATE;
     psf->pool_state = pool_state;
     com_writer_unlock(sf_object);
@@ -1069,7 +1485,7 @@ sf_set_master(
 {
     PCOM_DATA_SF    psf;
 
-    com_writer_lock(sf_object, (void **) &psf);
+    com_writer_lock_typed(SF, sf_object, &psf);
     psf->modified_mask |= SF_MODIFIED_MASK_MASTER;
     UUID_cpy(psf->master, master);
     com_writer_unlock(sf_object);
@@ -1092,7 +1508,7 @@ sf_set_excluded(
 {
     PCOM_DATA_SF    psf;
 
-    com_writer_lock(sf_object, (void **) &psf);
+    com_writer_lock_typed(SF, sf_object, &psf);
     psf->modified_mask |= SF_MODIFIED_MASK_EXCLUDED;
     MTC_HOSTMAP_SET_BOOLEAN(psf->excluded, _my_index, excluded);
     com_writer_unlock(sf_object);
@@ -1102,6 +1518,66 @@ sf_set_excluded(
     return MTC_SUCCESS;
 }
 
+//
+//  sf_set_self_fencing -
+//
+//  Record in the State-File that the local host is about to self-fence,
+//  so that the winners of the fault handler can finish the fencing wait
+//  early. Waits up to timeout ms until the record has been written.
+//  Returns TRUE if the record is known to be on the State-File.
+//
+
+MTC_BOOLEAN
+sf_set_self_fencing(
+    MTC_CLOCK timeout)
+{
+    PCOM_DATA_SF    psf;
+    MTC_U32         target;
+    MTC_CLOCK       start;
+    MTC_BOOLEAN     access, written;
+
+    if (sf_object == HA_COMMON_OBJECT_INVALID_HANDLE_VALUE)
+    {
+        return FALSE;
+    }
+
+    com_writer_lock_typed(SF, sf_object, &psf);
+    MTC_HOSTMAP_SET(psf->self_fencing, _my_index);
+    com_writer_unlock(sf_object);
+
+    // the element written with the next sequence number carries the flag
+
+    sf_lock();
+    target = sfvar.sequence;
+    sf_unlock();
+
+    sf_accelerate();
+
+    // the SF thread cannot wait for its own write
+
+    if (sfvar.sf_thread && pthread_equal(pthread_self(), sfvar.sf_thread))
+    {
+        return FALSE;
+    }
+
+    start = _getms();
+    do
+    {
+        sf_lock();
+        access = sfvar.SF_access;
+        written = (access && (MTC_S32) (sfvar.written_sequence - target) > 0);
+        sf_unlock();
+
+        if (written || !access || _getms() - start >= timeout)
+        {
+            break;
+        }
+        sf_sleep(10);
+    } while (TRUE);
+
+    return written;
+}
+
 //
 //  sf_sf_updated -
 //
@@ -1258,3 +1734,94 @@ sf_watchdog_set()
     }
     sf_unlock();
 }
+
+//
+//  sf_latency_summarize -
+//
+//  Compute percentiles of the State-File access latency over
+//  the current and the previous window.
+//  Called on the SF thread, which is the only one recording latencies.
+//
+
+MTC_STATIC  void
+sf_latency_summarize(
+    SF_LATENCY_SUMMARY summary[SF_SECTION_NUM][SF_ACCESS_NUM])
+{
+    int section, access, bucket, p;
+    MTC_U32 samples, count, target[3];
+    MTC_S32 *value[3];
+    PLATENCY_HISTOGRAM h0, h1;
+    PSF_LATENCY_SUMMARY sp;
+
+    for (section = 0; section < SF_SECTION_NUM; section++)
+    {
+        for (access = 0; access < SF_ACCESS_NUM; access++)
+        {
+            sp = &summary[section][access];
+            h0 = &sfvar.histogram[section][access].window[0];
+            h1 = &sfvar.histogram[section][access].window[1];
+
+            samples = h0->samples + h1->samples;
+            sp->samples = samples;
+            sp->p50 = sp->p99 = sp->p999 = sp->max = -1;
+            if (samples == 0)
+            {
+                continue;
+            }
+
+            //  rank (1 origin) of each percentile
+
+            target[0] = _max((samples * 500 + 999) / 1000, 1);
+            target[1] = _max((samples * 990 + 999) / 1000, 1);
+            target[2] = _max((samples * 999 + 999) / 1000, 1);
+            value[0] = &sp->p50;
+            value[1] = &sp->p99;
+            value[2] = &sp->p999;
+
+            count = 0;
+            p = 0;
+            for (bucket = 0; bucket < LATENCY_BUCKETS && p < 3; bucket++)
+            {
+                count += h0->bucket[bucket] + h1->bucket[bucket];
+                while (p < 3 && count >= target[p])
+                {
+                    *value[p++] = latency_bucket_value(bucket);
+                }
+            }
+
+            sp->max = _max(h0->max, h1->max);
+        }
+    }
+}
+
+//
+//  sf_log_latency -
+//
+//  Log the State-File access latency distribution (for dumpcom).
+//
+
+void
+sf_log_latency()
+{
+    PCOM_DATA_SF psf;
+    int section, access;
+    char *section_name[SF_SECTION_NUM] = {"global", "host"};
+    char *access_name[SF_ACCESS_NUM] = {"read", "write"};
+
+    com_reader_lock_typed(SF, sf_object, &psf);
+    for (section = 0; section < SF_SECTION_NUM; section++)
+    {
+        for (access = 0; access < SF_ACCESS_NUM; access++)
+        {
+            log_message(MTC_LOG_DEBUG,
+                        "SF: latency %s %s: samples=%d p50=%d p99=%d p999=%d max=%d (ms).\n",
+                        section_name[section], access_name[access],
+                        psf->latency_summary[section][access].samples,
+                        psf->latency_summary[section][access].p50,
+                        psf->latency_summary[section][access].p99,
+                        psf->latency_summary[section][access].p999,
+                        psf->latency_summary[section][access].max);
+        }
+    }
+    com_reader_unlock(sf_object);
+}
@@ -64,6 +64,7 @@
 #include "log.h"
 #include "config.h"
 #include "fist.h"
+#include "xha.h"
 
 ////
 //
@@ -100,6 +101,7 @@ enum {
 //
 
 static pthread_mutex_t watchdog_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t watchdog_mutex_once = PTHREAD_ONCE_INIT;
 static WATCHDOG_INSTANCE *instance[MAX_WATCHDOG_INSTANCE] = {NULL};
 static MTC_U32 instance_num = 0;
 static int     hypercall_fd = -1;
@@ -113,6 +115,27 @@ static MTC_U32 watchdog_mode = WATCHDOG_MODE_HYPERVISOR;
 
 static MTC_BOOLEAN initialized = FALSE;
 
+//  Set by watchdog_arm_fence; the instances are no longer extended
+//  or stopped.
+
+static MTC_BOOLEAN fence_armed = FALSE;
+
+//
+//  watchdog_mutex inherits priority, so that the threads refreshing
+//  the watchdog are not delayed behind a lower priority thread.
+//  There is no static initializer for it.
+//
+
+static void
+watchdog_mutex_init(void)
+{
+    (void) xhad_mutex_init(&watchdog_mutex, PTHREAD_MUTEX_NORMAL);
+}
+
+#define WATCHDOG_LOCK   {pthread_once(&watchdog_mutex_once, watchdog_mutex_init); \
+                         pthread_mutex_lock(&watchdog_mutex);}
+#define WATCHDOG_UNLOCK {pthread_mutex_unlock(&watchdog_mutex);}
+
 
 ////
 //
@@ -129,7 +152,6 @@ static MTC_BOOLEAN initialized = FALSE;
 #define PAGE_SHIFT              XC_PAGE_SHIFT
 #define PAGE_SIZE               (1UL << PAGE_SHIFT)
 #define PAGE_MASK               (~(PAGE_SIZE-1))
-#define WD_FENCE                (1)
 
 
 //
@@ -703,7 +725,7 @@ watchdog_create(
     MTC_STATUS ret = MTC_SUCCESS;
     
 
-    pthread_mutex_lock(&watchdog_mutex);
+    WATCHDOG_LOCK;
 
 
     //
@@ -785,7 +807,7 @@ watchdog_create(
     }
 
  error_return:
-    pthread_mutex_unlock(&watchdog_mutex);
+    WATCHDOG_UNLOCK;
     if (ret == MTC_SUCCESS)
     {
         record_watchdog_instatnce();
@@ -830,13 +852,18 @@ watchdog_close(
     MTC_U32 wdi;
     MTC_U32 found = FALSE;
 
-    pthread_mutex_lock(&watchdog_mutex);
+    WATCHDOG_LOCK;
     if (watchdog_handle == NULL) 
     {
         log_message(MTC_LOG_WARNING, "WD: (%s) invalid watchdog_handle.\n", __func__);        
         ret = MTC_ERROR_WD_INVALID_HANDLE;
         goto error_return;
     }
+    if (fence_armed)
+    {
+        log_message(MTC_LOG_WARNING, "WD: (%s) label=%s is armed to fence; not stopped.\n", __func__, w->label);
+        goto error_return;
+    }
     log_message(MTC_LOG_INFO, "WD: (%s) label=%s stopping watchdog timer.\n", __func__, w->label);        
     ret = do_watchdog_hypercall(&(w->id), 0, MTC_SUCCESS);
     if (ret != MTC_SUCCESS) 
@@ -868,7 +895,7 @@ watchdog_close(
     }
 
  error_return:
-    pthread_mutex_unlock(&watchdog_mutex);
+    WATCHDOG_UNLOCK;
     record_watchdog_instatnce();
     return MTC_SUCCESS; // SUCCESS
 
@@ -912,7 +939,14 @@ watchdog_set(
     MTC_STATUS ret = MTC_SUCCESS;
     WATCHDOG_INSTANCE *w = (WATCHDOG_INSTANCE *) watchdog_handle;
 
-    pthread_mutex_lock(&watchdog_mutex);
+    WATCHDOG_LOCK;
+
+    // the host is being fenced; do not extend the watchdog
+
+    if (fence_armed)
+    {
+        goto error_return;
+    }
 
     check_watchdog_timeout();
 
@@ -945,10 +979,71 @@ watchdog_set(
 
 
  error_return:
-    pthread_mutex_unlock(&watchdog_mutex);
+    WATCHDOG_UNLOCK;
     return ret; 
 }
 
+//
+//
+//  NAME:
+//
+//      watchdog_arm_fence
+//
+//  DESCRIPTION:
+//
+//      Arm all the watchdog instances to reset the host in
+//      WATCHDOG_FENCE_TIMEOUT, and keep them from being extended
+//      or stopped afterwards.
+//
+//  FORMAL PARAMETERS:
+//
+//      None
+//
+//          
+//  RETURN VALUE:
+//
+//      MTC_SUCCESS - at least one instance is armed
+//      others - fail
+//
+//  ENVIRONMENT:
+//
+//      dom0
+//
+//
+
+MTC_STATUS
+watchdog_arm_fence(void)
+{
+    MTC_STATUS ret = MTC_ERROR_WD_INSTANCE_UNAVAILABLE;
+    MTC_U32 wdi;
+
+    WATCHDOG_LOCK;
+
+    if (watchdog_mode != WATCHDOG_MODE_HYPERVISOR)
+    {
+        goto error_return;
+    }
+
+    fence_armed = TRUE;
+    for (wdi = 0; wdi < instance_num; wdi++)
+    {
+        if (do_watchdog_hypercall(&(instance[wdi]->id), WATCHDOG_FENCE_TIMEOUT, MTC_SUCCESS) == MTC_SUCCESS)
+        {
+            instance[wdi]->set_time = _getms();
+            instance[wdi]->timeout = WATCHDOG_FENCE_TIMEOUT;
+            ret = MTC_SUCCESS;
+        }
+        else
+        {
+            log_message(MTC_LOG_WARNING, "WD: (%s) label=%s id=%d failed.\n", __func__, instance[wdi]->label, instance[wdi]->id);
+        }
+    }
+
+ error_return:
+    WATCHDOG_UNLOCK;
+    return ret;
+}
+
 //
 //
 //  NAME:
@@ -984,7 +1079,7 @@ watchdog_selffence(void)
 
 
 
-    pthread_mutex_lock(&watchdog_mutex);
+    WATCHDOG_LOCK;
 
     if (watchdog_mode != WATCHDOG_MODE_HYPERVISOR) 
     {
@@ -1001,7 +1096,7 @@ watchdog_selffence(void)
     {
         // create instance for fence
         id = 0;
-        ret = do_watchdog_hypercall(&id, WD_FENCE, MTC_SUCCESS);
+        ret = do_watchdog_hypercall(&id, WATCHDOG_FENCE_TIMEOUT, MTC_SUCCESS);
         if (ret == MTC_SUCCESS) 
         {
             log_message(MTC_LOG_INFO, "WD: (%s) id=%d succeeded.\n", __func__, id);        
@@ -1014,7 +1109,7 @@ watchdog_selffence(void)
 
     for (wdi = 0; wdi < instance_num; wdi++)
     {
-        ret = do_watchdog_hypercall(&(instance[wdi]->id), WD_FENCE, MTC_SUCCESS);
+        ret = do_watchdog_hypercall(&(instance[wdi]->id), WATCHDOG_FENCE_TIMEOUT, MTC_SUCCESS);
         if (ret == MTC_SUCCESS) 
         {
             log_message(MTC_LOG_INFO, "WD: (%s) label=%s id=%d succeeded.\n", __func__, instance[wdi]->label, instance[wdi]->id);        
@@ -193,8 +193,7 @@ xapimon_initialize(
                 .err_string = ""};
 
             // create common object
-            ret = com_create(COM_ID_XAPIMON,
-                             &xapimon_object, sizeof(COM_DATA_XAPIMON), &xapimon);
+            ret = com_create_typed(XAPIMON, &xapimon_object, &xapimon);
             if (ret != MTC_SUCCESS)
             {
                 log_internal(MTC_LOG_ERR,
@@ -300,13 +299,14 @@ xapimon(
     MTC_STATUS          status;
 
     log_thread_id("Xapimon");
+    xhad_set_thread_priority(XHA_PRIORITY_LOW);
     while (!terminate)
     {
         log_maskable_debug_message(TRACE, "Xapimon: Xapi monitor thread activity log.\n");
 
         xm_sleep(_tXapi * ONE_SEC);
 
-        com_reader_lock(xapimon_object, (void **) &pxapimon);
+        com_reader_lock_typed(XAPIMON, xapimon_object, &pxapimon);
         enable_Xapi_monitor = pxapimon->ctl.enable_Xapi_monitor;
         com_reader_unlock(xapimon_object);
         if (!enable_Xapi_monitor)
@@ -338,7 +338,7 @@ xapimon(
         // record start time
         //
 
-        com_writer_lock(xapimon_object, (void **) &pxapimon);
+        com_writer_lock_typed(XAPIMON, xapimon_object, &pxapimon);
         pxapimon->time_healthcheck_start = start;
         com_writer_unlock(xapimon_object);
 
@@ -449,7 +449,7 @@ xapimon(
             // xapi is healthy, calculate and store diagnostic values
             now = _getms();
 
-            com_writer_lock(xapimon_object, (void **) &pxapimon);
+            com_writer_lock_typed(XAPIMON, xapimon_object, &pxapimon);
             pxapimon->latency = now - start;
             pxapimon->latency_max =
                 (pxapimon->latency_max < 0)? pxapimon->latency:
@@ -464,7 +464,7 @@ xapimon(
         else
         {
             // xapi is not healthy.
-            com_writer_lock(xapimon_object, (void **) &pxapimon);
+            com_writer_lock_typed(XAPIMON, xapimon_object, &pxapimon);
             strncpy(pxapimon->err_string, err_string,
                     sizeof(pxapimon->err_string));
             pxapimon->time_healthcheck_start = -1;
@@ -615,7 +615,7 @@ xapi_restart()
 
     // restart timestamp
     now = _getms();
-    com_writer_lock(xapimon_object, (void **) &pxapimon);
+    com_writer_lock_typed(XAPIMON, xapimon_object, &pxapimon);
     pxapimon->time_Xapi_restart = time_restarting = now;
     com_writer_unlock(xapimon_object);
 
@@ -649,7 +649,7 @@ xapi_restart()
             switch (status)
             {
             case 0:
-                com_writer_lock(xapimon_object, (void **) &pxapimon);
+                com_writer_lock_typed(XAPIMON, xapimon_object, &pxapimon);
                 pxapimon->time_Xapi_restart = -1;
                 com_writer_unlock(xapimon_object);
                 log_message(MTC_LOG_INFO, "Xapimon: Xapi restarted.\n");
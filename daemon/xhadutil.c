@@ -0,0 +1,65 @@
+//
+//++
+//
+//  MODULE: xhadutil.c
+//
+//      Copyright (c) Stratus Technologies Bermuda Ltd., 2008.
+//      All Rights Reserved. Unpublished rights reserved
+//      under the copyright laws of the United States.
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU Lesser General Public License as published
+//      by the Free Software Foundation; version 2.1 only. with the special
+//      exception on linking described in file LICENSE.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU Lesser General Public License for more details.
+//
+//
+//  DESCRIPTION:
+//
+//      Daemon utilities that do not depend on the rest of the daemon,
+//      shared by xhad and the development tools linked with its modules
+//      (combench).
+//
+//  CREATION DATE: 
+//
+//      October 19, 2026
+//
+//--
+//
+
+#define _GNU_SOURCE
+#include <pthread.h>
+
+#include "mtctypes.h"
+#include "xha.h"
+
+//
+//  xhad_mutex_init
+//
+//  Initialize a priority inheritance mutex.
+//
+
+int
+xhad_mutex_init(
+    pthread_mutex_t *mutex,
+    int type)
+{
+    pthread_mutexattr_t attr;
+    int ret;
+
+    if ((ret = pthread_mutexattr_init(&attr)) != 0)
+    {
+        return ret;
+    }
+    if ((ret = pthread_mutexattr_settype(&attr, type)) == 0 &&
+        (ret = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT)) == 0)
+    {
+        ret = pthread_mutex_init(mutex, &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+    return ret;
+}
@@ -5,12 +5,15 @@
 CC=gcc
 SOURCEDIR=..
 override CFLAGS+=-g -Wall -Wno-multichar -Werror=pointer-to-int-cast -Og
+ifdef MAX_HOST_NUM
+override CFLAGS+=-DMAX_HOST_NUM=$(MAX_HOST_NUM)
+endif
 
 OBJDIR=$(SOURCEDIR)/debug
 
 INCDIR=$(SOURCEDIR)/include
 INCLUDES=-I$(INCDIR)
-LIBS=-lxml2 -lrt $(LDFLAGS)
+LIBS=-lxml2 -lrt -lm $(LDFLAGS)
 HALIBS=$(OBJDIR)/libxha.a
 INSDIR=/usr/libexec/xapi/cluster-stack/xhad
 LOGCONFDIR=/etc/logrotate.d
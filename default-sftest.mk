@@ -0,0 +1,13 @@
+#
+#   default-sftest.mk
+#
+#   Development build with the State-File test backend (see sfbackend.h).
+#   It is built in its own directory so that its objects are never picked
+#   up by the debug build or installed.
+#
+
+include ../default-debug.mk
+
+override CFLAGS+=-DXHA_SF_TEST_BACKEND
+
+OBJDIR=$(SOURCEDIR)/sftest
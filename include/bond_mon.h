@@ -89,4 +89,6 @@ typedef struct _COM_DATA_BM {
     MTC_BOND_STATUS mtc_bond_status;
 } COM_DATA_BM, *PCOM_DATA_BM;
 
+#define COM_OBJECT_TYPE_BM COM_DATA_BM
+
 #endif	// BOND_MON_H
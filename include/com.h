@@ -56,6 +56,59 @@ typedef void *HA_COMMON_OBJECT_HANDLE, **PHA_COMMON_OBJECT_HANDLE;
 
 #define HA_COMMON_OBJECT_INVALID_HANDLE_VALUE          NULL
 
+//
+//
+// COM_OBJECT_ID
+//
+//  IDs of the objects known at compile time. com_create_id and
+//  com_open_id find them by indexing the registry, without hashing
+//  the object ID string. The names are the object IDs (COM_ID_*)
+//  used by the string API, which finds the same objects.
+//
+//  The owner of an object binds its data type as
+//  COM_OBJECT_TYPE_<name> (e.g. COM_OBJECT_TYPE_HB), and the typed
+//  macros below reject a buffer of another type at compile time.
+//
+
+typedef enum {
+    COM_OBJECT_SM,
+    COM_OBJECT_HB,
+    COM_OBJECT_SF,
+    COM_OBJECT_XAPIMON,
+    COM_OBJECT_BM,
+    COM_OBJECT_NUM              // not registered
+} COM_OBJECT_ID;
+
+#define COM_OBJECT_NAME_ARRAY { \
+        "statemanager",         \
+        "heartbeat",            \
+        "statefile",            \
+        "xapimon",              \
+        "bm"                    \
+    }
+
+//  Evaluates to ptr if it is a pointer to type, or fails to compile.
+
+#define COM_TYPE_CHECK(type, ptr) \
+    __builtin_choose_expr( \
+        __builtin_types_compatible_p(__typeof__(ptr), type), (ptr), (void) 0)
+
+#define com_create_typed(name, object_handle, buffer) \
+    com_create_id(COM_OBJECT_##name, (object_handle), \
+                  sizeof(COM_OBJECT_TYPE_##name), \
+                  COM_TYPE_CHECK(COM_OBJECT_TYPE_##name *, buffer))
+
+#define com_open_typed(name, object_handle) \
+    com_open_id(COM_OBJECT_##name, (object_handle))
+
+#define com_writer_lock_typed(name, object_handle, pbuffer) \
+    com_writer_lock((object_handle), \
+                    (void **) COM_TYPE_CHECK(COM_OBJECT_TYPE_##name **, pbuffer))
+
+#define com_reader_lock_typed(name, object_handle, pbuffer) \
+    com_reader_lock((object_handle), \
+                    (void **) COM_TYPE_CHECK(COM_OBJECT_TYPE_##name **, pbuffer))
+
 // HA_COMMON_OBJECT_CALLBACK
 //  callback function which is called when the object
 //  has been modified. 
@@ -77,6 +130,29 @@ typedef void *HA_COMMON_OBJECT_HANDLE, **PHA_COMMON_OBJECT_HANDLE;
 typedef void (*HA_COMMON_OBJECT_CALLBACK)(HA_COMMON_OBJECT_HANDLE object_handle,
                                           void *buffer);
 
+// HA_COMMON_OBJECT_ASYNC_CALLBACK
+//  callback function which is called when the object
+//  has been modified.
+//  The callback function is called in the COM dispatcher thread
+//  after the writer lock of the object has been released, so that
+//  the modifier does not pay for it. Updates made before the
+//  callback runs are coalesced into one call. Calls for an object
+//  are made in order and never concurrently.
+//
+//  buffer is a snapshot of the object data. Modifications to it
+//  are discarded. Do not register or deregister async callbacks
+//  in this callback.
+//
+//  paramaters
+//    object_handle: Handle of the HA Common Object 
+//    buffer: Snapshot of the HA Common Object data
+//    version: version of the snapshot (see com_snapshot)
+//
+
+typedef void (*HA_COMMON_OBJECT_ASYNC_CALLBACK)(HA_COMMON_OBJECT_HANDLE object_handle,
+                                                void *buffer,
+                                                MTC_U32 version);
+
 //
 // com_initialize
 //
@@ -149,6 +225,32 @@ com_open(
     char *object_id,
     HA_COMMON_OBJECT_HANDLE *object_handle);
 
+//
+// com_create_id
+// com_open_id
+//
+//  Same as com_create and com_open, for the objects registered
+//  at compile time. Use com_create_typed and com_open_typed.
+//
+//  paramaters
+//    id: COM_OBJECT_ID of the object
+//    object_handle: Handle of the HA Common Object
+//    size: data size of the HA Common Object
+//    buffer: initial data of the HA Common Object
+//
+
+MTC_STATUS
+com_create_id(
+    COM_OBJECT_ID id,
+    HA_COMMON_OBJECT_HANDLE *object_handle,
+    MTC_U32 size,
+    void *buffer);
+
+MTC_STATUS
+com_open_id(
+    COM_OBJECT_ID id,
+    HA_COMMON_OBJECT_HANDLE *object_handle);
+
 //
 // com_close
 //
@@ -215,6 +317,54 @@ com_deregister_callback(
     HA_COMMON_OBJECT_CALLBACK func);
 
 
+//
+// com_register_async_callback
+//
+//  Register callback function which is called by the dispatcher thread
+//  after the object has been modified and the writer lock has been
+//  released. See HA_COMMON_OBJECT_ASYNC_CALLBACK.
+//
+//  paramaters
+//    object_handle: Handle of the HA Common Object 
+//    func: callback function
+//
+//  return value
+//    0: success
+//    not 0: fail
+//           The object is not found
+//           other fail
+//
+
+MTC_STATUS
+com_register_async_callback(
+    HA_COMMON_OBJECT_HANDLE object_handle,
+    HA_COMMON_OBJECT_ASYNC_CALLBACK func);
+
+
+//
+// com_deregister_async_callback
+//
+//  Deregister async callback function. The callback is not called
+//  once this function returns.
+//
+//  paramaters
+//    object_handle: Handle of the HA Common Object 
+//    func: callback function
+//
+//  return value
+//    0: success
+//    not 0: fail
+//           The object is not found
+//           other fail
+//
+
+MTC_STATUS
+com_deregister_async_callback(
+    HA_COMMON_OBJECT_HANDLE object_handle,
+    HA_COMMON_OBJECT_ASYNC_CALLBACK func);
+
+
+
 //
 // com_writer_lock
 //
@@ -297,6 +447,187 @@ MTC_STATUS
 com_reader_unlock(
     HA_COMMON_OBJECT_HANDLE object_handle);
 
+//
+// com_snapshot
+//
+//  Copy the object data without taking the reader lock.
+//  The copy is consistent (no writer has owned the object during
+//  the copy) and writers are never blocked by this function.
+//  Use it instead of com_reader_lock when the reader may hold the
+//  data for a long time (e.g. logging or the script service).
+//  Do not call it while holding the writer lock of the same object.
+//
+//  paramaters
+//    object_handle: Handle of the HA Common Object 
+//    copy: buffer to which the HA Common Object data is copied
+//    size: size of the copy buffer (must be the object size)
+//    version: version of the copied data is passed when this
+//             function returns (may be NULL)
+//
+//  return value
+//    0: success
+//    not 0: fail
+//           The object has no data
+//           other fail
+
+MTC_STATUS
+com_snapshot(
+    HA_COMMON_OBJECT_HANDLE object_handle,
+    void *copy,
+    MTC_U32 size,
+    MTC_U32 *version);
+
+//
+// com_snapshot_many
+//
+//  Copy the data of several objects without taking the reader locks.
+//  The copies form a consistent view of all the objects at one point
+//  in time, as if the reader locks of all the objects had been held
+//  together. Use it instead of nested com_reader_lock calls.
+//  Do not call it while holding the writer lock of any of the objects.
+//
+//  paramaters
+//    snapshot: array of {object_handle, copy, size}. version of each
+//              copy is set when this function returns.
+//    num: number of the elements of snapshot (up to COM_SNAPSHOT_MAX)
+//
+//  return value
+//    0: success
+//    not 0: fail
+//           One of the objects has no data
+//           other fail
+
+#define COM_SNAPSHOT_MAX    8
+
+typedef struct ha_common_object_snapshot
+{
+    HA_COMMON_OBJECT_HANDLE object_handle;
+    void *copy;
+    MTC_U32 size;
+    MTC_U32 version;
+} HA_COMMON_OBJECT_SNAPSHOT;
+
+MTC_STATUS
+com_snapshot_many(
+    HA_COMMON_OBJECT_SNAPSHOT *snapshot,
+    MTC_U32 num);
+
+//
+// com_snapshot_share_many
+//
+//  Same as com_snapshot_many, but sets copy of each element to a
+//  read-only copy shared with the other callers instead of copying
+//  into the buffers of the caller. The data is copied only when the
+//  object has been changed since the last shared copy was made.
+//  Use it when the same view is taken repeatedly (e.g. polling
+//  until the view becomes consistent).
+//
+//  paramaters
+//    snapshot: array of {object_handle, size}. copy and version of
+//              each element are set when this function returns.
+//    num: number of the elements of snapshot (up to COM_SNAPSHOT_MAX)
+//
+//  return value
+//    0: success
+//    not 0: fail
+//           One of the objects has no data
+//           other fail
+
+MTC_STATUS
+com_snapshot_share_many(
+    HA_COMMON_OBJECT_SNAPSHOT *snapshot,
+    MTC_U32 num);
+
+//
+// com_snapshot_release
+//
+//  Release a copy set by com_snapshot_share_many or returned by
+//  com_snapshot_unshare. NULL is ignored.
+//
+
+void
+com_snapshot_release(
+    void *copy);
+
+//
+// com_snapshot_unshare
+//
+//  Get a private copy, which may be modified, of a shared copy.
+//  The reference to the shared copy is passed to the returned copy,
+//  so release only the returned copy. The data is copied only if
+//  the copy is still shared.
+//
+
+void *
+com_snapshot_unshare(
+    void *copy);
+
+//
+// com_writer_version
+//
+//  Returns the version which the object data will have when the
+//  writer lock held by the caller is released.
+//
+//  paramaters
+//    object_handle: Handle of the HA Common Object 
+//
+//  return value
+//    version
+//
+
+MTC_U32
+com_writer_version(
+    HA_COMMON_OBJECT_HANDLE object_handle);
+
+//
+// com_wait_change
+//
+//  Wait until the version of the object differs from since_version,
+//  i.e. until a writer has released a change made after the version
+//  was seen.
+//
+//  paramaters
+//    object_handle: Handle of the HA Common Object 
+//    since_version: version the caller has seen (see com_snapshot)
+//    timeout: in ms, or negative to wait forever
+//
+//  return value
+//    MTC_SUCCESS: changed
+//    MTC_ERROR_COM_TIMEOUT: timed out
+//
+
+MTC_STATUS
+com_wait_change(
+    HA_COMMON_OBJECT_HANDLE object_handle,
+    MTC_U32 since_version,
+    MTC_CLOCK timeout);
+
+//
+// com_wait_change_many
+//
+//  Wait until the version of any of the objects differs from
+//  the version in snapshot, e.g. the one set by com_snapshot_many.
+//  copy and size of snapshot are not used. Only the writers of these
+//  objects wake the caller.
+//
+//  paramaters
+//    snapshot: array of {object_handle, version}
+//    num: number of the elements of snapshot (up to COM_SNAPSHOT_MAX)
+//    timeout: in ms, or negative to wait forever
+//
+//  return value
+//    MTC_SUCCESS: changed
+//    MTC_ERROR_COM_TIMEOUT: timed out
+//    MTC_ERROR_INVALID_PARAMETER: num is larger than COM_SNAPSHOT_MAX
+//
+
+MTC_STATUS
+com_wait_change_many(
+    HA_COMMON_OBJECT_SNAPSHOT *snapshot,
+    MTC_U32 num,
+    MTC_CLOCK timeout);
+
+
 
 //
 // log all objects
@@ -307,5 +638,93 @@ MTC_STATUS
 com_log_all_objects(
     MTC_U32 dumpflag);
 
+//
+// lock profile
+//
+//  Each object keeps histograms of the time spent waiting for and
+//  holding its lock per thread role (the name given to log_thread_id)
+//  and lock mode, and the backtrace of the longest holder.
+//  Times are in microseconds. Percentiles are the upper bound of the
+//  log2 histogram bucket, capped by the maximum.
+//
+
+typedef enum {
+    COM_ROLE_HB_SEND,
+    COM_ROLE_HB_RECEIVE,
+    COM_ROLE_SF,
+    COM_ROLE_SM,
+    COM_ROLE_SM_WORKER,
+    COM_ROLE_LM,
+    COM_ROLE_SC,
+    COM_ROLE_XAPIMON,
+    COM_ROLE_BM,
+    COM_ROLE_DISPATCHER,
+    COM_ROLE_OTHER,                 // main thread and unnamed threads
+    COM_ROLE_NUM
+} COM_ROLE;
+
+#define COM_ROLE_NAME_ARRAY {   \
+        "HB_send",              \
+        "HB_receive",           \
+        "SF",                   \
+        "SM",                   \
+        "SM_Worker",            \
+        "LM",                   \
+        "SC",                   \
+        "Xapimon",              \
+        "BM",                   \
+        "COM_dispatcher",       \
+        "other"                 \
+    }
+
+typedef enum {
+    COM_LOCK_MODE_READER,
+    COM_LOCK_MODE_WRITER,
+    COM_LOCK_MODE_NUM
+} COM_LOCK_MODE;
+
+#define COM_PROFILE_OBJECT_MAX      8
+#define COM_PROFILE_ID_LEN          32
+#define COM_PROFILE_BACKTRACE_SIZE  12
+#define COM_PROFILE_SYMBOL_LEN      128
+
+typedef struct com_lock_summary {
+    MTC_U32 count;                  // number of acquisitions
+    MTC_U32 wait_p50;
+    MTC_U32 wait_p99;
+    MTC_U32 wait_max;
+    MTC_U32 hold_p50;
+    MTC_U32 hold_p99;
+    MTC_U32 hold_max;
+} COM_LOCK_SUMMARY;
+
+typedef struct com_object_profile {
+    MTC_S8 object_id[COM_PROFILE_ID_LEN];
+    COM_LOCK_SUMMARY lock[COM_ROLE_NUM][COM_LOCK_MODE_NUM];
+    MTC_U32 longest_hold;           // 0 if the lock has not been released yet
+    MTC_U32 longest_holder_role;
+    MTC_U32 longest_holder_mode;
+    MTC_U32 backtrace_num;
+    MTC_S8 backtrace[COM_PROFILE_BACKTRACE_SIZE][COM_PROFILE_SYMBOL_LEN];
+} COM_OBJECT_PROFILE;
+
+//
+// com_get_profile
+//
+//  Get the lock profile of the objects.
+//
+//  paramaters
+//    profile: array to receive the profile
+//    num: number of elements of profile
+//
+//  return value
+//    number of objects returned
+//
+
+MTC_U32
+com_get_profile(
+    COM_OBJECT_PROFILE *profile,
+    MTC_U32 num);
+
 
 #endif // COM_H
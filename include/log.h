@@ -340,5 +340,26 @@ extern void
 log_thread_id(
     char *thread_name);
 
+//
+//
+//  NAME:
+//
+//      log_thread_name
+//
+//  DESCRIPTION:
+//
+//      Get the name of the calling thread.
+//
+//  paramaters
+//
+//      none
+//
+//  return value
+//
+//      Thread name given to log_thread_id, or NULL if not given.
+//
+extern char *
+log_thread_name();
+
 #endif	// LOG_H
 
@@ -40,6 +40,8 @@
 #include "config.h"
 #include "xapi_mon.h"
 #include "hostweight.h"
+#include "sm.h"
+#include "com.h"
 
 ////
 //
@@ -95,6 +97,9 @@ enum {
     SCRIPT_TYPE_PRIVATELOG,
     SCRIPT_TYPE_FIST,
     SCRIPT_TYPE_RELOAD_HOST_WEIGHT,
+    SCRIPT_TYPE_COMPROFILE,
+    SCRIPT_TYPE_FHTRACE,
+    SCRIPT_TYPE_ATTEST_FENCED,
     SCRIPT_TYPE_NUM
 };
 
@@ -180,6 +185,9 @@ typedef struct script_func_table {
         {SCRIPT_TYPE_PRIVATELOG, SCRIPT_SOCK_INDEX_FOR_INTERNAL},       \
         {SCRIPT_TYPE_FIST, SCRIPT_SOCK_INDEX_FOR_INTERNAL},             \
         {SCRIPT_TYPE_RELOAD_HOST_WEIGHT, SCRIPT_SOCK_INDEX_FOR_INTERNAL},  \
+        {SCRIPT_TYPE_COMPROFILE, SCRIPT_SOCK_INDEX_FOR_INTERNAL},       \
+        {SCRIPT_TYPE_FHTRACE, SCRIPT_SOCK_INDEX_FOR_INTERNAL},          \
+        {SCRIPT_TYPE_ATTEST_FENCED, SCRIPT_SOCK_INDEX_FOR_OTHER},       \
         {0, 0}}
 
 # define SCRIPT_FUNC_TABLE_INITIALIZER {                                \
@@ -201,6 +209,9 @@ typedef struct script_func_table {
         {SCRIPT_TYPE_PRIVATELOG, script_service_do_privatelog},         \
         {SCRIPT_TYPE_FIST, script_service_do_fist},                     \
         {SCRIPT_TYPE_RELOAD_HOST_WEIGHT, script_service_do_reload_host_weight}, \
+        {SCRIPT_TYPE_COMPROFILE, script_service_do_comprofile},         \
+        {SCRIPT_TYPE_FHTRACE, script_service_do_fhtrace},               \
+        {SCRIPT_TYPE_ATTEST_FENCED, script_service_do_attest_fenced},   \
         {0, NULL}}
 
 //
@@ -256,6 +267,7 @@ typedef struct script_data_response_query_live_set {
     MTC_U32 xapi_approaching_timeout;
     MTC_U32 bonding_error;
     QUERY_LIVESET_HOST_INFO host[MAX_HOST_NUM];
+    SF_LATENCY_SUMMARY sf_latency_summary[SF_SECTION_NUM][SF_ACCESS_NUM];
 } SCRIPT_DATA_RESPONSE_QUERY_LIVESET;
 
 typedef struct script_data_response_propose_master {
@@ -298,6 +310,16 @@ typedef struct script_data_response_buildid {
     MTC_S8 build_id[BUILD_ID_LEN];
 } SCRIPT_DATA_RESPONSE_BUILDID;
 
+typedef struct script_data_response_comprofile {
+    MTC_U32 objectnum;
+    COM_OBJECT_PROFILE object[COM_PROFILE_OBJECT_MAX];
+} SCRIPT_DATA_RESPONSE_COMPROFILE;
+
+typedef struct script_data_response_fhtrace {
+    MTC_U32 tracenum;
+    SM_FH_TRACE trace[SM_FH_TRACE_MAX];         // the most recent first
+} SCRIPT_DATA_RESPONSE_FHTRACE;
+
 
 typedef struct script_data_request_dumpcom {
     MTC_U32 dumpflag;
@@ -308,6 +330,10 @@ typedef struct script_data_request_fist {
     MTC_BOOLEAN set;
 } SCRIPT_DATA_REQUEST_FIST;
 
+typedef struct script_data_request_attest_fenced {
+    MTC_U32 host_index;                         // host confirmed to be down
+} SCRIPT_DATA_REQUEST_ATTEST_FENCED;
+
 typedef struct script_data_request {
     SCRIPT_DATA_HEAD head;
     union {
@@ -316,6 +342,7 @@ typedef struct script_data_request {
         SCRIPT_DATA_REQUEST_RESETLOGMASK   request_resetlogmask;
         SCRIPT_DATA_REQUEST_DUMPCOM        request_dumpcom;
         SCRIPT_DATA_REQUEST_FIST           request_fist;
+        SCRIPT_DATA_REQUEST_ATTEST_FENCED  request_attest_fenced;
     } body;
 } SCRIPT_DATA_REQUEST;
 
@@ -329,6 +356,8 @@ typedef struct script_data_response {
         SCRIPT_DATA_RESPONSE_RETVAL_ONLY    retval_only;
         SCRIPT_DATA_RESPONSE_GETLOGMASK     getlogmask;
         SCRIPT_DATA_RESPONSE_BUILDID        buildid;
+        SCRIPT_DATA_RESPONSE_COMPROFILE     comprofile;
+        SCRIPT_DATA_RESPONSE_FHTRACE        fhtrace;
     } body;
 } SCRIPT_DATA_RESPONSE;
 
@@ -377,6 +406,9 @@ script_initialize(
 //      script_service_do_hoststate
 //      script_service_do_dumpcom
 //      script_service_do_buildid
+//      script_service_do_comprofile
+//      script_service_do_fhtrace
+//      script_service_do_attest_fenced
 //
 //  DESCRIPTION:
 //
@@ -520,6 +552,27 @@ script_service_do_reload_host_weight(
     MTC_U32 *res_len,
     void *res_body);
 
+MTC_STATUS
+script_service_do_comprofile(
+    MTC_U32 req_len,
+    void *req_body,
+    MTC_U32 *res_len,
+    void *res_body);
+
+MTC_STATUS
+script_service_do_fhtrace(
+    MTC_U32 req_len,
+    void *req_body,
+    MTC_U32 *res_len,
+    void *res_body);
+
+MTC_STATUS
+script_service_do_attest_fenced(
+    MTC_U32 req_len,
+    void *req_body,
+    MTC_U32 *res_len,
+    void *res_body);
+
 //
 //
 //  NAME:
@@ -0,0 +1,72 @@
+//  MODULE: sfbackend.h
+
+#ifndef SFBACKEND_H
+#define SFBACKEND_H (1)     // Set flag indicating this file was included
+
+//
+//      Copyright (c) Stratus Technologies Bermuda Ltd., 2008.
+//      All Rights Reserved. Unpublished rights reserved
+//      under the copyright laws of the United States.
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU Lesser General Public License as published
+//      by the Free Software Foundation; version 2.1 only. with the special
+//      exception on linking described in file LICENSE.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU Lesser General Public License for more details.
+//
+//
+//  DESCRIPTION:
+//
+//      State-File test backend.
+//
+//      In the development build, the State-File can be placed on a regular file,
+//      tmpfs or a loop device, and every access can be given a programmable
+//      latency, error rate and stall. The backend is enabled by setting the
+//      environment variable XHA_SF_BACKEND to the path of a profile, which
+//      consists of the following lines ('#' starts a comment).
+//
+//          direct      on|off              use O_DIRECT (default on; turned off
+//                                          automatically if the file system
+//                                          does not support it)
+//          target      read|write|all      accesses the profile applies to
+//                                          (default all)
+//          latency     constant <ms>
+//          latency     lognormal <median ms> <sigma>
+//          latency     trace <path>        replay latencies (one ms value per
+//                                          line) cyclically
+//          error_rate  <probability>       access fails with an I/O error
+//          stall       <probability> <ms>  access stalls for <ms>
+//          seed        <number>            seed of the random numbers
+//
+//      The backend is only compiled with XHA_SF_TEST_BACKEND, which is set
+//      by the development build ("make sftest", output in sftest/). The
+//      installed daemon and tools always open the State-File directly and
+//      ignore XHA_SF_BACKEND.
+//
+
+#include "mtctypes.h"
+
+#define SF_BACKEND_ENV      "XHA_SF_BACKEND"
+
+#ifdef XHA_SF_TEST_BACKEND
+
+extern int
+sf_backend_open(
+    char *path,
+    int flags);
+
+extern MTC_STATUS
+sf_backend_inject(
+    MTC_BOOLEAN write);
+
+#else
+
+#define sf_backend_open(path, flags)    open((path), (flags))
+#define sf_backend_inject(write)        (MTC_SUCCESS)
+
+#endif  // XHA_SF_TEST_BACKEND
+#endif  // SFBACKEND_H
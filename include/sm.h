@@ -52,9 +52,77 @@ typedef enum {
 
 typedef MTC_U32 MTC_HOSTMAP[_rounddiv(MAX_HOST_NUM, MTC_HOSTMAP_UNIT)];
 
+MTC_ASSERT_SIZE(MAX_HOST_NUM % MTC_HOSTMAP_UNIT == 0);
+
 #define _element(hostnum)       ((hostnum) / MTC_HOSTMAP_UNIT)
 #define _bitloc(hostnum)        (1 << ((hostnum) % MTC_HOSTMAP_UNIT))
 
+//
+//  The hostmap is stored as 32 bit words, which is its encoding on the
+//  wire and on the State-File. The set operations below process it as
+//  64 bit words: word w holds hosts 64w .. 64w + 63, and its low half
+//  is element 2w, so that the encoding does not depend on the byte
+//  order. Counting and iteration use the popcount/ctz builtins.
+//
+
+#define MTC_HOSTMAP_WORD_BITS       64
+#define MTC_HOSTMAP_WORD_NUM        _rounddiv(MAX_HOST_NUM, MTC_HOSTMAP_WORD_BITS)
+#define _hostmap_element_num        _rounddiv(MAX_HOST_NUM, MTC_HOSTMAP_UNIT)
+
+static __inline MTC_U64
+_hostmap_get_word(
+    const MTC_U32 *b,
+    MTC_S32 w)
+{
+    return (MTC_U64) b[2 * w] |
+           ((2 * w + 1 < _hostmap_element_num)? (MTC_U64) b[2 * w + 1] << 32: 0);
+}
+
+static __inline void
+_hostmap_put_word(
+    MTC_U32 *b,
+    MTC_S32 w,
+    MTC_U64 word)
+{
+    b[2 * w] = (MTC_U32) word;
+    if (2 * w + 1 < _hostmap_element_num)
+    {
+        b[2 * w + 1] = (MTC_U32) (word >> 32);
+    }
+}
+
+//  hosts of word w whose index is less than hostnum
+
+static __inline MTC_U64
+_hostmap_configured_word(
+    MTC_S32 hostnum,
+    MTC_S32 w)
+{
+    MTC_S32 n = hostnum - w * MTC_HOSTMAP_WORD_BITS;
+
+    return (n <= 0)? 0:
+           (n >= MTC_HOSTMAP_WORD_BITS)? ~(MTC_U64) 0: ((MTC_U64) 1 << n) - 1;
+}
+
+//  move *pw to the next word of b which has a host, and load it to
+//  *pbits (for MTC_HOSTMAP_FOR_EACH)
+
+static __inline MTC_BOOLEAN
+_hostmap_next_word(
+    const MTC_U32 *b,
+    MTC_U64 *pw,
+    MTC_U64 *pbits)
+{
+    while (++(*pw) < MTC_HOSTMAP_WORD_NUM)
+    {
+        if ((*pbits = _hostmap_get_word(b, *pw)) != 0)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 #define MTC_HOSTMAP_SET(b, hostnum)  ((b)[_element(hostnum)] |=  _bitloc(hostnum))
 #define MTC_HOSTMAP_RESET(b, hostnum)((b)[_element(hostnum)] &= ~_bitloc(hostnum))
 #define MTC_HOSTMAP_ISON(b, hostnum) (((b)[_element(hostnum)] &  _bitloc(hostnum)) != 0)
@@ -91,31 +159,25 @@ typedef MTC_U32 MTC_HOSTMAP[_rounddiv(MAX_HOST_NUM, MTC_HOSTMAP_UNIT)];
 #define MTC_HOSTMAP_COMPARE(b1, OP, b2) ({ \
     assert(OP == '!=' || OP == '<>' || OP == '><'); \
     assert(sizeof(b1) == sizeof(MTC_HOSTMAP) && sizeof(b2) == sizeof(MTC_HOSTMAP)); \
-    int i, ret = 0; \
-    for (i = 0; i < _rounddiv(MAX_HOST_NUM, MTC_HOSTMAP_UNIT); i++) \
+    int w; \
+    MTC_U64 diff = 0; \
+    for (w = 0; w < MTC_HOSTMAP_WORD_NUM; w++) \
     { \
-        if ((b1)[i] - (b2)[i]) \
-        { \
-            ret = 1; \
-            break; \
-        } \
+        diff |= _hostmap_get_word(b1, w) ^ _hostmap_get_word(b2, w); \
     } \
-    ret; \
+    (diff != 0); \
 })
 
 #define MTC_HOSTMAP_SUBSETEQUAL(b1, OP, b2) ({ \
     assert(sizeof(b1) == sizeof(MTC_HOSTMAP) && sizeof(b2) == sizeof(MTC_HOSTMAP)); \
     assert(OP == '(=' || OP == '<='); \
-    int i, ret = 1; \
-    for (i = 0; i < MAX_HOST_NUM; i++) \
+    int w; \
+    MTC_U64 extra = 0; \
+    for (w = 0; w < MTC_HOSTMAP_WORD_NUM; w++) \
     { \
-        if (MTC_HOSTMAP_ISON(b1, i) && !MTC_HOSTMAP_ISON(b2, i)) \
-        { \
-            ret = 0; \
-            break; \
-        } \
+        extra |= _hostmap_get_word(b1, w) & ~_hostmap_get_word(b2, w); \
     } \
-    ret; \
+    (extra == 0); \
 })
 
 #define MTC_HOSTMAP_DIFFERENCE(b1, EQ, b2, OP, b3) ({ \
@@ -172,40 +234,88 @@ typedef MTC_U32 MTC_HOSTMAP[_rounddiv(MAX_HOST_NUM, MTC_HOSTMAP_UNIT)];
 
 #define MTC_HOSTMAP_MASK_UNCONFIG(b1) ({ \
     assert(sizeof(b1) == sizeof(MTC_HOSTMAP)); \
-    int i; \
-    for (i = 0; i < MAX_HOST_NUM; i++) \
+    int w; \
+    for (w = 0; w < MTC_HOSTMAP_WORD_NUM; w++) \
     { \
-        if (!_is_configured_host(i)) \
-        { \
-            MTC_HOSTMAP_RESET(b1, i); \
-        } \
+        _hostmap_put_word(b1, w, _hostmap_get_word(b1, w) & \
+                    _hostmap_configured_word(ha_config.common.hostnum, w)); \
     } \
     b1; \
 })
 
+//  number of the hosts in b1
+
+#define MTC_HOSTMAP_COUNT(b1) ({ \
+    assert(sizeof(b1) == sizeof(MTC_HOSTMAP)); \
+    int w, count = 0; \
+    for (w = 0; w < MTC_HOSTMAP_WORD_NUM; w++) \
+    { \
+        count += __builtin_popcountll(_hostmap_get_word(b1, w)); \
+    } \
+    count; \
+})
+
+//  the lowest host index in b1, or -1 if b1 is empty
+
+#define MTC_HOSTMAP_FIRST(b1) ({ \
+    assert(sizeof(b1) == sizeof(MTC_HOSTMAP)); \
+    MTC_U64 _w = 0, _bits = _hostmap_get_word(b1, 0); \
+    (_bits != 0 || _hostmap_next_word(b1, &_w, &_bits))? \
+        (MTC_S32) (_w * MTC_HOSTMAP_WORD_BITS + __builtin_ctzll(_bits)): -1; \
+})
+
+//  for each host in b1 in ascending order (the hosts are taken from
+//  b1 one word at a time, so changes to b1 in the loop may not be seen)
+
+#define MTC_HOSTMAP_FOR_EACH(b1, index) \
+    for (MTC_U64 _w = (assert(sizeof(b1) == sizeof(MTC_HOSTMAP)), 0), \
+                 _bits = _hostmap_get_word(b1, 0); \
+         (_bits != 0 || _hostmap_next_word(b1, &_w, &_bits)) && \
+            ((index) = _w * MTC_HOSTMAP_WORD_BITS + __builtin_ctzll(_bits), TRUE); \
+         _bits &= _bits - 1)
+
 
 
 //
 // common data structure for HB, SF, SM
 //
-typedef struct _RAW_DATA {
-    MTC_HOSTMAP current_liveset;        // Current liveset as seen by this host
-    MTC_HOSTMAP proposed_liveset;       // Proposed liveset by this host
-    MTC_HOSTMAP hbdomain;               // Current host set on the heartbeat
-    MTC_HOSTMAP sfdomain;               // Current host set on the state file
-
-    MTC_S32     time_since_last_HB_receipt[MAX_HOST_NUM];
+//  Raw data of all the hosts, in structure-of-arrays form.
+//  The hostmaps, which the fault handler scans for every host, are
+//  contiguous columns of MAX_HOST_NUM hostmaps (512 bytes at 64 hosts,
+//  8 KB at 256); the time vectors follow them.
+
+typedef struct _RAW_VIEW {
+    MTC_HOSTMAP current_liveset[MAX_HOST_NUM];  // Current liveset as seen by host x
+    MTC_HOSTMAP proposed_liveset[MAX_HOST_NUM]; // Proposed liveset by host x
+    MTC_HOSTMAP hbdomain[MAX_HOST_NUM];         // Current host set on the heartbeat
+    MTC_HOSTMAP sfdomain[MAX_HOST_NUM];         // Current host set on the state file
+
+    MTC_S32     time_since_last_HB_receipt[MAX_HOST_NUM][MAX_HOST_NUM];
                                         // Set of time [msec] since last HB
                                         // receipt, received from node x.
 
-    MTC_S32     time_since_last_SF_update[MAX_HOST_NUM];
+    MTC_S32     time_since_last_SF_update[MAX_HOST_NUM][MAX_HOST_NUM];
                                         // Set of time [msec] since last SF
                                         // update, received from node x.
 
-    MTC_S32     time_since_xapi_restart;
+    MTC_S32     time_since_xapi_restart[MAX_HOST_NUM];
                                         // Set of time [msec] since xapi
                                         // restart received from node x.
-} RAW_DATA, *PRAW_DATA;
+} RAW_VIEW, *PRAW_VIEW;
+
+//  Copy the raw data of one host
+
+#define RAW_VIEW_COPY_HOST(dst, src, index) ({ \
+    MTC_HOSTMAP_COPY((dst).current_liveset[index], (src).current_liveset[index]); \
+    MTC_HOSTMAP_COPY((dst).proposed_liveset[index], (src).proposed_liveset[index]); \
+    MTC_HOSTMAP_COPY((dst).hbdomain[index], (src).hbdomain[index]); \
+    MTC_HOSTMAP_COPY((dst).sfdomain[index], (src).sfdomain[index]); \
+    memcpy((dst).time_since_last_HB_receipt[index], (src).time_since_last_HB_receipt[index], \
+           sizeof((dst).time_since_last_HB_receipt[index])); \
+    memcpy((dst).time_since_last_SF_update[index], (src).time_since_last_SF_update[index], \
+           sizeof((dst).time_since_last_SF_update[index])); \
+    (dst).time_since_xapi_restart[index] = (src).time_since_xapi_restart[index]; \
+})
 
 
 //
@@ -248,6 +358,8 @@ typedef struct _COM_DATA_SM {
     MTC_U32             commited_weight;    //  Commited weight of the local host
 } COM_DATA_SM, *PCOM_DATA_SM;
 
+#define COM_OBJECT_TYPE_SM COM_DATA_SM
+
 
 //
 // Heartbeat
@@ -285,8 +397,8 @@ typedef struct _COM_DATA_HB {
     MTC_HOSTMAP hbdomain;               // ON if the host looks active on the heartbeat
     MTC_HOSTMAP notjoining;             // Bit-on if the corresponding host is NOT ready to join.
 
-    RAW_DATA    raw[MAX_HOST_NUM];      // Raw data from node x.
-                                        // raw[local_host] shows the last data
+    RAW_VIEW    raw;                    // Raw data from node x.
+                                        // raw.*[local_host] shows the last data
                                         // transmitted from the local host.
 
     MTC_S8      err_string[MAX_HOST_NUM][XAPI_MAX_ERROR_STRING_LEN + 1];
@@ -300,12 +412,36 @@ typedef struct _COM_DATA_HB {
                                         //
 } COM_DATA_HB, *PCOM_DATA_HB;
 
+#define COM_OBJECT_TYPE_HB COM_DATA_HB
+
 
 //
 // StateFile
 //
 #define COM_ID_SF   "statefile"
 
+//  State-File access latency distribution
+
+typedef enum {
+    SF_SECTION_GLOBAL,                      // global section
+    SF_SECTION_HOST,                        // host specific elements
+    SF_SECTION_NUM
+} SF_SECTION;
+
+typedef enum {
+    SF_ACCESS_READ,
+    SF_ACCESS_WRITE,
+    SF_ACCESS_NUM
+} SF_ACCESS;
+
+typedef struct _SF_LATENCY_SUMMARY {
+    MTC_U32 samples;                        // number of accesses in the window
+    MTC_S32 p50;                            // percentiles in ms (-1 if no samples)
+    MTC_S32 p99;
+    MTC_S32 p999;
+    MTC_S32 max;                            // maximum in ms (-1 if no samples)
+} SF_LATENCY_SUMMARY, *PSF_LATENCY_SUMMARY;
+
 typedef struct _COM_DATA_SF
 {
     MTC_U32 modified_mask;                  // Fields designated by the mask have been
@@ -343,11 +479,16 @@ typedef struct _COM_DATA_SF
                                             // was seen from each host.
     MTC_HOSTMAP excluded;                   // Bit-on if the corresponding host has been excluded.
     MTC_HOSTMAP starting;                   // Bit-on if the corresponding host is starting.
-    RAW_DATA    raw[MAX_HOST_NUM];          // Array of raw data as seen by each host
+    MTC_HOSTMAP self_fencing;               // Bit-on if the corresponding host has recorded
+                                            // that it is about to self-fence.
+    RAW_VIEW    raw;                        // Raw data as seen by each host
 
     MTC_S32 latency;                        // State-Fie access latency in ms (latest)
     MTC_S32 latency_max;                    // State-Fie access latency in ms (max since the last query_liveset)
     MTC_S32 latency_min;                    // State-Fie access latency in ms (min since the last query_liveset)
+    MTC_U32 changed_sections;               // Number of host specific elements changed in the last read
+    SF_LATENCY_SUMMARY latency_summary[SF_SECTION_NUM][SF_ACCESS_NUM];
+                                            // State-File access latency distribution in the recent window
 
     MTC_HOSTMAP sfdomain;                   // ON if the host looks active on the State File
     MTC_FENCING_MODE fencing;               // Fencing mode (NULL->ARMED->DISARM_REQUESTED->DISARMED)
@@ -356,6 +497,85 @@ typedef struct _COM_DATA_SF
     MTC_U32     weight[MAX_HOST_NUM];       // Weight committed by each host
 } COM_DATA_SF, *PCOM_DATA_SF;
 
+#define COM_OBJECT_TYPE_SF COM_DATA_SF
+
+
+//
+// Fault handler timing
+//
+//  Shared by sm.c and the fault handler simulator (commands/fhsim.c),
+//  so that the simulator runs with the daemon's timing rules.
+//
+//  A losing host arms its watchdogs to WATCHDOG_FENCE_TIMEOUT [sec]
+//  and then waits up to SELF_FENCE_RECORD_TIMEOUT [ms] for its
+//  self-fencing record to reach the State-File. A winner still waits
+//  FH_SELF_FENCE_GRACE [sec] after all the records are seen, which
+//  covers the time from the write to the reset by the watchdog.
+//  FH_FENCE_WAIT is the FH4 fencing wait [ms] of the winners, given
+//  the time since FH3 started.
+//
+
+#define APPROACHING_TIMEOUT_FACTOR          (25)    // [%] of T1 or T2
+
+#define FH_MINIMUM_SLEEP_BEFORE_FO          (10)
+
+#define SELF_FENCE_RECORD_TIMEOUT           (ONE_SEC)
+#define FH_SELF_FENCE_GRACE                 (_max(_max(_t1, _t2), WATCHDOG_FENCE_TIMEOUT + 1))
+
+#define FH_FENCE_WAIT(since_fh3, extend) \
+    _max(((_max(_Wh, _Ws) - _min(_T1, _T2) + _max(_t1, _t2)) * ONE_SEC) \
+            - (since_fh3) \
+            + ((extend)? _min(_T1, _T2): 0) * ONE_SEC, \
+         FH_MINIMUM_SLEEP_BEFORE_FO * ONE_SEC)
+
+
+//
+// Fault handler trace
+//
+//  Time (ms, _getms) at which each fault-handling episode passed
+//  each point. The most recent SM_FH_TRACE_MAX episodes are kept.
+//  A point not passed (e.g. FENCED when no host is removed) is -1.
+//
+
+typedef enum {
+    SM_FH_TRACE_LAST_SEEN,      // last HB/SF from the lost host (-1 if forced)
+    SM_FH_TRACE_TRIGGERED,      // start_fh requested the fault handler
+    SM_FH_TRACE_START,          // fault handler started
+    SM_FH_TRACE_FH1,            // FH1 rendezvous done
+    SM_FH_TRACE_STABLE,         // HB/SF state has become stable
+    SM_FH_TRACE_FH2,            // FH2 rendezvous done
+    SM_FH_TRACE_CONSISTENT,     // all hosts have consistent view
+    SM_FH_TRACE_FH3,            // FH3 rendezvous done
+    SM_FH_TRACE_FH4,            // FH4 rendezvous done
+    SM_FH_TRACE_FENCED,         // fence wait done
+    SM_FH_TRACE_COMMITTED,      // new liveset committed
+    SM_FH_TRACE_END,            // fault handler ended
+    SM_FH_TRACE_POINT_NUM
+} SM_FH_TRACE_POINT;
+
+#define SM_FH_TRACE_POINT_NAME_ARRAY {  \
+        "last_seen",                    \
+        "triggered",                    \
+        "start",                        \
+        "fh1",                          \
+        "stable",                       \
+        "fh2",                          \
+        "consistent",                   \
+        "fh3",                          \
+        "fh4",                          \
+        "fenced",                       \
+        "committed",                    \
+        "end"                           \
+    }
+
+#define SM_FH_TRACE_MAX     8
+
+typedef struct _SM_FH_TRACE {
+    MTC_U32     episode;                        // 1, 2, ...
+    MTC_HOSTMAP removed;                        // hosts removed from the liveset
+    MTC_CLOCK   time[SM_FH_TRACE_POINT_NUM];
+} SM_FH_TRACE, *PSM_FH_TRACE;
+
 extern void
 start_fh(
     MTC_BOOLEAN force);
@@ -370,4 +590,13 @@ self_fence(MTC_STATUS code, PMTC_S8 message);
 extern MTC_BOOLEAN
 sm_get_join_block();
 
+extern MTC_U32
+sm_get_fh_trace(
+    PSM_FH_TRACE trace,
+    MTC_U32 num);
+
+extern MTC_STATUS
+sm_attest_fenced(
+    MTC_U32 host_index);
+
 #endif  // SM_H
@@ -41,10 +41,14 @@
 #include "config.h"
 
 //
-//  State-File format version 2 constants
+//  State-File format version 3 constants
+//
+//  Version 3 adds self_fencing to the host-specific element, which
+//  changes its checksummed range; daemons of version 2 reject the
+//  State-File as a version mismatch instead of as corrupted.
 //
 
-#define SF_VERSION              2
+#define SF_VERSION              3
 #define LENGTH_GLOBAL           4096
 #define LENGTH_HOST_SPECIFIC    4096
 
@@ -141,6 +145,7 @@ typedef struct _SF_HOST_SPECIFIC_SECTION {
             MTC_HOSTMAP lock_grant;
             SM_PHASE    sm_phase;               //  Current SM phase of this host
             MTC_U32     weight;                 //  Importance weight of this host
+            MTC_U32     self_fencing;           //  1 if this host has committed to self-fence
             MTC_U32     end_marker;             //  checksum end marker
         } data;
         char pad[LENGTH_HOST_SPECIFIC];
@@ -158,6 +163,40 @@ typedef struct _STATE_FILE {
     SF_HOST_SPECIFIC_SECTION    host[MAX_HOST_NUM];
 } STATE_FILE, *PSTATE_FILE;
 
+//
+//  SF_SNAPSHOT - Immutable, versioned view of the State-File.
+//
+//  The SF thread reads the State-File into one of two snapshot buffers
+//  and publishes it by swapping a pointer. A published snapshot is never
+//  modified until all the readers have released it.
+//
+
+typedef struct _SF_SNAPSHOT {
+    STATE_FILE  file;                       //  image of the State-File (I/O buffer)
+    MTC_U32     version;                    //  publication number (0 if never published)
+    MTC_CLOCK   readclock;                  //  clock(ms) when the image was read
+
+    //  host specific elements decoded for the SF object
+
+    struct {
+        MTC_HOSTMAP valid;                  //  bit-on if the element of the host has been decoded
+        MTC_U32     sequence[MAX_HOST_NUM]; //  sequence number of each decoded element
+        MTC_U32     checksum[MAX_HOST_NUM]; //  checksum of each decoded element
+        MTC_HOSTMAP changed;                //  bit-on if the element differs from the
+                                            //  previously published snapshot
+        struct {
+            MTC_BOOLEAN request;
+            MTC_HOSTMAP grant;
+        } lm[MAX_HOST_NUM];
+        MTC_HOSTMAP excluded;
+        MTC_HOSTMAP starting;
+        MTC_HOSTMAP self_fencing;
+        RAW_VIEW    raw;
+        SM_PHASE    sm_phase[MAX_HOST_NUM];
+        MTC_U32     weight[MAX_HOST_NUM];
+    } decoded;
+} SF_SNAPSHOT, *PSF_SNAPSHOT;
+
 extern MTC_S32
 sf_initialize(
     MTC_S32  phase);
@@ -215,7 +254,8 @@ sf_checksum(
 void
 sf_reportlatency(
     MTC_CLOCK latency,
-    MTC_BOOLEAN write);
+    MTC_BOOLEAN write,
+    SF_SECTION section);
 
 extern MTC_STATUS
 sf_set_pool_state(
@@ -229,6 +269,10 @@ extern MTC_STATUS
 sf_set_excluded(
     MTC_BOOLEAN excluded);
 
+extern MTC_BOOLEAN
+sf_set_self_fencing(
+    MTC_CLOCK timeout);
+
 void
 sf_accelerate();
 
@@ -242,5 +286,15 @@ void
 sf_sleep(
     MTC_U32 msec);
 
+extern void
+sf_log_latency();
+
+extern const SF_SNAPSHOT *
+sf_snapshot_acquire();
+
+extern void
+sf_snapshot_release(
+    const SF_SNAPSHOT *snapshot);
+
 #endif  // STATEFILE_H
 
@@ -57,6 +57,10 @@
 
 #define WATCHDOG_TIMEOUT_MAX     ((MTC_U32)0xFFFFFFFFUL)
 
+// Timeout (sec) of the watchdogs armed to fence the host
+
+#define WATCHDOG_FENCE_TIMEOUT   (1)
+
 
 //
 //
@@ -207,5 +211,37 @@ watchdog_set(
 void
 watchdog_selffence(void);
 
+//
+//
+//  NAME:
+//
+//      watchdog_arm_fence
+//
+//  DESCRIPTION:
+//
+//      Set all the watchdog instances to WATCHDOG_FENCE_TIMEOUT, and
+//      stop watchdog_set and watchdog_close from extending or stopping
+//      them, so that the host is reset by the hypervisor within the
+//      timeout even if dom0 stalls afterwards.
+//
+//  FORMAL PARAMETERS:
+//
+//      None
+//
+//          
+//  RETURN VALUE:
+//
+//      MTC_SUCCESS - at least one instance is armed
+//      others - fail
+//
+//  ENVIRONMENT:
+//
+//      dom0
+//
+//
+
+MTC_STATUS
+watchdog_arm_fence(void);
+
 
 #endif // WATCHDOG_H
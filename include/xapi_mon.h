@@ -87,6 +87,8 @@ typedef struct _COM_DATA_XAPIMON {
 
 } COM_DATA_XAPIMON, *PCOM_DATA_XAPIMON;
 
+#define COM_OBJECT_TYPE_XAPIMON COM_DATA_XAPIMON
+
 
 
 extern pthread_mutex_t  mut_sigchld;
@@ -38,7 +38,25 @@
 //
 //
 
+//
+//  MAX_HOST_NUM - the largest pool supported by the build.
+//
+//  This is a build option, not a runtime setting. It sizes the heartbeat
+//  packet, the host-specific elements of the State-File and the COM
+//  objects, so all the hosts in a pool must be built with the same value
+//  (packets and State-Files of other builds are rejected).
+//  It can be set by "make MAX_HOST_NUM=<n>"; n must be a multiple of 32
+//  and at most 128, the largest pool whose heartbeat packet still fits
+//  in one datagram on a 1500-byte MTU.
+//
+
+#ifndef MAX_HOST_NUM
 #define MAX_HOST_NUM 64
+#endif
+
+#if MAX_HOST_NUM > 128
+#error "MAX_HOST_NUM must be at most 128"
+#endif
 
 extern void
 main_terminate(
@@ -53,4 +71,37 @@ main_reset_scheduler(void);
 extern pthread_attr_t * 
 xhad_pthread_attr;
 
+//
+//  Thread priorities (SCHED_RR)
+//
+//  The process runs at XHA_PRIORITY_HIGH. Threads lower their own
+//  priority by role with xhad_set_thread_priority, so that the heartbeat
+//  and the State-File (watchdog refresh) paths are never delayed behind
+//  a client request.
+//
+
+#define XHA_PRIORITY_HIGH       48      // HB_send, HB_receive, SF, main
+#define XHA_PRIORITY_MIDDLE     47      // SM, SM_Worker, LM, COM_dispatcher
+#define XHA_PRIORITY_LOW        46      // Xapimon, BM
+#define XHA_PRIORITY_CLIENT     45      // SC
+
+extern void
+xhad_set_thread_priority(
+    int priority);
+
+extern int
+xhad_thread_priority(void);
+
+//
+//  xhad_mutex_init
+//
+//  Initialize a priority inheritance mutex of the type
+//  (PTHREAD_MUTEX_NORMAL, PTHREAD_MUTEX_RECURSIVE ...).
+//
+
+extern int
+xhad_mutex_init(
+    pthread_mutex_t *mutex,
+    int type);
+
 #endif  // XHA_H
@@ -0,0 +1,407 @@
+//
+//      Copyright (c) Stratus Technologies Bermuda Ltd., 2008.
+//      All Rights Reserved. Unpublished rights reserved
+//      under the copyright laws of the United States.
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU Lesser General Public License as published
+//      by the Free Software Foundation; version 2.1 only. with the special
+//      exception on linking described in file LICENSE.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU Lesser General Public License for more details.
+//
+//
+//  DESCRIPTION:
+//
+//      This module contains the State-File test backend, which places
+//      the State-File on a local file and injects latencies and faults
+//      according to the profile. See sfbackend.h for the profile format.
+//
+//
+
+#ifdef XHA_SF_TEST_BACKEND
+
+//
+//
+//  O P E R A T I N G   S Y S T E M   I N C L U D E   F I L E S
+//
+//
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+//
+//
+//  M A R A T H O N   I N C L U D E   F I L E S
+//
+//
+
+#include "mtctypes.h"
+#include "mtcerrno.h"
+#include "log.h"
+#include "sm.h"
+#include "statefile.h"
+#include "sfbackend.h"
+
+//
+//
+//  L O C A L   D E F I N I T I O N S
+//
+//
+
+#define PROFILE_LINE_LEN    (PATH_MAX + 64)
+#define TRACE_MAX_SAMPLES   65536
+
+typedef enum {
+    LATENCY_NONE,
+    LATENCY_CONSTANT,
+    LATENCY_LOGNORMAL,
+    LATENCY_TRACE,
+} LATENCY_MODEL;
+
+static struct {
+    MTC_BOOLEAN     loaded;             // TRUE if a profile has been loaded
+    MTC_BOOLEAN     direct;             // use O_DIRECT
+    MTC_BOOLEAN     on_read;            // profile applies to reads
+    MTC_BOOLEAN     on_write;           // profile applies to writes
+    LATENCY_MODEL   model;
+    double          latency_ms;         // constant latency, or median of lognormal
+    double          sigma;              // sigma of lognormal
+    MTC_U32         *trace;             // replayed latencies
+    MTC_U32         trace_num;
+    MTC_U32         trace_next;
+    double          error_rate;
+    double          stall_rate;
+    MTC_U32         stall_ms;
+    unsigned int    seed;
+} backend = {
+    .loaded = FALSE,
+    .direct = TRUE,
+    .on_read = TRUE,
+    .on_write = TRUE,
+    .model = LATENCY_NONE,
+    .trace = NULL,
+    .seed = 1,
+};
+
+//
+//
+//  F U N C T I O N   P R O T O T Y P E S
+//
+//
+
+static MTC_STATUS
+sf_backend_load_profile(
+    char *path);
+
+static MTC_STATUS
+sf_backend_load_trace(
+    char *path);
+
+static double
+sf_backend_uniform();
+
+static double
+sf_backend_normal();
+
+//
+//
+//  F U N C T I O N   D E F I N I T I O N S
+//
+//
+
+//
+//  sf_backend_open -
+//
+//  Open the State-File. If XHA_SF_BACKEND is set, the profile is loaded
+//  and O_DIRECT is used only if the profile (and the file system) allows.
+//
+
+int
+sf_backend_open(
+    char *path,
+    int flags)
+{
+    char *profile;
+    int desc;
+
+    if ((profile = getenv(SF_BACKEND_ENV)) == NULL || *profile == '\0')
+    {
+        return open(path, flags);
+    }
+
+    if (!backend.loaded)
+    {
+        if (sf_backend_load_profile(profile) != MTC_SUCCESS)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        backend.loaded = TRUE;
+        log_message(MTC_LOG_NOTICE,
+                    "SF: test backend profile %s is loaded.\n", profile);
+    }
+
+    if (!backend.direct)
+    {
+        flags &= ~O_DIRECT;
+    }
+
+    desc = open(path, flags);
+    if (desc < 0 && errno == EINVAL && (flags & O_DIRECT))
+    {
+        //  tmpfs does not support O_DIRECT
+
+        log_message(MTC_LOG_NOTICE,
+                    "SF: %s does not support O_DIRECT. Opened without it.\n", path);
+        desc = open(path, flags & ~O_DIRECT);
+    }
+
+    return desc;
+}
+
+//
+//  sf_backend_inject -
+//
+//  Called before each State-File access. Sleeps for the latency
+//  and the stall given by the profile, and returns MTC_ERROR_SF_IO_ERROR
+//  if an error is to be injected.
+//
+
+MTC_STATUS
+sf_backend_inject(
+    MTC_BOOLEAN write)
+{
+    double delay = 0;
+
+    if (!backend.loaded ||
+        (write && !backend.on_write) ||
+        (!write && !backend.on_read))
+    {
+        return MTC_SUCCESS;
+    }
+
+    switch (backend.model)
+    {
+    case LATENCY_CONSTANT:
+        delay = backend.latency_ms;
+        break;
+
+    case LATENCY_LOGNORMAL:
+        delay = backend.latency_ms * exp(backend.sigma * sf_backend_normal());
+        break;
+
+    case LATENCY_TRACE:
+        delay = backend.trace[backend.trace_next];
+        backend.trace_next = (backend.trace_next + 1) % backend.trace_num;
+        break;
+
+    case LATENCY_NONE:
+    default:
+        break;
+    }
+
+    if (backend.stall_rate > 0 && sf_backend_uniform() < backend.stall_rate)
+    {
+        log_message(MTC_LOG_DEBUG,
+                    "SF(backend): %s stalls for %d ms\n", (write)? "write": "read", backend.stall_ms);
+        delay += backend.stall_ms;
+    }
+
+    if (delay >= 1)
+    {
+        sf_sleep((MTC_U32) delay);
+    }
+
+    if (backend.error_rate > 0 && sf_backend_uniform() < backend.error_rate)
+    {
+        log_message(MTC_LOG_DEBUG,
+                    "SF(backend): %s error is injected\n", (write)? "write": "read");
+        return MTC_ERROR_SF_IO_ERROR;
+    }
+
+    return MTC_SUCCESS;
+}
+
+//
+//  sf_backend_load_profile -
+//
+//  Parse the profile.
+//
+
+static MTC_STATUS
+sf_backend_load_profile(
+    char *path)
+{
+    FILE *fp;
+    char line[PROFILE_LINE_LEN], keyword[32], arg1[PATH_MAX], arg2[32];
+    int lineno = 0, n;
+    MTC_STATUS status = MTC_SUCCESS;
+
+    if ((fp = fopen(path, "r")) == NULL)
+    {
+        log_message(MTC_LOG_ERR,
+                    "SF: cannot open the test backend profile %s (sys %d).\n", path, errno);
+        return MTC_ERROR_SF_OPEN;
+    }
+
+    while (status == MTC_SUCCESS && fgets(line, sizeof(line), fp) != NULL)
+    {
+        lineno++;
+        if (strchr(line, '#'))
+        {
+            *strchr(line, '#') = '\0';
+        }
+
+        n = sscanf(line, "%31s %4095s %31s", keyword, arg1, arg2);
+        if (n <= 0)
+        {
+            continue;
+        }
+
+        if (!strcmp(keyword, "direct") && n == 2)
+        {
+            backend.direct = (strcmp(arg1, "off") != 0);
+        }
+        else if (!strcmp(keyword, "target") && n == 2)
+        {
+            backend.on_read = (!strcmp(arg1, "read") || !strcmp(arg1, "all"));
+            backend.on_write = (!strcmp(arg1, "write") || !strcmp(arg1, "all"));
+        }
+        else if (!strcmp(keyword, "latency") && n >= 3 && !strcmp(arg1, "constant"))
+        {
+            backend.model = LATENCY_CONSTANT;
+            backend.latency_ms = atof(arg2);
+        }
+        else if (!strcmp(keyword, "latency") && n >= 3 && !strcmp(arg1, "lognormal"))
+        {
+            backend.model = LATENCY_LOGNORMAL;
+            if (sscanf(line, "%*s %*s %lf %lf", &backend.latency_ms, &backend.sigma) != 2)
+            {
+                status = MTC_ERROR_INVALID_PARAMETER;
+            }
+        }
+        else if (!strcmp(keyword, "latency") && n >= 3 && !strcmp(arg1, "trace"))
+        {
+            if (sscanf(line, "%*s %*s %4095s", arg1) != 1 ||
+                (status = sf_backend_load_trace(arg1)) != MTC_SUCCESS)
+            {
+                status = MTC_ERROR_INVALID_PARAMETER;
+            }
+            else
+            {
+                backend.model = LATENCY_TRACE;
+            }
+        }
+        else if (!strcmp(keyword, "error_rate") && n == 2)
+        {
+            backend.error_rate = atof(arg1);
+        }
+        else if (!strcmp(keyword, "stall") && n == 3)
+        {
+            backend.stall_rate = atof(arg1);
+            backend.stall_ms = atoi(arg2);
+        }
+        else if (!strcmp(keyword, "seed") && n == 2)
+        {
+            backend.seed = strtoul(arg1, NULL, 0);
+        }
+        else
+        {
+            status = MTC_ERROR_INVALID_PARAMETER;
+        }
+
+        if (status != MTC_SUCCESS)
+        {
+            log_message(MTC_LOG_ERR,
+                        "SF: invalid line %d in the test backend profile %s.\n", lineno, path);
+        }
+    }
+
+    fclose(fp);
+    return status;
+}
+
+//
+//  sf_backend_load_trace -
+//
+//  Load latencies (ms) to be replayed.
+//
+
+static MTC_STATUS
+sf_backend_load_trace(
+    char *path)
+{
+    FILE *fp;
+    MTC_U32 latency;
+
+    if ((fp = fopen(path, "r")) == NULL)
+    {
+        log_message(MTC_LOG_ERR,
+                    "SF: cannot open the latency trace %s (sys %d).\n", path, errno);
+        return MTC_ERROR_SF_OPEN;
+    }
+
+    free(backend.trace);
+    if ((backend.trace = malloc(sizeof(MTC_U32) * TRACE_MAX_SAMPLES)) == NULL)
+    {
+        fclose(fp);
+        return MTC_ERROR_SF_INSUFFICIENT_RESOURCE;
+    }
+
+    backend.trace_num = backend.trace_next = 0;
+    while (backend.trace_num < TRACE_MAX_SAMPLES && fscanf(fp, "%u", &latency) == 1)
+    {
+        backend.trace[backend.trace_num++] = latency;
+    }
+    fclose(fp);
+
+    return (backend.trace_num > 0)? MTC_SUCCESS: MTC_ERROR_INVALID_PARAMETER;
+}
+
+//
+//  sf_backend_uniform -
+//
+//  Returns a random number in [0, 1).
+//
+
+static double
+sf_backend_uniform()
+{
+    return (double) rand_r(&backend.seed) / ((double) RAND_MAX + 1);
+}
+
+//
+//  sf_backend_normal -
+//
+//  Returns a random number from the standard normal distribution
+//  (Box-Muller transform).
+//
+
+static double
+sf_backend_normal()
+{
+    double u1, u2;
+
+    do
+    {
+        u1 = sf_backend_uniform();
+    } while (u1 <= 0);
+    u2 = sf_backend_uniform();
+
+    return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+#endif  // XHA_SF_TEST_BACKEND
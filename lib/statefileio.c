@@ -63,6 +63,7 @@
 #include "watchdog.h"
 #include "xha.h"
 #include "statefile.h"
+#include "sfbackend.h"
 #include "fist.h"
 
 //
@@ -84,10 +85,6 @@
 //
 //
 
-//  State-File buffer
-
-extern STATE_FILE StateFile;
-
 //
 //
 //  F U N C T I O N   P R O T O T Y P E S
@@ -111,7 +108,7 @@ extern int
 sf_open(
     char *path)
 {
-    return open(path, (O_RDWR | O_DIRECT));
+    return sf_backend_open(path, (O_RDWR | O_DIRECT));
 }
 
 extern int
@@ -130,6 +127,7 @@ sf_read(
 {
     int n;
     MTC_CLOCK start;
+    MTC_STATUS status;
 
     assert((offset & (IOUNIT - 1)) == 0);
 
@@ -143,6 +141,11 @@ sf_read(
 
     sf_FIST_delay();
 
+    if ((status = sf_backend_inject(FALSE)) != MTC_SUCCESS)
+    {
+        return status;
+    }
+
     while (length)
     {
         n = read(desc, buffer, length);
@@ -156,7 +159,8 @@ sf_read(
 
     //  report the access latency to main
 
-    sf_reportlatency(_getms() - start, FALSE);
+    sf_reportlatency(_getms() - start, FALSE,
+                     (offset < sizeof(SF_GLOBAL_SECTION))? SF_SECTION_GLOBAL: SF_SECTION_HOST);
 
     return MTC_SUCCESS;
 }
@@ -169,6 +173,7 @@ sf_write(
     off_t offset)
 {
     MTC_CLOCK start;
+    MTC_STATUS status;
 
     assert((offset & (IOUNIT - 1)) == 0);
 
@@ -183,6 +188,11 @@ sf_write(
     sf_FIST_delay();
     sf_FIST_delay_on_write();
 
+    if ((status = sf_backend_inject(TRUE)) != MTC_SUCCESS)
+    {
+        return status;
+    }
+
     if (write(desc, buffer, length) < 0)
     {
         return MTC_ERROR_SF_IO_ERROR;
@@ -190,7 +200,8 @@ sf_write(
 
     //  report the access latency to main
 
-    sf_reportlatency(_getms() - start, TRUE);
+    sf_reportlatency(_getms() - start, TRUE,
+                     (offset < sizeof(SF_GLOBAL_SECTION))? SF_SECTION_GLOBAL: SF_SECTION_HOST);
 
     return MTC_SUCCESS;
 }
@@ -237,7 +248,10 @@ sf_readglobal(
         return MTC_ERROR_SF_CORRUPTION;
     }
 
-    if (pglobal->data.version != SF_VERSION)
+    //  The host-specific elements are laid out by MAX_HOST_NUM
+
+    if (pglobal->data.version != SF_VERSION ||
+        pglobal->data.max_hosts != MAX_HOST_NUM)
     {
         return MTC_ERROR_SF_VERSION_MISMATCH;
     }